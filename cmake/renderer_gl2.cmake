@@ -26,6 +26,7 @@ set(RENDERER_GL2_SOURCES
     ${SOURCE_DIR}/renderergl2/tr_mesh.c
     ${SOURCE_DIR}/renderergl2/tr_model.c
     ${SOURCE_DIR}/renderergl2/tr_model_iqm.c
+    ${SOURCE_DIR}/renderergl2/tr_occlusion.c
     ${SOURCE_DIR}/renderergl2/tr_postprocess.c
     ${SOURCE_DIR}/renderergl2/tr_scene.c
     ${SOURCE_DIR}/renderergl2/tr_shade.c
@@ -13,6 +13,7 @@ set(COMMON_SOURCES
     ${SOURCE_DIR}/qcommon/common.c
     ${SOURCE_DIR}/qcommon/cvar.c
     ${SOURCE_DIR}/qcommon/files.c
+    ${SOURCE_DIR}/qcommon/jobs.c
     ${SOURCE_DIR}/qcommon/md4.c
     ${SOURCE_DIR}/qcommon/md5.c
     ${SOURCE_DIR}/qcommon/msg.c
@@ -24,9 +25,11 @@ set(COMMON_SOURCES
     ${SOURCE_DIR}/qcommon/unzip.c
     ${SOURCE_DIR}/qcommon/ioapi.c
     ${SOURCE_DIR}/qcommon/vm.c
+    ${SOURCE_DIR}/qcommon/vm_aarch64.c
     ${SOURCE_DIR}/qcommon/vm_armv7l.c
     ${SOURCE_DIR}/qcommon/vm_interpreted.c
     ${SOURCE_DIR}/qcommon/vm_powerpc.c
+    ${SOURCE_DIR}/qcommon/vm_profile.c
     ${SOURCE_DIR}/qcommon/vm_sparc.c
     ${SOURCE_DIR}/qcommon/vm_x86.c
 )
@@ -0,0 +1,11 @@
+if(NOT BUILD_GAME_QVMS)
+    return()
+endif()
+
+include(utils/qvm_tools)
+
+# Test module for the vmcompare command, see misc/vmcompare.sh
+add_qvm(vmtest
+    SOURCES
+        ${SOURCE_DIR}/tools/vmtest/vmtest.c
+        ${SOURCE_DIR}/tools/vmtest/vmtest_syscalls.asm)
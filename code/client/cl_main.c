@@ -3338,6 +3338,14 @@ void CL_InitRef( void ) {
 	ri.Sys_GLimpInit = Sys_GLimpInit;
 	ri.Sys_LowPhysicalMemory = Sys_LowPhysicalMemory;
 
+	ri.Job_ParallelFor = Job_ParallelFor;
+
+	ri.FS_BaseDir_FOpenCacheFileRead = FS_BaseDir_FOpenCacheFileRead;
+	ri.FS_BaseDir_FOpenFileWrite = FS_BaseDir_FOpenFileWrite;
+	ri.FS_Read = FS_Read;
+	ri.FS_Write = FS_Write;
+	ri.FS_FCloseFile = FS_FCloseFile;
+
 	ret = GetRefAPI( REF_API_VERSION, &ri );
 
 #if defined __USEA3D && defined __A3D_GEOM
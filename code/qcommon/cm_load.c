@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 // cmodel.c -- model loading
 
 #include "cm_local.h"
+#include "cm_patch.h"
 
 #ifdef BSPC
 
@@ -41,19 +42,10 @@ void SetPlaneSignbits (cplane_t *out) {
 }
 #endif //BSPC
 
-// to allow boxes to be treated as brush models, we allocate
-// some extra indexes along with those needed by the map
-#define	BOX_BRUSHES		1
-#define	BOX_SIDES		6
-#define	BOX_LEAFS		2
-#define	BOX_PLANES		12
-
 #define	LL(x) x=LittleLong(x)
 
 
 clipMap_t	cm;
-int			c_pointcontents;
-int			c_traces, c_brush_traces, c_patch_traces;
 
 
 byte		*cmod_base;
@@ -62,15 +54,17 @@ byte		*cmod_base;
 cvar_t		*cm_noAreas;
 cvar_t		*cm_noCurves;
 cvar_t		*cm_playerCurveClip;
+cvar_t		*cm_debugSurfaceUpdate;
 #endif
 
-cmodel_t	box_model;
-cplane_t	*box_planes;
-cbrush_t	*box_brush;
+static Q_THREADLOCAL cmThread_t	*cm_thread;
+static cmThread_t	*cm_threads;		// every thread that has used the collision model
+static void			*cm_threadLock;
+static int			cm_generation;		// bumped whenever the map changes
 
 
 
-void	CM_InitBoxHull (void);
+void	CM_InitBoxHull( cboxHull_t *box );
 void	CM_FloodAreaConnections (void);
 
 
@@ -224,6 +218,45 @@ void CM_BoundBrush( cbrush_t *b ) {
 }
 
 
+/*
+=================
+CMod_LoadBrushPlanes
+
+Copies the planes of every brush's sides into cbrushPlanes_t blocks
+=================
+*/
+static void CMod_LoadBrushPlanes( void ) {
+	cbrush_t		*brush;
+	cbrushPlanes_t	*block;
+	cplane_t		*plane;
+	int				numBlocks;
+	int				i, j;
+
+	numBlocks = 0;
+	for ( i = 0, brush = cm.brushes ; i < cm.numBrushes ; i++, brush++ ) {
+		numBlocks += ( brush->numsides + 3 ) / 4;
+	}
+
+	// the unused slots of the last block of a brush stay zeroed
+	block = Hunk_Alloc( numBlocks * sizeof( *block ), h_high );
+
+	for ( i = 0, brush = cm.brushes ; i < cm.numBrushes ; i++, brush++ ) {
+		brush->planes = block;
+
+		for ( j = 0 ; j < brush->numsides ; j++ ) {
+			plane = brush->sides[j].plane;
+
+			block[j >> 2].normal[0][j & 3] = plane->normal[0];
+			block[j >> 2].normal[1][j & 3] = plane->normal[1];
+			block[j >> 2].normal[2][j & 3] = plane->normal[2];
+			block[j >> 2].dist[j & 3] = plane->dist;
+			block[j >> 2].signbits[j & 3] = plane->signbits;
+		}
+
+		block += ( brush->numsides + 3 ) / 4;
+	}
+}
+
 /*
 =================
 CMod_LoadBrushes
@@ -241,7 +274,7 @@ void CMod_LoadBrushes( lump_t *l ) {
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushes = Hunk_Alloc( ( BOX_BRUSHES + count ) * sizeof( *cm.brushes ), h_high );
+	cm.brushes = Hunk_Alloc( count * sizeof( *cm.brushes ), h_high );
 	cm.numBrushes = count;
 
 	out = cm.brushes;
@@ -259,6 +292,7 @@ void CMod_LoadBrushes( lump_t *l ) {
 		CM_BoundBrush( out );
 	}
 
+	CMod_LoadBrushPlanes();
 }
 
 /*
@@ -281,7 +315,7 @@ void CMod_LoadLeafs (lump_t *l)
 	if (count < 1)
 		Com_Error (ERR_DROP, "Map with no leafs");
 
-	cm.leafs = Hunk_Alloc( ( BOX_LEAFS + count ) * sizeof( *cm.leafs ), h_high );
+	cm.leafs = Hunk_Alloc( count * sizeof( *cm.leafs ), h_high );
 	cm.numLeafs = count;
 
 	out = cm.leafs;	
@@ -324,7 +358,7 @@ void CMod_LoadPlanes (lump_t *l)
 
 	if (count < 1)
 		Com_Error (ERR_DROP, "Map with no planes");
-	cm.planes = Hunk_Alloc( ( BOX_PLANES + count ) * sizeof( *cm.planes ), h_high );
+	cm.planes = Hunk_Alloc( count * sizeof( *cm.planes ), h_high );
 	cm.numPlanes = count;
 
 	out = cm.planes;	
@@ -362,7 +396,7 @@ void CMod_LoadLeafBrushes (lump_t *l)
 		Com_Error (ERR_DROP, "MOD_LoadBmodel: funny lump size");
 	count = l->filelen / sizeof(*in);
 
-	cm.leafbrushes = Hunk_Alloc( (count + BOX_BRUSHES) * sizeof( *cm.leafbrushes ), h_high );
+	cm.leafbrushes = Hunk_Alloc( count * sizeof( *cm.leafbrushes ), h_high );
 	cm.numLeafBrushes = count;
 
 	out = cm.leafbrushes;
@@ -418,7 +452,7 @@ void CMod_LoadBrushSides (lump_t *l)
 	}
 	count = l->filelen / sizeof(*in);
 
-	cm.brushsides = Hunk_Alloc( ( BOX_SIDES + count ) * sizeof( *cm.brushsides ), h_high );
+	cm.brushsides = Hunk_Alloc( count * sizeof( *cm.brushsides ), h_high );
 	cm.numBrushSides = count;
 
 	out = cm.brushsides;	
@@ -536,6 +570,81 @@ void CMod_LoadPatches( lump_t *surfs, lump_t *verts ) {
 	}
 }
 
+/*
+=================
+CMod_SetLeafBounds
+=================
+*/
+static void CMod_SetLeafBounds( cLeafBounds_t *out, int contents, const vec3_t mins, const vec3_t maxs ) {
+	int		i;
+
+	out->contents = contents;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		// map coordinates are small enough for this to be exact in floats
+		out->mins[i] = mins[i] - SURFACE_CLIP_EPSILON;
+		out->maxs[i] = maxs[i] + SURFACE_CLIP_EPSILON;
+	}
+}
+
+/*
+=================
+CMod_FillLeafBounds
+=================
+*/
+static cLeafBounds_t *CMod_FillLeafBounds( cLeaf_t *leaf, cLeafBounds_t *out ) {
+	cbrush_t	*brush;
+	cPatch_t	*patch;
+	int			k;
+
+	leaf->brushBounds = out;
+	for ( k = 0 ; k < leaf->numLeafBrushes ; k++, out++ ) {
+		brush = &cm.brushes[ cm.leafbrushes[ leaf->firstLeafBrush + k ] ];
+		CMod_SetLeafBounds( out, brush->contents, brush->bounds[0], brush->bounds[1] );
+	}
+
+	leaf->surfaceBounds = out;
+	for ( k = 0 ; k < leaf->numLeafSurfaces ; k++, out++ ) {
+		patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+		if ( !patch ) {
+			continue;	// stays zeroed, so nothing will match
+		}
+		CMod_SetLeafBounds( out, patch->contents, patch->pc->bounds[0], patch->pc->bounds[1] );
+	}
+
+	return out;
+}
+
+/*
+=================
+CMod_LoadLeafBounds
+
+Gives every leaf, and the single leaf of each submodel, an array with
+the bounds of the brushes and patches it references
+=================
+*/
+static void CMod_LoadLeafBounds( void ) {
+	cLeafBounds_t	*out;
+	int				count;
+	int				i;
+
+	count = 0;
+	for ( i = 0 ; i < cm.numLeafs ; i++ ) {
+		count += cm.leafs[i].numLeafBrushes + cm.leafs[i].numLeafSurfaces;
+	}
+	for ( i = 0 ; i < cm.numSubModels ; i++ ) {
+		count += cm.cmodels[i].leaf.numLeafBrushes + cm.cmodels[i].leaf.numLeafSurfaces;
+	}
+
+	out = Hunk_Alloc( count * sizeof( *out ), h_high );
+
+	for ( i = 0 ; i < cm.numLeafs ; i++ ) {
+		out = CMod_FillLeafBounds( &cm.leafs[i], out );
+	}
+	for ( i = 0 ; i < cm.numSubModels ; i++ ) {
+		out = CMod_FillLeafBounds( &cm.cmodels[i].leaf, out );
+	}
+}
+
 //==================================================================
 
 unsigned CM_LumpChecksum(lump_t *lump) {
@@ -559,6 +668,123 @@ unsigned CM_Checksum(dheader_t *header) {
 	return LittleLong(Com_BlockChecksum(checksums, 11 * 4));
 }
 
+/*
+===============================================================================
+
+PER-THREAD STATE
+
+===============================================================================
+*/
+
+/*
+==================
+CM_Thread
+
+Returns the collision state of the calling thread, creating it on the
+first call and resizing the check arrays after a map change
+==================
+*/
+cmThread_t *CM_Thread( void ) {
+	cmThread_t	*thread;
+
+	thread = cm_thread;
+
+	if ( !thread ) {
+		// plain malloc, this can be called from any thread
+		thread = calloc( 1, sizeof( *thread ) );
+		if ( !thread ) {
+			Com_Error( ERR_FATAL, "CM_Thread: out of memory" );
+		}
+		thread->generation = -1;
+		CM_InitBoxHull( &thread->box );
+
+		if ( cm_threadLock ) {
+			Sys_LockMutex( cm_threadLock );
+		}
+		thread->next = cm_threads;
+		cm_threads = thread;
+		if ( cm_threadLock ) {
+			Sys_UnlockMutex( cm_threadLock );
+		}
+
+		cm_thread = thread;
+	}
+
+	if ( thread->generation != cm_generation ) {
+		free( thread->brushChecks );
+		thread->brushChecks = calloc( cm.numBrushes + cm.numSurfaces + 1, sizeof( int ) );
+		if ( !thread->brushChecks ) {
+			Com_Error( ERR_FATAL, "CM_Thread: out of memory" );
+		}
+		thread->patchChecks = thread->brushChecks + cm.numBrushes;
+		thread->checkcount = 0;
+		thread->generation = cm_generation;
+	}
+
+	return thread;
+}
+
+/*
+==================
+CM_ResetThreads
+
+Called after the map changed, while no traces can be running
+==================
+*/
+static void CM_ResetThreads( void ) {
+	cmThread_t	*thread;
+
+	if ( !cm_threadLock ) {
+		cm_threadLock = Sys_CreateMutex();
+	}
+
+	Sys_LockMutex( cm_threadLock );
+	for ( thread = cm_threads ; thread ; thread = thread->next ) {
+		free( thread->brushChecks );
+		thread->brushChecks = NULL;
+		thread->patchChecks = NULL;
+	}
+	Sys_UnlockMutex( cm_threadLock );
+
+	cm_generation++;
+
+	// the thread that loads maps is the one that draws the debug surface
+	CM_Thread()->debugSurface = qtrue;
+}
+
+/*
+==================
+CM_TraceStats
+
+Sums the trace statistics of all threads
+==================
+*/
+void CM_TraceStats( int *traces, int *brushTraces, int *patchTraces, int *pointContents, qboolean clear ) {
+	cmThread_t	*thread;
+
+	*traces = *brushTraces = *patchTraces = *pointContents = 0;
+
+	if ( cm_threadLock ) {
+		Sys_LockMutex( cm_threadLock );
+	}
+	for ( thread = cm_threads ; thread ; thread = thread->next ) {
+		*traces += thread->c_traces;
+		*brushTraces += thread->c_brush_traces;
+		*patchTraces += thread->c_patch_traces;
+		*pointContents += thread->c_pointcontents;
+
+		if ( clear ) {
+			thread->c_traces = 0;
+			thread->c_brush_traces = 0;
+			thread->c_patch_traces = 0;
+			thread->c_pointcontents = 0;
+		}
+	}
+	if ( cm_threadLock ) {
+		Sys_UnlockMutex( cm_threadLock );
+	}
+}
+
 /*
 ==================
 CM_LoadMap
@@ -584,6 +810,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	cm_noAreas = Cvar_Get ("cm_noAreas", "0", CVAR_CHEAT);
 	cm_noCurves = Cvar_Get ("cm_noCurves", "0", CVAR_CHEAT);
 	cm_playerCurveClip = Cvar_Get ("cm_playerCurveClip", "1", CVAR_ARCHIVE|CVAR_CHEAT );
+	cm_debugSurfaceUpdate = Cvar_Get ("r_debugSurfaceUpdate", "1", 0 );
 #endif
 	Com_DPrintf( "CM_LoadMap( %s, %i )\n", name, clientload );
 
@@ -602,6 +829,7 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 		cm.numAreas = 1;
 		cm.cmodels = Hunk_Alloc( sizeof( *cm.cmodels ), h_high );
 		*checksum = 0;
+		CM_ResetThreads();
 		return;
 	}
 
@@ -646,14 +874,15 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	CMod_LoadEntityString (&header.lumps[LUMP_ENTITIES]);
 	CMod_LoadVisibility( &header.lumps[LUMP_VISIBILITY] );
 	CMod_LoadPatches( &header.lumps[LUMP_SURFACES], &header.lumps[LUMP_DRAWVERTS] );
+	CMod_LoadLeafBounds();
 
 	// we are NOT freeing the file, because it is cached for the ref
 	FS_FreeFile (buf.v);
 
-	CM_InitBoxHull ();
-
 	CM_FloodAreaConnections ();
 
+	CM_ResetThreads();
+
 	// allow this to be cached if it is loaded by the server
 	if ( !clientload ) {
 		Q_strncpyz( cm.name, name, sizeof( cm.name ) );
@@ -668,6 +897,7 @@ CM_ClearMap
 void CM_ClearMap( void ) {
 	Com_Memset( &cm, 0, sizeof( cm ) );
 	CM_ClearLevelPatches();
+	CM_ResetThreads();
 }
 
 /*
@@ -683,7 +913,7 @@ cmodel_t	*CM_ClipHandleToModel( clipHandle_t handle ) {
 		return &cm.cmodels[handle];
 	}
 	if ( handle == BOX_MODEL_HANDLE ) {
-		return &box_model;
+		return &CM_Thread()->box.model;
 	}
 	if ( handle < MAX_SUBMODELS ) {
 		Com_Error( ERR_DROP, "CM_ClipHandleToModel: bad handle %i < %i < %i", 
@@ -744,42 +974,34 @@ Set up the planes and nodes so that the six floats of a bounding box
 can just be stored out and get a proper clipping hull structure.
 ===================
 */
-void CM_InitBoxHull (void)
+void CM_InitBoxHull( cboxHull_t *box )
 {
 	int			i;
 	int			side;
 	cplane_t	*p;
 	cbrushside_t	*s;
 
-	box_planes = &cm.planes[cm.numPlanes];
-
-	box_brush = &cm.brushes[cm.numBrushes];
-	box_brush->numsides = 6;
-	box_brush->sides = cm.brushsides + cm.numBrushSides;
-	box_brush->contents = CONTENTS_BODY;
-
-	box_model.leaf.numLeafBrushes = 1;
-//	box_model.leaf.firstLeafBrush = cm.numBrushes;
-	box_model.leaf.firstLeafBrush = cm.numLeafBrushes;
-	cm.leafbrushes[cm.numLeafBrushes] = cm.numBrushes;
+	box->brush.numsides = 6;
+	box->brush.sides = box->sides;
+	box->brush.contents = CONTENTS_BODY;
 
 	for (i=0 ; i<6 ; i++)
 	{
 		side = i&1;
 
 		// brush sides
-		s = &cm.brushsides[cm.numBrushSides+i];
-		s->plane = 	cm.planes + (cm.numPlanes+i*2+side);
+		s = &box->sides[i];
+		s->plane = 	box->planes + (i*2+side);
 		s->surfaceFlags = 0;
 
 		// planes
-		p = &box_planes[i*2];
+		p = &box->planes[i*2];
 		p->type = i>>1;
 		p->signbits = 0;
 		VectorClear (p->normal);
 		p->normal[i>>1] = 1;
 
-		p = &box_planes[i*2+1];
+		p = &box->planes[i*2+1];
 		p->type = 3 + (i>>1);
 		p->signbits = 0;
 		VectorClear (p->normal);
@@ -796,32 +1018,37 @@ CM_TempBoxModel
 To keep everything totally uniform, bounding boxes are turned into small
 BSP trees instead of being compared directly.
 Capsules are handled differently though.
+The box belongs to the calling thread and stays valid for its traces
+until the thread makes another one.
 ===================
 */
 clipHandle_t CM_TempBoxModel( const vec3_t mins, const vec3_t maxs, int capsule ) {
+	cboxHull_t	*box;
+
+	box = &CM_Thread()->box;
 
-	VectorCopy( mins, box_model.mins );
-	VectorCopy( maxs, box_model.maxs );
+	VectorCopy( mins, box->model.mins );
+	VectorCopy( maxs, box->model.maxs );
 
 	if ( capsule ) {
 		return CAPSULE_MODEL_HANDLE;
 	}
 
-	box_planes[0].dist = maxs[0];
-	box_planes[1].dist = -maxs[0];
-	box_planes[2].dist = mins[0];
-	box_planes[3].dist = -mins[0];
-	box_planes[4].dist = maxs[1];
-	box_planes[5].dist = -maxs[1];
-	box_planes[6].dist = mins[1];
-	box_planes[7].dist = -mins[1];
-	box_planes[8].dist = maxs[2];
-	box_planes[9].dist = -maxs[2];
-	box_planes[10].dist = mins[2];
-	box_planes[11].dist = -mins[2];
-
-	VectorCopy( mins, box_brush->bounds[0] );
-	VectorCopy( maxs, box_brush->bounds[1] );
+	box->planes[0].dist = maxs[0];
+	box->planes[1].dist = -maxs[0];
+	box->planes[2].dist = mins[0];
+	box->planes[3].dist = -mins[0];
+	box->planes[4].dist = maxs[1];
+	box->planes[5].dist = -maxs[1];
+	box->planes[6].dist = mins[1];
+	box->planes[7].dist = -mins[1];
+	box->planes[8].dist = maxs[2];
+	box->planes[9].dist = -maxs[2];
+	box->planes[10].dist = mins[2];
+	box->planes[11].dist = -mins[2];
+
+	VectorCopy( mins, box->brush.bounds[0] );
+	VectorCopy( maxs, box->brush.bounds[1] );
 
 	return BOX_MODEL_HANDLE;
 }
@@ -24,6 +24,16 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "qcommon.h"
 #include "cm_polylib.h"
 
+// the plane distances are only computed with vectors where that
+// gives bit for bit the same floats as the scalar code
+#if defined( __SSE2_MATH__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define CM_SIMD_SSE2
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#include <arm_neon.h>
+#define CM_SIMD_NEON
+#endif
+
 #define	MAX_SUBMODELS			256
 #define	BOX_MODEL_HANDLE		255
 #define CAPSULE_MODEL_HANDLE	254
@@ -34,6 +44,16 @@ typedef struct {
 	int			children[2];		// negative numbers are leafs
 } cNode_t;
 
+// the bounds of a brush or patch referenced by a leaf, grown by
+// SURFACE_CLIP_EPSILON and stored next to the others of the same leaf
+// so most of them can be rejected without touching the brush or patch
+typedef struct {
+	float		mins[3];
+	int			contents;
+	float		maxs[3];
+	int			pad;
+} cLeafBounds_t;
+
 typedef struct {
 	int			cluster;
 	int			area;
@@ -43,6 +63,9 @@ typedef struct {
 
 	int			firstLeafSurface;
 	int			numLeafSurfaces;
+
+	cLeafBounds_t	*brushBounds;	// [numLeafBrushes], NULL if the bounds can change
+	cLeafBounds_t	*surfaceBounds;	// [numLeafSurfaces], contents 0 for non-patches
 } cLeaf_t;
 
 typedef struct cmodel_s {
@@ -56,18 +79,25 @@ typedef struct {
 	int			shaderNum;
 } cbrushside_t;
 
+// the planes of a brush's sides, four at a time, for the vectorized
+// distance calculations in cm_trace.c
+typedef struct {
+	float		normal[3][4];	// [axis][side]
+	float		dist[4];
+	int			signbits[4];
+} cbrushPlanes_t;
+
 typedef struct {
 	int			shaderNum;		// the shader that determined the contents
 	int			contents;
 	vec3_t		bounds[2];
 	int			numsides;
 	cbrushside_t	*sides;
-	int			checkcount;		// to avoid repeated testings
+	cbrushPlanes_t	*planes;	// ( numsides + 3 ) / 4 blocks, NULL if the planes can change
 } cbrush_t;
 
 
 typedef struct {
-	int			checkcount;				// to avoid repeated testings
 	int			surfaceFlags;
 	int			contents;
 	struct patchCollide_s	*pc;
@@ -125,7 +155,6 @@ typedef struct {
 	cPatch_t	**surfaces;			// non-patches will be NULL
 
 	int			floodvalid;
-	int			checkcount;					// incremented on each trace
 } clipMap_t;
 
 
@@ -133,12 +162,40 @@ typedef struct {
 // and to avoid various numeric issues
 #define	SURFACE_CLIP_EPSILON	(0.125)
 
+// the brush a bounding box is turned into by CM_TempBoxModel
+typedef struct {
+	cmodel_t	model;			// the leaf is empty, traces use the brush directly
+	cbrush_t	brush;
+	cbrushside_t	sides[6];
+	cplane_t	planes[12];
+} cboxHull_t;
+
+// everything a trace writes to outside of its own stack frame, kept
+// per thread so several threads can use the collision model at once
+typedef struct cmThread_s {
+	struct cmThread_s	*next;
+
+	int			generation;		// the map the check arrays were made for
+	int			checkcount;		// incremented on each trace
+	int			*brushChecks;	// [cm.numBrushes] to avoid repeated testings
+	int			*patchChecks;	// [cm.numSurfaces]
+
+	qboolean	debugSurface;	// hit patches update the patch debug surface
+
+	cboxHull_t	box;
+
+	// for statistics, may be zeroed
+	int			c_traces, c_brush_traces, c_patch_traces;
+	int			c_pointcontents;
+} cmThread_t;
+
 extern	clipMap_t	cm;
-extern	int			c_pointcontents;
-extern	int			c_traces, c_brush_traces, c_patch_traces;
 extern	cvar_t		*cm_noAreas;
 extern	cvar_t		*cm_noCurves;
 extern	cvar_t		*cm_playerCurveClip;
+extern	cvar_t		*cm_debugSurfaceUpdate;
+
+cmThread_t	*CM_Thread( void );
 
 // cm_test.c
 
@@ -164,6 +221,7 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	cmThread_t	*thread;	// the thread doing the trace
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -173,6 +231,7 @@ typedef struct leafList_s {
 	int		*list;
 	vec3_t	bounds[2];
 	int		lastLeaf;		// for overflows where each leaf can't be stored individually
+	cmThread_t	*thread;	// checkcount owner for CM_StoreBrushes
 	void	(*storeLeafs)( struct leafList_s *ll, int nodenum );
 } leafList_t;
 
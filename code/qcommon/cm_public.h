@@ -63,5 +63,8 @@ qboolean	CM_AreasConnected( int area1, int area2 );
 
 int			CM_WriteAreaBits( byte *buffer, int area );
 
+// sums the trace counters of every thread, zeroing them if clear is set
+void		CM_TraceStats( int *traces, int *brushTraces, int *patchTraces, int *pointContents, qboolean clear );
+
 // cm_patch.c
 void CM_DrawDebugSurface( void (*drawPoly)(int color, int numPoints, float *points) );
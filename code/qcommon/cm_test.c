@@ -48,7 +48,7 @@ int CM_PointLeafnum_r( const vec3_t p, int num ) {
 			num = node->children[0];
 	}
 
-	c_pointcontents++;		// optimize counter
+	CM_Thread()->c_pointcontents++;		// optimize counter
 
 	return -1 - num;
 }
@@ -93,18 +93,20 @@ void CM_StoreBrushes( leafList_t *ll, int nodenum ) {
 	int			brushnum;
 	cLeaf_t		*leaf;
 	cbrush_t	*b;
+	int			*checks;
 
 	leafnum = -1 - nodenum;
 
 	leaf = &cm.leafs[leafnum];
+	checks = ll->thread->brushChecks;
 
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( checks[brushnum] == ll->thread->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		checks[brushnum] = ll->thread->checkcount;
 		for ( i = 0 ; i < 3 ; i++ ) {
 			if ( b->bounds[0][i] >= ll->bounds[1][i] || b->bounds[1][i] <= ll->bounds[0][i] ) {
 				break;
@@ -172,13 +174,12 @@ CM_BoxLeafnums
 int	CM_BoxLeafnums( const vec3_t mins, const vec3_t maxs, int *list, int listsize, int *lastLeaf) {
 	leafList_t	ll;
 
-	cm.checkcount++;
-
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
 	ll.count = 0;
 	ll.maxcount = listsize;
 	ll.list = list;
+	ll.thread = NULL;
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
@@ -197,7 +198,8 @@ CM_BoxBrushes
 int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int listsize ) {
 	leafList_t	ll;
 
-	cm.checkcount++;
+	ll.thread = CM_Thread();
+	ll.thread->checkcount++;
 
 	VectorCopy( mins, ll.bounds[0] );
 	VectorCopy( maxs, ll.bounds[1] );
@@ -217,6 +219,34 @@ int CM_BoxBrushes( const vec3_t mins, const vec3_t maxs, cbrush_t **list, int li
 //====================================================================
 
 
+/*
+==================
+CM_BrushPointContents
+
+Returns the contents of the brush if the point is inside it
+==================
+*/
+static int CM_BrushPointContents( const vec3_t p, cbrush_t *b ) {
+	int			i;
+	float		d;
+
+	if ( !CM_BoundsIntersectPoint( b->bounds[0], b->bounds[1], p ) ) {
+		return 0;
+	}
+
+	// see if the point is in the brush
+	for ( i = 0 ; i < b->numsides ; i++ ) {
+		d = DotProduct( p, b->sides[i].plane->normal );
+// FIXME test for Cash
+//		if ( d >= b->sides[i].plane->dist ) {
+		if ( d > b->sides[i].plane->dist ) {
+			return 0;
+		}
+	}
+
+	return b->contents;
+}
+
 /*
 ==================
 CM_PointContents
@@ -225,19 +255,21 @@ CM_PointContents
 */
 int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 	int			leafnum;
-	int			i, k;
+	int			k;
 	int			brushnum;
 	cLeaf_t		*leaf;
 	cbrush_t	*b;
 	int			contents;
-	float		d;
 	cmodel_t	*clipm;
 
 	if (!cm.numNodes) {	// map not loaded
 		return 0;
 	}
 
-	if ( model ) {
+	if ( model == BOX_MODEL_HANDLE ) {
+		// the box brush isn't part of the map
+		return CM_BrushPointContents( p, &CM_Thread()->box.brush );
+	} else if ( model ) {
 		clipm = CM_ClipHandleToModel( model );
 		leaf = &clipm->leaf;
 	} else {
@@ -250,23 +282,7 @@ int CM_PointContents( const vec3_t p, clipHandle_t model ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
 
-		if ( !CM_BoundsIntersectPoint( b->bounds[0], b->bounds[1], p ) ) {
-			continue;
-		}
-
-		// see if the point is in the brush
-		for ( i = 0 ; i < b->numsides ; i++ ) {
-			d = DotProduct( p, b->sides[i].plane->normal );
-// FIXME test for Cash
-//			if ( d >= b->sides[i].plane->dist ) {
-			if ( d > b->sides[i].plane->dist ) {
-				break;
-			}
-		}
-
-		if ( i == b->numsides ) {
-			contents |= b->contents;
-		}
+		contents |= CM_BrushPointContents( p, b );
 	}
 
 	return contents;
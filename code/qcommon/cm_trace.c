@@ -155,74 +155,217 @@ POSITION TESTING
 
 /*
 ================
-CM_TestBoxInBrush
+CM_BrushPlaneDistances
+
+Computes how far the start and end points of the trace are in front of
+the planes of brush sides block * 4 to block * 4 + 3, with the plane
+distances adjusted for the box or capsule being traced.
 ================
 */
-void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
-	int			i;
+static void CM_BrushPlaneDistances( traceWork_t *tw, cbrush_t *brush, int block, float *d1, float *d2 ) {
+	int			i, num;
 	cplane_t	*plane;
 	float		dist;
-	float		d1;
-	cbrushside_t	*side;
 	float		t;
 	vec3_t		startp;
+	vec3_t		endp;
 
-	if (!brush->numsides) {
+#if defined( CM_SIMD_SSE2 )
+	if ( brush->planes ) {
+		const cbrushPlanes_t *p = &brush->planes[block];
+		__m128	nx, ny, nz, pdist, dist4;
+		__m128	sx, sy, sz, ex, ey, ez;
+
+		nx = _mm_loadu_ps( p->normal[0] );
+		ny = _mm_loadu_ps( p->normal[1] );
+		nz = _mm_loadu_ps( p->normal[2] );
+		pdist = _mm_loadu_ps( p->dist );
+
+		if ( tw->sphere.use ) {
+			__m128	ox, oy, oz, pos;
+
+			// adjust the plane distance appropriately for radius
+			dist4 = _mm_add_ps( pdist, _mm_set1_ps( tw->sphere.radius ) );
+
+			// find the closest point on the capsule to the plane
+			ox = _mm_set1_ps( tw->sphere.offset[0] );
+			oy = _mm_set1_ps( tw->sphere.offset[1] );
+			oz = _mm_set1_ps( tw->sphere.offset[2] );
+			pos = _mm_cmpgt_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( nx, ox ), _mm_mul_ps( ny, oy ) ), _mm_mul_ps( nz, oz ) ),
+								_mm_setzero_ps() );
+
+			sx = _mm_set1_ps( tw->start[0] );
+			sy = _mm_set1_ps( tw->start[1] );
+			sz = _mm_set1_ps( tw->start[2] );
+			ex = _mm_set1_ps( tw->end[0] );
+			ey = _mm_set1_ps( tw->end[1] );
+			ez = _mm_set1_ps( tw->end[2] );
+
+			sx = _mm_or_ps( _mm_and_ps( pos, _mm_sub_ps( sx, ox ) ), _mm_andnot_ps( pos, _mm_add_ps( sx, ox ) ) );
+			sy = _mm_or_ps( _mm_and_ps( pos, _mm_sub_ps( sy, oy ) ), _mm_andnot_ps( pos, _mm_add_ps( sy, oy ) ) );
+			sz = _mm_or_ps( _mm_and_ps( pos, _mm_sub_ps( sz, oz ) ), _mm_andnot_ps( pos, _mm_add_ps( sz, oz ) ) );
+			ex = _mm_or_ps( _mm_and_ps( pos, _mm_sub_ps( ex, ox ) ), _mm_andnot_ps( pos, _mm_add_ps( ex, ox ) ) );
+			ey = _mm_or_ps( _mm_and_ps( pos, _mm_sub_ps( ey, oy ) ), _mm_andnot_ps( pos, _mm_add_ps( ey, oy ) ) );
+			ez = _mm_or_ps( _mm_and_ps( pos, _mm_sub_ps( ez, oz ) ), _mm_andnot_ps( pos, _mm_add_ps( ez, oz ) ) );
+		} else {
+			__m128	ox, oy, oz;
+			__m128i	signbits;
+			__m128	mx, my, mz;
+
+			// adjust the plane distance appropriately for mins/maxs,
+			// bit n of signbits picks size[1][n] over size[0][n]
+			signbits = _mm_loadu_si128( (const __m128i *)p->signbits );
+			mx = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( signbits, _mm_set1_epi32( 1 ) ), _mm_set1_epi32( 1 ) ) );
+			my = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( signbits, _mm_set1_epi32( 2 ) ), _mm_set1_epi32( 2 ) ) );
+			mz = _mm_castsi128_ps( _mm_cmpeq_epi32( _mm_and_si128( signbits, _mm_set1_epi32( 4 ) ), _mm_set1_epi32( 4 ) ) );
+			ox = _mm_or_ps( _mm_and_ps( mx, _mm_set1_ps( tw->size[1][0] ) ), _mm_andnot_ps( mx, _mm_set1_ps( tw->size[0][0] ) ) );
+			oy = _mm_or_ps( _mm_and_ps( my, _mm_set1_ps( tw->size[1][1] ) ), _mm_andnot_ps( my, _mm_set1_ps( tw->size[0][1] ) ) );
+			oz = _mm_or_ps( _mm_and_ps( mz, _mm_set1_ps( tw->size[1][2] ) ), _mm_andnot_ps( mz, _mm_set1_ps( tw->size[0][2] ) ) );
+
+			dist4 = _mm_sub_ps( pdist, _mm_add_ps( _mm_add_ps( _mm_mul_ps( ox, nx ), _mm_mul_ps( oy, ny ) ), _mm_mul_ps( oz, nz ) ) );
+
+			sx = _mm_set1_ps( tw->start[0] );
+			sy = _mm_set1_ps( tw->start[1] );
+			sz = _mm_set1_ps( tw->start[2] );
+			ex = _mm_set1_ps( tw->end[0] );
+			ey = _mm_set1_ps( tw->end[1] );
+			ez = _mm_set1_ps( tw->end[2] );
+		}
+
+		_mm_storeu_ps( d1, _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( sx, nx ), _mm_mul_ps( sy, ny ) ), _mm_mul_ps( sz, nz ) ), dist4 ) );
+		_mm_storeu_ps( d2, _mm_sub_ps( _mm_add_ps( _mm_add_ps( _mm_mul_ps( ex, nx ), _mm_mul_ps( ey, ny ) ), _mm_mul_ps( ez, nz ) ), dist4 ) );
 		return;
 	}
+#elif defined( CM_SIMD_NEON )
+	if ( brush->planes ) {
+		const cbrushPlanes_t *p = &brush->planes[block];
+		float32x4_t	nx, ny, nz, pdist, dist4;
+		float32x4_t	sx, sy, sz, ex, ey, ez;
+
+		nx = vld1q_f32( p->normal[0] );
+		ny = vld1q_f32( p->normal[1] );
+		nz = vld1q_f32( p->normal[2] );
+		pdist = vld1q_f32( p->dist );
+
+		sx = vdupq_n_f32( tw->start[0] );
+		sy = vdupq_n_f32( tw->start[1] );
+		sz = vdupq_n_f32( tw->start[2] );
+		ex = vdupq_n_f32( tw->end[0] );
+		ey = vdupq_n_f32( tw->end[1] );
+		ez = vdupq_n_f32( tw->end[2] );
+
+		// separate multiplies and adds, a fused multiply-add would round differently
+		if ( tw->sphere.use ) {
+			float32x4_t	ox, oy, oz;
+			uint32x4_t	pos;
 
-	// special test for axial
-	if ( tw->bounds[0][0] > brush->bounds[1][0]
-		|| tw->bounds[0][1] > brush->bounds[1][1]
-		|| tw->bounds[0][2] > brush->bounds[1][2]
-		|| tw->bounds[1][0] < brush->bounds[0][0]
-		|| tw->bounds[1][1] < brush->bounds[0][1]
-		|| tw->bounds[1][2] < brush->bounds[0][2]
-		) {
+			// adjust the plane distance appropriately for radius
+			dist4 = vaddq_f32( pdist, vdupq_n_f32( tw->sphere.radius ) );
+
+			// find the closest point on the capsule to the plane
+			ox = vdupq_n_f32( tw->sphere.offset[0] );
+			oy = vdupq_n_f32( tw->sphere.offset[1] );
+			oz = vdupq_n_f32( tw->sphere.offset[2] );
+			pos = vcgtq_f32( vaddq_f32( vaddq_f32( vmulq_f32( nx, ox ), vmulq_f32( ny, oy ) ), vmulq_f32( nz, oz ) ),
+							 vdupq_n_f32( 0 ) );
+
+			sx = vbslq_f32( pos, vsubq_f32( sx, ox ), vaddq_f32( sx, ox ) );
+			sy = vbslq_f32( pos, vsubq_f32( sy, oy ), vaddq_f32( sy, oy ) );
+			sz = vbslq_f32( pos, vsubq_f32( sz, oz ), vaddq_f32( sz, oz ) );
+			ex = vbslq_f32( pos, vsubq_f32( ex, ox ), vaddq_f32( ex, ox ) );
+			ey = vbslq_f32( pos, vsubq_f32( ey, oy ), vaddq_f32( ey, oy ) );
+			ez = vbslq_f32( pos, vsubq_f32( ez, oz ), vaddq_f32( ez, oz ) );
+		} else {
+			float32x4_t	ox, oy, oz;
+			uint32x4_t	signbits;
+
+			// adjust the plane distance appropriately for mins/maxs,
+			// bit n of signbits picks size[1][n] over size[0][n]
+			signbits = vld1q_u32( (const uint32_t *)p->signbits );
+			ox = vbslq_f32( vtstq_u32( signbits, vdupq_n_u32( 1 ) ), vdupq_n_f32( tw->size[1][0] ), vdupq_n_f32( tw->size[0][0] ) );
+			oy = vbslq_f32( vtstq_u32( signbits, vdupq_n_u32( 2 ) ), vdupq_n_f32( tw->size[1][1] ), vdupq_n_f32( tw->size[0][1] ) );
+			oz = vbslq_f32( vtstq_u32( signbits, vdupq_n_u32( 4 ) ), vdupq_n_f32( tw->size[1][2] ), vdupq_n_f32( tw->size[0][2] ) );
+
+			dist4 = vsubq_f32( pdist, vaddq_f32( vaddq_f32( vmulq_f32( ox, nx ), vmulq_f32( oy, ny ) ), vmulq_f32( oz, nz ) ) );
+		}
+
+		vst1q_f32( d1, vsubq_f32( vaddq_f32( vaddq_f32( vmulq_f32( sx, nx ), vmulq_f32( sy, ny ) ), vmulq_f32( sz, nz ) ), dist4 ) );
+		vst1q_f32( d2, vsubq_f32( vaddq_f32( vaddq_f32( vmulq_f32( ex, nx ), vmulq_f32( ey, ny ) ), vmulq_f32( ez, nz ) ), dist4 ) );
 		return;
 	}
+#endif
+
+	num = brush->numsides - block * 4;
+	if ( num > 4 ) {
+		num = 4;
+	}
 
-   if ( tw->sphere.use ) {
-		// the first six planes are the axial planes, so we only
-		// need to test the remainder
-		for ( i = 6 ; i < brush->numsides ; i++ ) {
-			side = brush->sides + i;
-			plane = side->plane;
+	for ( i = 0 ; i < num ; i++ ) {
+		plane = brush->sides[block * 4 + i].plane;
 
+		if ( tw->sphere.use ) {
 			// adjust the plane distance appropriately for radius
 			dist = plane->dist + tw->sphere.radius;
+
 			// find the closest point on the capsule to the plane
 			t = DotProduct( plane->normal, tw->sphere.offset );
 			if ( t > 0 )
 			{
 				VectorSubtract( tw->start, tw->sphere.offset, startp );
+				VectorSubtract( tw->end, tw->sphere.offset, endp );
 			}
 			else
 			{
 				VectorAdd( tw->start, tw->sphere.offset, startp );
+				VectorAdd( tw->end, tw->sphere.offset, endp );
 			}
-			d1 = DotProduct( startp, plane->normal ) - dist;
-			// if completely in front of face, no intersection
-			if ( d1 > 0 ) {
-				return;
-			}
-		}
-	} else {
-		// the first six planes are the axial planes, so we only
-		// need to test the remainder
-		for ( i = 6 ; i < brush->numsides ; i++ ) {
-			side = brush->sides + i;
-			plane = side->plane;
 
+			d1[i] = DotProduct( startp, plane->normal ) - dist;
+			d2[i] = DotProduct( endp, plane->normal ) - dist;
+		} else {
 			// adjust the plane distance appropriately for mins/maxs
 			dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
 
-			d1 = DotProduct( tw->start, plane->normal ) - dist;
+			d1[i] = DotProduct( tw->start, plane->normal ) - dist;
+			d2[i] = DotProduct( tw->end, plane->normal ) - dist;
+		}
+	}
+}
 
-			// if completely in front of face, no intersection
-			if ( d1 > 0 ) {
-				return;
-			}
+/*
+================
+CM_TestBoxInBrush
+================
+*/
+void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
+	int			i;
+	float		d1[4], d2[4];
+
+	if (!brush->numsides) {
+		return;
+	}
+
+	// special test for axial
+	if ( tw->bounds[0][0] > brush->bounds[1][0]
+		|| tw->bounds[0][1] > brush->bounds[1][1]
+		|| tw->bounds[0][2] > brush->bounds[1][2]
+		|| tw->bounds[1][0] < brush->bounds[0][0]
+		|| tw->bounds[1][1] < brush->bounds[0][1]
+		|| tw->bounds[1][2] < brush->bounds[0][2]
+		) {
+		return;
+	}
+
+	// the first six planes are the axial planes, so we only
+	// need to test the remainder
+	for ( i = 6 ; i < brush->numsides ; i++ ) {
+		if ( i == 6 || !( i & 3 ) ) {
+			CM_BrushPlaneDistances( tw, brush, i >> 2, d1, d2 );
+		}
+
+		// if completely in front of face, no intersection
+		if ( d1[i & 3] > 0 ) {
+			return;
 		}
 	}
 
@@ -234,6 +377,47 @@ void CM_TestBoxInBrush( traceWork_t *tw, cbrush_t *brush ) {
 
 
 
+/*
+================
+CM_CullLeafBounds
+
+Returns qtrue if the brush or patch behind a leaf bounds entry can't
+be touched by the trace, without having to look at the brush or patch
+================
+*/
+static ID_INLINE qboolean CM_CullLeafBounds( const traceWork_t *tw, const cLeafBounds_t *lb ) {
+	if ( !( lb->contents & tw->contents ) ) {
+		return qtrue;
+	}
+
+#if defined( CM_SIMD_SSE2 )
+	{
+		__m128	out;
+
+		// the fourth lanes hold unrelated data and are masked off
+		out = _mm_or_ps( _mm_cmplt_ps( _mm_loadu_ps( tw->bounds[1] ), _mm_loadu_ps( lb->mins ) ),
+						 _mm_cmpgt_ps( _mm_loadu_ps( tw->bounds[0] ), _mm_loadu_ps( lb->maxs ) ) );
+		return ( _mm_movemask_ps( out ) & 7 ) != 0;
+	}
+#elif defined( CM_SIMD_NEON )
+	{
+		uint32x4_t	out;
+
+		// the fourth lanes hold unrelated data and are masked off
+		out = vorrq_u32( vcltq_f32( vld1q_f32( tw->bounds[1] ), vld1q_f32( lb->mins ) ),
+						 vcgtq_f32( vld1q_f32( tw->bounds[0] ), vld1q_f32( lb->maxs ) ) );
+		return vmaxvq_u32( vsetq_lane_u32( 0, out, 3 ) ) != 0;
+	}
+#else
+	return tw->bounds[1][0] < lb->mins[0]
+		|| tw->bounds[1][1] < lb->mins[1]
+		|| tw->bounds[1][2] < lb->mins[2]
+		|| tw->bounds[0][0] > lb->maxs[0]
+		|| tw->bounds[0][1] > lb->maxs[1]
+		|| tw->bounds[0][2] > lb->maxs[2];
+#endif
+}
+
 /*
 ================
 CM_TestInLeaf
@@ -241,18 +425,25 @@ CM_TestInLeaf
 */
 void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
+	cmThread_t	*thread;
+
+	thread = tw->thread;
 
 	// test box position against all brushes in the leaf
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
+		if ( leaf->brushBounds && CM_CullLeafBounds( tw, &leaf->brushBounds[k] ) ) {
+			continue;
+		}
+
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
+		if ( thread->brushChecks[brushnum] == thread->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		thread->brushChecks[brushnum] = thread->checkcount;
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -271,14 +462,21 @@ void CM_TestInLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif //BSPC
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			// the patch bounds don't bound what the position test can hit,
+			// so only the contents can be checked up front
+			if ( leaf->surfaceBounds && !( leaf->surfaceBounds[k].contents & tw->contents ) ) {
+				continue;
+			}
+
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( thread->patchChecks[surfnum] == thread->checkcount ) {
 				continue;	// already checked this brush in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			thread->patchChecks[surfnum] = thread->checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -363,6 +561,25 @@ void CM_TestCapsuleInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	}
 }
 
+/*
+================
+CM_TestInBoxHull
+
+CM_TestInLeaf for the box model of the tracing thread, its brush
+is not listed in cm.leafbrushes
+================
+*/
+static void CM_TestInBoxHull( traceWork_t *tw ) {
+	cbrush_t	*b;
+
+	b = &tw->thread->box.brush;
+	if ( !(b->contents & tw->contents) ) {
+		return;
+	}
+
+	CM_TestBoxInBrush( tw, b );
+}
+
 /*
 ==================
 CM_TestBoundingBoxInCapsule
@@ -372,8 +589,6 @@ bounding box inside capsule check
 */
 void CM_TestBoundingBoxInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	vec3_t mins, maxs, offset, size[2];
-	clipHandle_t h;
-	cmodel_t *cmod;
 	int i;
 
 	// mins maxs of the capsule
@@ -395,10 +610,9 @@ void CM_TestBoundingBoxInCapsule( traceWork_t *tw, clipHandle_t model ) {
 	VectorSet( tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius );
 
 	// replace the capsule with the bounding box
-	h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+	CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
 	// calculate collision
-	cmod = CM_ClipHandleToModel( h );
-	CM_TestInLeaf( tw, &cmod->leaf );
+	CM_TestInBoxHull( tw );
 }
 
 /*
@@ -424,17 +638,13 @@ void CM_PositionTest( traceWork_t *tw ) {
 	ll.count = 0;
 	ll.maxcount = MAX_POSITION_LEAFS;
 	ll.list = leafs;
+	ll.thread = tw->thread;
 	ll.storeLeafs = CM_StoreLeafs;
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
 
-	cm.checkcount++;
-
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
-
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
 		CM_TestInLeaf( tw, &cm.leafs[leafs[i]] );
@@ -462,7 +672,7 @@ CM_TraceThroughPatch
 void CM_TraceThroughPatch( traceWork_t *tw, cPatch_t *patch ) {
 	float		oldFrac;
 
-	c_patch_traces++;
+	tw->thread->c_patch_traces++;
 
 	oldFrac = tw->trace.fraction;
 
@@ -481,16 +691,13 @@ CM_TraceThroughBrush
 */
 void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 	int			i;
-	cplane_t	*plane, *clipplane;
-	float		dist;
+	cplane_t	*clipplane;
 	float		enterFrac, leaveFrac;
 	float		d1, d2;
+	float		block1[4], block2[4];
 	qboolean	getout, startout;
 	float		f;
 	cbrushside_t	*side, *leadside;
-	float		t;
-	vec3_t		startp;
-	vec3_t		endp;
 
 	enterFrac = -1.0;
 	leaveFrac = 1.0;
@@ -500,132 +707,62 @@ void CM_TraceThroughBrush( traceWork_t *tw, cbrush_t *brush ) {
 		return;
 	}
 
-	c_brush_traces++;
+	tw->thread->c_brush_traces++;
 
 	getout = qfalse;
 	startout = qfalse;
 
 	leadside = NULL;
 
-	if ( tw->sphere.use ) {
-		//
-		// compare the trace against all planes of the brush
-		// find the latest time the trace crosses a plane towards the interior
-		// and the earliest time the trace crosses a plane towards the exterior
-		//
-		for (i = 0; i < brush->numsides; i++) {
-			side = brush->sides + i;
-			plane = side->plane;
-
-			// adjust the plane distance appropriately for radius
-			dist = plane->dist + tw->sphere.radius;
-
-			// find the closest point on the capsule to the plane
-			t = DotProduct( plane->normal, tw->sphere.offset );
-			if ( t > 0 )
-			{
-				VectorSubtract( tw->start, tw->sphere.offset, startp );
-				VectorSubtract( tw->end, tw->sphere.offset, endp );
-			}
-			else
-			{
-				VectorAdd( tw->start, tw->sphere.offset, startp );
-				VectorAdd( tw->end, tw->sphere.offset, endp );
-			}
-
-			d1 = DotProduct( startp, plane->normal ) - dist;
-			d2 = DotProduct( endp, plane->normal ) - dist;
-
-			if (d2 > 0) {
-				getout = qtrue;	// endpoint is not in solid
-			}
-			if (d1 > 0) {
-				startout = qtrue;
-			}
-
-			// if completely in front of face, no intersection with the entire brush
-			if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
-				return;
-			}
+	//
+	// compare the trace against all planes of the brush
+	// find the latest time the trace crosses a plane towards the interior
+	// and the earliest time the trace crosses a plane towards the exterior
+	//
+	for (i = 0; i < brush->numsides; i++) {
+		side = brush->sides + i;
 
-			// if it doesn't cross the plane, the plane isn't relevant
-			if (d1 <= 0 && d2 <= 0 ) {
-				continue;
-			}
+		if ( !( i & 3 ) ) {
+			CM_BrushPlaneDistances( tw, brush, i >> 2, block1, block2 );
+		}
+		d1 = block1[i & 3];
+		d2 = block2[i & 3];
 
-			// crosses face
-			if (d1 > d2) {	// enter
-				f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
-				if ( f < 0 ) {
-					f = 0;
-				}
-				if (f > enterFrac) {
-					enterFrac = f;
-					clipplane = plane;
-					leadside = side;
-				}
-			} else {	// leave
-				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
-				if ( f > 1 ) {
-					f = 1;
-				}
-				if (f < leaveFrac) {
-					leaveFrac = f;
-				}
-			}
+		if (d2 > 0) {
+			getout = qtrue;	// endpoint is not in solid
+		}
+		if (d1 > 0) {
+			startout = qtrue;
 		}
-	} else {
-		//
-		// compare the trace against all planes of the brush
-		// find the latest time the trace crosses a plane towards the interior
-		// and the earliest time the trace crosses a plane towards the exterior
-		//
-		for (i = 0; i < brush->numsides; i++) {
-			side = brush->sides + i;
-			plane = side->plane;
 
-			// adjust the plane distance appropriately for mins/maxs
-			dist = plane->dist - DotProduct( tw->offsets[ plane->signbits ], plane->normal );
+		// if completely in front of face, no intersection with the entire brush
+		if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
+			return;
+		}
 
-			d1 = DotProduct( tw->start, plane->normal ) - dist;
-			d2 = DotProduct( tw->end, plane->normal ) - dist;
+		// if it doesn't cross the plane, the plane isn't relevant
+		if (d1 <= 0 && d2 <= 0 ) {
+			continue;
+		}
 
-			if (d2 > 0) {
-				getout = qtrue;	// endpoint is not in solid
+		// crosses face
+		if (d1 > d2) {	// enter
+			f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
+			if ( f < 0 ) {
+				f = 0;
 			}
-			if (d1 > 0) {
-				startout = qtrue;
+			if (f > enterFrac) {
+				enterFrac = f;
+				clipplane = side->plane;
+				leadside = side;
 			}
-
-			// if completely in front of face, no intersection with the entire brush
-			if (d1 > 0 && ( d2 >= SURFACE_CLIP_EPSILON || d2 >= d1 )  ) {
-				return;
+		} else {	// leave
+			f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
+			if ( f > 1 ) {
+				f = 1;
 			}
-
-			// if it doesn't cross the plane, the plane isn't relevant
-			if (d1 <= 0 && d2 <= 0 ) {
-				continue;
-			}
-
-			// crosses face
-			if (d1 > d2) {	// enter
-				f = (d1-SURFACE_CLIP_EPSILON) / (d1-d2);
-				if ( f < 0 ) {
-					f = 0;
-				}
-				if (f > enterFrac) {
-					enterFrac = f;
-					clipplane = plane;
-					leadside = side;
-				}
-			} else {	// leave
-				f = (d1+SURFACE_CLIP_EPSILON) / (d1-d2);
-				if ( f > 1 ) {
-					f = 1;
-				}
-				if (f < leaveFrac) {
-					leaveFrac = f;
-				}
+			if (f < leaveFrac) {
+				leaveFrac = f;
 			}
 		}
 	}
@@ -668,19 +805,26 @@ CM_TraceThroughLeaf
 */
 void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	int			k;
-	int			brushnum;
+	int			brushnum, surfnum;
 	cbrush_t	*b;
 	cPatch_t	*patch;
+	cmThread_t	*thread;
+
+	thread = tw->thread;
 
 	// trace line against all brushes in the leaf
 	for ( k = 0 ; k < leaf->numLeafBrushes ; k++ ) {
+		if ( leaf->brushBounds && CM_CullLeafBounds( tw, &leaf->brushBounds[k] ) ) {
+			continue;
+		}
+
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
+		if ( thread->brushChecks[brushnum] == thread->checkcount ) {
 			continue;	// already checked this brush in another leaf
 		}
-		b->checkcount = cm.checkcount;
+		thread->brushChecks[brushnum] = thread->checkcount;
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -704,14 +848,19 @@ void CM_TraceThroughLeaf( traceWork_t *tw, cLeaf_t *leaf ) {
 	if ( !cm_noCurves->integer ) {
 #endif
 		for ( k = 0 ; k < leaf->numLeafSurfaces ; k++ ) {
-			patch = cm.surfaces[ cm.leafsurfaces[ leaf->firstLeafSurface + k ] ];
+			if ( leaf->surfaceBounds && CM_CullLeafBounds( tw, &leaf->surfaceBounds[k] ) ) {
+				continue;
+			}
+
+			surfnum = cm.leafsurfaces[ leaf->firstLeafSurface + k ];
+			patch = cm.surfaces[ surfnum ];
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
+			if ( thread->patchChecks[surfnum] == thread->checkcount ) {
 				continue;	// already checked this patch in another leaf
 			}
-			patch->checkcount = cm.checkcount;
+			thread->patchChecks[surfnum] = thread->checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -920,6 +1069,29 @@ void CM_TraceThroughVerticalCylinder( traceWork_t *tw, vec3_t origin, float radi
 	// no intersection at all
 }
 
+/*
+================
+CM_TraceThroughBoxHull
+
+CM_TraceThroughLeaf for the box model of the tracing thread
+================
+*/
+static void CM_TraceThroughBoxHull( traceWork_t *tw ) {
+	cbrush_t	*b;
+
+	b = &tw->thread->box.brush;
+	if ( !(b->contents & tw->contents) ) {
+		return;
+	}
+
+	if ( !CM_BoundsIntersect( tw->bounds[0], tw->bounds[1],
+				b->bounds[0], b->bounds[1] ) ) {
+		return;
+	}
+
+	CM_TraceThroughBrush( tw, b );
+}
+
 /*
 ================
 CM_TraceCapsuleThroughCapsule
@@ -991,8 +1163,6 @@ bounding box vs. capsule collision
 */
 void CM_TraceBoundingBoxThroughCapsule( traceWork_t *tw, clipHandle_t model ) {
 	vec3_t mins, maxs, offset, size[2];
-	clipHandle_t h;
-	cmodel_t *cmod;
 	int i;
 
 	// mins maxs of the capsule
@@ -1014,10 +1184,9 @@ void CM_TraceBoundingBoxThroughCapsule( traceWork_t *tw, clipHandle_t model ) {
 	VectorSet( tw->sphere.offset, 0, 0, size[1][2] - tw->sphere.radius );
 
 	// replace the capsule with the bounding box
-	h = CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
+	CM_TempBoxModel(tw->size[0], tw->size[1], qfalse);
 	// calculate collision
-	cmod = CM_ClipHandleToModel( h );
-	CM_TraceThroughLeaf( tw, &cmod->leaf );
+	CM_TraceThroughBoxHull( tw );
 }
 
 //=========================================================================================
@@ -1154,12 +1323,11 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 
 	cmod = CM_ClipHandleToModel( model );
 
-	cm.checkcount++;		// for multi-check avoidance
-
-	c_traces++;				// for statistics, may be zeroed
-
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof(tw) );
+	tw.thread = CM_Thread();
+	tw.thread->checkcount++;	// for multi-check avoidance
+	tw.thread->c_traces++;		// for statistics, may be zeroed
 	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
 	VectorCopy(origin, tw.modelOrigin);
 
@@ -1271,7 +1439,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 #ifdef ALWAYS_BBOX_VS_BBOX // FIXME - compile time flag?
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
 				tw.sphere.use = qfalse;
-				CM_TestInLeaf( &tw, &cmod->leaf );
+				CM_TestInBoxHull( &tw );
 			}
 			else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
@@ -1288,6 +1456,9 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 					CM_TestBoundingBoxInCapsule( &tw, model );
 				}
 			}
+			else if ( model == BOX_MODEL_HANDLE ) {
+				CM_TestInBoxHull( &tw );
+			}
 			else {
 				CM_TestInLeaf( &tw, &cmod->leaf );
 			}
@@ -1315,7 +1486,7 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 #ifdef ALWAYS_BBOX_VS_BBOX
 			if ( model == BOX_MODEL_HANDLE || model == CAPSULE_MODEL_HANDLE) {
 				tw.sphere.use = qfalse;
-				CM_TraceThroughLeaf( &tw, &cmod->leaf );
+				CM_TraceThroughBoxHull( &tw );
 			}
 			else
 #elif defined(ALWAYS_CAPSULE_VS_CAPSULE)
@@ -1332,6 +1503,9 @@ void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, vec3_t mi
 					CM_TraceBoundingBoxThroughCapsule( &tw, model );
 				}
 			}
+			else if ( model == BOX_MODEL_HANDLE ) {
+				CM_TraceThroughBoxHull( &tw );
+			}
 			else {
 				CM_TraceThroughLeaf( &tw, &cmod->leaf );
 			}
@@ -2744,6 +2744,8 @@ void Com_Init( char *commandLine ) {
 	// allocate the stack based hunk allocator
 	Com_InitHunkMemory();
 
+	Job_Init();
+
 	// if any archived cvars are modified after this, we will trigger a writing
 	// of the config file
 	cvar_modifiedFlags &= ~CVAR_ARCHIVE;
@@ -3268,16 +3270,11 @@ void Com_Frame( void ) {
 	// trace optimization tracking
 	//
 	if ( com_showtrace->integer ) {
-	
-		extern	int c_traces, c_brush_traces, c_patch_traces;
-		extern	int	c_pointcontents;
+		int		traces, brushTraces, patchTraces, pointContents;
 
-		Com_Printf ("%4i traces  (%ib %ip) %4i points\n", c_traces,
-			c_brush_traces, c_patch_traces, c_pointcontents);
-		c_traces = 0;
-		c_brush_traces = 0;
-		c_patch_traces = 0;
-		c_pointcontents = 0;
+		CM_TraceStats( &traces, &brushTraces, &patchTraces, &pointContents, qtrue );
+		Com_Printf ("%4i traces  (%ib %ip) %4i points\n", traces,
+			brushTraces, patchTraces, pointContents);
 	}
 
 	Com_ReadFromPipe( );
@@ -3291,6 +3288,8 @@ Com_Shutdown
 =================
 */
 void Com_Shutdown (void) {
+	Job_Shutdown();
+
 	if (logfile) {
 		FS_FCloseFile (logfile);
 		logfile = 0;
@@ -722,13 +722,13 @@ fileHandle_t FS_BaseDir_FOpenFileWrite( const char *filename ) {
 
 /*
 ===========
-FS_BaseDir_FOpenFileRead
+FS_BaseDir_FOpenCacheFileRead
 
 Search for a file somewhere below the home path then base path
-in that order
+in that order, without clearing the sound buffer
 ===========
 */
-long FS_BaseDir_FOpenFileRead(const char *filename, fileHandle_t *fp)
+long FS_BaseDir_FOpenCacheFileRead(const char *filename, fileHandle_t *fp)
 {
 	char *ospath;
 	fileHandle_t f = 0;
@@ -742,9 +742,6 @@ long FS_BaseDir_FOpenFileRead(const char *filename, fileHandle_t *fp)
 
 	Q_strncpyz( fsh[f].name, filename, sizeof( fsh[f].name ) );
 
-	// don't let sound stutter
-	S_ClearSoundBuffer();
-
 	for(int i = 0; i < ARRAY_LEN( fs_pathVars ) && !fsh[f].handleFiles.file.o; i++) {
 		const cvar_t *pathVar = fs_pathVars[i];
 
@@ -776,6 +773,26 @@ long FS_BaseDir_FOpenFileRead(const char *filename, fileHandle_t *fp)
 	return -1;
 }
 
+/*
+===========
+FS_BaseDir_FOpenFileRead
+
+Search for a file somewhere below the home path then base path
+in that order
+===========
+*/
+long FS_BaseDir_FOpenFileRead(const char *filename, fileHandle_t *fp)
+{
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	// don't let sound stutter
+	S_ClearSoundBuffer();
+
+	return FS_BaseDir_FOpenCacheFileRead( filename, fp );
+}
+
 
 /*
 ===========
@@ -27,51 +27,79 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 
-static int			bloc = 0;
-
 void	Huff_putBit( int bit, byte *fout, int *offset) {
-	bloc = *offset;
+	int bloc = *offset;
 	if ((bloc&7) == 0) {
 		fout[(bloc>>3)] = 0;
 	}
 	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
-	*offset = bloc;
+	*offset = bloc + 1;
+}
+
+int		Huff_getBit( byte *fin, int *offset) {
+	int t;
+	int bloc = *offset;
+	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
+	*offset = bloc + 1;
+	return t;
 }
 
-int		Huff_getBloc(void)
-{
-	return bloc;
+/* Write count (at most 32) bits at once, the same way count calls to Huff_putBit would */
+static ID_INLINE void put_bits( unsigned int value, int count, byte *fout, int bloc ) {
+	uint64_t	bits;
+	byte		*p;
+
+	p = fout + (bloc>>3);
+	bits = (uint64_t)value << (bloc&7);
+	if ((bloc&7) != 0) {
+		bits |= *p;
+	}
+	for (count += bloc&7; count > 0; count -= 8) {
+		*p++ = (byte)bits;
+		bits >>= 8;
+	}
 }
 
-void	Huff_setBloc(int _bloc)
-{
-	bloc = _bloc;
+/* Read count (at most 24) bits at once */
+static ID_INLINE unsigned int get_bits( const byte *fin, int bloc, int count ) {
+	const byte	*p;
+	unsigned int	bits;
+	int			n;
+
+	p = fin + (bloc>>3);
+	bits = 0;
+	for (n = 0; n < (bloc&7) + count; n += 8) {
+		bits |= (unsigned int)*p++ << n;
+	}
+	return (bits >> (bloc&7)) & ((1u << count) - 1);
 }
 
-int		Huff_getBit( byte *fin, int *offset) {
+void	Huff_putBits( int value, int count, byte *fout, int *offset ) {
+	put_bits( value & (0xffffffffu >> (32 - count)), count, fout, *offset );
+	*offset += count;
+}
+
+int		Huff_getBits( int count, byte *fin, int *offset ) {
 	int t;
-	bloc = *offset;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
-	*offset = bloc;
+	t = get_bits( fin, *offset, count );
+	*offset += count;
 	return t;
 }
 
 /* Add a bit to the output file (buffered) */
-static void add_bit (char bit, byte *fout) {
-	if ((bloc&7) == 0) {
-		fout[(bloc>>3)] = 0;
+static void add_bit (char bit, byte *fout, int *bloc) {
+	if ((*bloc&7) == 0) {
+		fout[(*bloc>>3)] = 0;
 	}
-	fout[(bloc>>3)] |= bit << (bloc&7);
-	bloc++;
+	fout[(*bloc>>3)] |= bit << (*bloc&7);
+	(*bloc)++;
 }
 
 /* Receive one bit from the input file (buffered) */
-static int get_bit (byte *fin) {
+static int get_bit (byte *fin, int *bloc) {
 	int t;
-	t = (fin[(bloc>>3)] >> (bloc&7)) & 0x1;
-	bloc++;
+	t = (fin[(*bloc>>3)] >> (*bloc&7)) & 0x1;
+	(*bloc)++;
 	return t;
 }
 
@@ -263,9 +291,9 @@ void Huff_addRef(huff_t* huff, byte ch) {
 }
 
 /* Get a symbol */
-int Huff_Receive (node_t *node, int *ch, byte *fin) {
+int Huff_Receive (node_t *node, int *ch, byte *fin, int *offset) {
 	while (node && node->symbol == INTERNAL_NODE) {
-		if (get_bit(fin)) {
+		if (get_bit(fin, offset)) {
 			node = node->right;
 		} else {
 			node = node->left;
@@ -280,14 +308,14 @@ int Huff_Receive (node_t *node, int *ch, byte *fin) {
 
 /* Get a symbol */
 void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset, int maxoffset) {
-	bloc = *offset;
+	int bloc = *offset;
 	while (node && node->symbol == INTERNAL_NODE) {
 		if (bloc >= maxoffset) {
 			*ch = 0;
 			*offset = maxoffset + 1;
 			return;
 		}
-		if (get_bit(fin)) {
+		if (get_bit(fin, &bloc)) {
 			node = node->right;
 		} else {
 			node = node->left;
@@ -303,45 +331,130 @@ void Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset, int maxo
 }
 
 /* Send the prefix code for this node */
-static void send(node_t *node, node_t *child, byte *fout, int maxoffset) {
+static void send(node_t *node, node_t *child, byte *fout, int *bloc, int maxoffset) {
 	if (node->parent) {
-		send(node->parent, node, fout, maxoffset);
+		send(node->parent, node, fout, bloc, maxoffset);
 	}
 	if (child) {
-		if (bloc >= maxoffset) {
-			bloc = maxoffset + 1;
+		if (*bloc >= maxoffset) {
+			*bloc = maxoffset + 1;
 			return;
 		}
 		if (node->right == child) {
-			add_bit(1, fout);
+			add_bit(1, fout, bloc);
 		} else {
-			add_bit(0, fout);
+			add_bit(0, fout, bloc);
 		}
 	}
 }
 
 /* Send a symbol */
-void Huff_transmit (huff_t *huff, int ch, byte *fout, int maxoffset) {
+void Huff_transmit (huff_t *huff, int ch, byte *fout, int *offset, int maxoffset) {
 	int i;
 	if (huff->loc[ch] == NULL) { 
 		/* node_t hasn't been transmitted, send a NYT, then the symbol */
-		Huff_transmit(huff, NYT, fout, maxoffset);
+		Huff_transmit(huff, NYT, fout, offset, maxoffset);
 		for (i = 7; i >= 0; i--) {
-			add_bit((char)((ch >> i) & 0x1), fout);
+			add_bit((char)((ch >> i) & 0x1), fout, offset);
 		}
 	} else {
-		send(huff->loc[ch], NULL, fout, maxoffset);
+		send(huff->loc[ch], NULL, fout, offset, maxoffset);
 	}
 }
 
 void Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset, int maxoffset) {
-	bloc = *offset;
-	send(huff->loc[ch], NULL, fout, maxoffset);
-	*offset = bloc;
+	send(huff->loc[ch], NULL, fout, offset, maxoffset);
+}
+
+/* Fill in the lookup tables from the trees, which must not be updated afterwards */
+void Huff_BuildTable( huffTable_t *table, huffman_t *huff ) {
+	node_t	*node;
+	int		ch, len, i;
+	unsigned int code;
+
+	Com_Memset(table, 0, sizeof(*table));
+	table->compressor = &huff->compressor;
+	table->decompressor = &huff->decompressor;
+
+	for (ch = 0; ch < HMAX; ch++) {
+		node = huff->compressor.loc[ch];
+		if (!node) {
+			continue;
+		}
+		for (len = 0; node->parent; node = node->parent) {
+			len++;
+		}
+		if (len > 32) {
+			continue;
+		}
+		/* the bits are sent from the root down, so the last one is the leaf's */
+		code = 0;
+		node = huff->compressor.loc[ch];
+		for (i = len - 1; i >= 0; i--, node = node->parent) {
+			if (node->parent->right == node) {
+				code |= 1u << i;
+			}
+		}
+		table->code[ch] = code;
+		table->length[ch] = len;
+	}
+
+	for (ch = 0; ch <= NYT; ch++) {
+		node = huff->decompressor.loc[ch];
+		if (!node) {
+			continue;
+		}
+		for (len = 0; node->parent; node = node->parent) {
+			len++;
+		}
+		if (len == 0 || len > HUFF_DECODE_BITS) {
+			continue;
+		}
+		code = 0;
+		node = huff->decompressor.loc[ch];
+		for (i = len - 1; i >= 0; i--, node = node->parent) {
+			if (node->parent->right == node) {
+				code |= 1u << i;
+			}
+		}
+		/* every index starting with the code decodes to this symbol */
+		for (i = code; i < (1<<HUFF_DECODE_BITS); i += 1<<len) {
+			table->decode[i] = ch | (len << 9);
+		}
+	}
+}
+
+/* Send a symbol of a static tree */
+void Huff_tableTransmit( const huffTable_t *table, int ch, byte *fout, int *offset, int maxoffset ) {
+	int len = table->length[ch];
+
+	if (len == 0 || *offset + len > maxoffset) {
+		/* let the tree deal with running out of room half way through */
+		Huff_offsetTransmit(table->compressor, ch, fout, offset, maxoffset);
+		return;
+	}
+	put_bits(table->code[ch], len, fout, *offset);
+	*offset += len;
+}
+
+/* Get a symbol of a static tree */
+void Huff_tableReceive( const huffTable_t *table, int *ch, byte *fin, int *offset, int maxoffset ) {
+	int entry;
+
+	if (*offset + HUFF_DECODE_BITS <= maxoffset) {
+		entry = table->decode[get_bits(fin, *offset, HUFF_DECODE_BITS)];
+		if (entry >> 9) {
+			*ch = entry & 511;
+			*offset += entry >> 9;
+			return;
+		}
+	}
+	/* close to the end or a long code */
+	Huff_offsetReceive(table->decompressor->tree, ch, fin, offset, maxoffset);
 }
 
 void Huff_Decompress(msg_t *mbuf, int offset) {
-	int			ch, cch, i, j, size;
+	int			ch, cch, i, j, size, bloc;
 	byte		seq[65536];
 	byte*		buffer;
 	huff_t		huff;
@@ -376,11 +489,11 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 			seq[j] = 0;
 			break;
 		}
-		Huff_Receive(huff.tree, &ch, buffer);				/* Get a character */
+		Huff_Receive(huff.tree, &ch, buffer, &bloc);		/* Get a character */
 		if ( ch == NYT ) {								/* We got a NYT, get the symbol associated with it */
 			ch = 0;
 			for ( i = 0; i < 8; i++ ) {
-				ch = (ch<<1) + get_bit(buffer);
+				ch = (ch<<1) + get_bit(buffer, &bloc);
 			}
 		}
     
@@ -392,10 +505,8 @@ void Huff_Decompress(msg_t *mbuf, int offset) {
 	Com_Memcpy(mbuf->data + offset, seq, cch);
 }
 
-extern 	int oldsize;
-
 void Huff_Compress(msg_t *mbuf, int offset) {
-	int			i, ch, size;
+	int			i, ch, size, bloc;
 	byte		seq[65536];
 	byte*		buffer;
 	huff_t		huff;
@@ -422,7 +533,7 @@ void Huff_Compress(msg_t *mbuf, int offset) {
 
 	for (i=0; i<size; i++ ) {
 		ch = buffer[i];
-		Huff_transmit(&huff, ch, seq, size<<3);						/* Transmit symbol */
+		Huff_transmit(&huff, ch, seq, &bloc, size<<3);				/* Transmit symbol */
 		Huff_addRef(&huff, (byte)ch);								/* Do update */
 	}
 
@@ -0,0 +1,237 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// jobs.c -- fork/join worker pool
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+typedef struct {
+	jobFunc_t		func;
+	void			*data;
+	int				count;
+	volatile int	next;		// next index to hand out
+} jobBatch_t;
+
+typedef struct {
+	qboolean		initialized;
+	qboolean		busy;		// a batch is being run, guarded by lock
+	qboolean		quit;
+
+	void			*lock;
+	void			*wake;		// posted once for every worker that should join a batch
+	void			*done;		// posted by every worker that finished a batch
+
+	int				numThreads;
+	void			*threads[MAX_JOB_THREADS];
+
+	jobBatch_t		batch;
+} jobPool_t;
+
+static jobPool_t	jobs;
+
+/*
+==============
+Job_RunBatch
+
+Grabs indices until the batch is exhausted
+==============
+*/
+static void Job_RunBatch( jobBatch_t *batch ) {
+	int		index;
+
+	while ( ( index = Sys_AtomicAdd( &batch->next, 1 ) - 1 ) < batch->count ) {
+		batch->func( batch->data, index );
+	}
+}
+
+/*
+==============
+Job_WorkerThread
+==============
+*/
+static void Job_WorkerThread( void *arg ) {
+	for ( ;; ) {
+		Sys_SemaphoreWait( jobs.wake );
+
+		if ( jobs.quit ) {
+			return;
+		}
+
+		Job_RunBatch( &jobs.batch );
+		Sys_SemaphorePost( jobs.done );
+	}
+}
+
+/*
+==============
+Job_StartWorkers
+
+Makes sure at least numWorkers threads are running, returns how
+many are actually available
+==============
+*/
+static int Job_StartWorkers( int numWorkers ) {
+	void	*thread;
+
+	if ( numWorkers > MAX_JOB_THREADS ) {
+		numWorkers = MAX_JOB_THREADS;
+	}
+
+	while ( jobs.numThreads < numWorkers ) {
+		thread = Sys_CreateThread( Job_WorkerThread, NULL );
+		if ( !thread ) {
+			break;
+		}
+		jobs.threads[jobs.numThreads++] = thread;
+	}
+
+	if ( numWorkers > jobs.numThreads ) {
+		return jobs.numThreads;
+	}
+	return numWorkers;
+}
+
+/*
+==============
+Job_ParallelFor
+==============
+*/
+void Job_ParallelFor( jobFunc_t func, void *data, int count, int numThreads ) {
+	jobBatch_t	batch;
+	int			numWorkers;
+	int			i;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	// the calling thread always takes part, so only spawn helpers
+	// when there is more than one item to go around
+	numWorkers = numThreads - 1;
+	if ( numWorkers > count - 1 ) {
+		numWorkers = count - 1;
+	}
+
+	if ( numWorkers > 0 && jobs.initialized ) {
+		Sys_LockMutex( jobs.lock );
+
+		if ( jobs.busy ) {
+			// nested or concurrent use, don't wait on ourselves
+			numWorkers = 0;
+		} else {
+			numWorkers = Job_StartWorkers( numWorkers );
+			jobs.busy = ( numWorkers > 0 );
+		}
+
+		Sys_UnlockMutex( jobs.lock );
+	} else {
+		numWorkers = 0;
+	}
+
+	if ( numWorkers <= 0 ) {
+		batch.func = func;
+		batch.data = data;
+		batch.count = count;
+		batch.next = 0;
+		Job_RunBatch( &batch );
+		return;
+	}
+
+	jobs.batch.func = func;
+	jobs.batch.data = data;
+	jobs.batch.count = count;
+	jobs.batch.next = 0;
+
+	for ( i = 0 ; i < numWorkers ; i++ ) {
+		Sys_SemaphorePost( jobs.wake );
+	}
+
+	Job_RunBatch( &jobs.batch );
+
+	for ( i = 0 ; i < numWorkers ; i++ ) {
+		Sys_SemaphoreWait( jobs.done );
+	}
+
+	Sys_LockMutex( jobs.lock );
+	jobs.busy = qfalse;
+	Sys_UnlockMutex( jobs.lock );
+}
+
+/*
+==============
+Job_MaxThreads
+
+Number of threads worth asking Job_ParallelFor for
+==============
+*/
+int Job_MaxThreads( void ) {
+	int		count;
+
+	count = Sys_ProcessorCount();
+	if ( count > MAX_JOB_THREADS ) {
+		count = MAX_JOB_THREADS;
+	}
+	return count;
+}
+
+/*
+==============
+Job_Init
+==============
+*/
+void Job_Init( void ) {
+	if ( jobs.initialized ) {
+		return;
+	}
+
+	jobs.lock = Sys_CreateMutex();
+	jobs.wake = Sys_CreateSemaphore();
+	jobs.done = Sys_CreateSemaphore();
+	jobs.initialized = qtrue;
+}
+
+/*
+==============
+Job_Shutdown
+==============
+*/
+void Job_Shutdown( void ) {
+	int		i;
+
+	if ( !jobs.initialized ) {
+		return;
+	}
+
+	jobs.quit = qtrue;
+	for ( i = 0 ; i < jobs.numThreads ; i++ ) {
+		Sys_SemaphorePost( jobs.wake );
+	}
+	for ( i = 0 ; i < jobs.numThreads ; i++ ) {
+		Sys_JoinThread( jobs.threads[i] );
+	}
+
+	Sys_DestroySemaphore( jobs.done );
+	Sys_DestroySemaphore( jobs.wake );
+	Sys_DestroyMutex( jobs.lock );
+
+	Com_Memset( &jobs, 0, sizeof( jobs ) );
+}
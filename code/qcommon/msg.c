@@ -22,7 +22,16 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define MSG_DELTA_SSE2
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#include <arm_neon.h>
+#define MSG_DELTA_NEON
+#endif
+
 static huffman_t		msgHuff;
+static huffTable_t		msgHuffTable;
 
 static qboolean			msgInit = qfalse;
 
@@ -37,13 +46,13 @@ Handles byte ordering and avoids alignment errors
 ==============================================================================
 */
 
-int oldsize = 0;
-
 void MSG_initHuffman( void );
+static void MSG_InitDeltaFields( void );
 
 void MSG_Init( msg_t *buf, byte *data, int length ) {
 	if (!msgInit) {
 		MSG_initHuffman();
+		MSG_InitDeltaFields();
 	}
 	Com_Memset (buf, 0, sizeof(*buf));
 	buf->data = data;
@@ -53,6 +62,7 @@ void MSG_Init( msg_t *buf, byte *data, int length ) {
 void MSG_InitOOB( msg_t *buf, byte *data, int length ) {
 	if (!msgInit) {
 		MSG_initHuffman();
+		MSG_InitDeltaFields();
 	}
 	Com_Memset (buf, 0, sizeof(*buf));
 	buf->data = data;
@@ -105,8 +115,6 @@ bit functions
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 	int	i;
 
-	oldsize += bits;
-
 	if ( msg->overflowed ) {
 		return;
 	}
@@ -151,15 +159,13 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 				msg->overflowed = qtrue;
 				return;
 			}
-			for( i = 0; i < nbits; i++ ) {
-				Huff_putBit( (value & 1), msg->data, &msg->bit );
-				value = (value >> 1);
-			}
+			Huff_putBits( value, nbits, msg->data, &msg->bit );
+			value = (value >> nbits);
 			bits = bits - nbits;
 		}
 		if ( bits ) {
 			for( i = 0; i < bits; i += 8 ) {
-				Huff_offsetTransmit( &msgHuff.compressor, (value & 0xff), msg->data, &msg->bit, msg->maxsize << 3 );
+				Huff_tableTransmit( &msgHuffTable, (value & 0xff), msg->data, &msg->bit, msg->maxsize << 3 );
 				value = (value >> 8);
 
 				if ( msg->bit > msg->maxsize << 3 ) {
@@ -229,15 +235,13 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 				msg->readcount = msg->cursize + 1;
 				return 0;
 			}
-			for(i=0;i<nbits;i++) {
-				value |= (Huff_getBit(msg->data, &msg->bit)<<i);
-			}
+			value = Huff_getBits(nbits, msg->data, &msg->bit);
 			bits = bits - nbits;
 		}
 		if (bits) {
 //			fp = fopen("c:\\netchan.bin", "a");
 			for(i=0;i<bits;i+=8) {
-				Huff_offsetReceive (msgHuff.decompressor.tree, &get, msg->data, &msg->bit, msg->cursize<<3);
+				Huff_tableReceive (&msgHuffTable, &get, msg->data, &msg->bit, msg->cursize<<3);
 //				fwrite(&get, 1, 1, fp);
 				value = (unsigned int)value | ((unsigned int)get<<(i+nbits));
 
@@ -401,11 +405,9 @@ int MSG_ReadByte( msg_t *msg ) {
 }
 
 int MSG_LookaheadByte( msg_t *msg ) {
-	const int bloc = Huff_getBloc();
 	const int readcount = msg->readcount;
 	const int bit = msg->bit;
 	int c = MSG_ReadByte(msg);
-	Huff_setBloc(bloc);
 	msg->readcount = readcount;
 	msg->bit = bit;
 	return c;
@@ -653,7 +655,6 @@ void MSG_WriteDeltaUsercmdKey( msg_t *msg, int key, usercmd_t *from, usercmd_t *
 		from->buttons == to->buttons &&
 		from->weapon == to->weapon) {
 			MSG_WriteBits( msg, 0, 1 );				// no change
-			oldsize += 7;
 			return;
 	}
 	key ^= to->serverTime;
@@ -711,6 +712,120 @@ void MSG_ReadDeltaUsercmdKey( msg_t *msg, int key, usercmd_t *from, usercmd_t *t
 /*
 =============================================================================
 
+delta change masks
+
+entityState_t and playerState_t are made of nothing but 32 bit words,
+so the two states of a delta are compared a whole vector at a time into
+a mask with a bit set for every word that differs.  The field lists are
+then only walked up to the last changed field, and the arrays in the
+playerState_t are read straight out of the mask.
+
+=============================================================================
+*/
+
+#define	MAX_DELTA_WORDS		128
+#define	DELTA_MASK_SIZE		( MAX_DELTA_WORDS / 32 )
+
+// netField index + 1 for every word of the structs, 0 if it isn't in the field list
+static byte		entityWordFields[MAX_DELTA_WORDS];
+static byte		playerWordFields[MAX_DELTA_WORDS];
+
+static qboolean	msgDeltaScalar;		// only set while MSG_BenchmarkDeltas runs
+
+/*
+==================
+MSG_DeltaMask
+
+Sets a bit in mask for every one of the numWords words that differ
+==================
+*/
+static void MSG_DeltaMask( const void *from, const void *to, int numWords, unsigned int *mask ) {
+	const int	*a = from;
+	const int	*b = to;
+	int			i;
+
+	Com_Memset( mask, 0, sizeof( mask[0] ) * DELTA_MASK_SIZE );
+
+	i = 0;
+#if defined( MSG_DELTA_SSE2 )
+	for ( ; i + 4 <= numWords && !msgDeltaScalar ; i += 4 ) {
+		__m128i	eq;
+
+		eq = _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i *)( a + i ) ),
+							  _mm_loadu_si128( (const __m128i *)( b + i ) ) );
+		// groups of 4 never straddle two mask words
+		mask[i >> 5] |= ( ~_mm_movemask_ps( _mm_castsi128_ps( eq ) ) & 15 ) << ( i & 31 );
+	}
+#elif defined( MSG_DELTA_NEON )
+	{
+		static const uint32_t	laneBits[4] = { 1, 2, 4, 8 };
+		uint32x4_t				lanes = vld1q_u32( laneBits );
+
+		for ( ; i + 4 <= numWords && !msgDeltaScalar ; i += 4 ) {
+			uint32x4_t	ne;
+
+			ne = vmvnq_u32( vceqq_u32( vld1q_u32( (const uint32_t *)( a + i ) ),
+									   vld1q_u32( (const uint32_t *)( b + i ) ) ) );
+			mask[i >> 5] |= vaddvq_u32( vandq_u32( ne, lanes ) ) << ( i & 31 );
+		}
+	}
+#endif
+	for ( ; i < numWords ; i++ ) {
+		if ( a[i] != b[i] ) {
+			mask[i >> 5] |= 1u << ( i & 31 );
+		}
+	}
+}
+
+/*
+==================
+MSG_DeltaLastField
+
+Returns the number of fields that have to be sent to cover every changed one
+==================
+*/
+static int MSG_DeltaLastField( const unsigned int *mask, const byte *wordFields ) {
+	unsigned int	bits;
+	int				i, w;
+	int				lc;
+
+	lc = 0;
+	for ( i = 0 ; i < DELTA_MASK_SIZE ; i++ ) {
+		for ( bits = mask[i] ; bits ; bits &= bits - 1 ) {
+			w = ( i << 5 ) + Q_ctz( bits );
+			if ( wordFields[w] > lc ) {
+				lc = wordFields[w];
+			}
+		}
+	}
+	return lc;
+}
+
+/*
+==================
+MSG_DeltaMaskBits
+
+Extracts count (at most 32) bits starting at word first
+==================
+*/
+static int MSG_DeltaMaskBits( const unsigned int *mask, int first, int count ) {
+	unsigned int	bits;
+
+	bits = mask[first >> 5] >> ( first & 31 );
+	if ( ( first & 31 ) + count > 32 ) {
+		bits |= mask[( first >> 5 ) + 1] << ( 32 - ( first & 31 ) );
+	}
+	if ( count < 32 ) {
+		bits &= ( 1u << count ) - 1;
+	}
+	return bits;
+}
+
+#define	DELTA_MASK_CHANGED( mask, offset )	( ( mask )[( offset ) >> 7] & ( 1u << ( ( ( offset ) >> 2 ) & 31 ) ) )
+
+/*
+=============================================================================
+
 entityState_t communication
   
 =============================================================================
@@ -816,19 +931,17 @@ identical, under the assumption that the in-order delta code will catch it.
 void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entityState_s *to, 
 						   qboolean force ) {
 	int			i, lc;
-	int			numFields;
 	netField_t	*field;
 	int			trunc;
 	float		fullFloat;
-	int			*fromF, *toF;
-
-	numFields = ARRAY_LEN( entityStateFields );
+	int			*toF;
+	unsigned int	mask[DELTA_MASK_SIZE];
 
 	// all fields should be 32 bits to avoid any compiler packing issues
 	// the "number" field is not part of the field list
 	// if this assert fails, someone added a field to the entityState_t
 	// struct without updating the message fields
-	assert( numFields + 1 == sizeof( *from )/4 );
+	assert( ARRAY_LEN( entityStateFields ) + 1 == sizeof( *from )/4 );
 
 	// a NULL to is a delta remove message
 	if ( to == NULL ) {
@@ -844,15 +957,9 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 		Com_Error (ERR_FATAL, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
 	}
 
-	lc = 0;
 	// build the change vector as bytes so it is endien independent
-	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
-	}
+	MSG_DeltaMask( from, to, sizeof( *from ) / 4, mask );
+	lc = MSG_DeltaLastField( mask, entityWordFields );
 
 	if ( lc == 0 ) {
 		// nothing at all changed
@@ -872,13 +979,10 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields;
-
 	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
 
-		if ( *fromF == *toF ) {
+		if ( !DELTA_MASK_CHANGED( mask, field->offset ) ) {
 			MSG_WriteBits( msg, 0, 1 );	// no change
 			continue;
 		}
@@ -892,7 +996,6 @@ void MSG_WriteDeltaEntity( msg_t *msg, struct entityState_s *from, struct entity
 
 			if (fullFloat == 0.0f) {
 					MSG_WriteBits( msg, 0, 1 );
-					oldsize += FLOAT_INT_BITS;
 			} else {
 				MSG_WriteBits( msg, 1, 1 );
 				if ( trunc == fullFloat && trunc + FLOAT_INT_BIAS >= 0 && 
@@ -1110,6 +1213,28 @@ netField_t	playerStateFields[] =
 { PSF(loopSound), 16 }
 };
 
+/*
+=============
+MSG_InitDeltaFields
+
+Maps the words of the structs back to the netFields sending them
+=============
+*/
+static void MSG_InitDeltaFields( void ) {
+	int		i;
+
+	if ( sizeof( playerState_t ) / 4 > MAX_DELTA_WORDS || sizeof( entityState_t ) / 4 > MAX_DELTA_WORDS ) {
+		Com_Error( ERR_FATAL, "MSG_InitDeltaFields: MAX_DELTA_WORDS is too small" );
+	}
+
+	for ( i = 0 ; i < ARRAY_LEN( entityStateFields ) ; i++ ) {
+		entityWordFields[ entityStateFields[i].offset / 4 ] = i + 1;
+	}
+	for ( i = 0 ; i < ARRAY_LEN( playerStateFields ) ; i++ ) {
+		playerWordFields[ playerStateFields[i].offset / 4 ] = i + 1;
+	}
+}
+
 /*
 =============
 MSG_WriteDeltaPlayerstate
@@ -1123,37 +1248,26 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 	int				persistantbits;
 	int				ammobits;
 	int				powerupbits;
-	int				numFields;
 	netField_t		*field;
-	int				*fromF, *toF;
+	int				*toF;
 	float			fullFloat;
 	int				trunc, lc;
+	unsigned int	mask[DELTA_MASK_SIZE];
 
 	if (!from) {
 		from = &dummy;
 		Com_Memset (&dummy, 0, sizeof(dummy));
 	}
 
-	numFields = ARRAY_LEN( playerStateFields );
-
-	lc = 0;
-	for ( i = 0, field = playerStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
-		}
-	}
+	MSG_DeltaMask( from, to, sizeof( *from ) / 4, mask );
+	lc = MSG_DeltaLastField( mask, playerWordFields );
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
-	oldsize += numFields - lc;
-
 	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
 		toF = (int *)( (byte *)to + field->offset );
 
-		if ( *fromF == *toF ) {
+		if ( !DELTA_MASK_CHANGED( mask, field->offset ) ) {
 			MSG_WriteBits( msg, 0, 1 );	// no change
 			continue;
 		}
@@ -1186,34 +1300,13 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 	//
 	// send the arrays
 	//
-	statsbits = 0;
-	for (i=0 ; i<MAX_STATS ; i++) {
-		if (to->stats[i] != from->stats[i]) {
-			statsbits |= 1<<i;
-		}
-	}
-	persistantbits = 0;
-	for (i=0 ; i<MAX_PERSISTANT ; i++) {
-		if (to->persistant[i] != from->persistant[i]) {
-			persistantbits |= 1<<i;
-		}
-	}
-	ammobits = 0;
-	for (i=0 ; i<MAX_WEAPONS ; i++) {
-		if (to->ammo[i] != from->ammo[i]) {
-			ammobits |= 1<<i;
-		}
-	}
-	powerupbits = 0;
-	for (i=0 ; i<MAX_POWERUPS ; i++) {
-		if (to->powerups[i] != from->powerups[i]) {
-			powerupbits |= 1<<i;
-		}
-	}
+	statsbits = MSG_DeltaMaskBits( mask, offsetof( playerState_t, stats ) / 4, MAX_STATS );
+	persistantbits = MSG_DeltaMaskBits( mask, offsetof( playerState_t, persistant ) / 4, MAX_PERSISTANT );
+	ammobits = MSG_DeltaMaskBits( mask, offsetof( playerState_t, ammo ) / 4, MAX_WEAPONS );
+	powerupbits = MSG_DeltaMaskBits( mask, offsetof( playerState_t, powerups ) / 4, MAX_POWERUPS );
 
 	if (!statsbits && !persistantbits && !ammobits && !powerupbits) {
 		MSG_WriteBits( msg, 0, 1 );	// no change
-		oldsize += 4;
 		return;
 	}
 	MSG_WriteBits( msg, 1, 1 );	// changed
@@ -1263,6 +1356,74 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 }
 
 
+/*
+===================
+MSG_TimeDeltas
+===================
+*/
+static int MSG_TimeDeltas( msg_t *msg, entityState_t **from, entityState_t **to, int numDeltas, int iterations ) {
+	int		start;
+	int		i, j;
+
+	start = Sys_Milliseconds();
+
+	for ( i = 0 ; i < iterations ; i++ ) {
+		for ( j = 0 ; j < numDeltas ; j++ ) {
+			if ( msg->cursize > msg->maxsize - 1024 ) {
+				MSG_Clear( msg );
+			}
+			MSG_WriteDeltaEntity( msg, from[j], to[j], qtrue );
+		}
+	}
+
+	return Sys_Milliseconds() - start;
+}
+
+/*
+===================
+MSG_BenchmarkDeltas
+
+Writes the recorded entity deltas with the scalar and the vectorized
+change masks, checks both give the same bits and prints the timings
+===================
+*/
+void MSG_BenchmarkDeltas( entityState_t **from, entityState_t **to, int numDeltas, int iterations ) {
+	static byte	scalarBuf[MAX_MSGLEN], vectorBuf[MAX_MSGLEN];
+	msg_t		scalarMsg, vectorMsg;
+	int			scalarTime, vectorTime;
+	int			i;
+
+	MSG_Init( &scalarMsg, scalarBuf, sizeof( scalarBuf ) );
+	MSG_Init( &vectorMsg, vectorBuf, sizeof( vectorBuf ) );
+
+	for ( i = 0 ; i < numDeltas ; i++ ) {
+		if ( scalarMsg.cursize > scalarMsg.maxsize - 1024 ) {
+			MSG_Clear( &scalarMsg );
+			MSG_Clear( &vectorMsg );
+		}
+
+		msgDeltaScalar = qtrue;
+		MSG_WriteDeltaEntity( &scalarMsg, from[i], to[i], qtrue );
+		msgDeltaScalar = qfalse;
+		MSG_WriteDeltaEntity( &vectorMsg, from[i], to[i], qtrue );
+
+		if ( scalarMsg.bit != vectorMsg.bit || memcmp( scalarBuf, vectorBuf, scalarMsg.cursize ) ) {
+			Com_Printf( "MSG_BenchmarkDeltas: delta %i of entity %i differs\n", i,
+				to[i] ? to[i]->number : from[i]->number );
+			return;
+		}
+	}
+
+	MSG_Clear( &scalarMsg );
+	msgDeltaScalar = qtrue;
+	scalarTime = MSG_TimeDeltas( &scalarMsg, from, to, numDeltas, iterations );
+	msgDeltaScalar = qfalse;
+	vectorTime = MSG_TimeDeltas( &scalarMsg, from, to, numDeltas, iterations );
+
+	Com_Printf( "%i deltas x %i: scalar %i msec, vector %i msec\n",
+		numDeltas, iterations, scalarTime, vectorTime );
+}
+
 /*
 ===================
 MSG_ReadDeltaPlayerstate
@@ -1677,6 +1838,7 @@ void MSG_initHuffman( void ) {
 			Huff_addRef(&msgHuff.decompressor,	(byte)i);			// Do update
 		}
 	}
+	Huff_BuildTable(&msgHuffTable, &msgHuff);
 }
 
 /*
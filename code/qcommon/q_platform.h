@@ -193,6 +193,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 # define HAVE_VM_COMPILED
 #elif defined(__aarch64__)
 # define ARCH_STRING "arm64"
+# define HAVE_VM_COMPILED
 #elif defined(__arm__)
 # define ARCH_STRING "arm"
 # define HAVE_VM_COMPILED
@@ -692,6 +692,22 @@ void Vector4Scale( const vec4_t in, vec_t scale, vec4_t out );
 void VectorRotate( vec3_t in, vec3_t matrix[3], vec3_t out );
 int Q_log2(int val);
 
+#ifndef Q3_VM
+// index of the lowest set bit, x must not be 0
+static ID_INLINE int Q_ctz( unsigned int x ) {
+#if defined( __GNUC__ ) || defined( __clang__ )
+	return __builtin_ctz( x );
+#else
+	int		n;
+
+	for ( n = 0 ; !( x & 1 ) ; n++ ) {
+		x >>= 1;
+	}
+	return n;
+#endif
+}
+#endif
+
 float Q_acos(float c);
 
 int		Q_rand( int *seed );
@@ -100,6 +100,8 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct p
 void MSG_ReadDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct playerState_s *to );
 
 
+void MSG_BenchmarkDeltas( entityState_t **from, entityState_t **to, int numDeltas, int iterations );
+
 void MSG_ReportChangeVectors_f( void );
 
 //============================================================================
@@ -640,6 +642,9 @@ fileHandle_t	FS_FCreateOpenPipeFile( const char *filename );
 
 fileHandle_t FS_BaseDir_FOpenFileWrite( const char *filename );
 long		FS_BaseDir_FOpenFileRead( const char *filename, fileHandle_t *fp );
+// same as FS_BaseDir_FOpenFileRead but leaves the sound system alone, safe
+// to call while the renderer is building its caches
+long		FS_BaseDir_FOpenCacheFileRead( const char *filename, fileHandle_t *fp );
 void	FS_BaseDir_Rename( const char *from, const char *to, qboolean safe );
 long		FS_FOpenFileRead( const char *qpath, fileHandle_t *file, qboolean uniqueFILE );
 // if uniqueFILE is true, then a new FILE will be fopened even if the file
@@ -958,6 +963,30 @@ void Com_Frame( void );
 void Com_Shutdown( void );
 
 
+/*
+==============================================================
+
+JOBS
+
+Fork/join helper on top of the Sys_ thread services, worker threads
+are started on demand the first time a caller asks for them
+
+==============================================================
+*/
+
+#define	MAX_JOB_THREADS		16
+
+// called once for every index in [0, count), from any thread in the pool
+typedef void (*jobFunc_t)( void *data, int index );
+
+// runs func over count items using up to numThreads threads (the
+// calling thread included) and returns once all of them have finished,
+// runs everything on the calling thread if the pool is already busy
+void	Job_ParallelFor( jobFunc_t func, void *data, int count, int numThreads );
+int		Job_MaxThreads( void );
+void	Job_Init( void );
+void	Job_Shutdown( void );
+
 /*
 ==============================================================
 
@@ -1091,6 +1120,7 @@ void	Sys_Print( const char *msg );
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds (void);
+int64_t	Sys_Nanoseconds( void );	// high resolution, for profiling only
 
 qboolean Sys_RandomBytes( byte *string, int len );
 
@@ -1158,6 +1188,30 @@ dialogResult_t Sys_Dialog( dialogType_t type, const char *message, const char *t
 void Sys_RemovePIDFile( const char *gamedir );
 void Sys_InitPIDFile( const char *gamedir );
 
+// threads may not call Com_Printf, Com_Error or touch the zone/hunk,
+// Sys_CreateThread returns NULL where threads aren't available
+typedef void (*threadFunc_t)( void *arg );
+
+void	*Sys_CreateThread( threadFunc_t func, void *arg );
+void	Sys_JoinThread( void *thread );
+void	*Sys_CreateMutex( void );
+void	Sys_DestroyMutex( void *mutex );
+void	Sys_LockMutex( void *mutex );
+void	Sys_UnlockMutex( void *mutex );
+void	*Sys_CreateSemaphore( void );
+void	Sys_DestroySemaphore( void *semaphore );
+void	Sys_SemaphoreWait( void *semaphore );
+void	Sys_SemaphorePost( void *semaphore );
+int		Sys_AtomicAdd( volatile int *value, int add );	// returns the new value
+int		Sys_ProcessorCount( void );
+
+// storage class for variables that every thread has its own copy of
+#ifdef _MSC_VER
+#define Q_THREADLOCAL	__declspec( thread )
+#else
+#define Q_THREADLOCAL	__thread
+#endif
+
 /* This is based on the Adaptive Huffman algorithm described in Sayood's Data
  * Compression book.  The ranks are not actually stored, but implicitly defined
  * by the location of a node within a doubly-linked list */
@@ -1194,20 +1248,33 @@ typedef struct {
 	huff_t		decompressor;
 } huffman_t;
 
+// lookup tables for a tree that doesn't change anymore, decoding
+// HUFF_DECODE_BITS bits at a time and encoding whole symbols at once
+#define	HUFF_DECODE_BITS	11
+
+typedef struct {
+	huff_t			*compressor;
+	huff_t			*decompressor;
+	unsigned int	code[HMAX];			// first bit sent in bit 0
+	byte			length[HMAX];		// 0 = longer than 32 bits, walk the tree
+	unsigned short	decode[1<<HUFF_DECODE_BITS];	// symbol | length << 9, 0 length = walk the tree
+} huffTable_t;
+
 void	Huff_Compress(msg_t *buf, int offset);
 void	Huff_Decompress(msg_t *buf, int offset);
 void	Huff_Init(huffman_t *huff);
 void	Huff_addRef(huff_t* huff, byte ch);
-int		Huff_Receive (node_t *node, int *ch, byte *fin);
-void	Huff_transmit (huff_t *huff, int ch, byte *fout, int maxoffset);
+int		Huff_Receive (node_t *node, int *ch, byte *fin, int *offset);
+void	Huff_transmit (huff_t *huff, int ch, byte *fout, int *offset, int maxoffset);
 void	Huff_offsetReceive (node_t *node, int *ch, byte *fin, int *offset, int maxoffset);
 void	Huff_offsetTransmit (huff_t *huff, int ch, byte *fout, int *offset, int maxoffset);
 void	Huff_putBit( int bit, byte *fout, int *offset);
 int		Huff_getBit( byte *fout, int *offset);
-
-// don't use if you don't know what you're doing.
-int		Huff_getBloc(void);
-void	Huff_setBloc(int _bloc);
+void	Huff_putBits( int value, int count, byte *fout, int *offset );
+int		Huff_getBits( int count, byte *fin, int *offset );
+void	Huff_BuildTable( huffTable_t *table, huffman_t *huff );
+void	Huff_tableTransmit( const huffTable_t *table, int ch, byte *fout, int *offset, int maxoffset );
+void	Huff_tableReceive( const huffTable_t *table, int *ch, byte *fin, int *offset, int maxoffset );
 
 
 extern huffman_t clientHuffTables;
@@ -40,6 +40,12 @@ vm_t	*currentVM = NULL;
 vm_t	*lastVM    = NULL;
 int		vm_debugLevel;
 
+cvar_t	*vm_optimize;
+cvar_t	*vm_profile;
+#ifdef __aarch64__
+cvar_t	*vm_arm64Compiler;
+#endif
+
 // used by Com_Error to get rid of running vm's before longjmp
 static int forced_unload;
 
@@ -49,6 +55,8 @@ vm_t	vmTable[MAX_VM];
 
 void VM_VmInfo_f( void );
 void VM_VmProfile_f( void );
+void VM_VmCompare_f( void );
+void VM_VmBench_f( void );
 
 
 
@@ -73,9 +81,17 @@ void VM_Init( void ) {
 	Cvar_Get( "vm_cgame", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_game", "2", CVAR_ARCHIVE );	// !@# SHIP WITH SET TO 2
 	Cvar_Get( "vm_ui", "2", CVAR_ARCHIVE );		// !@# SHIP WITH SET TO 2
+	vm_optimize = Cvar_Get( "vm_optimize", "1", CVAR_ARCHIVE );
+	vm_profile = Cvar_Get( "vm_profile", "0", 0 );
+#ifdef __aarch64__
+	// opt-in until misc/vmcompare.sh has passed on arm64 hardware
+	vm_arm64Compiler = Cvar_Get( "vm_arm64Compiler", "0", CVAR_ARCHIVE );
+#endif
 
 	Cmd_AddCommand ("vmprofile", VM_VmProfile_f );
 	Cmd_AddCommand ("vminfo", VM_VmInfo_f );
+	Cmd_AddCommand ("vmcompare", VM_VmCompare_f );
+	Cmd_AddCommand ("vmbench", VM_VmBench_f );
 
 	Com_Memset( vmTable, 0, sizeof( vmTable ) );
 }
@@ -231,8 +247,8 @@ void VM_LoadSymbols( vm_t *vm ) {
 	int		segment;
 	int		numInstructions;
 
-	// don't load symbols if not developer
-	if ( !com_developer->integer ) {
+	// don't load symbols if not developer or profiling
+	if ( !com_developer->integer && !vm->profile ) {
 		return;
 	}
 
@@ -653,6 +669,23 @@ vm_t *VM_Create( const char *module, intptr_t (*systemCalls)(intptr_t *),
 
 	vm->compiled = qfalse;
 
+	if ( vm_profile->integer ) {
+		VM_ProfileCreate( vm, header );
+#if !id386 && !idx64
+		if ( interpret >= VMI_COMPILED ) {
+			Com_Printf( "Profiling %s with the interpreter, only the x86 compilers can be profiled\n", module );
+			interpret = VMI_BYTECODE;
+		}
+#endif
+	}
+
+#ifdef __aarch64__
+	if(interpret >= VMI_COMPILED && !vm_arm64Compiler->integer) {
+		Com_Printf("vm_arm64Compiler is 0, using interpreter\n");
+		interpret = VMI_BYTECODE;
+	}
+#endif
+
 #ifndef HAVE_VM_COMPILED
 	if(interpret >= VMI_COMPILED) {
 		Com_Printf("Architecture doesn't have a bytecode compiler, using interpreter\n");
@@ -821,6 +854,10 @@ intptr_t QDECL VM_Call( vm_t *vm, int callnum, ... )
 	  Com_Printf( "VM_Call( %d )\n", callnum );
 	}
 
+	if ( vm->profile && !vm->callLevel ) {
+		VM_ProfileBegin( vm );
+	}
+
 	++vm->callLevel;
 	// if we have a dll loaded, call it directly
 	if ( vm->entryPoint ) {
@@ -893,21 +930,50 @@ static int QDECL VM_ProfileSort( const void *a, const void *b ) {
 ==============
 VM_VmProfile_f
 
+Reports the vm_profile timings of a VM, or the instruction counts of
+a DEBUG_VM interpreter when it wasn't loaded with vm_profile
 ==============
 */
 void VM_VmProfile_f( void ) {
 	vm_t		*vm;
 	vmSymbol_t	**sorted, *sym;
-	int			i;
+	const char	*cmd;
+	int			i, arg;
 	double		total;
 
-	if ( !lastVM ) {
+	vm = lastVM;
+	arg = 1;
+
+	if ( Cmd_Argc() > 1 ) {
+		for ( i = 0 ; i < MAX_VM ; i++ ) {
+			if ( vmTable[i].name[0] && !Q_stricmp( vmTable[i].name, Cmd_Argv( 1 ) ) ) {
+				vm = &vmTable[i];
+				arg = 2;
+				break;
+			}
+		}
+	}
+
+	if ( !vm ) {
 		return;
 	}
 
-	vm = lastVM;
+	if ( vm->profile ) {
+		cmd = Cmd_Argv( arg );
+		if ( !cmd[0] ) {
+			VM_ProfilePrint( vm );
+		} else if ( !Q_stricmp( cmd, "reset" ) ) {
+			VM_ProfileReset( vm );
+		} else if ( !Q_stricmp( cmd, "folded" ) && Cmd_Argc() > arg + 1 ) {
+			VM_ProfileWriteFolded( vm, Cmd_Argv( arg + 1 ) );
+		} else {
+			Com_Printf( "usage: vmprofile [module] [reset | folded <file>]\n" );
+		}
+		return;
+	}
 
 	if ( !vm->numSymbols ) {
+		Com_Printf( "%s wasn't loaded with vm_profile\n", vm->name );
 		return;
 	}
 
@@ -968,6 +1034,216 @@ void VM_VmInfo_f( void ) {
 	}
 }
 
+static unsigned int	vmCompareHash;
+static int			vmCompareCalls;
+
+/*
+==============
+VM_CompareSyscall
+
+Answers every system call with a running hash of the call numbers and
+their first argument, so both runs see the same values
+==============
+*/
+static intptr_t VM_CompareSyscall( intptr_t *args ) {
+	vmCompareHash = ( vmCompareHash ^ (unsigned int)args[0] ) * 16777619u;
+	vmCompareHash = ( vmCompareHash ^ (unsigned int)args[1] ) * 16777619u;
+	vmCompareCalls++;
+
+	return (int)vmCompareHash;
+}
+
+/*
+==============
+VM_ReserveTestSlot
+
+Makes sure a test module can be loaded, freeing a copy left behind
+by an earlier vmcompare or vmbench that was dropped
+==============
+*/
+static qboolean VM_ReserveTestSlot( const char *module ) {
+	vm_t	*vm;
+	int		i;
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		vm = &vmTable[i];
+		if ( Q_stricmp( vm->name, module ) ) {
+			continue;
+		}
+		if ( vm->systemCall != VM_CompareSyscall || vm->callLevel ) {
+			Com_Printf( "%s is in use\n", module );
+			return qfalse;
+		}
+		VM_Free( vm );
+	}
+
+	for ( i = 0 ; i < MAX_VM ; i++ ) {
+		if ( !vmTable[i].name[0] ) {
+			return qtrue;
+		}
+	}
+
+	Com_Printf( "no free vm_t\n" );
+	return qfalse;
+}
+
+/*
+==============
+VM_VmCompare_f
+
+Loads a module once interpreted and once compiled, calls the same
+vmMain command in both and compares the return value, the system calls
+made and the data segment below the stack.  Meant for small test modules
+that only talk to the engine through system calls, it can be run under
+qemu-user to check a bytecode compiler for another architecture.
+==============
+*/
+void VM_VmCompare_f( void ) {
+	static const vmInterpret_t modes[2] = { VMI_BYTECODE, VMI_COMPILED };
+	static const char *modeNames[2] = { "interpreted", "compiled" };
+	vm_t		*vm;
+	char		module[MAX_QPATH];
+	int			args[MAX_VMMAIN_ARGS];
+	intptr_t	result[2];
+	unsigned int	callHash[2], dataHash[2];
+	int			calls[2], msec[2];
+	int			i, j, start;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: vmcompare <module> [command] [arg1] ... [arg%i]\n", MAX_VMMAIN_ARGS - 1 );
+		return;
+	}
+
+	Q_strncpyz( module, Cmd_Argv( 1 ), sizeof( module ) );
+
+	Com_Memset( args, 0, sizeof( args ) );
+	for ( i = 2 ; i < Cmd_Argc() && i - 2 < MAX_VMMAIN_ARGS ; i++ ) {
+		args[i - 2] = atoi( Cmd_Argv( i ) );
+	}
+
+	if ( !VM_ReserveTestSlot( module ) ) {
+		return;
+	}
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		vm = VM_Create( module, VM_CompareSyscall, modes[i] );
+		if ( !vm ) {
+			Com_Printf( "couldn't load %s\n", module );
+			return;
+		}
+		if ( modes[i] == VMI_COMPILED && !vm->compiled ) {
+			Com_Printf( "no bytecode compiler for " ARCH_STRING ", nothing to compare\n" );
+			VM_Free( vm );
+			return;
+		}
+
+		vmCompareHash = 2166136261u;
+		vmCompareCalls = 0;
+
+		start = Sys_Milliseconds();
+		result[i] = VM_Call( vm, args[0], args[1], args[2], args[3], args[4], args[5], args[6],
+			args[7], args[8], args[9], args[10], args[11], args[12] );
+		msec[i] = Sys_Milliseconds() - start;
+
+		callHash[i] = vmCompareHash;
+		calls[i] = vmCompareCalls;
+
+		// the stack is left out, only the interpreter stores return addresses there
+		dataHash[i] = 2166136261u;
+		for ( j = 0 ; j < vm->stackBottom ; j++ ) {
+			dataHash[i] = ( dataHash[i] ^ vm->dataBase[j] ) * 16777619u;
+		}
+
+		Com_Printf( "%-11s: returned %i, %i system calls %08x, data %08x, %i msec\n", modeNames[i],
+			(int)result[i], calls[i], callHash[i], dataHash[i], msec[i] );
+
+		VM_Free( vm );
+	}
+
+	if ( result[0] == result[1] && calls[0] == calls[1] && callHash[0] == callHash[1] && dataHash[0] == dataHash[1] ) {
+		Com_Printf( "%s: results match\n", module );
+	} else {
+		Com_Printf( S_COLOR_RED "%s: results differ\n", module );
+	}
+}
+
+/*
+==============
+VM_VmBench_f
+
+Loads a module interpreted and compiled and times the same vmMain
+command in both, the way vmcompare runs it
+==============
+*/
+void VM_VmBench_f( void ) {
+	static const vmInterpret_t modes[2] = { VMI_BYTECODE, VMI_COMPILED };
+	static const char *modeNames[2] = { "interpreted", "compiled" };
+	vm_t		*vm;
+	char		module[MAX_QPATH];
+	int			args[MAX_VMMAIN_ARGS];
+	int			iterations;
+	int			msec[2];
+	int			i, j, start;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: vmbench <module> [iterations] [command] [arg1] ... [arg%i]\n", MAX_VMMAIN_ARGS - 1 );
+		return;
+	}
+
+	Q_strncpyz( module, Cmd_Argv( 1 ), sizeof( module ) );
+
+	iterations = 100;
+	if ( Cmd_Argc() > 2 ) {
+		iterations = atoi( Cmd_Argv( 2 ) );
+		if ( iterations < 1 ) {
+			iterations = 1;
+		}
+	}
+
+	Com_Memset( args, 0, sizeof( args ) );
+	for ( i = 3 ; i < Cmd_Argc() && i - 3 < MAX_VMMAIN_ARGS ; i++ ) {
+		args[i - 3] = atoi( Cmd_Argv( i ) );
+	}
+
+	if ( !VM_ReserveTestSlot( module ) ) {
+		return;
+	}
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		msec[i] = 0;
+
+		vm = VM_Create( module, VM_CompareSyscall, modes[i] );
+		if ( !vm ) {
+			Com_Printf( "couldn't load %s\n", module );
+			return;
+		}
+		if ( modes[i] == VMI_COMPILED && !vm->compiled ) {
+			Com_Printf( "no bytecode compiler for " ARCH_STRING "\n" );
+			VM_Free( vm );
+			break;
+		}
+
+		vmCompareHash = 2166136261u;
+		vmCompareCalls = 0;
+
+		start = Sys_Milliseconds();
+		for ( j = 0 ; j < iterations ; j++ ) {
+			VM_Call( vm, args[0], args[1], args[2], args[3], args[4], args[5], args[6],
+				args[7], args[8], args[9], args[10], args[11], args[12] );
+		}
+		msec[i] = Sys_Milliseconds() - start;
+
+		Com_Printf( "%-11s: %i calls in %i msec, %.2f usec per call\n", modeNames[i],
+			iterations, msec[i], msec[i] * 1000.0f / iterations );
+
+		VM_Free( vm );
+	}
+
+	if ( i == 2 && msec[1] > 0 ) {
+		Com_Printf( "%s: compiled code is %.2f times faster\n", module, (float)msec[0] / msec[1] );
+	}
+}
+
 /*
 ===============
 VM_LogSyscalls
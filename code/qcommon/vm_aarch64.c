@@ -0,0 +1,886 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+
+AArch64 VM, translates every QVM instruction to a fixed sequence of A64
+instructions working on the opStack in memory, like the ARMv7 one.
+
+The VM state lives in callee saved registers so calls into C for system
+calls and block copies don't need to save anything.  QVM procedures are
+called with bl and keep their return address on the native stack, the
+program stack stays in the data segment.
+
+The opStack is a block of OPSTACK_SIZE bytes aligned to its size.  Every
+instruction that moves the opStack pointer puts back the bits above the
+block, so it wraps around like the 8 bit opStack offset of the x86
+compiler and a broken module can't reach the native stack.
+
+Docu:
+Arm Architecture Reference Manual for A-profile architecture (DDI0487)
+*/
+
+#ifdef __aarch64__
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <stddef.h>
+
+#include "vm_local.h"
+
+#define R0	0
+#define R1	1
+#define R2	2
+#define IP0	16
+#define FP	29
+#define LR	30
+#define SP	31
+#define ZR	31
+
+#define S0	0
+#define S1	1
+
+#define rOPSTACK	19	// points at the top of the opStack, which grows upwards
+#define rOPSTACKHI	20	// opStack base >> OPSTACK_SHIFT
+#define rPSTACK		21
+#define rDATABASE	22
+#define rDATAMASK	23
+#define rINSPOINTERS	24
+#define rHELPERS	25
+#define rPSTACKPTR	26
+
+#define OPSTACK_SHIFT	10
+#if (1 << OPSTACK_SHIFT) != OPSTACK_SIZE
+#error "OPSTACK_SHIFT doesn't match OPSTACK_SIZE"
+#endif
+
+/* exit() won't be called but use it because it is marked with noreturn */
+#define DIE( reason, args... ) \
+	do { \
+		Com_Error(ERR_DROP, "vm_aarch64 compiler error: " reason, ##args); \
+		exit(1); \
+	} while(0)
+
+// entry point generated at the start of the code, returns the final opStack top
+typedef int *(*vmEntry_t)(int *opStack, int *programStack, intptr_t *instructionPointers,
+	byte *dataBase, int dataMask, void **helpers);
+
+static void VM_Destroy_Compiled(vm_t *vm)
+{
+	if (vm->codeBase) {
+		if (munmap(vm->codeBase, vm->codeLength))
+			Com_Printf(S_COLOR_RED "Memory unmap failed, possible memory leak\n");
+	}
+	vm->codeBase = NULL;
+}
+
+/*
+=================
+ErrJump
+Error handler for jump/call to invalid instruction number
+=================
+*/
+
+static void Q_NO_RETURN ErrJump(int num)
+{
+	Com_Error(ERR_DROP, "program tried to execute code outside VM (%x)", num);
+}
+
+/*
+=================
+ErrDivide
+Error handler for an integer division by zero, which sdiv and udiv
+silently turn into 0
+=================
+*/
+
+static void Q_NO_RETURN ErrDivide(void)
+{
+	Com_Error(ERR_DROP, "program tried to divide by zero");
+}
+
+static intptr_t asmcall(int call, int pstack)
+{
+	// save currentVM so as to allow for recursive VM entry
+	vm_t *savedVM = currentVM;
+	intptr_t args[MAX_VMSYSCALL_ARGS];
+	int *argPosition;
+	intptr_t ret;
+	int i;
+
+	// modify VM stack pointer for recursive VM entry
+	currentVM->programStack = pstack - 4;
+
+	// the vm has ints on the stack, we expect pointers
+	argPosition = (int *)((byte *)currentVM->dataBase + pstack + 4);
+	argPosition[0] = -1 - call;
+	for( i = 0; i < (int)ARRAY_LEN(args); i++ )
+		args[i] = argPosition[i];
+
+	ret = currentVM->systemCall(args);
+
+	currentVM = savedVM;
+
+	return ret;
+}
+
+// called through rHELPERS, see the HELPER_ offsets
+static void *vm_helpers[] = {
+	(void *)asmcall,
+	(void *)VM_BlockCopy,
+	(void *)ErrJump,
+	(void *)ErrDivide
+};
+
+#define HELPER_SYSCALL		0
+#define HELPER_BLOCKCOPY	8
+#define HELPER_ERRJUMP		16
+#define HELPER_ERRDIVIDE	24
+
+static void _emit(vm_t *vm, unsigned isn, int pass)
+{
+	if (pass)
+		memcpy(vm->codeBase+vm->codeLength, &isn, 4);
+	vm->codeLength+=4;
+}
+
+#define emit(isn) _emit(vm, isn, pass)
+
+// conditions
+#define EQ 0b0000
+#define NE 0b0001
+#define HS 0b0010
+#define LO 0b0011
+#define MI 0b0100
+#define PL 0b0101
+#define HI 0b1000
+#define LS 0b1001
+#define GE 0b1010
+#define LT 0b1011
+#define GT 0b1100
+#define LE 0b1101
+#define INVERT(cond) ((cond) ^ 1)
+
+#define BRK(i)			(0xD4200000 | ((i)&0xFFFF)<<5)
+#define RET			0xD65F03C0
+
+// 32 bit moves
+#define MOVZw(dst, i, hw)	(0x52800000 | (hw)<<21 | ((i)&0xFFFF)<<5 | (dst))
+#define MOVKw(dst, i, hw)	(0x72800000 | (hw)<<21 | ((i)&0xFFFF)<<5 | (dst))
+#define MOVw(dst, src)		(0x2A0003E0 | (src)<<16 | (dst))
+#define MOVx(dst, src)		(0xAA0003E0 | (src)<<16 | (dst))
+#define MOVxSP(dst, src)	(0x91000000 | (src)<<5 | (dst))
+
+// immediate value must fit in 0xFFF!
+#define ADDwi(dst, src, i)	(0x11000000 | ((i)&0xFFF)<<10 | (src)<<5 | (dst))
+#define SUBwi(dst, src, i)	(0x51000000 | ((i)&0xFFF)<<10 | (src)<<5 | (dst))
+#define ADDxi(dst, src, i)	(0x91000000 | ((i)&0xFFF)<<10 | (src)<<5 | (dst))
+#define SUBxi(dst, src, i)	(0xD1000000 | ((i)&0xFFF)<<10 | (src)<<5 | (dst))
+
+#define ADDw(dst, src, reg)	(0x0B000000 | (reg)<<16 | (src)<<5 | (dst))
+#define SUBw(dst, src, reg)	(0x4B000000 | (reg)<<16 | (src)<<5 | (dst))
+#define ANDw(dst, src, reg)	(0x0A000000 | (reg)<<16 | (src)<<5 | (dst))
+#define ORRw(dst, src, reg)	(0x2A000000 | (reg)<<16 | (src)<<5 | (dst))
+#define EORw(dst, src, reg)	(0x4A000000 | (reg)<<16 | (src)<<5 | (dst))
+#define MVNw(dst, reg)		(0x2A2003E0 | (reg)<<16 | (dst))
+#define NEGw(dst, reg)		(0x4B0003E0 | (reg)<<16 | (dst))
+#define MULw(dst, src, reg)	(0x1B007C00 | (reg)<<16 | (src)<<5 | (dst))
+// dst = acc - src * reg
+#define MSUBw(dst, src, reg, acc) (0x1B008000 | (reg)<<16 | (acc)<<10 | (src)<<5 | (dst))
+#define SDIVw(dst, src, reg)	(0x1AC00C00 | (reg)<<16 | (src)<<5 | (dst))
+#define UDIVw(dst, src, reg)	(0x1AC00800 | (reg)<<16 | (src)<<5 | (dst))
+#define LSLw(dst, src, reg)	(0x1AC02000 | (reg)<<16 | (src)<<5 | (dst))
+#define LSRw(dst, src, reg)	(0x1AC02400 | (reg)<<16 | (src)<<5 | (dst))
+#define ASRw(dst, src, reg)	(0x1AC02800 | (reg)<<16 | (src)<<5 | (dst))
+#define SXTBw(dst, src)		(0x13001C00 | (src)<<5 | (dst))
+#define SXTHw(dst, src)		(0x13003C00 | (src)<<5 | (dst))
+#define LSRxi(dst, src, i)	(0xD340FC00 | ((i)&0x3F)<<16 | (src)<<5 | (dst))
+// dst bits lsb .. lsb+width-1 = src bits 0 .. width-1
+#define BFIx(dst, src, lsb, width)	(0xB3400000 | ((-(lsb))&0x3F)<<16 | (((width)-1)&0x3F)<<10 | (src)<<5 | (dst))
+#define CMPw(src, reg)		(0x6B00001F | (reg)<<16 | (src)<<5)
+
+// loads and stores, offsets in bytes
+#define LDRwi(dst, base, off)	(0xB9400000 | (((off)>>2)&0xFFF)<<10 | (base)<<5 | (dst))
+#define STRwi(src, base, off)	(0xB9000000 | (((off)>>2)&0xFFF)<<10 | (base)<<5 | (src))
+#define LDRxi(dst, base, off)	(0xF9400000 | (((off)>>3)&0xFFF)<<10 | (base)<<5 | (dst))
+// load with post-increment
+#define LDRwpost(dst, base, off) (0xB8400400 | ((off)&0x1FF)<<12 | (base)<<5 | (dst))
+// store with pre-increment
+#define STRwpre(src, base, off)	(0xB8000C00 | ((off)&0x1FF)<<12 | (base)<<5 | (src))
+#define LDPw(dst1, dst2, base, off)	(0x29400000 | (((off)>>2)&0x7F)<<15 | (dst2)<<10 | (base)<<5 | (dst1))
+#define LDPwpre(dst1, dst2, base, off)	(0x29C00000 | (((off)>>2)&0x7F)<<15 | (dst2)<<10 | (base)<<5 | (dst1))
+#define STPx(src1, src2, base, off)	(0xA9000000 | (((off)>>3)&0x7F)<<15 | (src2)<<10 | (base)<<5 | (src1))
+#define LDPx(dst1, dst2, base, off)	(0xA9400000 | (((off)>>3)&0x7F)<<15 | (dst2)<<10 | (base)<<5 | (dst1))
+#define STPxpre(src1, src2, base, off)	(0xA9800000 | (((off)>>3)&0x7F)<<15 | (src2)<<10 | (base)<<5 | (src1))
+#define LDPxpost(dst1, dst2, base, off)	(0xA8C00000 | (((off)>>3)&0x7F)<<15 | (dst2)<<10 | (base)<<5 | (dst1))
+
+// base + (unsigned)index
+#define LDRw_uxtw(dst, base, index)	(0xB8604800 | (index)<<16 | (base)<<5 | (dst))
+#define LDRHw_uxtw(dst, base, index)	(0x78604800 | (index)<<16 | (base)<<5 | (dst))
+#define LDRBw_uxtw(dst, base, index)	(0x38604800 | (index)<<16 | (base)<<5 | (dst))
+#define STRw_uxtw(src, base, index)	(0xB8204800 | (index)<<16 | (base)<<5 | (src))
+#define STRHw_uxtw(src, base, index)	(0x78204800 | (index)<<16 | (base)<<5 | (src))
+#define STRBw_uxtw(src, base, index)	(0x38204800 | (index)<<16 | (base)<<5 | (src))
+// base + (unsigned)index * 8
+#define LDRx_uxtw3(dst, base, index)	(0xF8605800 | (index)<<16 | (base)<<5 | (dst))
+
+// single precision
+#define LDRsi(dst, base, off)	(0xBD400000 | (((off)>>2)&0xFFF)<<10 | (base)<<5 | (dst))
+#define STRsi(src, base, off)	(0xBD000000 | (((off)>>2)&0xFFF)<<10 | (base)<<5 | (src))
+#define LDPs(dst1, dst2, base, off)	(0x2D400000 | (((off)>>2)&0x7F)<<15 | (dst2)<<10 | (base)<<5 | (dst1))
+#define LDPspre(dst1, dst2, base, off)	(0x2DC00000 | (((off)>>2)&0x7F)<<15 | (dst2)<<10 | (base)<<5 | (dst1))
+#define FADDs(dst, src, reg)	(0x1E202800 | (reg)<<16 | (src)<<5 | (dst))
+#define FSUBs(dst, src, reg)	(0x1E203800 | (reg)<<16 | (src)<<5 | (dst))
+#define FMULs(dst, src, reg)	(0x1E200800 | (reg)<<16 | (src)<<5 | (dst))
+#define FDIVs(dst, src, reg)	(0x1E201800 | (reg)<<16 | (src)<<5 | (dst))
+#define FNEGs(dst, src)		(0x1E214000 | (src)<<5 | (dst))
+#define FCMPs(src, reg)		(0x1E202000 | (reg)<<16 | (src)<<5)
+#define SCVTFsw(dst, src)	(0x1E220000 | (src)<<5 | (dst))
+#define FCVTZSws(dst, src)	(0x1E380000 | (src)<<5 | (dst))
+
+// branches, offsets in bytes relative to the branch instruction
+#define Bi(off)			(0x14000000 | (((off)>>2)&0x3FFFFFF))
+#define BLi(off)		(0x94000000 | (((off)>>2)&0x3FFFFFF))
+#define Bcond(cond, off)	(0x54000000 | (((off)>>2)&0x7FFFF)<<5 | (cond))
+#define CBNZw(reg, off)		(0x35000000 | (((off)>>2)&0x7FFFF)<<5 | (reg))
+#define TBNZw(reg, bit, off)	(0x37000000 | (bit)<<19 | (((off)>>2)&0x3FFF)<<5 | (reg))
+#define BR(reg)			(0xD61F0000 | (reg)<<5)
+#define BLR(reg)		(0xD63F0000 | (reg)<<5)
+
+// puts integer arg in register reg, one or two instructions
+#define emit_MOVRxi(reg, arg) do { \
+	if ((arg) & 0xFFFF) { \
+		emit(MOVZw(reg, (arg), 0)); \
+		if ((unsigned)(arg) > 0xFFFF) \
+			emit(MOVKw(reg, ((unsigned)(arg)>>16), 1)); \
+	} else \
+		emit(MOVZw(reg, ((unsigned)(arg)>>16), 1)); \
+	} while(0)
+
+// reg = src +/- arg
+#define emit_ADDRxi(reg, src, arg) do { \
+	if ((unsigned)(arg) <= 0xFFF) \
+		emit(ADDwi(reg, src, (arg))); \
+	else if ((unsigned)-(arg) <= 0xFFF) \
+		emit(SUBwi(reg, src, -(arg))); \
+	else { \
+		emit_MOVRxi(IP0, (arg)); \
+		emit(ADDw(reg, src, IP0)); \
+	} \
+	} while(0)
+
+// calls a C function from the helper table
+#define emit_CALLHELPER(ofs) do { \
+	emit(LDRxi(IP0, rHELPERS, ofs)); \
+	emit(BLR(IP0)); \
+	} while(0)
+
+// opStack access, the top is at [rOPSTACK] and it grows upwards
+// wraps rOPSTACK around inside the opStack block after it moved, a slot on
+// either side of the block catches the access that moved it out
+#define emit_WRAP()		emit(BFIx(rOPSTACK, rOPSTACKHI, OPSTACK_SHIFT, 64 - OPSTACK_SHIFT))
+#define emit_PUSH(reg) do { \
+	emit(STRwpre(reg, rOPSTACK, 4));	/* opstack+=4; *opstack = reg */ \
+	emit_WRAP(); \
+	} while(0)
+#define emit_POP(reg) do { \
+	emit(LDRwpost(reg, rOPSTACK, -4));	/* reg = *opstack; opstack-=4 */ \
+	emit_WRAP(); \
+	} while(0)
+#define emit_LOADTOP(reg)	emit(LDRwi(reg, rOPSTACK, 0))		// reg = *opstack
+#define emit_STORETOP(reg)	emit(STRwi(reg, rOPSTACK, 0))		// *opstack = reg
+// r1 = opstack[-1]; r0 = *opstack; opstack-=4
+#define emit_POP2(r1, r0) do { \
+	emit(LDPwpre(r1, r0, rOPSTACK, -4)); \
+	emit_WRAP(); \
+	} while(0)
+
+static int _j_rel(int x, int range, int pc)
+{
+	if (x&3 || x < -range || x >= range)
+		DIE("jump %d out of range at %d", x, pc);
+	return x;
+}
+
+/*
+=================
+VM_FindJumpTargets
+Marks every instruction that can be reached other than by falling through
+from the previous one
+=================
+*/
+static void VM_FindJumpTargets(vm_t *vm, vmHeader_t *header, byte *code, byte *jused)
+{
+	int i, v, op, pc = 0;
+
+	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
+		v = *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) );
+		if (v >= 0 && v < header->instructionCount)
+			jused[v] = 1;
+	}
+
+	for (i = 0; i < header->instructionCount && pc < header->codeLength; i++) {
+		op = code[pc++];
+		switch (op) {
+			case OP_CONST:
+				v = *(int *)&code[pc];
+				pc += 4;
+				if (code[pc] == OP_JUMP && v >= 0 && v < header->instructionCount)
+					jused[v] = 1;
+				break;
+			case OP_EQ: case OP_NE:
+			case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+			case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+			case OP_EQF: case OP_NEF:
+			case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+				v = *(int *)&code[pc];
+				pc += 4;
+				if (v >= 0 && v < header->instructionCount)
+					jused[v] = 1;
+				break;
+			case OP_ENTER:
+			case OP_LEAVE:
+			case OP_LOCAL:
+			case OP_BLOCK_COPY:
+				pc += 4;
+				break;
+			case OP_ARG:
+				pc += 1;
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void VM_Compile(vm_t *vm, vmHeader_t *header)
+{
+	byte *code, *jused;
+	int i_count, pc = 0;
+	int pass, i;
+	int off_call, off_syscall, off_errjump, off_errdivide;
+	qboolean fuse;
+
+#define j_rel(x) (pass?_j_rel(x, 1<<27, pc):0)
+#define jcond_rel(x) (pass?_j_rel(x, 1<<20, pc):0)
+// branch to the code of instruction x
+#define j_ins(x) j_rel(vm->instructionPointers[x]-vm->codeLength)
+#define VMFREE_BUFFERS() do {Z_Free(code); Z_Free(jused);} while(0)
+
+	vm->compiled = qfalse;
+
+	vm->codeBase = NULL;
+	vm->codeLength = 0;
+
+	// padded so the operands of a truncated last instruction can be read
+	code = Z_Malloc(header->codeLength + 32);
+	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength);
+
+	// calls and jumps to constants are only turned into direct branches
+	// when nothing else can jump in between the constant and the branch
+	jused = Z_Malloc(header->instructionCount + 1);
+	fuse = vm_optimize->integer && vm->jumpTableTargets;
+	if (fuse)
+		VM_FindJumpTargets(vm, header, code, jused);
+
+	off_call = off_syscall = off_errjump = off_errdivide = 0;
+
+	for (pass = 0; pass < 2; ++pass) {
+
+	if(pass)
+	{
+		vm->codeBase = mmap(NULL, vm->codeLength, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if(vm->codeBase == MAP_FAILED)
+		{
+			VMFREE_BUFFERS();
+			Com_Error(ERR_FATAL, "VM_CompileAArch64: can't mmap memory");
+		}
+		vm->codeLength = 0;
+	}
+
+	// vmEntry_t
+	emit(STPxpre(FP, LR, SP, -80));			// save FP, LR and x19 - x26
+	emit(MOVxSP(FP, SP));
+	emit(STPx(19, 20, SP, 16));
+	emit(STPx(21, 22, SP, 32));
+	emit(STPx(23, 24, SP, 48));
+	emit(STPx(25, 26, SP, 64));
+	emit(MOVx(rOPSTACK, 0));
+	emit(LSRxi(rOPSTACKHI, 0, OPSTACK_SHIFT));
+	emit(MOVx(rPSTACKPTR, 1));
+	emit(LDRwi(rPSTACK, 1, 0));
+	emit(MOVx(rINSPOINTERS, 2));
+	emit(MOVx(rDATABASE, 3));
+	emit(MOVw(rDATAMASK, 4));
+	emit(MOVx(rHELPERS, 5));
+
+	emit(BLi(j_ins(0)));
+
+	emit(STRwi(rPSTACK, rPSTACKPTR, 0));		// write back programStack
+	emit(MOVx(R0, rOPSTACK));
+	emit(LDPx(25, 26, SP, 64));
+	emit(LDPx(23, 24, SP, 48));
+	emit(LDPx(21, 22, SP, 32));
+	emit(LDPx(19, 20, SP, 16));
+	emit(LDPxpost(FP, LR, SP, 80));
+	emit(RET);
+
+	// call to the instruction or system call number on top of the opStack,
+	// the return address is already in LR
+	off_call = vm->codeLength;
+	emit_POP(R0);
+	emit(TBNZw(R0, 31, jcond_rel(off_syscall-vm->codeLength)));
+	emit_MOVRxi(IP0, vm->instructionCount);
+	emit(CMPw(R0, IP0));
+	emit(Bcond(HS, jcond_rel(off_errjump-vm->codeLength)));
+	emit(LDRx_uxtw3(IP0, rINSPOINTERS, R0));
+	emit(BR(IP0));
+
+	// system call number in r0
+	off_syscall = vm->codeLength;
+	emit(STPxpre(FP, LR, SP, -16));
+	emit(MOVw(R1, rPSTACK));
+	emit_CALLHELPER(HELPER_SYSCALL);
+	emit_PUSH(R0);
+	emit(LDPxpost(FP, LR, SP, 16));
+	emit(RET);
+
+	// invalid instruction number in r0
+	off_errjump = vm->codeLength;
+	emit_CALLHELPER(HELPER_ERRJUMP);
+	emit(BRK(0));
+
+	// integer division by zero
+	off_errdivide = vm->codeLength;
+	emit_CALLHELPER(HELPER_ERRDIVIDE);
+	emit(BRK(0));
+
+	pc = 0;
+
+	for (i_count = 0; i_count < header->instructionCount; i_count++) {
+		union {
+			unsigned char b[4];
+			unsigned int i;
+		} arg;
+		unsigned char op;
+
+		if (pc > header->codeLength)
+		{
+			VMFREE_BUFFERS();
+			Com_Error(ERR_DROP, "VM_CompileAArch64: pc > header->codeLength");
+		}
+
+		op = code[pc++];
+
+		vm->instructionPointers[i_count] = vm->codeLength;
+
+		switch (op)
+		{
+			case OP_ENTER:
+			case OP_LEAVE:
+			case OP_CONST:
+			case OP_LOCAL:
+			case OP_BLOCK_COPY:
+			case OP_EQ: case OP_NE:
+			case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+			case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+			case OP_EQF: case OP_NEF:
+			case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+				memcpy(arg.b, &code[pc], 4);
+				pc += 4;
+				break;
+			case OP_ARG:
+				arg.i = code[pc++];
+				break;
+			default:
+				arg.i = 0;
+				break;
+		}
+
+		switch ( op )
+		{
+			case OP_UNDEF:
+				break;
+
+			case OP_BREAK:
+				emit(BRK(0));
+				break;
+
+			case OP_ENTER:
+				emit(STPxpre(FP, LR, SP, -16));
+				emit_ADDRxi(rPSTACK, rPSTACK, -(int)arg.i);	// pstack -= arg
+				break;
+
+			case OP_LEAVE:
+				emit_ADDRxi(rPSTACK, rPSTACK, (int)arg.i);	// pstack += arg
+				emit(LDPxpost(FP, LR, SP, 16));
+				emit(RET);
+				break;
+
+			case OP_CALL:
+				emit(BLi(j_rel(off_call-vm->codeLength)));
+				break;
+
+			case OP_PUSH:
+				emit(ADDxi(rOPSTACK, rOPSTACK, 4));
+				emit_WRAP();
+				break;
+
+			case OP_POP:
+				emit(SUBxi(rOPSTACK, rOPSTACK, 4));
+				emit_WRAP();
+				break;
+
+			case OP_CONST:
+				if (fuse && i_count + 1 < header->instructionCount && !jused[i_count+1]
+					&& (code[pc] == OP_CALL || code[pc] == OP_JUMP))
+				{
+					int v = (int)arg.i;
+
+					if (code[pc] == OP_CALL && v < 0)
+					{
+						emit_MOVRxi(R0, arg.i);
+						emit(BLi(j_rel(off_syscall-vm->codeLength)));
+					}
+					else
+					{
+						if (v < 0 || v >= header->instructionCount)
+						{
+							VMFREE_BUFFERS();
+							Com_Error(ERR_DROP, "VM_CompileAArch64: jump target out of range at offset %d", pc);
+						}
+
+						if (code[pc] == OP_CALL)
+							emit(BLi(j_ins(v)));
+						else
+							emit(Bi(j_ins(v)));
+					}
+
+					// the CALL or JUMP is part of this instruction
+					pc++;
+					i_count++;
+					vm->instructionPointers[i_count] = vm->codeLength;
+					break;
+				}
+
+				emit_MOVRxi(R0, arg.i);
+				emit_PUSH(R0);
+				break;
+
+			case OP_LOCAL:
+				emit_ADDRxi(R0, rPSTACK, (int)arg.i);		// r0 = pstack+arg
+				emit_PUSH(R0);
+				break;
+
+			case OP_JUMP:
+				emit_POP(R0);
+				emit_MOVRxi(IP0, vm->instructionCount);
+				emit(CMPw(R0, IP0));
+				emit(Bcond(LO, 8));
+				emit(Bi(j_rel(off_errjump-vm->codeLength)));
+				emit(LDRx_uxtw3(IP0, rINSPOINTERS, R0));
+				emit(BR(IP0));
+				break;
+
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+			{
+				static const int cond[] = { EQ, NE, LT, LE, GT, GE, LO, LS, HI, HS };
+
+				if (arg.i >= (unsigned)header->instructionCount)
+				{
+					VMFREE_BUFFERS();
+					Com_Error(ERR_DROP, "VM_CompileAArch64: jump target out of range at offset %d", pc);
+				}
+
+				emit(LDPw(R1, R0, rOPSTACK, -4));
+				emit(SUBxi(rOPSTACK, rOPSTACK, 8));
+				emit_WRAP();
+				emit(CMPw(R1, R0));
+				// conditional branches only reach 1MB
+				emit(Bcond(INVERT(cond[op - OP_EQ]), 8));
+				emit(Bi(j_ins(arg.i)));
+				break;
+			}
+
+			case OP_EQF:
+			case OP_NEF:
+			case OP_LTF:
+			case OP_LEF:
+			case OP_GTF:
+			case OP_GEF:
+			{
+				// unordered sets C and V, these are all false for NaNs except NE
+				static const int cond[] = { EQ, NE, MI, LS, GT, GE };
+
+				if (arg.i >= (unsigned)header->instructionCount)
+				{
+					VMFREE_BUFFERS();
+					Com_Error(ERR_DROP, "VM_CompileAArch64: jump target out of range at offset %d", pc);
+				}
+
+				emit(LDPs(S1, S0, rOPSTACK, -4));
+				emit(SUBxi(rOPSTACK, rOPSTACK, 8));
+				emit_WRAP();
+				emit(FCMPs(S1, S0));
+				emit(Bcond(INVERT(cond[op - OP_EQF]), 8));
+				emit(Bi(j_ins(arg.i)));
+				break;
+			}
+
+			case OP_LOAD1:
+				emit_LOADTOP(R0);
+				emit(ANDw(R0, R0, rDATAMASK));
+				emit(LDRBw_uxtw(R0, rDATABASE, R0));	// r0 = (unsigned char)dataBase[r0]
+				emit_STORETOP(R0);
+				break;
+
+			case OP_LOAD2:
+				emit_LOADTOP(R0);
+				emit(ANDw(R0, R0, rDATAMASK));
+				emit(LDRHw_uxtw(R0, rDATABASE, R0));	// r0 = (unsigned short)dataBase[r0]
+				emit_STORETOP(R0);
+				break;
+
+			case OP_LOAD4:
+				emit_LOADTOP(R0);
+				emit(ANDw(R0, R0, rDATAMASK));
+				emit(LDRw_uxtw(R0, rDATABASE, R0));	// r0 = dataBase[r0]
+				emit_STORETOP(R0);
+				break;
+
+			case OP_STORE1:
+			case OP_STORE2:
+			case OP_STORE4:
+				// r1 = pointer, r0 = value
+				emit(LDPw(R1, R0, rOPSTACK, -4));
+				emit(SUBxi(rOPSTACK, rOPSTACK, 8));
+				emit_WRAP();
+				emit(ANDw(R1, R1, rDATAMASK));
+				if (op == OP_STORE1)
+					emit(STRBw_uxtw(R0, rDATABASE, R1));
+				else if (op == OP_STORE2)
+					emit(STRHw_uxtw(R0, rDATABASE, R1));
+				else
+					emit(STRw_uxtw(R0, rDATABASE, R1));
+				break;
+
+			case OP_ARG:
+				emit_POP(R0);
+				emit(ADDwi(R1, rPSTACK, arg.i));	// r1 = programStack+arg
+				emit(ANDw(R1, R1, rDATAMASK));
+				emit(STRw_uxtw(R0, rDATABASE, R1));	// dataBase[r1] = r0
+				break;
+
+			case OP_BLOCK_COPY:
+				// r0 = dest, r1 = src
+				emit(LDPw(R0, R1, rOPSTACK, -4));
+				emit(SUBxi(rOPSTACK, rOPSTACK, 8));
+				emit_WRAP();
+				emit_MOVRxi(R2, arg.i);
+				emit_CALLHELPER(HELPER_BLOCKCOPY);
+				break;
+
+			case OP_SEX8:
+				emit_LOADTOP(R0);
+				emit(SXTBw(R0, R0));
+				emit_STORETOP(R0);
+				break;
+
+			case OP_SEX16:
+				emit_LOADTOP(R0);
+				emit(SXTHw(R0, R0));
+				emit_STORETOP(R0);
+				break;
+
+			case OP_NEGI:
+				emit_LOADTOP(R0);
+				emit(NEGw(R0, R0));
+				emit_STORETOP(R0);
+				break;
+
+			case OP_BCOM:
+				emit_LOADTOP(R0);
+				emit(MVNw(R0, R0));
+				emit_STORETOP(R0);
+				break;
+
+			case OP_ADD:
+			case OP_SUB:
+			case OP_MULI:
+			case OP_MULU:
+			case OP_BAND:
+			case OP_BOR:
+			case OP_BXOR:
+			case OP_LSH:
+			case OP_RSHI:
+			case OP_RSHU:
+			case OP_DIVI:
+			case OP_DIVU:
+				emit_POP2(R1, R0);
+				if (op == OP_DIVI || op == OP_DIVU)
+				{
+					emit(CBNZw(R0, 8));
+					emit(Bi(j_rel(off_errdivide-vm->codeLength)));
+				}
+				switch (op)
+				{
+					case OP_ADD: emit(ADDw(R0, R1, R0)); break;		// r0 = r1 + r0
+					case OP_SUB: emit(SUBw(R0, R1, R0)); break;		// r0 = r1 - r0
+					case OP_MULI:
+					case OP_MULU: emit(MULw(R0, R1, R0)); break;		// r0 = r1 * r0
+					case OP_BAND: emit(ANDw(R0, R1, R0)); break;		// r0 = r1 & r0
+					case OP_BOR: emit(ORRw(R0, R1, R0)); break;		// r0 = r1 | r0
+					case OP_BXOR: emit(EORw(R0, R1, R0)); break;		// r0 = r1 ^ r0
+					case OP_LSH: emit(LSLw(R0, R1, R0)); break;		// r0 = r1 << r0
+					case OP_RSHI: emit(ASRw(R0, R1, R0)); break;		// r0 = r1 >> r0
+					case OP_RSHU: emit(LSRw(R0, R1, R0)); break;		// r0 = (unsigned)r1 >> r0
+					case OP_DIVI: emit(SDIVw(R0, R1, R0)); break;		// r0 = r1 / r0
+					default: emit(UDIVw(R0, R1, R0)); break;		// r0 = (unsigned)r1 / r0
+				}
+				emit_STORETOP(R0);
+				break;
+
+			case OP_MODI:
+			case OP_MODU:
+				emit_POP2(R1, R0);
+				emit(CBNZw(R0, 8));
+				emit(Bi(j_rel(off_errdivide-vm->codeLength)));
+				if (op == OP_MODI)
+					emit(SDIVw(R2, R1, R0));	// r2 = r1 / r0
+				else
+					emit(UDIVw(R2, R1, R0));
+				emit(MSUBw(R0, R2, R0, R1));		// r0 = r1 - r2 * r0
+				emit_STORETOP(R0);
+				break;
+
+			case OP_NEGF:
+				emit(LDRsi(S0, rOPSTACK, 0));
+				emit(FNEGs(S0, S0));
+				emit(STRsi(S0, rOPSTACK, 0));
+				break;
+
+			case OP_ADDF:
+			case OP_SUBF:
+			case OP_MULF:
+			case OP_DIVF:
+				emit(LDPspre(S1, S0, rOPSTACK, -4));
+				emit_WRAP();
+				if (op == OP_ADDF)
+					emit(FADDs(S0, S1, S0));	// s0 = s1 + s0
+				else if (op == OP_SUBF)
+					emit(FSUBs(S0, S1, S0));	// s0 = s1 - s0
+				else if (op == OP_MULF)
+					emit(FMULs(S0, S1, S0));	// s0 = s1 * s0
+				else
+					emit(FDIVs(S0, S1, S0));	// s0 = s1 / s0
+				emit(STRsi(S0, rOPSTACK, 0));
+				break;
+
+			case OP_CVIF:
+				emit_LOADTOP(R0);
+				emit(SCVTFsw(S0, R0));
+				emit(STRsi(S0, rOPSTACK, 0));
+				break;
+
+			case OP_CVFI:
+				emit(LDRsi(S0, rOPSTACK, 0));
+				emit(FCVTZSws(R0, S0));			// truncates like Q_VMftol
+				emit_STORETOP(R0);
+				break;
+
+			default:
+				VMFREE_BUFFERS();
+				Com_Error(ERR_DROP, "VM_CompileAArch64: bad opcode %i at offset %i", op, pc);
+		}
+	}
+
+	// never reached
+	emit(BRK(0));
+	} // pass
+
+	VMFREE_BUFFERS();
+
+	if (mprotect(vm->codeBase, vm->codeLength, PROT_READ|PROT_EXEC)) {
+		VM_Destroy_Compiled(vm);
+		DIE("mprotect failed");
+	}
+
+	__builtin___clear_cache((char *)vm->codeBase, (char *)vm->codeBase+vm->codeLength);
+
+	// offsets to addresses
+	for (i = 0; i < header->instructionCount; i++)
+		vm->instructionPointers[i] += (intptr_t) vm->codeBase;
+
+	vm->destroy = VM_Destroy_Compiled;
+	vm->compiled = qtrue;
+}
+
+int VM_CallCompiled(vm_t *vm, int *args)
+{
+	byte	stack[OPSTACK_SIZE * 2 + 8];	// an aligned block and a slot on either side
+	int	*opStack, *opStackTop;
+	int	programStack = vm->programStack;
+	int	stackOnEntry = programStack;
+	byte	*image = vm->dataBase;
+	vmEntry_t	entry;
+	int	arg;
+
+	currentVM = vm;
+
+	vm->currentlyInterpreting = qtrue;
+
+	programStack -= ( 8 + 4 * MAX_VMMAIN_ARGS );
+
+	for ( arg = 0; arg < MAX_VMMAIN_ARGS; arg++ )
+		*(int *)&image[ programStack + 8 + arg * 4 ] = args[ arg ];
+
+	*(int *)&image[ programStack + 4 ] = 0;	// return stack
+	*(int *)&image[ programStack ] = -1;	// will terminate the loop on return
+
+	opStack = PADP(stack + 4, OPSTACK_SIZE);
+	*opStack = 0xDEADBEEF;
+
+	/* call generated code */
+	entry = (vmEntry_t)vm->codeBase;
+	opStackTop = entry(opStack, &programStack, vm->instructionPointers, vm->dataBase, vm->dataMask, vm_helpers);
+
+	if(opStackTop != opStack + 1 || *opStack != 0xDEADBEEF)
+	{
+		Com_Error(ERR_DROP, "opStack corrupted in compiled code");
+	}
+
+	if(programStack != stackOnEntry - (8 + 4 * MAX_VMMAIN_ARGS))
+		Com_Error(ERR_DROP, "programStack corrupted in compiled code");
+
+	vm->programStack = stackOnEntry;
+	vm->currentlyInterpreting = qfalse;
+
+	return *opStackTop;
+}
+
+#endif // __aarch64__
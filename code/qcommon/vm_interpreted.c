@@ -161,6 +161,56 @@ void VM_StackTrace( vm_t *vm, int programCounter, int programStack ) {
 
 }
 
+/*
+===================================================================
+
+THREADED CODE
+
+The bytecode is decoded once into an array of vmInstruction_t, one per
+instruction, and the program counter is an instruction number.  With gcc
+and clang every instruction holds the address of the label that executes
+it, so moving to the next one is a single indirect jump (computed goto);
+other compilers get the opcode and a switch.
+
+When vm_optimize is set a few common pairs are fused into a single
+superinstruction.  The second instruction of a pair is left in place, so a
+jump landing on it still runs it on its own.
+
+===================================================================
+*/
+
+#if defined( __GNUC__ ) || defined( __clang__ )
+#define VM_THREADED
+#endif
+
+enum {
+	OP_LOCAL_LOAD4 = OP_CVFI + 1,	// LOCAL, LOAD4
+	OP_CONST_ADD,					// CONST, ADD
+	OP_CONST_EQ,					// CONST, EQ
+	OP_CONST_NE,					// CONST, NE
+	OP_CONST_JUMP,					// CONST, JUMP
+	OP_CONST_CALL,					// CONST, CALL
+	OP_END,							// past the last instruction
+
+	OP_NUM_INTERPRETED
+};
+
+typedef struct {
+#ifdef VM_THREADED
+	const void	*handler;			// label in VM_CallInterpreted
+#else
+	int			op;
+#endif
+	int			arg;				// operand, jumps hold instruction numbers
+	int			arg2;				// branch target of OP_CONST_EQ / OP_CONST_NE
+#ifdef DEBUG_VM
+	int			opcode;				// original opcode, for tracing
+#endif
+} vmInstruction_t;
+
+#ifdef VM_THREADED
+static const void	**vmDispatch;		// filled by VM_CallInterpreted( NULL, NULL )
+#endif
 
 /*
 ====================
@@ -168,35 +218,41 @@ VM_PrepareInterpreter
 ====================
 */
 void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
-	int		op;
+	vmInstruction_t	*code;
+	byte	*bytecode;
+	byte	*ops;
 	int		byte_pc;
-	int		int_pc;
-	byte	*code;
 	int		instruction;
-	int		*codeBase;
+	int		count;
+	int		op, next;
 
-	vm->codeBase = Hunk_Alloc( vm->codeLength*4, h_high );			// we're now int aligned
-//	memcpy( vm->codeBase, (byte *)header + header->codeOffset, vm->codeLength );
+#ifdef VM_THREADED
+	if ( !vmDispatch ) {
+		VM_CallInterpreted( NULL, NULL );
+	}
+#endif
+
+	count = header->instructionCount;
 
-	// we don't need to translate the instructions, but we still need
-	// to find each instructions starting point for jumps
-	int_pc = byte_pc = 0;
-	instruction = 0;
-	code = (byte *)header + header->codeOffset;
-	codeBase = (int *)vm->codeBase;
+	// one more to catch running off the end of the code
+	code = Hunk_Alloc( ( count + 1 ) * sizeof( *code ), h_high );
+	vm->codeBase = (byte *)code;
 
-	// Copy and expand instructions to words while building instruction table
-	while ( instruction < header->instructionCount ) {
-		vm->instructionPointers[ instruction ] = int_pc;
-		instruction++;
+	ops = Z_Malloc( count );
 
-		op = (int)code[ byte_pc ];
-		codeBase[int_pc] = op;
-		if(byte_pc > header->codeLength)
-			Com_Error(ERR_DROP, "VM_PrepareInterpreter: pc > header->codeLength");
+	// decode the instructions and their operands
+	bytecode = (byte *)header + header->codeOffset;
+	byte_pc = 0;
+	for ( instruction = 0 ; instruction < count ; instruction++ ) {
+		// the program counter is the instruction number, jumps and
+		// symbols need no translation
+		vm->instructionPointers[ instruction ] = instruction;
 
-		byte_pc++;
-		int_pc++;
+		op = bytecode[ byte_pc++ ];
+		if ( op > OP_CVFI ) {
+			Com_Error( ERR_DROP, "VM_PrepareInterpreter: bad opcode %i at instruction %i", op, instruction );
+		}
+		ops[ instruction ] = op;
 
 		// these are the only opcodes that aren't a single byte
 		switch ( op ) {
@@ -221,72 +277,83 @@ void VM_PrepareInterpreter( vm_t *vm, vmHeader_t *header ) {
 		case OP_GTF:
 		case OP_GEF:
 		case OP_BLOCK_COPY:
-			codeBase[int_pc] = loadWord(&code[byte_pc]);
+			code[ instruction ].arg = loadWord( &bytecode[ byte_pc ] );
 			byte_pc += 4;
-			int_pc++;
 			break;
 		case OP_ARG:
-			codeBase[int_pc] = (int)code[byte_pc];
+			code[ instruction ].arg = bytecode[ byte_pc ];
 			byte_pc++;
-			int_pc++;
 			break;
 		default:
 			break;
 		}
 
+		if ( byte_pc > header->codeLength ) {
+			Com_Error( ERR_DROP, "VM_PrepareInterpreter: pc > header->codeLength" );
+		}
+
+		// branch targets are checked once here instead of on every jump,
+		// the extra instruction at the end stops a branch past the code
+		if ( op >= OP_EQ && op <= OP_GEF ) {
+			if ( code[ instruction ].arg < 0 || code[ instruction ].arg > count ) {
+				Com_Error( ERR_DROP, "VM_PrepareInterpreter: Jump to invalid instruction number" );
+			}
+		}
 	}
-	int_pc = 0;
-	instruction = 0;
-	
-	// Now that the code has been expanded to int-sized opcodes, we'll translate instruction index
-	//into an index into codeBase[], which contains opcodes and operands.
-	while ( instruction < header->instructionCount ) {
-		op = codeBase[ int_pc ];
-		instruction++;
-		int_pc++;
-		
-		switch ( op ) {
-		// These ops need to translate addresses in jumps from instruction index to int index
-		case OP_EQ:
-		case OP_NE:
-		case OP_LTI:
-		case OP_LEI:
-		case OP_GTI:
-		case OP_GEI:
-		case OP_LTU:
-		case OP_LEU:
-		case OP_GTU:
-		case OP_GEU:
-		case OP_EQF:
-		case OP_NEF:
-		case OP_LTF:
-		case OP_LEF:
-		case OP_GTF:
-		case OP_GEF:
-			if(codeBase[int_pc] < 0 || codeBase[int_pc] > vm->instructionCount)
-				Com_Error(ERR_DROP, "VM_PrepareInterpreter: Jump to invalid instruction number");
 
-			// codeBase[pc] is the instruction index. Convert that into an offset into
-			//the int-aligned codeBase[] by the lookup table.
-			codeBase[int_pc] = vm->instructionPointers[codeBase[int_pc]];
-			int_pc++;
-			break;
+	// fuse superinstructions and fill in the handlers
+	for ( instruction = 0 ; instruction < count ; instruction++ ) {
+		op = ops[ instruction ];
+		next = instruction + 1 < count ? ops[ instruction + 1 ] : OP_UNDEF;
 
-		// These opcodes have an operand that isn't an instruction index
-		case OP_ENTER:
-		case OP_CONST:
-		case OP_LOCAL:
-		case OP_LEAVE:
-		case OP_BLOCK_COPY:
-		case OP_ARG:
-			int_pc++;
-			break;
-
-		default:
-			break;
+#ifdef DEBUG_VM
+		code[ instruction ].opcode = op;
+#endif
+		if ( vm_optimize->integer ) {
+			if ( op == OP_LOCAL && next == OP_LOAD4 ) {
+				op = OP_LOCAL_LOAD4;
+			} else if ( op == OP_CONST ) {
+				switch ( next ) {
+				case OP_ADD:
+					op = OP_CONST_ADD;
+					break;
+				case OP_EQ:
+					op = OP_CONST_EQ;
+					code[ instruction ].arg2 = code[ instruction + 1 ].arg;
+					break;
+				case OP_NE:
+					op = OP_CONST_NE;
+					code[ instruction ].arg2 = code[ instruction + 1 ].arg;
+					break;
+				case OP_JUMP:
+					if ( (unsigned)code[ instruction ].arg < (unsigned)count ) {
+						op = OP_CONST_JUMP;
+					}
+					break;
+				case OP_CALL:
+					// negative targets are system calls
+					if ( code[ instruction ].arg < count ) {
+						op = OP_CONST_CALL;
+					}
+					break;
+				}
+			}
 		}
 
+#ifdef VM_THREADED
+		code[ instruction ].handler = vmDispatch[ op ];
+#else
+		code[ instruction ].op = op;
+#endif
 	}
+
+#ifdef VM_THREADED
+	code[ count ].handler = vmDispatch[ OP_END ];
+#else
+	code[ count ].op = OP_END;
+#endif
+
+	Z_Free( ops );
 }
 
 /*
@@ -310,26 +377,94 @@ sp		return address
 An interpreted function will immediately execute
 an OP_ENTER instruction, which will subtract space for
 locals from sp
+
+The top of the opStack is kept in tos, opStack[0 .. opStackOfs-1]
+holds the values below it.  Calling with a NULL vm only fills in
+the dispatch table for VM_PrepareInterpreter.
 ==============
 */
 
 #define	DEBUGSTR va("%s%i", VM_Indent(vm), opStackOfs)
 
+#ifdef VM_THREADED
+#define	CASE( op )		L_##op:
+#define	HANDLER( op )	[op] = &&L_##op
+#else
+#define	CASE( op )		case op:
+#endif
+
+#if defined( VM_THREADED ) && !defined( DEBUG_VM )
+#define	DISPATCH()		goto *ip->handler
+#else
+#define	DISPATCH()		goto nextInstruction
+#endif
+
+#define	NOS				opStack[ (uint8_t)( opStackOfs - 1 ) ]
+#define	PUSH( v )		( opStack[ opStackOfs++ ] = tos, tos.i = (v) )
+#define	POP()			( tos = opStack[ --opStackOfs ] )
+
+// compare the two values on top of the opStack and pop them
+#define	BRANCH( cond ) \
+	if ( cond ) { \
+		opStackOfs -= 2; \
+		tos = opStack[ opStackOfs ]; \
+		ip = code + ip->arg; \
+	} else { \
+		opStackOfs -= 2; \
+		tos = opStack[ opStackOfs ]; \
+		ip++; \
+	} \
+	DISPATCH()
+
 int	VM_CallInterpreted( vm_t *vm, int *args ) {
-	byte		stack[OPSTACK_SIZE + 15];
-	int		*opStack;
-	uint8_t 	opStackOfs;
-	int		programCounter;
+	floatint_t	opStack[ OPSTACK_SIZE / 4 ];
+	uint8_t		opStackOfs;
+	floatint_t	tos;
+	vmInstruction_t	*code, *ip;
 	int		programStack;
 	int		stackOnEntry;
 	byte	*image;
-	int		*codeImage;
 	int		v1;
 	int		dataMask;
 	int		arg;
 #ifdef DEBUG_VM
 	vmSymbol_t	*profileSymbol;
 #endif
+#ifdef VM_THREADED
+	static const void *dispatch[ OP_NUM_INTERPRETED ] = {
+		HANDLER( OP_UNDEF ), HANDLER( OP_IGNORE ), HANDLER( OP_BREAK ),
+		HANDLER( OP_ENTER ), HANDLER( OP_LEAVE ), HANDLER( OP_CALL ),
+		HANDLER( OP_PUSH ), HANDLER( OP_POP ), HANDLER( OP_CONST ),
+		HANDLER( OP_LOCAL ), HANDLER( OP_JUMP ),
+		HANDLER( OP_EQ ), HANDLER( OP_NE ),
+		HANDLER( OP_LTI ), HANDLER( OP_LEI ), HANDLER( OP_GTI ), HANDLER( OP_GEI ),
+		HANDLER( OP_LTU ), HANDLER( OP_LEU ), HANDLER( OP_GTU ), HANDLER( OP_GEU ),
+		HANDLER( OP_EQF ), HANDLER( OP_NEF ),
+		HANDLER( OP_LTF ), HANDLER( OP_LEF ), HANDLER( OP_GTF ), HANDLER( OP_GEF ),
+		HANDLER( OP_LOAD1 ), HANDLER( OP_LOAD2 ), HANDLER( OP_LOAD4 ),
+		HANDLER( OP_STORE1 ), HANDLER( OP_STORE2 ), HANDLER( OP_STORE4 ),
+		HANDLER( OP_ARG ), HANDLER( OP_BLOCK_COPY ),
+		HANDLER( OP_SEX8 ), HANDLER( OP_SEX16 ),
+		HANDLER( OP_NEGI ), HANDLER( OP_ADD ), HANDLER( OP_SUB ),
+		HANDLER( OP_DIVI ), HANDLER( OP_DIVU ), HANDLER( OP_MODI ), HANDLER( OP_MODU ),
+		HANDLER( OP_MULI ), HANDLER( OP_MULU ),
+		HANDLER( OP_BAND ), HANDLER( OP_BOR ), HANDLER( OP_BXOR ), HANDLER( OP_BCOM ),
+		HANDLER( OP_LSH ), HANDLER( OP_RSHI ), HANDLER( OP_RSHU ),
+		HANDLER( OP_NEGF ), HANDLER( OP_ADDF ), HANDLER( OP_SUBF ),
+		HANDLER( OP_DIVF ), HANDLER( OP_MULF ),
+		HANDLER( OP_CVIF ), HANDLER( OP_CVFI ),
+
+		HANDLER( OP_LOCAL_LOAD4 ), HANDLER( OP_CONST_ADD ),
+		HANDLER( OP_CONST_EQ ), HANDLER( OP_CONST_NE ),
+		HANDLER( OP_CONST_JUMP ), HANDLER( OP_CONST_CALL ),
+		HANDLER( OP_END )
+	};
+
+	if ( !vm ) {
+		vmDispatch = dispatch;
+		return 0;
+	}
+#endif
 
 	// interpret the code
 	vm->currentlyInterpreting = qtrue;
@@ -342,13 +477,11 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 	// uncomment this for debugging breakpoints
 	vm->breakFunction = 0;
 #endif
-	// set up the stack frame 
+	// set up the stack frame
 
 	image = vm->dataBase;
-	codeImage = (int *)vm->codeBase;
+	code = (vmInstruction_t *)vm->codeBase;
 	dataMask = vm->dataMask;
-	
-	programCounter = 0;
 
 	programStack -= ( 8 + 4 * MAX_VMMAIN_ARGS );
 
@@ -360,542 +493,450 @@ int	VM_CallInterpreted( vm_t *vm, int *args ) {
 
 	VM_Debug(0);
 
-	// leave a free spot at start of stack so
-	// that as long as opStack is valid, opStack-1 will
-	// not corrupt anything
-	opStack = PADP(stack, 16);
-	*opStack = 0xDEADBEEF;
+	// the marker below the first value is checked on return
+	opStack[0].ui = 0xDEADBEEF;
+	tos.ui = 0xDEADBEEF;
 	opStackOfs = 0;
 
-//	vm_debugLevel=2;
 	// main interpreter loop, will exit when a LEAVE instruction
 	// grabs the -1 program counter
+	ip = code;
 
-#define r2 codeImage[programCounter]
-
-	while ( 1 ) {
-		int		opcode,	r0, r1;
-//		unsigned int	r2;
-
+#if !defined( VM_THREADED ) || defined( DEBUG_VM )
 nextInstruction:
-		r0 = opStack[opStackOfs];
-		r1 = opStack[(uint8_t) (opStackOfs - 1)];
-nextInstruction2:
+#endif
 #ifdef DEBUG_VM
-		if ( (unsigned)programCounter >= vm->codeLength ) {
-			Com_Error( ERR_DROP, "VM pc out of range" );
-			return 0;
-		}
+	if ( ip - code >= vm->instructionCount ) {
+		Com_Error( ERR_DROP, "VM pc out of range" );
+	}
 
-		if ( programStack <= vm->stackBottom ) {
-			Com_Error( ERR_DROP, "VM stack overflow" );
-			return 0;
-		}
+	if ( programStack <= vm->stackBottom ) {
+		Com_Error( ERR_DROP, "VM stack overflow" );
+	}
 
-		if ( programStack & 3 ) {
-			Com_Error( ERR_DROP, "VM program stack misaligned" );
-			return 0;
-		}
+	if ( programStack & 3 ) {
+		Com_Error( ERR_DROP, "VM program stack misaligned" );
+	}
 
-		if ( vm_debugLevel > 1 ) {
-			Com_Printf( "%s %s\n", DEBUGSTR, opnames[opcode] );
-		}
-		profileSymbol->profileCount++;
+	if ( vm_debugLevel > 1 ) {
+		Com_Printf( "%s %s\n", DEBUGSTR, opnames[ip->opcode] );
+	}
+	profileSymbol->profileCount++;
 #endif
-		opcode = codeImage[ programCounter++ ];
 
-		switch ( opcode ) {
-#ifdef DEBUG_VM
-		default:
-			Com_Error( ERR_DROP, "Bad VM instruction" );  // this should be scanned on load!
-			return 0;
+#ifdef VM_THREADED
+	goto *ip->handler;
+#else
+	switch ( ip->op ) {
+	default:
+		Com_Error( ERR_DROP, "Bad VM instruction" );  // this should be scanned on load!
 #endif
-		case OP_BREAK:
-			vm->breakCount++;
-			goto nextInstruction2;
-		case OP_CONST:
-			opStackOfs++;
-			r1 = r0;
-			r0 = opStack[opStackOfs] = r2;
-			
-			programCounter += 1;
-			goto nextInstruction2;
-		case OP_LOCAL:
-			opStackOfs++;
-			r1 = r0;
-			r0 = opStack[opStackOfs] = r2+programStack;
-
-			programCounter += 1;
-			goto nextInstruction2;
 
-		case OP_LOAD4:
+	CASE( OP_UNDEF )
+	CASE( OP_IGNORE )
+		ip++;
+		DISPATCH();
+	CASE( OP_BREAK )
+		vm->breakCount++;
+		ip++;
+		DISPATCH();
+	CASE( OP_END )
+		Com_Error( ERR_DROP, "VM pc out of range" );
+
+	CASE( OP_CONST )
+		PUSH( ip->arg );
+		ip++;
+		DISPATCH();
+	CASE( OP_LOCAL )
+		PUSH( ip->arg + programStack );
+		ip++;
+		DISPATCH();
+
+	CASE( OP_LOAD4 )
 #ifdef DEBUG_VM
-			if(opStack[opStackOfs] & 3)
-			{
-				Com_Error( ERR_DROP, "OP_LOAD4 misaligned" );
-				return 0;
-			}
+		if ( tos.i & 3 ) {
+			Com_Error( ERR_DROP, "OP_LOAD4 misaligned" );
+		}
 #endif
-			r0 = opStack[opStackOfs] = *(int *) &image[ r0 & dataMask ];
-			goto nextInstruction2;
-		case OP_LOAD2:
-			r0 = opStack[opStackOfs] = *(unsigned short *)&image[ r0 & dataMask ];
-			goto nextInstruction2;
-		case OP_LOAD1:
-			r0 = opStack[opStackOfs] = image[ r0 & dataMask ];
-			goto nextInstruction2;
-
-		case OP_STORE4:
-			*(int *)&image[ r1 & dataMask ] = r0;
-			opStackOfs -= 2;
-			goto nextInstruction;
-		case OP_STORE2:
-			*(short *)&image[ r1 & dataMask ] = r0;
-			opStackOfs -= 2;
-			goto nextInstruction;
-		case OP_STORE1:
-			image[ r1 & dataMask ] = r0;
-			opStackOfs -= 2;
-			goto nextInstruction;
-
-		case OP_ARG:
-			// single byte offset from programStack
-			*(int *)&image[ (codeImage[programCounter] + programStack) & dataMask ] = r0;
-			opStackOfs--;
-			programCounter += 1;
-			goto nextInstruction;
-
-		case OP_BLOCK_COPY:
-			VM_BlockCopy(r1, r0, r2);
-			programCounter += 1;
-			opStackOfs -= 2;
-			goto nextInstruction;
-
-		case OP_CALL:
-			// save current program counter
-			*(int *)&image[ programStack ] = programCounter;
-			
-			// jump to the location on the stack
-			programCounter = r0;
-			opStackOfs--;
-			if ( programCounter < 0 ) {
-				// system call
-				int		r;
-//				int		temp;
+		tos.i = *(int *)&image[ tos.i & dataMask ];
+		ip++;
+		DISPATCH();
+	CASE( OP_LOAD2 )
+		tos.i = *(unsigned short *)&image[ tos.i & dataMask ];
+		ip++;
+		DISPATCH();
+	CASE( OP_LOAD1 )
+		tos.i = image[ tos.i & dataMask ];
+		ip++;
+		DISPATCH();
+
+	CASE( OP_STORE4 )
+		*(int *)&image[ NOS.i & dataMask ] = tos.i;
+		opStackOfs -= 2;
+		tos = opStack[ opStackOfs ];
+		ip++;
+		DISPATCH();
+	CASE( OP_STORE2 )
+		*(short *)&image[ NOS.i & dataMask ] = tos.i;
+		opStackOfs -= 2;
+		tos = opStack[ opStackOfs ];
+		ip++;
+		DISPATCH();
+	CASE( OP_STORE1 )
+		image[ NOS.i & dataMask ] = tos.i;
+		opStackOfs -= 2;
+		tos = opStack[ opStackOfs ];
+		ip++;
+		DISPATCH();
+
+	CASE( OP_ARG )
+		// single byte offset from programStack
+		*(int *)&image[ ( ip->arg + programStack ) & dataMask ] = tos.i;
+		POP();
+		ip++;
+		DISPATCH();
+
+	CASE( OP_BLOCK_COPY )
+		VM_BlockCopy( NOS.i, tos.i, ip->arg );
+		opStackOfs -= 2;
+		tos = opStack[ opStackOfs ];
+		ip++;
+		DISPATCH();
+
+	CASE( OP_CALL )
+		v1 = tos.i;
+		POP();
+		ip++;
+		goto doCall;
+	CASE( OP_CONST_CALL )
+		v1 = ip->arg;
+		ip += 2;
+doCall:
+		// save the return address
+		*(int *)&image[ programStack ] = ip - code;
+
+		if ( v1 < 0 ) {
+			// system call
+			int		r;
 #ifdef DEBUG_VM
-				int		stomped;
+			int		stomped;
 
-				if ( vm_debugLevel ) {
-					Com_Printf( "%s---> systemcall(%i)\n", DEBUGSTR, -1 - programCounter );
-				}
-#endif
-				// save the stack to allow recursive VM entry
-//				temp = vm->callLevel;
-				vm->programStack = programStack - 4;
-#ifdef DEBUG_VM
-				stomped = *(int *)&image[ programStack + 4 ];
+			if ( vm_debugLevel ) {
+				Com_Printf( "%s---> systemcall(%i)\n", DEBUGSTR, -1 - v1 );
+			}
 #endif
-				*(int *)&image[ programStack + 4 ] = -1 - programCounter;
-
-//VM_LogSyscalls( (int *)&image[ programStack + 4 ] );
-				{
-					// the vm has ints on the stack, we expect
-					// pointers so we might have to convert it
-					if (sizeof(intptr_t) != sizeof(int)) {
-						intptr_t argarr[ MAX_VMSYSCALL_ARGS ];
-						int *imagePtr = (int *)&image[ programStack ];
-						int i;
-						for (i = 0; i < ARRAY_LEN(argarr); ++i) {
-							argarr[i] = *(++imagePtr);
-						}
-						r = vm->systemCall( argarr );
-					} else {
-						intptr_t* argptr = (intptr_t *)&image[ programStack + 4 ];
-						r = vm->systemCall( argptr );
-					}
-				}
-
+			// save the stack to allow recursive VM entry
+			vm->programStack = programStack - 4;
 #ifdef DEBUG_VM
-				// this is just our stack frame pointer, only needed
-				// for debugging
-				*(int *)&image[ programStack + 4 ] = stomped;
+			stomped = *(int *)&image[ programStack + 4 ];
 #endif
-
-				// save return value
-				opStackOfs++;
-				opStack[opStackOfs] = r;
-				programCounter = *(int *)&image[ programStack ];
-//				vm->callLevel = temp;
-#ifdef DEBUG_VM
-				if ( vm_debugLevel ) {
-					Com_Printf( "%s<--- %s\n", DEBUGSTR, VM_ValueToSymbol( vm, programCounter ) );
+			*(int *)&image[ programStack + 4 ] = -1 - v1;
+
+			// the vm has ints on the stack, we expect
+			// pointers so we might have to convert it
+			if (sizeof(intptr_t) != sizeof(int)) {
+				intptr_t argarr[ MAX_VMSYSCALL_ARGS ];
+				int *imagePtr = (int *)&image[ programStack ];
+				int i;
+				for (i = 0; i < ARRAY_LEN(argarr); ++i) {
+					argarr[i] = *(++imagePtr);
 				}
-#endif
-			} else if ( (unsigned)programCounter >= vm->instructionCount ) {
-				Com_Error( ERR_DROP, "VM program counter out of range in OP_CALL" );
-				return 0;
+				r = vm->systemCall( argarr );
 			} else {
-				programCounter = vm->instructionPointers[ programCounter ];
+				intptr_t* argptr = (intptr_t *)&image[ programStack + 4 ];
+				r = vm->systemCall( argptr );
 			}
-			goto nextInstruction;
-
-		// push and pop are only needed for discarded or bad function return values
-		case OP_PUSH:
-			opStackOfs++;
-			goto nextInstruction;
-		case OP_POP:
-			opStackOfs--;
-			goto nextInstruction;
 
-		case OP_ENTER:
 #ifdef DEBUG_VM
-			profileSymbol = VM_ValueToFunctionSymbol( vm, programCounter );
-#endif
-			// get size of stack frame
-			v1 = r2;
+			// this is just our stack frame pointer, only needed
+			// for debugging
+			*(int *)&image[ programStack + 4 ] = stomped;
 
-			programCounter += 1;
-			programStack -= v1;
-#ifdef DEBUG_VM
-			// save old stack frame for debugging traces
-			*(int *)&image[programStack+4] = programStack + v1;
 			if ( vm_debugLevel ) {
-				Com_Printf( "%s---> %s\n", DEBUGSTR, VM_ValueToSymbol( vm, programCounter - 5 ) );
-				if ( vm->breakFunction && programCounter - 5 == vm->breakFunction ) {
-					// this is to allow setting breakpoints here in the debugger
-					vm->breakCount++;
-//					vm_debugLevel = 2;
-//					VM_StackTrace( vm, programCounter, programStack );
-				}
-//				vm->callLevel++;
+				Com_Printf( "%s<--- %s\n", DEBUGSTR, VM_ValueToSymbol( vm, ip - code ) );
 			}
 #endif
-			goto nextInstruction;
-		case OP_LEAVE:
-			// remove our stack frame
-			v1 = r2;
-
-			programStack += v1;
+			// save return value
+			PUSH( r );
+			DISPATCH();
+		}
 
-			// grab the saved program counter
-			programCounter = *(int *)&image[ programStack ];
+		if ( (unsigned)v1 >= vm->instructionCount ) {
+			Com_Error( ERR_DROP, "VM program counter out of range in OP_CALL" );
+		}
+		ip = code + v1;
+		DISPATCH();
+
+	// push and pop are only needed for discarded or bad function return values
+	CASE( OP_PUSH )
+		PUSH( 0 );
+		ip++;
+		DISPATCH();
+	CASE( OP_POP )
+		POP();
+		ip++;
+		DISPATCH();
+
+	CASE( OP_ENTER )
+		if ( vm->profile ) {
+			VM_ProfileEnter( vm, ip - code );
+		}
+		// get size of stack frame
+		v1 = ip->arg;
+		programStack -= v1;
 #ifdef DEBUG_VM
-			profileSymbol = VM_ValueToFunctionSymbol( vm, programCounter );
-			if ( vm_debugLevel ) {
-//				vm->callLevel--;
-				Com_Printf( "%s<--- %s\n", DEBUGSTR, VM_ValueToSymbol( vm, programCounter ) );
+		profileSymbol = VM_ValueToFunctionSymbol( vm, ip - code );
+		// save old stack frame for debugging traces
+		*(int *)&image[programStack+4] = programStack + v1;
+		if ( vm_debugLevel ) {
+			Com_Printf( "%s---> %s\n", DEBUGSTR, VM_ValueToSymbol( vm, ip - code ) );
+			if ( vm->breakFunction && ip - code == vm->breakFunction ) {
+				// this is to allow setting breakpoints here in the debugger
+				vm->breakCount++;
 			}
+		}
 #endif
-			// check for leaving the VM
-			if ( programCounter == -1 ) {
-				goto done;
-			} else if ( (unsigned)programCounter >= vm->codeLength ) {
-				Com_Error( ERR_DROP, "VM program counter out of range in OP_LEAVE" );
-				return 0;
-			}
-			goto nextInstruction;
-
-		/*
-		===================================================================
-		BRANCHES
-		===================================================================
-		*/
-
-		case OP_JUMP:
-			if ( (unsigned)r0 >= vm->instructionCount )
-			{
-				Com_Error( ERR_DROP, "VM program counter out of range in OP_JUMP" );
-				return 0;
-			}
-
-			programCounter = vm->instructionPointers[ r0 ];
-
-			opStackOfs--;
-			goto nextInstruction;
-
-		case OP_EQ:
-			opStackOfs -= 2;
-			if ( r1 == r0 ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_NE:
-			opStackOfs -= 2;
-			if ( r1 != r0 ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_LTI:
-			opStackOfs -= 2;
-			if ( r1 < r0 ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_LEI:
-			opStackOfs -= 2;
-			if ( r1 <= r0 ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_GTI:
-			opStackOfs -= 2;
-			if ( r1 > r0 ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_GEI:
-			opStackOfs -= 2;
-			if ( r1 >= r0 ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_LTU:
-			opStackOfs -= 2;
-			if ( ((unsigned)r1) < ((unsigned)r0) ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_LEU:
-			opStackOfs -= 2;
-			if ( ((unsigned)r1) <= ((unsigned)r0) ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_GTU:
-			opStackOfs -= 2;
-			if ( ((unsigned)r1) > ((unsigned)r0) ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_GEU:
-			opStackOfs -= 2;
-			if ( ((unsigned)r1) >= ((unsigned)r0) ) {
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_EQF:
-			opStackOfs -= 2;
-			
-			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] == ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
-			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_NEF:
-			opStackOfs -= 2;
-
-			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] != ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
-			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_LTF:
-			opStackOfs -= 2;
-
-			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] < ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
-			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_LEF:
-			opStackOfs -= 2;
-
-			if(((float *) opStack)[(uint8_t) ((uint8_t) (opStackOfs + 1))] <= ((float *) opStack)[(uint8_t) ((uint8_t) (opStackOfs + 2))])
-			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_GTF:
-			opStackOfs -= 2;
-
-			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] > ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
-			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
-		case OP_GEF:
-			opStackOfs -= 2;
-
-			if(((float *) opStack)[(uint8_t) (opStackOfs + 1)] >= ((float *) opStack)[(uint8_t) (opStackOfs + 2)])
-			{
-				programCounter = r2;	//vm->instructionPointers[r2];
-				goto nextInstruction;
-			} else {
-				programCounter += 1;
-				goto nextInstruction;
-			}
-
+		ip++;
+		DISPATCH();
+	CASE( OP_LEAVE )
+		if ( vm->profile ) {
+			VM_ProfileLeave( vm );
+		}
+		// remove our stack frame
+		programStack += ip->arg;
 
-		//===================================================================
-
-		case OP_NEGI:
-			opStack[opStackOfs] = -r0;
-			goto nextInstruction;
-		case OP_ADD:
-			opStackOfs--;
-			opStack[opStackOfs] = r1 + r0;
-			goto nextInstruction;
-		case OP_SUB:
-			opStackOfs--;
-			opStack[opStackOfs] = r1 - r0;
-			goto nextInstruction;
-		case OP_DIVI:
-			opStackOfs--;
-			opStack[opStackOfs] = r1 / r0;
-			goto nextInstruction;
-		case OP_DIVU:
-			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) / ((unsigned) r0);
-			goto nextInstruction;
-		case OP_MODI:
-			opStackOfs--;
-			opStack[opStackOfs] = r1 % r0;
-			goto nextInstruction;
-		case OP_MODU:
-			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) % ((unsigned) r0);
-			goto nextInstruction;
-		case OP_MULI:
-			opStackOfs--;
-			opStack[opStackOfs] = r1 * r0;
-			goto nextInstruction;
-		case OP_MULU:
-			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) * ((unsigned) r0);
-			goto nextInstruction;
-
-		case OP_BAND:
-			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) & ((unsigned) r0);
-			goto nextInstruction;
-		case OP_BOR:
-			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) | ((unsigned) r0);
-			goto nextInstruction;
-		case OP_BXOR:
-			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) ^ ((unsigned) r0);
-			goto nextInstruction;
-		case OP_BCOM:
-			opStack[opStackOfs] = ~((unsigned) r0);
-			goto nextInstruction;
-
-		case OP_LSH:
-			opStackOfs--;
-			opStack[opStackOfs] = r1 << r0;
-			goto nextInstruction;
-		case OP_RSHI:
-			opStackOfs--;
-			opStack[opStackOfs] = r1 >> r0;
-			goto nextInstruction;
-		case OP_RSHU:
-			opStackOfs--;
-			opStack[opStackOfs] = ((unsigned) r1) >> r0;
-			goto nextInstruction;
-
-		case OP_NEGF:
-			((float *) opStack)[opStackOfs] =  -((float *) opStack)[opStackOfs];
-			goto nextInstruction;
-		case OP_ADDF:
-			opStackOfs--;
-			((float *) opStack)[opStackOfs] = ((float *) opStack)[opStackOfs] + ((float *) opStack)[(uint8_t) (opStackOfs + 1)];
-			goto nextInstruction;
-		case OP_SUBF:
-			opStackOfs--;
-			((float *) opStack)[opStackOfs] = ((float *) opStack)[opStackOfs] - ((float *) opStack)[(uint8_t) (opStackOfs + 1)];
-			goto nextInstruction;
-		case OP_DIVF:
-			opStackOfs--;
-			((float *) opStack)[opStackOfs] = ((float *) opStack)[opStackOfs] / ((float *) opStack)[(uint8_t) (opStackOfs + 1)];
-			goto nextInstruction;
-		case OP_MULF:
-			opStackOfs--;
-			((float *) opStack)[opStackOfs] = ((float *) opStack)[opStackOfs] * ((float *) opStack)[(uint8_t) (opStackOfs + 1)];
-			goto nextInstruction;
-
-		case OP_CVIF:
-			((float *) opStack)[opStackOfs] = (float) opStack[opStackOfs];
-			goto nextInstruction;
-		case OP_CVFI:
-			opStack[opStackOfs] = Q_ftol(((float *) opStack)[opStackOfs]);
-			goto nextInstruction;
-		case OP_SEX8:
-			opStack[opStackOfs] = (signed char) opStack[opStackOfs];
-			goto nextInstruction;
-		case OP_SEX16:
-			opStack[opStackOfs] = (short) opStack[opStackOfs];
-			goto nextInstruction;
+		// grab the saved program counter
+		v1 = *(int *)&image[ programStack ];
+#ifdef DEBUG_VM
+		profileSymbol = VM_ValueToFunctionSymbol( vm, v1 );
+		if ( vm_debugLevel ) {
+			Com_Printf( "%s<--- %s\n", DEBUGSTR, VM_ValueToSymbol( vm, v1 ) );
 		}
+#endif
+		// check for leaving the VM
+		if ( v1 == -1 ) {
+			goto done;
+		} else if ( (unsigned)v1 >= vm->instructionCount ) {
+			Com_Error( ERR_DROP, "VM program counter out of range in OP_LEAVE" );
+		}
+		ip = code + v1;
+		DISPATCH();
+
+	/*
+	===================================================================
+	BRANCHES
+	===================================================================
+	*/
+
+	CASE( OP_JUMP )
+		if ( (unsigned)tos.i >= vm->instructionCount ) {
+			Com_Error( ERR_DROP, "VM program counter out of range in OP_JUMP" );
+		}
+		ip = code + tos.i;
+		POP();
+		DISPATCH();
+	CASE( OP_CONST_JUMP )
+		ip = code + ip->arg;
+		DISPATCH();
+
+	CASE( OP_EQ )
+		BRANCH( NOS.i == tos.i );
+	CASE( OP_NE )
+		BRANCH( NOS.i != tos.i );
+	CASE( OP_LTI )
+		BRANCH( NOS.i < tos.i );
+	CASE( OP_LEI )
+		BRANCH( NOS.i <= tos.i );
+	CASE( OP_GTI )
+		BRANCH( NOS.i > tos.i );
+	CASE( OP_GEI )
+		BRANCH( NOS.i >= tos.i );
+	CASE( OP_LTU )
+		BRANCH( NOS.ui < tos.ui );
+	CASE( OP_LEU )
+		BRANCH( NOS.ui <= tos.ui );
+	CASE( OP_GTU )
+		BRANCH( NOS.ui > tos.ui );
+	CASE( OP_GEU )
+		BRANCH( NOS.ui >= tos.ui );
+	CASE( OP_EQF )
+		BRANCH( NOS.f == tos.f );
+	CASE( OP_NEF )
+		BRANCH( NOS.f != tos.f );
+	CASE( OP_LTF )
+		BRANCH( NOS.f < tos.f );
+	CASE( OP_LEF )
+		BRANCH( NOS.f <= tos.f );
+	CASE( OP_GTF )
+		BRANCH( NOS.f > tos.f );
+	CASE( OP_GEF )
+		BRANCH( NOS.f >= tos.f );
+
+	CASE( OP_CONST_EQ )
+		if ( tos.i == ip->arg ) {
+			POP();
+			ip = code + ip->arg2;
+		} else {
+			POP();
+			ip += 2;
+		}
+		DISPATCH();
+	CASE( OP_CONST_NE )
+		if ( tos.i != ip->arg ) {
+			POP();
+			ip = code + ip->arg2;
+		} else {
+			POP();
+			ip += 2;
+		}
+		DISPATCH();
+
+	//===================================================================
+
+	CASE( OP_NEGI )
+		tos.i = -tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_ADD )
+		opStackOfs--;
+		tos.i = opStack[ opStackOfs ].i + tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_CONST_ADD )
+		tos.i += ip->arg;
+		ip += 2;
+		DISPATCH();
+	CASE( OP_SUB )
+		opStackOfs--;
+		tos.i = opStack[ opStackOfs ].i - tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_DIVI )
+		opStackOfs--;
+		tos.i = opStack[ opStackOfs ].i / tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_DIVU )
+		opStackOfs--;
+		tos.ui = opStack[ opStackOfs ].ui / tos.ui;
+		ip++;
+		DISPATCH();
+	CASE( OP_MODI )
+		opStackOfs--;
+		tos.i = opStack[ opStackOfs ].i % tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_MODU )
+		opStackOfs--;
+		tos.ui = opStack[ opStackOfs ].ui % tos.ui;
+		ip++;
+		DISPATCH();
+	CASE( OP_MULI )
+		opStackOfs--;
+		tos.i = opStack[ opStackOfs ].i * tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_MULU )
+		opStackOfs--;
+		tos.ui = opStack[ opStackOfs ].ui * tos.ui;
+		ip++;
+		DISPATCH();
+
+	CASE( OP_BAND )
+		opStackOfs--;
+		tos.ui = opStack[ opStackOfs ].ui & tos.ui;
+		ip++;
+		DISPATCH();
+	CASE( OP_BOR )
+		opStackOfs--;
+		tos.ui = opStack[ opStackOfs ].ui | tos.ui;
+		ip++;
+		DISPATCH();
+	CASE( OP_BXOR )
+		opStackOfs--;
+		tos.ui = opStack[ opStackOfs ].ui ^ tos.ui;
+		ip++;
+		DISPATCH();
+	CASE( OP_BCOM )
+		tos.ui = ~tos.ui;
+		ip++;
+		DISPATCH();
+
+	CASE( OP_LSH )
+		opStackOfs--;
+		tos.i = opStack[ opStackOfs ].i << tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_RSHI )
+		opStackOfs--;
+		tos.i = opStack[ opStackOfs ].i >> tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_RSHU )
+		opStackOfs--;
+		tos.ui = opStack[ opStackOfs ].ui >> tos.i;
+		ip++;
+		DISPATCH();
+
+	CASE( OP_NEGF )
+		tos.f = -tos.f;
+		ip++;
+		DISPATCH();
+	CASE( OP_ADDF )
+		opStackOfs--;
+		tos.f = opStack[ opStackOfs ].f + tos.f;
+		ip++;
+		DISPATCH();
+	CASE( OP_SUBF )
+		opStackOfs--;
+		tos.f = opStack[ opStackOfs ].f - tos.f;
+		ip++;
+		DISPATCH();
+	CASE( OP_DIVF )
+		opStackOfs--;
+		tos.f = opStack[ opStackOfs ].f / tos.f;
+		ip++;
+		DISPATCH();
+	CASE( OP_MULF )
+		opStackOfs--;
+		tos.f = opStack[ opStackOfs ].f * tos.f;
+		ip++;
+		DISPATCH();
+
+	CASE( OP_CVIF )
+		tos.f = (float)tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_CVFI )
+		tos.i = Q_ftol( tos.f );
+		ip++;
+		DISPATCH();
+	CASE( OP_SEX8 )
+		tos.i = (signed char)tos.i;
+		ip++;
+		DISPATCH();
+	CASE( OP_SEX16 )
+		tos.i = (short)tos.i;
+		ip++;
+		DISPATCH();
+
+	CASE( OP_LOCAL_LOAD4 )
+		PUSH( *(int *)&image[ ( ip->arg + programStack ) & dataMask ] );
+		ip += 2;
+		DISPATCH();
+
+#ifndef VM_THREADED
 	}
+#endif
 
 done:
 	vm->currentlyInterpreting = qfalse;
 
-	if (opStackOfs != 1 || *opStack != 0xDEADBEEF)
-		Com_Error(ERR_DROP, "Interpreter error: opStack[0] = %X, opStackOfs = %d", opStack[0], opStackOfs);
+	if ( opStackOfs != 1 || opStack[0].ui != 0xDEADBEEF )
+		Com_Error( ERR_DROP, "Interpreter error: opStack[0] = %X, opStackOfs = %d", opStack[0].ui, opStackOfs );
 
 	vm->programStack = stackOnEntry;
 
 	// return the result
-	return opStack[opStackOfs];
+	return tos.i;
 }
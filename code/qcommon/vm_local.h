@@ -138,6 +138,8 @@ typedef struct vmSymbol_s {
 	char	symName[1];		// variable sized
 } vmSymbol_t;
 
+typedef struct vmProfile_s vmProfile_t;		// vm_profile.c
+
 #define	VM_OFFSET_PROGRAM_STACK		0
 #define	VM_OFFSET_SYSTEM_CALL		4
 
@@ -183,11 +185,15 @@ struct vm_s {
 
 	byte		*jumpTableTargets;
 	int			numJumpTableTargets;
+
+	vmProfile_t	*profile;		// set when loaded with vm_profile
 };
 
 
 extern	vm_t	*currentVM;
 extern	int		vm_debugLevel;
+extern	cvar_t	*vm_optimize;
+extern	cvar_t	*vm_profile;
 
 void VM_Compile( vm_t *vm, vmHeader_t *header );
 int	VM_CallCompiled( vm_t *vm, int *args );
@@ -201,3 +207,11 @@ const char *VM_ValueToSymbol( vm_t *vm, int value );
 void VM_LogSyscalls( int *args );
 
 void VM_BlockCopy(unsigned int dest, unsigned int src, size_t n);
+
+void VM_ProfileCreate( vm_t *vm, vmHeader_t *header );
+void VM_ProfileBegin( vm_t *vm );
+void VM_ProfileEnter( vm_t *vm, int instruction );
+void VM_ProfileLeave( vm_t *vm );
+void VM_ProfileReset( vm_t *vm );
+void VM_ProfilePrint( vm_t *vm );
+void VM_ProfileWriteFolded( vm_t *vm, const char *filename );
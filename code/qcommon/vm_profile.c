@@ -0,0 +1,443 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// vm_profile.c -- per function timing of QVM code
+
+/*
+A VM loaded while vm_profile is set gets a call on every OP_ENTER and
+OP_LEAVE, from the interpreter or from the code made by the x86 compilers.
+The calls keep a shadow stack of the running functions and charge the time
+between them to the function on top, and to its path in a call tree that
+is written out as folded stacks for flamegraph.pl.
+
+Recording follows vm_profile at the start of every outermost VM_Call, so
+it can be switched off and on without reloading the VM.  Time spent in
+system calls belongs to the function that made them.
+*/
+
+#include "vm_local.h"
+
+#define	MAX_PROFILE_DEPTH	256
+#define	MAX_PROFILE_NODES	16384
+
+typedef struct {
+	int			instruction;	// the OP_ENTER
+	const char	*name;			// symbol, looked up when first reported
+	int			calls;
+	int			active;			// recursive calls on the stack
+	int64_t		inclusive;		// nanoseconds
+	int64_t		exclusive;
+} vmProfileFunc_t;
+
+typedef struct {
+	int			func;
+	int			parent;
+	int			child;			// first callee, 0 for none
+	int			sibling;
+	int64_t		time;			// exclusive time spent on this call path
+} vmProfileNode_t;
+
+typedef struct {
+	int			func;
+	int			node;
+	int64_t		start;
+	int64_t		children;		// time spent in the functions it called
+} vmProfileFrame_t;
+
+struct vmProfile_s {
+	qboolean	recording;
+	int			*funcForInstruction;
+
+	int			numFuncs;
+	vmProfileFunc_t	*funcs;
+
+	// nodes[0] is the root of the call tree
+	int			numNodes;
+	vmProfileNode_t	*nodes;
+
+	// the depth keeps counting past MAX_PROFILE_DEPTH, deeper calls are
+	// charged to the last frame that fit
+	int			depth;
+	vmProfileFrame_t	frames[MAX_PROFILE_DEPTH];
+
+	int			vmCalls;		// outermost VM_Calls while recording
+	int64_t		total;
+};
+
+/*
+==============
+VM_ProfileCreate
+
+Called before the code is compiled or prepared, so the backends can
+check vm->profile for adding the hooks
+==============
+*/
+void VM_ProfileCreate( vm_t *vm, vmHeader_t *header ) {
+	vmProfile_t	*profile;
+	byte		*code;
+	int			pc, instruction, op;
+
+	profile = Hunk_Alloc( sizeof( *profile ), h_high );
+	profile->funcForInstruction = Hunk_Alloc( header->instructionCount * sizeof( int ), h_high );
+
+	// every OP_ENTER starts a function
+	code = (byte *)header + header->codeOffset;
+	pc = 0;
+	for ( instruction = 0 ; instruction < header->instructionCount && pc < header->codeLength ; instruction++ ) {
+		op = code[pc++];
+		profile->funcForInstruction[instruction] = -1;
+		if ( op == OP_ENTER ) {
+			profile->funcForInstruction[instruction] = profile->numFuncs++;
+		}
+
+		// skip the operands
+		switch ( op ) {
+		case OP_ENTER:
+		case OP_CONST:
+		case OP_LOCAL:
+		case OP_LEAVE:
+		case OP_EQ:
+		case OP_NE:
+		case OP_LTI:
+		case OP_LEI:
+		case OP_GTI:
+		case OP_GEI:
+		case OP_LTU:
+		case OP_LEU:
+		case OP_GTU:
+		case OP_GEU:
+		case OP_EQF:
+		case OP_NEF:
+		case OP_LTF:
+		case OP_LEF:
+		case OP_GTF:
+		case OP_GEF:
+		case OP_BLOCK_COPY:
+			pc += 4;
+			break;
+		case OP_ARG:
+			pc++;
+			break;
+		default:
+			break;
+		}
+	}
+
+	profile->funcs = Hunk_Alloc( ( profile->numFuncs + 1 ) * sizeof( *profile->funcs ), h_high );
+	for ( instruction = 0 ; instruction < header->instructionCount ; instruction++ ) {
+		if ( profile->funcForInstruction[instruction] >= 0 ) {
+			profile->funcs[ profile->funcForInstruction[instruction] ].instruction = instruction;
+		}
+	}
+
+	profile->nodes = Hunk_Alloc( MAX_PROFILE_NODES * sizeof( *profile->nodes ), h_high );
+	profile->numNodes = 1;
+	profile->nodes[0].func = -1;
+
+	vm->profile = profile;
+}
+
+/*
+==============
+VM_ProfileBegin
+
+Called by VM_Call when entering the VM from outside.  A VM_Call that
+was left with an error may have left frames on the stack.
+==============
+*/
+void VM_ProfileBegin( vm_t *vm ) {
+	vmProfile_t	*profile = vm->profile;
+	int			i;
+
+	for ( i = 0 ; i < profile->depth && i < MAX_PROFILE_DEPTH ; i++ ) {
+		profile->funcs[ profile->frames[i].func ].active--;
+	}
+	profile->depth = 0;
+
+	profile->recording = vm_profile->integer ? qtrue : qfalse;
+	if ( profile->recording ) {
+		profile->vmCalls++;
+	}
+}
+
+/*
+==============
+VM_ProfileChild
+
+Finds or adds the call tree node for func called from parent
+==============
+*/
+static int VM_ProfileChild( vmProfile_t *profile, int parent, int func ) {
+	vmProfileNode_t	*node;
+	int				n;
+
+	for ( n = profile->nodes[parent].child ; n ; n = profile->nodes[n].sibling ) {
+		if ( profile->nodes[n].func == func ) {
+			return n;
+		}
+	}
+
+	// out of nodes, the time stays with the caller
+	if ( profile->numNodes == MAX_PROFILE_NODES ) {
+		return parent;
+	}
+
+	n = profile->numNodes++;
+	node = &profile->nodes[n];
+	node->func = func;
+	node->parent = parent;
+	node->child = 0;
+	node->sibling = profile->nodes[parent].child;
+	node->time = 0;
+	profile->nodes[parent].child = n;
+
+	return n;
+}
+
+/*
+==============
+VM_ProfileEnter
+
+instruction is the OP_ENTER being run
+==============
+*/
+void VM_ProfileEnter( vm_t *vm, int instruction ) {
+	vmProfile_t			*profile = vm->profile;
+	vmProfileFrame_t	*frame;
+	int					func, parent;
+
+	if ( !profile->recording ) {
+		return;
+	}
+
+	if ( profile->depth >= MAX_PROFILE_DEPTH ) {
+		profile->depth++;
+		return;
+	}
+
+	func = profile->funcForInstruction[instruction];
+	parent = profile->depth ? profile->frames[ profile->depth - 1 ].node : 0;
+
+	frame = &profile->frames[ profile->depth++ ];
+	frame->func = func;
+	frame->node = VM_ProfileChild( profile, parent, func );
+	frame->children = 0;
+
+	profile->funcs[func].calls++;
+	profile->funcs[func].active++;
+
+	frame->start = Sys_Nanoseconds();
+}
+
+/*
+==============
+VM_ProfileLeave
+==============
+*/
+void VM_ProfileLeave( vm_t *vm ) {
+	vmProfile_t			*profile = vm->profile;
+	vmProfileFrame_t	*frame;
+	vmProfileFunc_t		*func;
+	int64_t				now, elapsed;
+
+	if ( !profile->recording || !profile->depth ) {
+		return;
+	}
+
+	now = Sys_Nanoseconds();
+
+	if ( --profile->depth >= MAX_PROFILE_DEPTH ) {
+		return;
+	}
+
+	frame = &profile->frames[ profile->depth ];
+	elapsed = now - frame->start;
+
+	func = &profile->funcs[ frame->func ];
+	func->exclusive += elapsed - frame->children;
+	// recursive calls are already part of the outermost one
+	if ( !--func->active ) {
+		func->inclusive += elapsed;
+	}
+	profile->nodes[ frame->node ].time += elapsed - frame->children;
+
+	if ( profile->depth ) {
+		profile->frames[ profile->depth - 1 ].children += elapsed;
+	} else {
+		profile->total += elapsed;
+	}
+}
+
+/*
+==============
+VM_ProfileReset
+==============
+*/
+void VM_ProfileReset( vm_t *vm ) {
+	vmProfile_t	*profile = vm->profile;
+	int			i;
+
+	if ( vm->callLevel ) {
+		Com_Printf( "%s is running\n", vm->name );
+		return;
+	}
+
+	for ( i = 0 ; i < profile->numFuncs ; i++ ) {
+		profile->funcs[i].calls = 0;
+		profile->funcs[i].inclusive = 0;
+		profile->funcs[i].exclusive = 0;
+	}
+
+	profile->numNodes = 1;
+	profile->nodes[0].child = 0;
+	profile->vmCalls = 0;
+	profile->total = 0;
+}
+
+/*
+==============
+VM_ProfileFuncName
+
+Symbol values were converted to code offsets by VM_LoadSymbols, so the
+function is found by its converted entry point
+==============
+*/
+static const char *VM_ProfileFuncName( vm_t *vm, vmProfileFunc_t *func ) {
+	vmSymbol_t	*sym;
+	int			value;
+
+	if ( func->name ) {
+		return func->name;
+	}
+
+	value = vm->instructionPointers[ func->instruction ];
+	for ( sym = vm->symbols ; sym ; sym = sym->next ) {
+		if ( sym->symValue == value ) {
+			func->name = sym->symName;
+			return func->name;
+		}
+	}
+
+	return va( "func_%i", func->instruction );
+}
+
+static vmProfileFunc_t	*sortFuncs;
+
+static int QDECL VM_ProfileSortExclusive( const void *a, const void *b ) {
+	int64_t	ta, tb;
+
+	ta = sortFuncs[ *(const int *)a ].exclusive;
+	tb = sortFuncs[ *(const int *)b ].exclusive;
+
+	if ( ta > tb ) {
+		return -1;
+	}
+	if ( ta < tb ) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+==============
+VM_ProfilePrint
+
+Lists the functions that were called, the most expensive first
+==============
+*/
+void VM_ProfilePrint( vm_t *vm ) {
+	vmProfile_t		*profile = vm->profile;
+	vmProfileFunc_t	*func;
+	int				*sorted;
+	int				i, count;
+	double			total;
+
+	sorted = Z_Malloc( ( profile->numFuncs + 1 ) * sizeof( *sorted ) );
+	count = 0;
+	for ( i = 0 ; i < profile->numFuncs ; i++ ) {
+		if ( profile->funcs[i].calls ) {
+			sorted[count++] = i;
+		}
+	}
+
+	sortFuncs = profile->funcs;
+	qsort( sorted, count, sizeof( *sorted ), VM_ProfileSortExclusive );
+
+	total = profile->total ? (double)profile->total : 1.0;
+
+	Com_Printf( " excl%%   excl msec   incl msec      calls  function\n" );
+	for ( i = 0 ; i < count ; i++ ) {
+		func = &profile->funcs[ sorted[i] ];
+		Com_Printf( "%5.1f%% %11.3f %11.3f %10i  %s\n", 100.0 * func->exclusive / total,
+			func->exclusive / 1000000.0, func->inclusive / 1000000.0, func->calls,
+			VM_ProfileFuncName( vm, func ) );
+	}
+
+	Com_Printf( "%.3f msec in %i calls to %s, %i of %i call paths\n", profile->total / 1000000.0,
+		profile->vmCalls, vm->name, profile->numNodes - 1, MAX_PROFILE_NODES - 1 );
+
+	Z_Free( sorted );
+}
+
+/*
+==============
+VM_ProfileWriteFolded
+
+One line per call path with its exclusive time in nanoseconds, the
+input format of flamegraph.pl
+==============
+*/
+void VM_ProfileWriteFolded( vm_t *vm, const char *filename ) {
+	vmProfile_t		*profile = vm->profile;
+	fileHandle_t	f;
+	int				path[MAX_PROFILE_DEPTH];
+	int				i, n, depth, lines;
+
+	f = FS_FOpenFileWrite( filename );
+	if ( !f ) {
+		Com_Printf( "couldn't open %s\n", filename );
+		return;
+	}
+
+	lines = 0;
+	for ( i = 1 ; i < profile->numNodes ; i++ ) {
+		if ( profile->nodes[i].time <= 0 ) {
+			continue;
+		}
+
+		// nodes are only added below the frames on the stack, so
+		// a path is never longer than MAX_PROFILE_DEPTH
+		depth = 0;
+		for ( n = i ; n ; n = profile->nodes[n].parent ) {
+			path[depth++] = profile->nodes[n].func;
+		}
+
+		while ( depth-- ) {
+			FS_Printf( f, "%s%s", VM_ProfileFuncName( vm, &profile->funcs[ path[depth] ] ), depth ? ";" : "" );
+		}
+		FS_Printf( f, " %lld\n", (long long)profile->nodes[i].time );
+		lines++;
+	}
+
+	FS_FCloseFile( f );
+
+	Com_Printf( "wrote %i call paths to %s\n", lines, filename );
+}
@@ -86,7 +86,9 @@ typedef enum
 typedef enum
 {
 	VM_JMP_VIOLATION = 0,
-	VM_BLOCK_COPY = 1
+	VM_BLOCK_COPY = 1,
+	VM_PROFILE_ENTER = 2,
+	VM_PROFILE_LEAVE = 3
 } ESysCallType;
 
 static	ELastCommand	LastCommand;
@@ -453,6 +455,12 @@ static void DoSyscall(void)
 			
 			VM_BlockCopy(vm_opStackBase[(vm_opStackOfs - 1)], vm_opStackBase[vm_opStackOfs], vm_arg);
 		break;
+		case VM_PROFILE_ENTER:
+			VM_ProfileEnter(savedVM, vm_arg);
+		break;
+		case VM_PROFILE_LEAVE:
+			VM_ProfileLeave(savedVM);
+		break;
 		default:
 			Com_Error(ERR_DROP, "Unknown VM operation %d", vm_syscallNum);
 		break;
@@ -560,6 +568,25 @@ static void EmitCallErrJump(vm_t *vm, int sysCallOfs)
 	EmitCallRel(vm, sysCallOfs);
 }
 
+/*
+=================
+EmitCallProfile
+Report entering or leaving a function to the profiler. DoSyscall saves
+everything but eax.
+=================
+*/
+
+static void EmitCallProfile(vm_t *vm, int type, int instr, int sysCallOfs)
+{
+	EmitString("50");			// push eax
+	EmitString("B8");			// mov eax, 0x12345678
+	Emit4(type);
+	EmitString("B9");			// mov ecx, 0x12345678
+	Emit4(instr);
+	EmitCallRel(vm, sysCallOfs);
+	EmitString("58");			// pop eax
+}
+
 /*
 =================
 EmitCallProcedure
@@ -1064,51 +1091,1317 @@ qboolean ConstOptimize(vm_t *vm, int callProcOfsSyscall)
 	return qfalse;
 }
 
+/*
+===============================================================================
+
+REGISTER ALLOCATED OPSTACK
+
+With vm_optimize 1 the x86_64 compiler keeps up to VS_MAX_ITEMS entries from
+the top of the opStack in r10 - r15, or as constants and local addresses that
+are only known at compile time, instead of going through memory for every
+opcode.  Constants are folded into the instructions that use them and
+comparisons are fused with their conditional jump.
+
+The cached entries are written back to the memory opStack before anything
+that can be reached from somewhere else or leaves the current function: jump
+targets, function entry points, jumps, calls, returns and block copies.  So
+every instruction another piece of code can continue at sees the same opStack
+as it would with the one to one translation.  This needs the jump table
+targets of a VM_MAGIC_VER2 file, older files always get the plain
+translation.
+
+===============================================================================
+*/
+
+// also the number of opStack entries a flush writes past ebx before adding it
+#define VS_MAX_ITEMS	8
+
+#if idx64
+
+enum {
+	X64_EAX, X64_ECX, X64_EDX, X64_EBX, X64_ESP, X64_EBP, X64_ESI, X64_EDI,
+	X64_R8, X64_R9, X64_R10, X64_R11, X64_R12, X64_R13, X64_R14, X64_R15
+};
+
+typedef enum {
+	VS_REG,			// in a register
+	VS_CONST,		// known at compile time
+	VS_LOCAL		// programStack + value
+} vsType_t;
+
+typedef struct {
+	vsType_t	type;
+	int			reg;
+	int			value;
+} vsItem_t;
+
+// r12 - r15 are saved by VM_CallCompiled, r10 and r11 are scratch in both
+// calling conventions and the cache is always empty across calls
+static const int vsRegs[] = { X64_R10, X64_R11, X64_R12, X64_R13, X64_R14, X64_R15 };
+
+static vsItem_t	vsStack[VS_MAX_ITEMS];	// [0] is the deepest cached entry
+static int		vsDepth;
+static int		vsUsed;					// bit mask of allocated registers
+
 /*
 =================
-VM_Compile
+EmitRex
+Emits a REX prefix if any of the registers needs one
 =================
 */
-void VM_Compile(vm_t *vm, vmHeader_t *header)
+static void EmitRex(int reg, int index, int base)
 {
-	int		op;
-	int		maxLength;
-	int		v;
-	int		i;
-        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+	int rex;
 
-	jusedSize = header->instructionCount + 2;
+	rex = 0x40 | ((reg & 8) >> 1) | ((index & 8) >> 2) | ((base & 8) >> 3);
+	if(rex != 0x40)
+		Emit1(rex);
+}
 
-	// allocate a very large temp buffer, we will shrink it later
-	maxLength = header->codeLength * 8 + 64;
-	buf = Z_Malloc(maxLength);
-	jused = Z_Malloc(jusedSize);
-	code = Z_Malloc(header->codeLength+32);
-	
-	Com_Memset(jused, 0, jusedSize);
-	Com_Memset(buf, 0, maxLength);
+/*
+=================
+EmitOpcode
+One or two byte (0F xx) opcode
+=================
+*/
+static void EmitOpcode(int opcode)
+{
+	if(opcode > 0xFF)
+		Emit1(opcode >> 8);
+	Emit1(opcode & 0xFF);
+}
 
-	// copy code in larger buffer and put some zeros at the end
-	// so we can safely look ahead for a few instructions in it
-	// without a chance to get false-positive because of some garbage bytes
-	Com_Memset(code, 0, header->codeLength+32);
-	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
+/*
+=================
+EmitRegReg
+opcode reg, rm with both operands in registers
+=================
+*/
+static void EmitRegReg(int prefix, int opcode, int reg, int rm)
+{
+	if(prefix)
+		Emit1(prefix);
+	EmitRex(reg, 0, rm);
+	EmitOpcode(opcode);
+	Emit1(0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
 
-	// ensure that the optimisation pass knows about all the jump
-	// table targets
-	pc = -1; // a bogus value to be printed in out-of-bounds error messages
-	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
-		JUSED( *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) ) );
+/*
+=================
+EmitRegImm
+Group 1 operation (add, or, and, sub, xor, cmp) of a register and an immediate
+=================
+*/
+static void EmitRegImm(int ext, int rm, int v)
+{
+	EmitRex(0, 0, rm);
+	if(iss8(v))
+	{
+		Emit1(0x83);
+		Emit1(0xC0 | (ext << 3) | (rm & 7));
+		Emit1(v);
+	}
+	else
+	{
+		Emit1(0x81);
+		Emit1(0xC0 | (ext << 3) | (rm & 7));
+		Emit4(v);
 	}
+}
 
-	// Start buffer with x86-VM specific procedures
-	compiledOfs = 0;
+/*
+=================
+EmitMovRegImm
+=================
+*/
+static void EmitMovRegImm(int reg, int v)
+{
+	EmitRex(0, 0, reg);
+	Emit1(0xB8 | (reg & 7));			// mov reg, 0x12345678
+	Emit4(v);
+}
 
-	callDoSyscallOfs = compiledOfs;
-	callProcOfs = EmitCallDoSyscall(vm);
-	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
-	vm->entryOfs = compiledOfs;
+/*
+=================
+EmitMovRegReg
+=================
+*/
+static void EmitMovRegReg(int dst, int src)
+{
+	if(dst != src)
+		EmitRegReg(0, 0x89, src, dst);		// mov dst, src
+}
+
+/*
+=================
+EmitLeaLocal
+lea reg, [esi + v]
+=================
+*/
+static void EmitLeaLocal(int reg, int v)
+{
+	EmitRex(reg, 0, 0);
+	Emit1(0x8D);
+	Emit1(0x86 | ((reg & 7) << 3));
+	Emit4(v);
+}
+
+/*
+=================
+EmitOpStack
+opcode reg, dword ptr disp[edi + ebx * 4]
+=================
+*/
+static void EmitOpStack(int opcode, int reg, int disp)
+{
+	EmitRex(reg, 0, 0);
+	Emit1(opcode);
+	if(disp)
+	{
+		Emit1(0x44 | ((reg & 7) << 3));
+		Emit1(0x9F);
+		Emit1(disp);
+	}
+	else
+	{
+		Emit1(0x04 | ((reg & 7) << 3));
+		Emit1(0x9F);
+	}
+}
+
+/*
+=================
+EmitDataIndex
+opcode reg, [r9 + index], index has to be masked already
+=================
+*/
+static void EmitDataIndex(int prefix, int opcode, int reg, int index)
+{
+	if(prefix)
+		Emit1(prefix);
+	EmitRex(reg, index, X64_R9);
+	EmitOpcode(opcode);
+	Emit1(0x04 | ((reg & 7) << 3));
+	Emit1(((index & 7) << 3) | (X64_R9 & 7));
+}
+
+/*
+=================
+EmitDataConst
+opcode reg, [r9 + ofs]
+=================
+*/
+static void EmitDataConst(int prefix, int opcode, int reg, int ofs)
+{
+	if(prefix)
+		Emit1(prefix);
+	EmitRex(reg, 0, X64_R9);
+	EmitOpcode(opcode);
+	Emit1(0x80 | ((reg & 7) << 3) | (X64_R9 & 7));
+	Emit4(ofs);
+}
+
+/*
+=================
+VS_Release
+=================
+*/
+static void VS_Release(const vsItem_t *item)
+{
+	if(item->type == VS_REG)
+		vsUsed &= ~(1 << item->reg);
+}
+
+/*
+=================
+VS_Reset
+Nothing is cached after a jump or a call
+=================
+*/
+static void VS_Reset(void)
+{
+	vsDepth = 0;
+	vsUsed = 0;
+}
+
+/*
+=================
+VS_StoreItem
+Writes an entry to the memory opStack without touching any register
+=================
+*/
+static void VS_StoreItem(const vsItem_t *item, int disp)
+{
+	switch(item->type)
+	{
+	case VS_REG:
+		EmitOpStack(0x89, item->reg, disp);		// mov dword ptr disp[edi + ebx * 4], reg
+		break;
+	case VS_CONST:
+		EmitOpStack(0xC7, 0, disp);			// mov dword ptr disp[edi + ebx * 4], 0x12345678
+		Emit4(item->value);
+		break;
+	case VS_LOCAL:
+		EmitOpStack(0x89, X64_ESI, disp);		// mov dword ptr disp[edi + ebx * 4], esi
+		EmitOpStack(0x81, 0, disp);			// add dword ptr disp[edi + ebx * 4], 0x12345678
+		Emit4(item->value);
+		break;
+	}
+}
+
+/*
+=================
+VS_SpillBottom
+Moves the deepest cached entry to the memory opStack
+=================
+*/
+static void VS_SpillBottom(void)
+{
+	STACK_PUSH(1);					// add bl, 1
+	VS_StoreItem(&vsStack[0], 0);
+	VS_Release(&vsStack[0]);
+
+	vsDepth--;
+	memmove(vsStack, vsStack + 1, vsDepth * sizeof(vsStack[0]));
+}
+
+/*
+=================
+VS_Flush
+Moves all cached entries to the memory opStack
+=================
+*/
+static void VS_Flush(void)
+{
+	int i;
+
+	if(!vsDepth)
+		return;
+
+	for(i = 0; i < vsDepth; i++)
+	{
+		VS_StoreItem(&vsStack[i], (i + 1) * 4);
+		VS_Release(&vsStack[i]);
+	}
+
+	STACK_PUSH(vsDepth);				// add bl, vsDepth
+	vsDepth = 0;
+}
+
+/*
+=================
+VS_AllocReg
+=================
+*/
+static int VS_AllocReg(void)
+{
+	int i;
+
+	for(;;)
+	{
+		for(i = 0; i < (int)ARRAY_LEN(vsRegs); i++)
+		{
+			if(!(vsUsed & (1 << vsRegs[i])))
+			{
+				vsUsed |= 1 << vsRegs[i];
+				return vsRegs[i];
+			}
+		}
+
+		// at most two registers are held by operands being worked on,
+		// everything else belongs to the cache
+		VS_SpillBottom();
+	}
+}
 
+/*
+=================
+VS_Push
+=================
+*/
+static void VS_Push(vsType_t type, int reg, int value)
+{
+	if(vsDepth == VS_MAX_ITEMS)
+		VS_SpillBottom();
+
+	vsStack[vsDepth].type = type;
+	vsStack[vsDepth].reg = reg;
+	vsStack[vsDepth].value = value;
+	vsDepth++;
+}
+
+/*
+=================
+VS_Pop
+Takes the top entry, reading it from the memory opStack if nothing is cached.
+A register it is in stays allocated until released.
+=================
+*/
+static void VS_Pop(vsItem_t *item)
+{
+	if(vsDepth)
+	{
+		*item = vsStack[--vsDepth];
+		return;
+	}
+
+	item->type = VS_REG;
+	item->reg = VS_AllocReg();
+	item->value = 0;
+
+	EmitOpStack(0x8B, item->reg, 0);		// mov reg, dword ptr [edi + ebx * 4]
+	STACK_POP(1);					// sub bl, 1
+}
+
+/*
+=================
+VS_ToReg
+Moves an entry into a register of its own that can be modified
+=================
+*/
+static int VS_ToReg(vsItem_t *item)
+{
+	if(item->type == VS_REG)
+		return item->reg;
+
+	item->reg = VS_AllocReg();
+	if(item->type == VS_CONST)
+		EmitMovRegImm(item->reg, item->value);
+	else
+		EmitLeaLocal(item->reg, item->value);
+
+	item->type = VS_REG;
+	return item->reg;
+}
+
+/*
+=================
+VS_Scratch
+Returns a register with the value of an entry, either its own or the
+given scratch register, which must not be modified
+=================
+*/
+static int VS_Scratch(const vsItem_t *item, int scratch)
+{
+	switch(item->type)
+	{
+	case VS_REG:
+		return item->reg;
+	case VS_CONST:
+		EmitMovRegImm(scratch, item->value);
+		return scratch;
+	default:
+		EmitLeaLocal(scratch, item->value);
+		return scratch;
+	}
+}
+
+/*
+=================
+VS_FoldInt
+Evaluates an integer operation on two constants the way x86 would
+=================
+*/
+static qboolean VS_FoldInt(int op, int a, int b, int *result)
+{
+	switch(op)
+	{
+	case OP_ADD: *result = (int)((unsigned)a + (unsigned)b); return qtrue;
+	case OP_SUB: *result = (int)((unsigned)a - (unsigned)b); return qtrue;
+	case OP_MULI:
+	case OP_MULU: *result = (int)((unsigned)a * (unsigned)b); return qtrue;
+	case OP_BAND: *result = a & b; return qtrue;
+	case OP_BOR: *result = a | b; return qtrue;
+	case OP_BXOR: *result = a ^ b; return qtrue;
+	case OP_LSH: *result = (int)((unsigned)a << (b & 31)); return qtrue;
+	case OP_RSHU: *result = (int)((unsigned)a >> (b & 31)); return qtrue;
+	case OP_RSHI:
+		// right shift of negative values is implementation defined in C
+		*result = a < 0 ? ~(~a >> (b & 31)) : a >> (b & 31);
+		return qtrue;
+	case OP_DIVU:
+	case OP_MODU:
+		if(!b)
+			return qfalse;
+		*result = (int)(op == OP_DIVU ? (unsigned)a / (unsigned)b : (unsigned)a % (unsigned)b);
+		return qtrue;
+	case OP_DIVI:
+	case OP_MODI:
+		// leave the faults to run time
+		if(!b || (a == INT_MIN && b == -1))
+			return qfalse;
+		*result = op == OP_DIVI ? a / b : a % b;
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
+/*
+=================
+VS_CompareInt
+=================
+*/
+static qboolean VS_CompareInt(int op, int a, int b)
+{
+	switch(op)
+	{
+	case OP_EQ: return a == b;
+	case OP_NE: return a != b;
+	case OP_LTI: return a < b;
+	case OP_LEI: return a <= b;
+	case OP_GTI: return a > b;
+	case OP_GEI: return a >= b;
+	case OP_LTU: return (unsigned)a < (unsigned)b;
+	case OP_LEU: return (unsigned)a <= (unsigned)b;
+	case OP_GTU: return (unsigned)a > (unsigned)b;
+	default: return (unsigned)a >= (unsigned)b;
+	}
+}
+
+/*
+=================
+VS_SwapCompare
+The comparison to use with its operands exchanged
+=================
+*/
+static int VS_SwapCompare(int op)
+{
+	switch(op)
+	{
+	case OP_LTI: return OP_GTI;
+	case OP_LEI: return OP_GEI;
+	case OP_GTI: return OP_LTI;
+	case OP_GEI: return OP_LEI;
+	case OP_LTU: return OP_GTU;
+	case OP_LEU: return OP_GEU;
+	case OP_GTU: return OP_LTU;
+	case OP_GEU: return OP_LEU;
+	default: return op;
+	}
+}
+
+/*
+=================
+VS_CompileIntOp
+ADD, SUB, MULI, MULU, BAND, BOR, BXOR
+=================
+*/
+static void VS_CompileIntOp(int op)
+{
+	static const int immExt[] = { 0, 5, 4, 1, 6 };		// add, sub, and, or, xor
+	static const int regOp[] = { 0x01, 0x29, 0x21, 0x09, 0x31 };
+	vsItem_t a, b, t;
+	int index, ra, rb, v;
+
+	VS_Pop(&b);
+	VS_Pop(&a);
+
+	if(a.type == VS_CONST && b.type == VS_CONST)
+	{
+		VS_FoldInt(op, a.value, b.value, &v);
+		VS_Push(VS_CONST, 0, v);
+		return;
+	}
+
+	// let the operand that is already in a register take the result
+	if(op != OP_SUB && a.type != VS_REG && b.type == VS_REG)
+	{
+		t = a;
+		a = b;
+		b = t;
+	}
+
+	ra = VS_ToReg(&a);
+
+	if(op == OP_MULI || op == OP_MULU)
+	{
+		if(b.type == VS_CONST)
+		{
+			EmitRex(ra, 0, ra);
+			if(iss8(b.value))
+			{
+				Emit1(0x6B);			// imul ra, ra, 0x7F
+				Emit1(0xC0 | ((ra & 7) << 3) | (ra & 7));
+				Emit1(b.value);
+			}
+			else
+			{
+				Emit1(0x69);			// imul ra, ra, 0x12345678
+				Emit1(0xC0 | ((ra & 7) << 3) | (ra & 7));
+				Emit4(b.value);
+			}
+		}
+		else
+		{
+			rb = VS_Scratch(&b, X64_ECX);
+			EmitRegReg(0, 0x0FAF, ra, rb);	// imul ra, rb
+		}
+	}
+	else
+	{
+		switch(op)
+		{
+		case OP_ADD: index = 0; break;
+		case OP_SUB: index = 1; break;
+		case OP_BAND: index = 2; break;
+		case OP_BOR: index = 3; break;
+		default: index = 4; break;
+		}
+
+		if(b.type == VS_CONST)
+			EmitRegImm(immExt[index], ra, b.value);	// op ra, 0x12345678
+		else
+		{
+			rb = VS_Scratch(&b, X64_ECX);
+			EmitRegReg(0, regOp[index], rb, ra);	// op ra, rb
+		}
+	}
+
+	VS_Release(&b);
+	VS_Push(VS_REG, ra, 0);
+}
+
+/*
+=================
+VS_CompileDivOp
+DIVI, DIVU, MODI, MODU
+=================
+*/
+static void VS_CompileDivOp(int op)
+{
+	vsItem_t a, b;
+	int r, v;
+
+	VS_Pop(&b);
+	VS_Pop(&a);
+
+	if(a.type == VS_CONST && b.type == VS_CONST && VS_FoldInt(op, a.value, b.value, &v))
+	{
+		VS_Push(VS_CONST, 0, v);
+		return;
+	}
+
+	r = VS_Scratch(&b, X64_ECX);
+	EmitMovRegReg(X64_EAX, VS_Scratch(&a, X64_EAX));
+
+	if(op == OP_DIVI || op == OP_MODI)
+	{
+		EmitString("99");			// cdq
+		EmitRegReg(0, 0xF7, 7, r);		// idiv r
+	}
+	else
+	{
+		EmitString("31 D2");			// xor edx, edx
+		EmitRegReg(0, 0xF7, 6, r);		// div r
+	}
+
+	VS_Release(&a);
+	VS_Release(&b);
+
+	r = VS_AllocReg();
+	if(op == OP_DIVI || op == OP_DIVU)
+		EmitMovRegReg(r, X64_EAX);
+	else
+		EmitMovRegReg(r, X64_EDX);
+	VS_Push(VS_REG, r, 0);
+}
+
+/*
+=================
+VS_CompileShiftOp
+LSH, RSHI, RSHU
+=================
+*/
+static void VS_CompileShiftOp(int op)
+{
+	vsItem_t a, b;
+	int ext, ra, v;
+
+	VS_Pop(&b);
+	VS_Pop(&a);
+
+	if(a.type == VS_CONST && b.type == VS_CONST)
+	{
+		VS_FoldInt(op, a.value, b.value, &v);
+		VS_Push(VS_CONST, 0, v);
+		return;
+	}
+
+	if(op == OP_LSH)
+		ext = 4;
+	else if(op == OP_RSHI)
+		ext = 7;
+	else
+		ext = 5;
+
+	ra = VS_ToReg(&a);
+
+	if(b.type == VS_CONST)
+	{
+		if(b.value & 31)
+		{
+			EmitRex(0, 0, ra);
+			Emit1(0xC1);				// shl/sar/shr ra, 0x12
+			Emit1(0xC0 | (ext << 3) | (ra & 7));
+			Emit1(b.value & 31);
+		}
+	}
+	else
+	{
+		EmitMovRegReg(X64_ECX, VS_Scratch(&b, X64_ECX));
+		EmitRegReg(0, 0xD3, ext, ra);		// shl/sar/shr ra, cl
+	}
+
+	VS_Release(&b);
+	VS_Push(VS_REG, ra, 0);
+}
+
+/*
+=================
+VS_CompileFloatOp
+ADDF, SUBF, MULF, DIVF
+=================
+*/
+static void VS_CompileFloatOp(int op)
+{
+	vsItem_t a, b;
+	floatint_t fa, fb;
+	int r, sse;
+
+	VS_Pop(&b);
+	VS_Pop(&a);
+
+	if(a.type == VS_CONST && b.type == VS_CONST)
+	{
+		fa.i = a.value;
+		fb.i = b.value;
+		switch(op)
+		{
+		case OP_ADDF: fa.f = fa.f + fb.f; break;
+		case OP_SUBF: fa.f = fa.f - fb.f; break;
+		case OP_MULF: fa.f = fa.f * fb.f; break;
+		default: fa.f = fa.f / fb.f; break;
+		}
+		VS_Push(VS_CONST, 0, fa.i);
+		return;
+	}
+
+	switch(op)
+	{
+	case OP_ADDF: sse = 0x0F58; break;
+	case OP_SUBF: sse = 0x0F5C; break;
+	case OP_MULF: sse = 0x0F59; break;
+	default: sse = 0x0F5E; break;
+	}
+
+	EmitRegReg(0x66, 0x0F6E, 0, VS_Scratch(&a, X64_EAX));	// movd xmm0, a
+	EmitRegReg(0x66, 0x0F6E, 1, VS_Scratch(&b, X64_ECX));	// movd xmm1, b
+	EmitRegReg(0xF3, sse, 0, 1);				// addss/subss/mulss/divss xmm0, xmm1
+
+	VS_Release(&a);
+	VS_Release(&b);
+
+	r = VS_AllocReg();
+	EmitRegReg(0x66, 0x0F7E, 0, r);				// movd r, xmm0
+	VS_Push(VS_REG, r, 0);
+}
+
+/*
+=================
+VS_CompileUnaryOp
+SEX8, SEX16, NEGI, BCOM, NEGF, CVIF, CVFI
+=================
+*/
+static void VS_CompileUnaryOp(int op)
+{
+	vsItem_t a;
+	floatint_t f;
+	int r;
+
+	VS_Pop(&a);
+
+	if(a.type == VS_CONST && op != OP_CVFI)
+	{
+		switch(op)
+		{
+		case OP_SEX8: a.value = (signed char)a.value; break;
+		case OP_SEX16: a.value = (short)a.value; break;
+		case OP_NEGI: a.value = (int)(0u - (unsigned)a.value); break;
+		case OP_BCOM: a.value = ~a.value; break;
+		case OP_NEGF: a.value ^= 0x80000000; break;
+		default:
+			f.f = (float)a.value;
+			a.value = f.i;
+			break;
+		}
+		VS_Push(VS_CONST, 0, a.value);
+		return;
+	}
+
+	r = VS_ToReg(&a);
+
+	switch(op)
+	{
+	case OP_SEX8:
+		EmitRegReg(0, 0x0FBE, r, r);			// movsx r, r8
+		break;
+	case OP_SEX16:
+		EmitRegReg(0, 0x0FBF, r, r);			// movsx r, r16
+		break;
+	case OP_NEGI:
+		EmitRegReg(0, 0xF7, 3, r);			// neg r
+		break;
+	case OP_BCOM:
+		EmitRegReg(0, 0xF7, 2, r);			// not r
+		break;
+	case OP_NEGF:
+		EmitRex(0, 0, r);
+		Emit1(0x81);					// xor r, 0x80000000
+		Emit1(0xF0 | (r & 7));
+		Emit4(0x80000000);
+		break;
+	case OP_CVIF:
+		EmitRegReg(0xF3, 0x0F2A, 0, r);			// cvtsi2ss xmm0, r
+		EmitRegReg(0x66, 0x0F7E, 0, r);			// movd r, xmm0
+		break;
+	default:
+		// truncate like Q_VMftol
+		EmitRegReg(0x66, 0x0F6E, 0, r);			// movd xmm0, r
+		EmitRegReg(0xF3, 0x0F2C, r, 0);			// cvttss2si r, xmm0
+		break;
+	}
+
+	VS_Push(VS_REG, r, 0);
+}
+
+/*
+=================
+VS_CompileLoad
+LOAD1, LOAD2, LOAD4
+=================
+*/
+static void VS_CompileLoad(vm_t *vm, int op)
+{
+	vsItem_t a;
+	int opcode, r;
+
+	if(op == OP_LOAD4)
+		opcode = 0x8B;					// mov
+	else if(op == OP_LOAD2)
+		opcode = 0x0FB7;				// movzx word
+	else
+		opcode = 0x0FB6;				// movzx byte
+
+	VS_Pop(&a);
+
+	if(a.type == VS_CONST)
+	{
+		r = VS_AllocReg();
+		EmitDataConst(0, opcode, r, a.value & vm->dataMask);	// mov r, [r9 + 0x12345678]
+	}
+	else
+	{
+		r = VS_ToReg(&a);
+		EmitRegImm(4, r, vm->dataMask);			// and r, vm->dataMask
+		EmitDataIndex(0, opcode, r, r);			// mov r, [r9 + r]
+	}
+
+	VS_Push(VS_REG, r, 0);
+}
+
+/*
+=================
+VS_CompileStore
+STORE1, STORE2, STORE4
+=================
+*/
+static void VS_CompileStore(vm_t *vm, int op)
+{
+	vsItem_t a, v;
+	int prefix, opcode, ra, rv, size;
+
+	size = (op == OP_STORE4) ? 4 : (op == OP_STORE2) ? 2 : 1;
+	prefix = (size == 2) ? 0x66 : 0;
+
+	VS_Pop(&v);
+	VS_Pop(&a);
+
+	rv = 0;
+	if(v.type == VS_CONST)
+		opcode = (size == 1) ? 0xC6 : 0xC7;		// mov [], 0x12345678
+	else
+	{
+		opcode = (size == 1) ? 0x88 : 0x89;		// mov [], rv
+		rv = VS_Scratch(&v, X64_EDX);
+	}
+
+	if(a.type == VS_CONST)
+		EmitDataConst(prefix, opcode, rv, a.value & vm->dataMask);
+	else
+	{
+		ra = (a.type == VS_REG) ? a.reg : VS_Scratch(&a, X64_EAX);
+		EmitRegImm(4, ra, vm->dataMask);		// and ra, vm->dataMask
+		EmitDataIndex(prefix, opcode, rv, ra);
+	}
+
+	if(v.type == VS_CONST)
+	{
+		if(size == 4)
+			Emit4(v.value);
+		else if(size == 2)
+			Emit2(v.value);
+		else
+			Emit1(v.value & 0xFF);
+	}
+
+	VS_Release(&a);
+	VS_Release(&v);
+}
+
+/*
+=================
+VS_CompileArg
+=================
+*/
+static void VS_CompileArg(vm_t *vm, int ofs)
+{
+	vsItem_t v;
+	int rv;
+
+	VS_Pop(&v);
+
+	rv = (v.type == VS_CONST) ? 0 : VS_Scratch(&v, X64_EDX);
+
+	EmitLeaLocal(X64_EAX, ofs);				// lea eax, [esi + ofs]
+	EmitRegImm(4, X64_EAX, vm->dataMask);		// and eax, vm->dataMask
+
+	if(v.type == VS_CONST)
+	{
+		EmitDataIndex(0, 0xC7, 0, X64_EAX);		// mov dword ptr [r9 + eax], 0x12345678
+		Emit4(v.value);
+	}
+	else
+		EmitDataIndex(0, 0x89, rv, X64_EAX);		// mov dword ptr [r9 + eax], rv
+
+	VS_Release(&v);
+}
+
+/*
+=================
+VS_CompileCompare
+Integer comparison and conditional jump
+=================
+*/
+static void VS_CompileCompare(vm_t *vm, int op, int dest)
+{
+	static const char *jcc[] = {
+		"0F 84", "0F 85", "0F 8C", "0F 8E", "0F 8F", "0F 8D", "0F 82", "0F 86", "0F 87", "0F 83"
+	};
+	vsItem_t a, b, t;
+	int ra;
+
+	VS_Pop(&b);
+	VS_Pop(&a);
+
+	if(a.type == VS_CONST && b.type == VS_CONST)
+	{
+		if(VS_CompareInt(op, a.value, b.value))
+		{
+			VS_Flush();
+			EmitJumpIns(vm, "E9", dest);		// jmp 0x12345678
+			VS_Reset();
+		}
+		return;
+	}
+
+	VS_Flush();
+
+	if(a.type == VS_CONST)
+	{
+		t = a;
+		a = b;
+		b = t;
+		op = VS_SwapCompare(op);
+	}
+
+	ra = VS_Scratch(&a, X64_EAX);
+	if(b.type == VS_CONST)
+		EmitRegImm(7, ra, b.value);			// cmp ra, 0x12345678
+	else
+		EmitRegReg(0, 0x39, VS_Scratch(&b, X64_ECX), ra);	// cmp ra, rb
+
+	EmitJumpIns(vm, jcc[op - OP_EQ], dest);		// j?? 0x12345678
+
+	VS_Release(&a);
+	VS_Release(&b);
+}
+
+/*
+=================
+VS_CompileCompareF
+Float comparison and conditional jump, NaNs compare like they do in C
+=================
+*/
+static void VS_CompileCompareF(vm_t *vm, int op, int dest)
+{
+	vsItem_t a, b;
+
+	VS_Pop(&b);
+	VS_Pop(&a);
+	VS_Flush();
+
+	EmitRegReg(0x66, 0x0F6E, 0, VS_Scratch(&a, X64_EAX));	// movd xmm0, a
+	EmitRegReg(0x66, 0x0F6E, 1, VS_Scratch(&b, X64_ECX));	// movd xmm1, b
+
+	VS_Release(&a);
+	VS_Release(&b);
+
+	switch(op)
+	{
+	case OP_EQF:
+		EmitString("0F 2E C1");				// ucomiss xmm0, xmm1
+		EmitString("7A 06");				// jp +6
+		EmitJumpIns(vm, "0F 84", dest);			// je 0x12345678
+		break;
+	case OP_NEF:
+		EmitString("0F 2E C1");				// ucomiss xmm0, xmm1
+		EmitJumpIns(vm, "0F 8A", dest);			// jp 0x12345678
+		EmitJumpIns(vm, "0F 85", dest);			// jne 0x12345678
+		break;
+	case OP_LTF:
+		EmitString("0F 2E C8");				// ucomiss xmm1, xmm0
+		EmitJumpIns(vm, "0F 87", dest);			// ja 0x12345678
+		break;
+	case OP_LEF:
+		EmitString("0F 2E C8");				// ucomiss xmm1, xmm0
+		EmitJumpIns(vm, "0F 83", dest);			// jae 0x12345678
+		break;
+	case OP_GTF:
+		EmitString("0F 2E C1");				// ucomiss xmm0, xmm1
+		EmitJumpIns(vm, "0F 87", dest);			// ja 0x12345678
+		break;
+	default:
+		EmitString("0F 2E C1");				// ucomiss xmm0, xmm1
+		EmitJumpIns(vm, "0F 83", dest);			// jae 0x12345678
+		break;
+	}
+}
+
+/*
+=================
+VS_FindJumpTargets
+Marks every instruction that can be reached other than by falling through
+from the previous one, before any code is generated
+=================
+*/
+static void VS_FindJumpTargets(vm_t *vm, vmHeader_t *header)
+{
+	int i, op, v;
+
+	pc = 0;
+	for(i = 0; i < header->instructionCount && pc < header->codeLength; i++)
+	{
+		op = code[pc++];
+		switch(op)
+		{
+		case OP_CONST:
+			v = Constant4();
+			if(code[pc] == OP_JUMP || (code[pc] == OP_CALL && v >= 0))
+				JUSED(v);
+			break;
+		case OP_EQ: case OP_NE:
+		case OP_LTI: case OP_LEI: case OP_GTI: case OP_GEI:
+		case OP_LTU: case OP_LEU: case OP_GTU: case OP_GEU:
+		case OP_EQF: case OP_NEF:
+		case OP_LTF: case OP_LEF: case OP_GTF: case OP_GEF:
+			v = Constant4();
+			JUSED(v);
+			break;
+		case OP_ENTER:
+		case OP_LEAVE:
+		case OP_LOCAL:
+		case OP_BLOCK_COPY:
+			pc += 4;
+			break;
+		case OP_ARG:
+			pc += 1;
+			break;
+		default:
+			break;
+		}
+	}
+}
+
+/*
+=================
+VS_Compile
+Translates the whole program with the register allocated opStack, returns
+qfalse if the code didn't fit and the plain translation should be used
+=================
+*/
+static qboolean VS_Compile(vm_t *vm, vmHeader_t *header, int maxLength,
+	int callProcOfs, int callProcOfsSyscall, int callDoSyscallOfs)
+{
+	vsItem_t item;
+	int op;
+
+	VS_FindJumpTargets(vm, header);
+
+	for(pass = 0; pass < 3; pass++)
+	{
+		pc = 0;
+		instruction = 0;
+		compiledOfs = vm->entryOfs;
+		VS_Reset();
+
+		while(instruction < header->instructionCount)
+		{
+			// a single instruction with a full flush stays well below this
+			if(compiledOfs > maxLength - 256)
+				return qfalse;
+
+			if(pc > header->codeLength)
+			{
+				VMFREE_BUFFERS();
+				Com_Error(ERR_DROP, "VM_CompileX86: pc > header->codeLength");
+			}
+
+			op = code[pc];
+
+			// anything that jumps here expects all of the opStack in memory
+			if(jused[instruction] || op == OP_ENTER)
+				VS_Flush();
+
+			vm->instructionPointers[instruction] = compiledOfs;
+			instruction++;
+			pc++;
+
+			switch(op)
+			{
+			case 0:
+				break;
+			case OP_BREAK:
+				VS_Flush();
+				EmitString("CC");			// int 3
+				break;
+			case OP_ENTER:
+				if(vm->profile)
+					EmitCallProfile(vm, VM_PROFILE_ENTER, instruction - 1, callDoSyscallOfs);
+				EmitString("81 EE");			// sub esi, 0x12345678
+				Emit4(Constant4());
+				break;
+			case OP_LEAVE:
+				VS_Flush();
+				if(vm->profile)
+					EmitCallProfile(vm, VM_PROFILE_LEAVE, 0, callDoSyscallOfs);
+				EmitString("81 C6");			// add esi, 0x12345678
+				Emit4(Constant4());
+				EmitString("C3");			// ret
+				VS_Reset();
+				break;
+			case OP_CONST:
+				VS_Push(VS_CONST, 0, Constant4());
+				break;
+			case OP_LOCAL:
+				VS_Push(VS_LOCAL, 0, Constant4());
+				break;
+			case OP_PUSH:
+				// the value is never read
+				VS_Push(VS_CONST, 0, 0);
+				break;
+			case OP_POP:
+				if(vsDepth)
+				{
+					VS_Pop(&item);
+					VS_Release(&item);
+				}
+				else
+					STACK_POP(1);			// sub bl, 1
+				break;
+			case OP_ARG:
+				VS_CompileArg(vm, Constant1() & 0xFF);
+				break;
+
+			case OP_CALL:
+				if(vsDepth && vsStack[vsDepth - 1].type == VS_CONST)
+				{
+					VS_Pop(&item);
+					VS_Flush();
+					EmitCallConst(vm, item.value, callProcOfsSyscall);
+				}
+				else
+				{
+					VS_Flush();
+					EmitCallRel(vm, callProcOfs);
+				}
+				// the return value is on the memory opStack
+				VS_Reset();
+				break;
+
+			case OP_JUMP:
+				VS_Pop(&item);
+				if(item.type == VS_CONST)
+				{
+					VS_Flush();
+					EmitJumpIns(vm, "E9", item.value);	// jmp 0x12345678
+				}
+				else
+				{
+					EmitMovRegReg(X64_EAX, VS_Scratch(&item, X64_EAX));
+					VS_Flush();
+					EmitString("81 F8");			// cmp eax, vm->instructionCount
+					Emit4(vm->instructionCount);
+					EmitString("73 04");			// jae +4
+					EmitRexString(0x49, "FF 24 C0");	// jmp qword ptr [r8 + eax * 8]
+					EmitCallErrJump(vm, callDoSyscallOfs);
+				}
+				VS_Reset();
+				break;
+
+			case OP_EQ:
+			case OP_NE:
+			case OP_LTI:
+			case OP_LEI:
+			case OP_GTI:
+			case OP_GEI:
+			case OP_LTU:
+			case OP_LEU:
+			case OP_GTU:
+			case OP_GEU:
+				VS_CompileCompare(vm, op, Constant4());
+				break;
+			case OP_EQF:
+			case OP_NEF:
+			case OP_LTF:
+			case OP_LEF:
+			case OP_GTF:
+			case OP_GEF:
+				VS_CompileCompareF(vm, op, Constant4());
+				break;
+
+			case OP_LOAD1:
+			case OP_LOAD2:
+			case OP_LOAD4:
+				VS_CompileLoad(vm, op);
+				break;
+			case OP_STORE1:
+			case OP_STORE2:
+			case OP_STORE4:
+				VS_CompileStore(vm, op);
+				break;
+
+			case OP_BLOCK_COPY:
+				VS_Flush();
+				EmitString("B8");			// mov eax, 0x12345678
+				Emit4(VM_BLOCK_COPY);
+				EmitString("B9");			// mov ecx, 0x12345678
+				Emit4(Constant4());
+				EmitCallRel(vm, callDoSyscallOfs);
+				STACK_POP(2);				// sub bl, 2
+				break;
+
+			case OP_SEX8:
+			case OP_SEX16:
+			case OP_NEGI:
+			case OP_BCOM:
+			case OP_NEGF:
+			case OP_CVIF:
+			case OP_CVFI:
+				VS_CompileUnaryOp(op);
+				break;
+
+			case OP_ADD:
+			case OP_SUB:
+			case OP_MULI:
+			case OP_MULU:
+			case OP_BAND:
+			case OP_BOR:
+			case OP_BXOR:
+				VS_CompileIntOp(op);
+				break;
+			case OP_DIVI:
+			case OP_DIVU:
+			case OP_MODI:
+			case OP_MODU:
+				VS_CompileDivOp(op);
+				break;
+			case OP_LSH:
+			case OP_RSHI:
+			case OP_RSHU:
+				VS_CompileShiftOp(op);
+				break;
+
+			case OP_ADDF:
+			case OP_SUBF:
+			case OP_MULF:
+			case OP_DIVF:
+				VS_CompileFloatOp(op);
+				break;
+
+			default:
+				VMFREE_BUFFERS();
+				Com_Error(ERR_DROP, "VM_CompileX86: bad opcode %i at offset %i", op, pc);
+			}
+		}
+	}
+
+	return qtrue;
+}
+#endif
+
+/*
+=================
+VM_Compile
+=================
+*/
+void VM_Compile(vm_t *vm, vmHeader_t *header)
+{
+	int		op;
+	int		maxLength;
+	int		v;
+	int		i;
+        int		callProcOfsSyscall, callProcOfs, callDoSyscallOfs;
+
+	jusedSize = header->instructionCount + 2;
+
+	// allocate a very large temp buffer, we will shrink it later
+	maxLength = header->codeLength * 8 + 64;
+	buf = Z_Malloc(maxLength);
+	jused = Z_Malloc(jusedSize);
+	code = Z_Malloc(header->codeLength+32);
+	
+	Com_Memset(jused, 0, jusedSize);
+	Com_Memset(buf, 0, maxLength);
+
+	// copy code in larger buffer and put some zeros at the end
+	// so we can safely look ahead for a few instructions in it
+	// without a chance to get false-positive because of some garbage bytes
+	Com_Memset(code, 0, header->codeLength+32);
+	Com_Memcpy(code, (byte *)header + header->codeOffset, header->codeLength );
+
+	// ensure that the optimisation pass knows about all the jump
+	// table targets
+	pc = -1; // a bogus value to be printed in out-of-bounds error messages
+	for( i = 0; i < vm->numJumpTableTargets; i++ ) {
+		JUSED( *(int *)(vm->jumpTableTargets + ( i * sizeof( int ) ) ) );
+	}
+
+	// Start buffer with x86-VM specific procedures
+	compiledOfs = 0;
+
+	callDoSyscallOfs = compiledOfs;
+	callProcOfs = EmitCallDoSyscall(vm);
+	callProcOfsSyscall = EmitCallProcedure(vm, callDoSyscallOfs);
+	vm->entryOfs = compiledOfs;
+
+#if idx64
+	if(vm_optimize->integer && vm->jumpTableTargets &&
+		VS_Compile(vm, header, maxLength, callProcOfs, callProcOfsSyscall, callDoSyscallOfs))
+	{
+	}
+	else
+#endif
 	for(pass=0; pass < 3; pass++) {
 	oc0 = -23423;
 	oc1 = -234354;
@@ -1155,6 +2448,8 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 			EmitString("CC");				// int 3
 			break;
 		case OP_ENTER:
+			if(vm->profile)
+				EmitCallProfile(vm, VM_PROFILE_ENTER, instruction - 1, callDoSyscallOfs);
 			EmitString("81 EE");				// sub esi, 0x12345678
 			Emit4(Constant4());
 			break;
@@ -1203,6 +2498,8 @@ void VM_Compile(vm_t *vm, vmHeader_t *header)
 			EmitCommand(LAST_COMMAND_SUB_BL_1);		// sub bl, 1
 			break;
 		case OP_LEAVE:
+			if(vm->profile)
+				EmitCallProfile(vm, VM_PROFILE_LEAVE, 0, callDoSyscallOfs);
 			v = Constant4();
 			EmitString("81 C6");				// add	esi, 0x12345678
 			Emit4(v);
@@ -1717,7 +3014,7 @@ extern uint8_t qvmcall64(int *programStack, int *opStack, intptr_t *instructionP
 
 int VM_CallCompiled(vm_t *vm, int *args)
 {
-	byte	stack[OPSTACK_SIZE + 15];
+	byte	stack[OPSTACK_SIZE + 15 + VS_MAX_ITEMS * 4];	// a flush of the register cache may write past the top
 	void	*entryPoint;
 	int		programStack, stackOnEntry;
 	byte	*image;
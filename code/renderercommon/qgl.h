@@ -244,7 +244,9 @@ extern void (APIENTRYP qglUnlockArraysEXT) (void);
 	GLE(const GLubyte *, GetStringi, GLenum name, GLuint index) \
 	GLE(void *, MapBufferRange, GLenum target, GLintptr offset, GLsizeiptr length, GLbitfield access) \
 	GLE(void, BindBufferBase, GLenum target, GLuint index, GLuint buffer) \
-	GLE(void, FramebufferTextureLayer, GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer)
+	GLE(void, FramebufferTextureLayer, GLenum target, GLenum attachment, GLuint texture, GLint level, GLint layer) \
+	GLE(void, TexImage3D, GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels) \
+	GLE(void, TexSubImage3D, GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels)
 
 // GL_ARB_framebuffer_object, built-in to OpenGL 3.0
 #define QGL_ARB_framebuffer_object_PROCS \
@@ -258,6 +260,7 @@ extern void (APIENTRYP qglUnlockArraysEXT) (void);
 	GLE(GLenum, CheckFramebufferStatus, GLenum target) \
 	GLE(void, FramebufferTexture2D, GLenum target, GLenum attachment, GLenum textarget, GLuint texture, GLint level) \
 	GLE(void, FramebufferRenderbuffer, GLenum target, GLenum attachment, GLenum renderbuffertarget, GLuint renderbuffer) \
+	GLE(void, GetFramebufferAttachmentParameteriv, GLenum target, GLenum attachment, GLenum pname, GLint *params) \
 	GLE(void, GenerateMipmap, GLenum target) \
 	GLE(void, BlitFramebuffer, GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter) \
 	GLE(void, RenderbufferStorageMultisample, GLenum target, GLsizei samples, GLenum internalformat, GLsizei width, GLsizei height) \
@@ -275,6 +278,9 @@ extern void (APIENTRYP qglUnlockArraysEXT) (void);
 
 #define QGL_3_2_PROCS \
 	GLE(void, FramebufferTexture, GLenum target, GLenum attachment, GLuint texture, GLint level) \
+	GLE(GLsync, FenceSync, GLenum condition, GLbitfield flags) \
+	GLE(GLenum, ClientWaitSync, GLsync sync, GLbitfield flags, GLuint64 timeout) \
+	GLE(void, DeleteSync, GLsync sync) \
 
 #define QGL_4_2_PROCS \
 	GLE(void, TexStorage3D, GLenum target, GLsizei levels, GLenum internalformat, GLsizei width, GLsizei height, GLsizei depth) \
@@ -284,8 +290,27 @@ extern void (APIENTRYP qglUnlockArraysEXT) (void);
 	GLE(void, InvalidateFramebuffer, GLenum target, GLsizei numAttachments, const GLenum * attachments) \
 
 #define QGL_4_5_PROCS \
+	GLE(void, GetTextureImage, GLuint texture, GLint level, GLenum format, GLenum type, GLsizei bufSize, void *pixels) \
 	GLE(void, BlitNamedFramebuffer, GLuint readFramebuffer, GLuint drawFramebuffer, GLint srcX0, GLint srcY0, GLint srcX1, GLint srcY1, GLint dstX0, GLint dstY0, GLint dstX1, GLint dstY1, GLbitfield mask, GLenum filter) \
 
+// OpenGL 4.1, OpenGL ES 3.0 or GL_ARB_get_program_binary
+#define QGL_ARB_get_program_binary_PROCS \
+	GLE(void, GetProgramBinary, GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary) \
+	GLE(void, ProgramBinary, GLuint program, GLenum binaryFormat, const void *binary, GLsizei length) \
+	GLE(void, ProgramParameteri, GLuint program, GLenum pname, GLint value) \
+
+// OpenGL 4.4 or GL_ARB_buffer_storage
+#define QGL_ARB_buffer_storage_PROCS \
+	GLE(void, BufferStorage, GLenum target, GLsizeiptr size, const void *data, GLbitfield flags) \
+
+// OpenGL 4.3, GL_ARB_multi_draw_indirect or GL_EXT_multi_draw_indirect
+#define QGL_ARB_multi_draw_indirect_PROCS \
+	GLE(void, MultiDrawElementsIndirect, GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride) \
+
+// GL_KHR_parallel_shader_compile
+#define QGL_KHR_parallel_shader_compile_PROCS \
+	GLE(void, MaxShaderCompilerThreadsKHR, GLuint count) \
+
 #define QGL_OVR_multiview_PROCS \
 	GLE(void, FramebufferTextureMultiviewOVR, GLenum target, GLenum attachment, GLuint texture, GLint level, GLint baseViewIndex, GLsizei numViews) \
 
@@ -322,6 +347,8 @@ extern void (APIENTRYP qglUnlockArraysEXT) (void);
 	GLE(GLvoid, TextureParameteriEXT, GLuint texture, GLenum target, GLenum pname, GLint param) \
 	GLE(GLvoid, TextureImage2DEXT, GLuint texture, GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLint border, GLenum format, GLenum type, const GLvoid *pixels) \
 	GLE(GLvoid, TextureSubImage2DEXT, GLuint texture, GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLenum type, const GLvoid *pixels) \
+	GLE(GLvoid, TextureImage3DEXT, GLuint texture, GLenum target, GLint level, GLint internalformat, GLsizei width, GLsizei height, GLsizei depth, GLint border, GLenum format, GLenum type, const GLvoid *pixels) \
+	GLE(GLvoid, TextureSubImage3DEXT, GLuint texture, GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width, GLsizei height, GLsizei depth, GLenum format, GLenum type, const GLvoid *pixels) \
 	GLE(GLvoid, CopyTextureSubImage2DEXT, GLuint texture, GLenum target, GLint level, GLint xoffset, GLint yoffset, GLint x, GLint y, GLsizei width, GLsizei height) \
 	GLE(GLvoid, CompressedTextureImage2DEXT, GLuint texture, GLenum target, GLint level, GLenum internalformat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const GLvoid *data) \
 	GLE(GLvoid, CompressedTextureSubImage2DEXT, GLuint texture, GLenum target, GLint level, GLint xoffset, GLint yoffset, GLsizei width, GLsizei height, GLenum format, GLsizei imageSize, const GLvoid *data) \
@@ -356,6 +383,10 @@ QGL_4_2_PROCS;
 QGL_4_3_PROCS;
 QGL_4_5_PROCS;
 QGL_OVR_multiview_PROCS;
+QGL_ARB_get_program_binary_PROCS;
+QGL_ARB_buffer_storage_PROCS;
+QGL_ARB_multi_draw_indirect_PROCS;
+QGL_KHR_parallel_shader_compile_PROCS;
 QGL_ARB_occlusion_query_PROCS;
 QGL_ARB_framebuffer_object_PROCS;
 QGL_ARB_vertex_array_object_PROCS;
@@ -44,6 +44,7 @@ typedef enum
 	IMGFLAG_NOLIGHTSCALE   = 0x0020,
 	IMGFLAG_CLAMPTOEDGE    = 0x0040,
 	IMGFLAG_GENNORMALMAP   = 0x0080,
+	IMGFLAG_ARRAY          = 0x0100,
 } imgFlags_t;
 
 typedef struct image_s {
@@ -159,6 +160,8 @@ IMPLEMENTATION SPECIFIC FUNCTIONS
 void		GLimp_Init( qboolean fixedFunction );
 void		GLimp_Shutdown( void );
 void		GLimp_EndFrame( void );
+void		GLimp_SwapBuffers( void );
+void		GLimp_UpdateFullscreen( void );
 
 void		GLimp_LogComment( char *comment );
 void		GLimp_Minimize(void);
@@ -167,5 +170,12 @@ void		GLimp_SetGamma( unsigned char red[256],
 		unsigned char green[256],
 		unsigned char blue[256] );
 
+// r_smp render thread
+qboolean	GLimp_SpawnRenderThread( void (*function)( void ) );
+void		GLimp_ShutdownRenderThread( void );
+void		*GLimp_RendererSleep( void );
+void		GLimp_FrontEndSleep( void );
+void		GLimp_WakeRenderer( void *data );
+
 
 #endif
@@ -24,7 +24,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 #include "tr_types.h"
 
-#define	REF_API_VERSION		8
+#define	REF_API_VERSION		11
 
 //
 // these are the functions exported by the refresh module
@@ -91,6 +91,13 @@ typedef struct {
 									   int mainSceneReadBuffer, int mainSceneWidth, int mainSceneHeight );
 	void	(*ScreenOverlayBufferStart)( qboolean clear );
 	void	(*ScreenOverlayBufferEnd)( void );
+	void	(*SetVRRenderBuffer)( int renderBuffer );
+
+	// with r_smp the back end runs on its own thread; callers that use GL
+	// outside the renderer must sync first, or hand the work to the
+	// renderer as frame callbacks (see RE_SetFrameCallbacks)
+	void	(*SyncRenderThread)( void );
+	qboolean (*SetFrameCallbacks)( void (*begin)( void *data ), void (*end)( void *data ), void *data );
 
 	int		(*MarkFragments)( int numPoints, const vec3_t *points, const vec3_t projection,
 				   int maxPoints, vec3_t pointBuffer, int maxFragments, markFragment_t *fragmentBuffer );
@@ -189,6 +196,17 @@ typedef struct {
 	void	(*Sys_GLimpSafeInit)( void );
 	void	(*Sys_GLimpInit)( void );
 	qboolean (*Sys_LowPhysicalMemory)( void );
+
+	// runs func over count items on up to numThreads threads of the
+	// common worker pool, returns once all of them have finished
+	void	(*Job_ParallelFor)( void (*func)( void *data, int index ), void *data, int count, int numThreads );
+	// raw files below the home path (or base path when reading), never
+	// from a pk3, for data the renderer caches for itself
+	long	(*FS_BaseDir_FOpenCacheFileRead)( const char *filename, fileHandle_t *fp );
+	fileHandle_t (*FS_BaseDir_FOpenFileWrite)( const char *filename );
+	int		(*FS_Read)( void *buffer, int len, fileHandle_t f );
+	int		(*FS_Write)( const void *buffer, int len, fileHandle_t f );
+	void	(*FS_FCloseFile)( fileHandle_t f );
 } refimport_t;
 
 
@@ -1,4 +1,8 @@
+#if defined(USE_LIGHTMAP_ARRAY)
+uniform sampler2DArray u_DiffuseMap;
+#else
 uniform sampler2D u_DiffuseMap;
+#endif
 
 uniform int       u_AlphaTest;
 uniform int       u_IsDrawingHUD;
@@ -6,13 +10,20 @@ uniform int       u_Is2DDraw;
 uniform int       u_IsBlending;
 
 varying vec2      var_DiffuseTex;
+#if defined(USE_LIGHTMAP_ARRAY)
+flat varying float var_LightmapLayer;
+#endif
 
 varying vec4      var_Color;
 
 
 void main()
 {
+#if defined(USE_LIGHTMAP_ARRAY)
+	vec4 color  = texture2D(u_DiffuseMap, vec3(var_DiffuseTex, var_LightmapLayer));
+#else
 	vec4 color  = texture2D(u_DiffuseMap, var_DiffuseTex);
+#endif
 
 	float alpha = color.a * var_Color.a;
 	if (u_AlphaTest == 1)
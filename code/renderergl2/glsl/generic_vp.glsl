@@ -12,7 +12,7 @@ attribute vec4 attr_BoneWeights;
 attribute vec4 attr_Color;
 attribute vec4 attr_TexCoord0;
 
-#if defined(USE_TCGEN)
+#if defined(USE_TCGEN) || defined(USE_LIGHTMAP_ARRAY)
 attribute vec4 attr_TexCoord1;
 #endif
 
@@ -81,6 +81,9 @@ layout(shared) uniform ProjectionMatrices
 };
 
 varying vec2   var_DiffuseTex;
+#if defined(USE_LIGHTMAP_ARRAY)
+flat varying float var_LightmapLayer;
+#endif
 varying vec4   var_Color;
 
 #if defined(USE_DEFORM_VERTEXES)
@@ -278,6 +281,10 @@ void main()
     var_DiffuseTex = tex;
 #endif
 
+#if defined(USE_LIGHTMAP_ARRAY)
+	var_LightmapLayer = attr_TexCoord1.p;
+#endif
+
 #if defined(USE_RGBAGEN)
 	var_Color = CalcColor(position, normal);
 #else
@@ -0,0 +1,33 @@
+#if defined(GL_ES)
+precision highp float;
+precision highp sampler2DArray;
+#endif
+
+uniform sampler2DArray u_TextureMap;
+
+// x, y = size of u_TextureMap, z = depth closer than this is dropped
+uniform vec4      u_ViewInfo;
+flat varying int  var_Layer;
+
+void main()
+{
+	ivec2 base = ivec2(gl_FragCoord.xy) * 4;
+	ivec2 last = ivec2(u_ViewInfo.xy) - 1;
+	float depth = 0.0;
+
+	for (int y = 0; y < 4; y++)
+	{
+		for (int x = 0; x < 4; x++)
+		{
+			float d = texelFetch(u_TextureMap, ivec3(min(base + ivec2(x, y), last), var_Layer), 0).r;
+
+			// near surfaces, the view model included, never occlude
+			if (d < u_ViewInfo.z)
+				d = 1.0;
+
+			depth = max(depth, d);
+		}
+	}
+
+	gl_FragColor = vec4(depth);
+}
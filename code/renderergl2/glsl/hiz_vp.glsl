@@ -0,0 +1,10 @@
+attribute vec3 attr_Position;
+
+flat varying int var_Layer;
+
+
+void main()
+{
+	gl_Position = vec4(attr_Position, 1.0);
+	var_Layer = int(gl_ViewID_OVR);
+}
@@ -1,7 +1,16 @@
+#if defined(USE_LIGHTMAP_ARRAY) && !defined(USE_LIGHTMAP)
+// r_lightmap is drawing a lightmap array layer as the diffuse map
+uniform sampler2DArray u_DiffuseMap;
+#else
 uniform sampler2D u_DiffuseMap;
+#endif
 
 #if defined(USE_LIGHTMAP)
+  #if defined(USE_LIGHTMAP_ARRAY)
+uniform sampler2DArray u_LightMap;
+  #else
 uniform sampler2D u_LightMap;
+  #endif
 #endif
 
 #if defined(USE_NORMALMAP)
@@ -9,7 +18,11 @@ uniform sampler2D u_NormalMap;
 #endif
 
 #if defined(USE_DELUXEMAP)
+  #if defined(USE_LIGHTMAP_ARRAY)
+uniform sampler2DArray u_DeluxeMap;
+  #else
 uniform sampler2D u_DeluxeMap;
+  #endif
 #endif
 
 #if defined(USE_SPECULARMAP)
@@ -52,6 +65,13 @@ uniform int       u_IsBlending;
 
 varying vec4      var_TexCoords;
 
+#if defined(USE_LIGHTMAP_ARRAY)
+flat varying float var_LightmapLayer;
+#define LIGHTMAP_COORDS(tc) vec3(tc, var_LightmapLayer)
+#else
+#define LIGHTMAP_COORDS(tc) (tc)
+#endif
+
 varying vec4      var_Color;
 #if (defined(USE_LIGHT) && !defined(USE_FAST_LIGHT))
 varying vec4      var_ColorAmbient;
@@ -276,7 +296,7 @@ void main()
 	lightColor = var_Color.rgb;
 
 #if defined(USE_LIGHTMAP)
-	vec4 lightmapColor = texture2D(u_LightMap, var_TexCoords.zw);
+	vec4 lightmapColor = texture2D(u_LightMap, LIGHTMAP_COORDS(var_TexCoords.zw));
   #if defined(RGBM_LIGHTMAP)
 	lightmapColor.rgb *= lightmapColor.a;
   #endif
@@ -296,7 +316,11 @@ void main()
 	texCoords += offsetDir.xy * RayIntersectDisplaceMap(texCoords, offsetDir.xy, u_NormalMap);
 #endif
 
+#if defined(USE_LIGHTMAP_ARRAY) && !defined(USE_LIGHTMAP)
+	vec4 diffuse = texture2D(u_DiffuseMap, LIGHTMAP_COORDS(texCoords));
+#else
 	vec4 diffuse = texture2D(u_DiffuseMap, texCoords);
+#endif
 	
 	float alpha = diffuse.a * var_Color.a;
 	if (u_AlphaTest == 1)
@@ -318,7 +342,7 @@ void main()
 #if defined(USE_LIGHT) && !defined(USE_FAST_LIGHT)
 	L = var_LightDir.xyz;
   #if defined(USE_DELUXEMAP)
-	L += (texture2D(u_DeluxeMap, var_TexCoords.zw).xyz - vec3(0.5)) * u_EnableTextures.y;
+	L += (texture2D(u_DeluxeMap, LIGHTMAP_COORDS(var_TexCoords.zw)).xyz - vec3(0.5)) * u_EnableTextures.y;
   #endif
 	float sqrLightDist = dot(L, L);
 	L /= sqrt(sqrLightDist);
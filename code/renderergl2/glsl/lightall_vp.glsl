@@ -82,6 +82,10 @@ layout(shared) uniform ProjectionMatrices
 
 varying vec4   var_TexCoords;
 
+#if defined(USE_LIGHTMAP_ARRAY)
+flat varying float var_LightmapLayer;
+#endif
+
 varying vec4   var_Color;
 #if defined(USE_LIGHT_VECTOR) && !defined(USE_FAST_LIGHT)
 varying vec4   var_ColorAmbient;
@@ -246,6 +250,10 @@ void main()
 	var_TexCoords.zw = attr_TexCoord1.st;
 #endif
 
+#if defined(USE_LIGHTMAP_ARRAY)
+	var_LightmapLayer = attr_TexCoord1.p;
+#endif
+
 	var_Color = u_VertColor * attr_Color + u_BaseColor;
 
 #if defined(USE_LIGHT_VECTOR)
@@ -23,9 +23,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "tr_fbo.h"
 #include "tr_dsa.h"
 
-backEndData_t	*backEndData;
+backEndData_t	*backEndData[SMP_FRAMES];
 backEndState_t	backEnd;
 
+volatile qboolean	renderThreadActive;
+
 
 static float	s_flipMatrix[16] = {
 	// convert from our coordinate system (looking down X)
@@ -49,6 +51,8 @@ void GL_BindToTMU( image_t *image, int tmu )
 	{
 		if (image->flags & IMGFLAG_CUBEMAP)
 			target = GL_TEXTURE_CUBE_MAP;
+		else if (image->flags & IMGFLAG_ARRAY)
+			target = GL_TEXTURE_2D_ARRAY;
 
 		image->frameUsed = tr.frameCount;
 		texture = image->texnum;
@@ -324,8 +328,15 @@ static void SetViewportAndScissor( void ) {
 	// set the window clipping
 	qglViewport( backEnd.viewParms.viewportX, backEnd.viewParms.viewportY, 
 		backEnd.viewParms.viewportWidth, backEnd.viewParms.viewportHeight );
-	qglScissor( backEnd.viewParms.viewportX, backEnd.viewParms.viewportY, 
-		backEnd.viewParms.viewportWidth, backEnd.viewParms.viewportHeight );
+
+	// portal views only have to fill the part of the screen the portal covers
+	if ( backEnd.viewParms.scissorWidth > 0 ) {
+		qglScissor( backEnd.viewParms.scissorX, backEnd.viewParms.scissorY,
+			backEnd.viewParms.scissorWidth, backEnd.viewParms.scissorHeight );
+	} else {
+		qglScissor( backEnd.viewParms.viewportX, backEnd.viewParms.viewportY,
+			backEnd.viewParms.viewportWidth, backEnd.viewParms.viewportHeight );
+	}
 }
 
 /*
@@ -475,6 +486,7 @@ void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 				continue;
 
 			// fast path, same as previous sort
+			backEnd.currentDrawSurf = i;
 			rb_surfaceTable[ *drawSurf->surface ]( drawSurf->surface );
 			continue;
 		}
@@ -601,6 +613,7 @@ void RB_RenderDrawSurfList( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 		}
 
 		// add the triangles for this surface
+		backEnd.currentDrawSurf = i;
 		rb_surfaceTable[ *drawSurf->surface ]( drawSurf->surface );
 	}
 
@@ -665,10 +678,10 @@ void	RB_SetGL2D (void) {
 		qglViewport(0, 0, tr.hudImage->width, tr.hudImage->height);
 		qglScissor(0, 0, tr.hudImage->width, tr.hudImage->height);
 	}
-	else if (glState.isDrawingScreenOverlay && tr.vrParms.screenOverlayBuffer != 0)
+	else if (glState.isDrawingScreenOverlay && backEnd.vrParms.screenOverlayBuffer != 0)
 	{
-		qglViewport(0, 0, tr.vrParms.screenOverlayWidth, tr.vrParms.screenOverlayHeight);
-		qglScissor(0, 0, tr.vrParms.screenOverlayWidth, tr.vrParms.screenOverlayHeight);
+		qglViewport(0, 0, backEnd.vrParms.screenOverlayWidth, backEnd.vrParms.screenOverlayHeight);
+		qglScissor(0, 0, backEnd.vrParms.screenOverlayWidth, backEnd.vrParms.screenOverlayHeight);
 	}
 	else
 	{
@@ -793,6 +806,9 @@ void RE_UploadCinematic (int w, int h, int cols, int rows, const byte *data, int
 		return;
 	}
 
+	// the client calls this directly too, take the GL context back
+	R_SyncRenderThread();
+
 	texture = tr.scratchImage[client]->texnum;
 
 	// if the scratchImage isn't in the format we want, specify it as a new texture
@@ -956,6 +972,10 @@ const void	*RB_DrawSurfs( const void *data ) {
 	backEnd.refdef = cmd->refdef;
 	backEnd.viewParms = cmd->viewParms;
 
+	backEnd.indirectCommands = cmd->indirectCommands;
+	if (backEnd.indirectCommands)
+		RB_UploadIndirectCommands(cmd->indirectCommands, cmd->numDrawSurfs);
+
 	isShadowView = !!(backEnd.viewParms.flags & VPF_DEPTHSHADOW);
 
 	// clear the z buffer, set the modelview, etc
@@ -1197,6 +1217,9 @@ const void	*RB_DrawSurfs( const void *data ) {
 	{
 		RB_RenderDrawSurfList( cmd->drawSurfs, cmd->numDrawSurfs );
 
+		// keep the depth for culling the next frames
+		RB_CaptureOcclusion();
+
 		if (r_drawSun->integer)
 		{
 			RB_DrawSun(0.1f, tr.sunShader);
@@ -1249,6 +1272,8 @@ const void	*RB_DrawSurfs( const void *data ) {
 	backEnd.viewParms.isMirror = qfalse;
 	backEnd.viewParms.flags = 0;
 
+	backEnd.indirectCommands = NULL;
+
 	return (const void *)(cmd + 1);
 }
 
@@ -1813,7 +1838,7 @@ RB_SwitchEye
 const void* RB_SwitchEye( const void* data ) {
 	const switchEyeCommand_t *cmd = data;
 
-	tr.renderFbo->frameBuffer = cmd->eye;
+	tr.renderFbo->frameBuffer = backEnd.vrParms.renderBuffer;
 
 	// finish any 2D drawing if needed
 	if(tess.numIndexes)
@@ -1858,28 +1883,28 @@ const void* RB_ScreenOverlayBuffer( const void* data ) {
 		glState.isDrawingScreenOverlay = qtrue;
 
 		// Bind screen overlay framebuffer if available
-		if (tr.vrParms.screenOverlayBuffer != 0)
+		if (backEnd.vrParms.screenOverlayBuffer != 0)
 		{
 			// Save current framebuffer
 			tr.backupFrameBuffer = tr.renderFbo->frameBuffer;
 
 			// Bind overlay framebuffer
-			GL_BindFramebuffer(GL_FRAMEBUFFER, tr.vrParms.screenOverlayBuffer);
+			GL_BindFramebuffer(GL_FRAMEBUFFER, backEnd.vrParms.screenOverlayBuffer);
 
 			// Set viewport to match overlay size
-			qglViewport(0, 0, tr.vrParms.screenOverlayWidth, tr.vrParms.screenOverlayHeight);
-			qglScissor(0, 0, tr.vrParms.screenOverlayWidth, tr.vrParms.screenOverlayHeight);
+			qglViewport(0, 0, backEnd.vrParms.screenOverlayWidth, backEnd.vrParms.screenOverlayHeight);
+			qglScissor(0, 0, backEnd.vrParms.screenOverlayWidth, backEnd.vrParms.screenOverlayHeight);
 
 			// When weapon is zoomed, blit the main scene as the base layer for mono rendering
 			// This copies the game world to the overlay, then reticle/HUD draws on top
 			// Only blit on the initial clear call, not on subsequent appends
-			if (cmd->clear && vr.weapon_zoomed && tr.vrParms.mainSceneReadBuffer != 0)
+			if (cmd->clear && backEnd.vrWeaponZoomed && backEnd.vrParms.mainSceneReadBuffer != 0)
 			{
 				qglBlitNamedFramebuffer(
-					tr.vrParms.mainSceneReadBuffer,
-					tr.vrParms.screenOverlayBuffer,
-					0, 0, tr.vrParms.mainSceneWidth, tr.vrParms.mainSceneHeight,
-					0, 0, tr.vrParms.screenOverlayWidth, tr.vrParms.screenOverlayHeight,
+					backEnd.vrParms.mainSceneReadBuffer,
+					backEnd.vrParms.screenOverlayBuffer,
+					0, 0, backEnd.vrParms.mainSceneWidth, backEnd.vrParms.mainSceneHeight,
+					0, 0, backEnd.vrParms.screenOverlayWidth, backEnd.vrParms.screenOverlayHeight,
 					GL_COLOR_BUFFER_BIT,
 					GL_LINEAR);
 			}
@@ -1895,7 +1920,7 @@ const void* RB_ScreenOverlayBuffer( const void* data ) {
 		glState.isDrawingScreenOverlay = qfalse;
 
 		// Restore original framebuffer
-		if (tr.vrParms.screenOverlayBuffer != 0)
+		if (backEnd.vrParms.screenOverlayBuffer != 0)
 		{
 			tr.renderFbo->frameBuffer = tr.backupFrameBuffer;
 			GL_BindFramebuffer(GL_FRAMEBUFFER, tr.renderFbo->frameBuffer);
@@ -1968,6 +1993,62 @@ const void* RB_HUDBuffer( const void* data ) {
 	return (const void*)(cmd + 1);
 }
 
+/*
+====================
+RB_BeginFrame
+
+Uploads the per-frame uniform buffers from the back end's copy of
+the VR parameters, so the front end never touches GL to start a frame.
+====================
+*/
+const void *RB_BeginFrame( const void *data ) {
+	const beginFrameCommand_t *cmd = data;
+
+	glState.finishCalled = qfalse;
+
+	GLSL_PrepareUniformBuffers();
+	GLSL_WarmupShaders();
+
+	return (const void *)(cmd + 1);
+}
+
+/*
+====================
+RB_MirrorProjection
+====================
+*/
+const void *RB_MirrorProjection( const void *data ) {
+	const mirrorProjectionCommand_t *cmd = data;
+
+	// finish any 2D drawing if needed
+	if(tess.numIndexes)
+		RB_EndSurface();
+
+	GLSL_UpdateMirrorProjection( cmd->projectionEye );
+
+	return (const void *)(cmd + 1);
+}
+
+/*
+====================
+RB_FrameEnd
+
+Runs the callback registered with RE_SetFrameCallbacks once the
+frame's commands have been drawn.
+====================
+*/
+const void *RB_FrameEnd( const void *data ) {
+	const frameEndCommand_t *cmd = data;
+
+	// finish any 2D drawing if needed
+	if(tess.numIndexes)
+		RB_EndSurface();
+
+	cmd->callback( cmd->data );
+
+	return (const void *)(cmd + 1);
+}
+
 /*
 ====================
 RB_ExecuteRenderCommands
@@ -2027,6 +2108,15 @@ void RB_ExecuteRenderCommands( const void *data ) {
 		case RC_SCREEN_OVERLAY_BUFFER:
 			data = RB_ScreenOverlayBuffer(data);
 			break;
+		case RC_BEGIN_FRAME:
+			data = RB_BeginFrame(data);
+			break;
+		case RC_MIRROR_PROJECTION:
+			data = RB_MirrorProjection(data);
+			break;
+		case RC_FRAME_END:
+			data = RB_FrameEnd(data);
+			break;
 		case RC_END_OF_LIST:
 		default:
 			// finish any 2D drawing if needed
@@ -2041,3 +2131,31 @@ void RB_ExecuteRenderCommands( const void *data ) {
 	}
 
 }
+
+
+/*
+================
+RB_RenderThread
+
+Entry point of the r_smp render thread
+================
+*/
+void RB_RenderThread( void ) {
+	const void	*data;
+
+	// wait for either a rendering command or a quit command
+	while ( 1 ) {
+		// sleep until we have work to do
+		data = GLimp_RendererSleep();
+
+		if ( !data ) {
+			return;	// all done, renderer is shutting down
+		}
+
+		renderThreadActive = qtrue;
+
+		RB_ExecuteRenderCommands( data );
+
+		renderThreadActive = qfalse;
+	}
+}
@@ -209,6 +209,8 @@ static	void R_LoadLightmaps( lump_t *l, lump_t *surfs ) {
 	int			numLightmapsPerPage = 16;
 	float maxIntensity = 0;
 
+	tr.numLightmapLayers = 0;
+
 	len = l->filelen;
 	if ( !len ) {
 		return;
@@ -245,8 +247,18 @@ static	void R_LoadLightmaps( lump_t *l, lump_t *surfs ) {
 	if (tr.worldDeluxeMapping)
 		numLightmaps >>= 1;
 
+	// Put every lightmap in its own layer of one texture array, so surfaces
+	// that only differ by lightmap can share a shader and batch together.
+	if (r_lightmapArray->integer && glRefConfig.textureArray && numLightmaps <= glRefConfig.maxArrayTextureLayers)
+	{
+		tr.fatLightmapCols = 0;
+		tr.fatLightmapRows = 0;
+		tr.numLightmapLayers = numLightmaps;
+
+		tr.numLightmaps = 1;
+	}
 	// Use fat lightmaps of an appropriate size.
-	if (r_mergeLightmaps->integer)
+	else if (r_mergeLightmaps->integer)
 	{
 		int maxLightmapsPerAxis = glConfig.maxTextureSize / tr.lightmapSize;
 		int lightmapCols = 4, lightmapRows = 4;
@@ -285,7 +297,14 @@ static	void R_LoadLightmaps( lump_t *l, lump_t *surfs ) {
 			textureInternalFormat = GL_RGBA16;
 	}
 
-	if (r_mergeLightmaps->integer)
+	if (tr.numLightmapLayers)
+	{
+		tr.lightmaps[0] = R_CreateImageArray("_lightmaparray", tr.lightmapSize, tr.lightmapSize, tr.numLightmapLayers, IMGTYPE_COLORALPHA, imgFlags, textureInternalFormat);
+
+		if (tr.worldDeluxeMapping)
+			tr.deluxemaps[0] = R_CreateImageArray("_deluxemaparray", tr.lightmapSize, tr.lightmapSize, tr.numLightmapLayers, IMGTYPE_DELUXE, imgFlags, GL_RGBA8);
+	}
+	else if (r_mergeLightmaps->integer)
 	{
 		int width  = tr.fatLightmapCols * tr.lightmapSize;
 		int height = tr.fatLightmapRows * tr.lightmapSize;
@@ -305,7 +324,7 @@ static	void R_LoadLightmaps( lump_t *l, lump_t *surfs ) {
 		int lightmapnum = i;
 		// expand the 24 bit on-disk to 32 bit
 
-		if (r_mergeLightmaps->integer)
+		if (r_mergeLightmaps->integer && !tr.numLightmapLayers)
 		{
 			int lightmaponpage = i % numLightmapsPerPage;
 			xoff = (lightmaponpage % tr.fatLightmapCols) * tr.lightmapSize;
@@ -450,7 +469,9 @@ static	void R_LoadLightmaps( lump_t *l, lump_t *surfs ) {
 				}
 			}
 
-			if (r_mergeLightmaps->integer)
+			if (tr.numLightmapLayers)
+				R_UpdateImageLayer(tr.lightmaps[0], image, i, tr.lightmapSize, tr.lightmapSize, textureInternalFormat);
+			else if (r_mergeLightmaps->integer)
 				R_UpdateSubImage(tr.lightmaps[lightmapnum], image, xoff, yoff, tr.lightmapSize, tr.lightmapSize, textureInternalFormat);
 			else
 				tr.lightmaps[i] = R_CreateImage(va("*lightmap%d", i), image, tr.lightmapSize, tr.lightmapSize, IMGTYPE_COLORALPHA, imgFlags, textureInternalFormat );
@@ -479,7 +500,9 @@ static	void R_LoadLightmaps( lump_t *l, lump_t *surfs ) {
 				image[j*4+3] = 255;
 			}
 
-			if (r_mergeLightmaps->integer)
+			if (tr.numLightmapLayers)
+				R_UpdateImageLayer(tr.deluxemaps[0], image, i, tr.lightmapSize, tr.lightmapSize, GL_RGBA8 );
+			else if (r_mergeLightmaps->integer)
 				R_UpdateSubImage(tr.deluxemaps[lightmapnum], image, xoff, yoff, tr.lightmapSize, tr.lightmapSize, GL_RGBA8 );
 			else
 				tr.deluxemaps[i] = R_CreateImage(va("*deluxemap%d", i), image, tr.lightmapSize, tr.lightmapSize, IMGTYPE_DELUXE, imgFlags, 0 );
@@ -538,12 +561,27 @@ static int FatLightmap(int lightmapnum)
 	if (tr.worldDeluxeMapping)
 		lightmapnum >>= 1;
 
+	// all layers share the one array, anything past it falls back to vertex lighting
+	if (tr.numLightmapLayers)
+		return lightmapnum < tr.numLightmapLayers ? 0 : lightmapnum;
+
 	if (tr.fatLightmapCols > 0)
 		return lightmapnum / (tr.fatLightmapCols * tr.fatLightmapRows);
 	
 	return lightmapnum;
 }
 
+static float LightmapLayer(int lightmapnum)
+{
+	if (lightmapnum < 0 || !tr.numLightmapLayers)
+		return 0.0f;
+
+	if (tr.worldDeluxeMapping)
+		lightmapnum >>= 1;
+
+	return lightmapnum;
+}
+
 /*
 =================
 RE_SetWorldVisData
@@ -642,11 +680,13 @@ void LoadDrawVertToSrfVert(srfVert_t *s, drawVert_t *d, int realLightmapNum, flo
 	{
 		s->lightmap[0] = FatPackU(LittleFloat(d->lightmap[0]), realLightmapNum);
 		s->lightmap[1] = FatPackV(LittleFloat(d->lightmap[1]), realLightmapNum);
+		s->lightmap[2] = LightmapLayer(realLightmapNum);
 	}
 	else
 	{
 		s->lightmap[0] = LittleFloat(d->lightmap[0]);
 		s->lightmap[1] = LittleFloat(d->lightmap[1]);
+		s->lightmap[2] = 0.0f;
 	}
 
 	v[0] = LittleFloat(d->normal[0]);
@@ -1717,6 +1757,8 @@ static	void R_LoadSurfaces( lump_t *surfs, lump_t *verts, lump_t *indexLump ) {
 	s_worldData.surfacesViewCount = ri.Hunk_Alloc ( count * sizeof(*s_worldData.surfacesViewCount), h_low );
 	s_worldData.surfacesDlightBits = ri.Hunk_Alloc ( count * sizeof(*s_worldData.surfacesDlightBits), h_low );
 	s_worldData.surfacesPshadowBits = ri.Hunk_Alloc ( count * sizeof(*s_worldData.surfacesPshadowBits), h_low );
+	s_worldData.cullSurfaces = ri.Hunk_Alloc ( count * sizeof(*s_worldData.cullSurfaces), h_low );
+	s_worldData.cullSurfaceFlags = ri.Hunk_Alloc ( count * sizeof(*s_worldData.cullSurfaceFlags), h_low );
 
 	// load hdr vertex colors
 	if (r_hdr->integer)
@@ -1900,6 +1942,9 @@ static	void R_LoadNodesAndLeafs (lump_t *nodeLump, lump_t *leafLump) {
 	s_worldData.numnodes = numNodes + numLeafs;
 	s_worldData.numDecisionNodes = numNodes;
 
+	s_worldData.cullLeafs = ri.Hunk_Alloc ( numLeafs * sizeof(*s_worldData.cullLeafs), h_low );
+	s_worldData.cullLeafsVisIndex = -1;
+
 	// load nodes
 	for ( i=0 ; i<numNodes; i++, in++, out++)
 	{
@@ -2692,6 +2737,83 @@ void R_CalcVertexLightDirs( void )
 }
 
 
+/*
+=================
+R_CreateWorldVao
+
+Puts the face and triangle surfaces in one static VAO, so runs of them can
+be drawn with glMultiDrawElementsIndirect instead of being copied into tess
+every frame.  Patches are left out, they are tessellated for each view.
+=================
+*/
+static void R_CreateWorldVao( void )
+{
+	int i, numVerts = 0, numIndexes = 0;
+	srfVert_t *verts;
+	glIndex_t *indexes;
+	msurface_t *surface;
+
+	s_worldData.vao = NULL;
+
+	if (!glRefConfig.multiDrawIndirect)
+		return;
+
+	for (i = 0, surface = s_worldData.surfaces; i < s_worldData.numsurfaces; i++, surface++)
+	{
+		srfBspSurface_t *bspSurf = (srfBspSurface_t *) surface->data;
+
+		if (bspSurf->surfaceType != SF_FACE && bspSurf->surfaceType != SF_TRIANGLES)
+			continue;
+
+		bspSurf->worldFirstIndex = -1;
+		bspSurf->worldBaseVertex = 0;
+
+		if (!bspSurf->numVerts || !bspSurf->numIndexes)
+			continue;
+
+		numVerts += bspSurf->numVerts;
+		numIndexes += bspSurf->numIndexes;
+	}
+
+	if (!numVerts)
+		return;
+
+	verts = ri.Hunk_AllocateTempMemory(numVerts * sizeof(*verts));
+	indexes = ri.Hunk_AllocateTempMemory(numIndexes * sizeof(*indexes));
+
+	numVerts = 0;
+	numIndexes = 0;
+
+	for (i = 0, surface = s_worldData.surfaces; i < s_worldData.numsurfaces; i++, surface++)
+	{
+		srfBspSurface_t *bspSurf = (srfBspSurface_t *) surface->data;
+
+		if (bspSurf->surfaceType != SF_FACE && bspSurf->surfaceType != SF_TRIANGLES)
+			continue;
+
+		if (!bspSurf->numVerts || !bspSurf->numIndexes)
+			continue;
+
+		// indexes stay relative to the surface, the draw command adds the base vertex
+		bspSurf->worldFirstIndex = numIndexes;
+		bspSurf->worldBaseVertex = numVerts;
+
+		Com_Memcpy(verts + numVerts, bspSurf->verts, bspSurf->numVerts * sizeof(*verts));
+		Com_Memcpy(indexes + numIndexes, bspSurf->indexes, bspSurf->numIndexes * sizeof(*indexes));
+
+		numVerts += bspSurf->numVerts;
+		numIndexes += bspSurf->numIndexes;
+	}
+
+	s_worldData.vao = R_CreateVao2("world", numVerts, verts, numIndexes, indexes);
+
+	ri.Hunk_FreeTempMemory(indexes);
+	ri.Hunk_FreeTempMemory(verts);
+
+	ri.Printf(PRINT_ALL, "...world VAO has %i vertexes, %i indexes\n", numVerts, numIndexes);
+}
+
+
 /*
 =================
 RE_LoadWorldMap
@@ -2786,6 +2908,8 @@ void RE_LoadWorldMap( const char *name ) {
 	// determine vertex light directions
 	R_CalcVertexLightDirs();
 
+	R_CreateWorldVao();
+
 	// determine which parts of the map are in sunlight
 	if (0)
 	{
@@ -3004,6 +3128,9 @@ void RE_LoadWorldMap( const char *name ) {
 	// make sure the VAO glState entry is safe
 	R_BindNullVao();
 
+	// build the permutations the world's shaders use before anything draws
+	GLSL_CompileReferencedShaders();
+
 	// Render or load all cubemaps
 	if (r_cubeMapping->integer && tr.numCubemaps && glRefConfig.framebufferObject)
 	{
@@ -21,6 +21,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "tr_local.h"
 
+// registered with RE_SetFrameCallbacks, kept across renderer restarts
+static void	(*frameBeginCallback)( void *data );
+static void	(*frameEndCallback)( void *data );
+static void	*frameCallbackData;
+
 /*
 =====================
 R_PerformanceCounters
@@ -66,8 +71,8 @@ void R_PerformanceCounters( void ) {
 	}
 	else if (r_speeds->integer == 7 )
 	{
-		ri.Printf( PRINT_ALL, "VAO draws: static %i dynamic %i\n",
-			backEnd.pc.c_staticVaoDraws, backEnd.pc.c_dynamicVaoDraws);
+		ri.Printf( PRINT_ALL, "VAO draws: static %i dynamic %i  streamed: %i KB\n",
+			backEnd.pc.c_staticVaoDraws, backEnd.pc.c_dynamicVaoDraws, backEnd.pc.c_dynamicVaoBytes / 1024);
 		ri.Printf( PRINT_ALL, "GLSL binds: %i  draws: gen %i light %i fog %i dlight %i\n",
 			backEnd.pc.c_glslShaderBinds, backEnd.pc.c_genericDraws, backEnd.pc.c_lightallDraws, backEnd.pc.c_fogDraws, backEnd.pc.c_dlightDraws);
 	}
@@ -77,6 +82,37 @@ void R_PerformanceCounters( void ) {
 }
 
 
+/*
+====================
+R_InitCommandBuffers
+====================
+*/
+void R_InitCommandBuffers( void ) {
+	glConfig.smpActive = qfalse;
+	if ( r_smp->integer && backEndData[1] ) {
+		ri.Printf( PRINT_ALL, "Trying SMP acceleration...\n" );
+		if ( GLimp_SpawnRenderThread( RB_RenderThread ) ) {
+			ri.Printf( PRINT_ALL, "...succeeded.\n" );
+			glConfig.smpActive = qtrue;
+		} else {
+			ri.Printf( PRINT_ALL, "...failed.\n" );
+		}
+	}
+}
+
+/*
+====================
+R_ShutdownCommandBuffers
+====================
+*/
+void R_ShutdownCommandBuffers( void ) {
+	// kill the rendering thread
+	if ( glConfig.smpActive ) {
+		GLimp_ShutdownRenderThread();
+		glConfig.smpActive = qfalse;
+	}
+}
+
 /*
 ====================
 R_IssueRenderCommands
@@ -85,7 +121,7 @@ R_IssueRenderCommands
 void R_IssueRenderCommands( qboolean runPerformanceCounters ) {
 	renderCommandList_t	*cmdList;
 
-	cmdList = &backEndData->commands;
+	cmdList = &backEndData[tr.smpFrame]->commands;
 	assert(cmdList);
 	// add an end-of-list command
 	*(int *)(cmdList->cmds + cmdList->used) = RC_END_OF_LIST;
@@ -93,6 +129,43 @@ void R_IssueRenderCommands( qboolean runPerformanceCounters ) {
 	// clear it out, in case this is a sync and not a buffer flip
 	cmdList->used = 0;
 
+	if ( glConfig.smpActive ) {
+		// if the render thread is not idle, wait for it
+		if ( r_showSmp->integer ) {
+			ri.Printf( PRINT_ALL, renderThreadActive ? "R" : "." );
+		}
+
+		// sleep until the renderer has completed
+		GLimp_FrontEndSleep();
+	}
+
+	// raise whatever a shader compiled on the render thread ran into
+	GLSL_CheckErrors();
+
+	// upload the images queued during registration before anything
+	// that uses them gets drawn
+	R_FinishImageLoads();
+
+	// the back end is idle, so this is the place to set up whatever
+	// the first commands of a frame will draw into
+	if ( frameBeginCallback ) {
+		void	(*callback)( void *data ) = frameBeginCallback;
+
+		frameBeginCallback = NULL;
+		callback( frameCallbackData );
+	}
+
+	// give the back end its own copy of the state the front end
+	// changes while the render thread is still drawing
+	backEnd.vrParms = tr.vrParms;
+	backEnd.vrWeaponZoomed = vr.weapon_zoomed;
+	backEnd.vrVirtualScreen = vr.virtual_screen;
+
+	// pick up the depth the back end read back
+	R_LatchOcclusion();
+
+	// at this point, the back end thread is idle, so it is ok
+	// to look at its performance counters
 	if ( runPerformanceCounters ) {
 		R_PerformanceCounters();
 	}
@@ -100,8 +173,28 @@ void R_IssueRenderCommands( qboolean runPerformanceCounters ) {
 	// actually start the commands going
 	if ( !r_skipBackEnd->integer ) {
 		// let it start on the new batch
-		RB_ExecuteRenderCommands( cmdList->cmds );
+		if ( !glConfig.smpActive ) {
+			RB_ExecuteRenderCommands( cmdList->cmds );
+		} else {
+			GLimp_WakeRenderer( cmdList->cmds );
+		}
+	}
+}
+
+
+/*
+====================
+R_SyncRenderThread
+
+Wait for the render thread to finish the commands it has been given.
+The calling thread owns the GL context afterwards.
+====================
+*/
+void R_SyncRenderThread( void ) {
+	if ( !glConfig.smpActive ) {
+		return;
 	}
+	GLimp_FrontEndSleep();
 }
 
 
@@ -117,6 +210,7 @@ void R_IssuePendingRenderCommands( void ) {
 		return;
 	}
 	R_IssueRenderCommands( qfalse );
+	R_SyncRenderThread();
 }
 
 /*
@@ -129,7 +223,7 @@ make sure there is enough command space
 void *R_GetCommandBufferReserved( int bytes, int reservedBytes ) {
 	renderCommandList_t	*cmdList;
 
-	cmdList = &backEndData->commands;
+	cmdList = &backEndData[tr.smpFrame]->commands;
 	bytes = PAD(bytes, sizeof(void *));
 
 	// always leave room for the end of list command
@@ -154,7 +248,45 @@ returns NULL if there is not enough space for important commands
 =============
 */
 void *R_GetCommandBuffer( int bytes ) {
-	return R_GetCommandBufferReserved( bytes, PAD( sizeof( swapBuffersCommand_t ), sizeof(void *) ) );
+	return R_GetCommandBufferReserved( bytes, PAD( sizeof( swapBuffersCommand_t ), sizeof(void *) ) +
+		PAD( sizeof( frameEndCommand_t ), sizeof(void *) ) );
+}
+
+
+/*
+=============
+R_BuildIndirectCommands
+
+Fills in where each face and triangle surface sits in the world VAO, so
+the back end can draw a run of them with one glMultiDrawElementsIndirect.
+Other surfaces get an empty command.
+=============
+*/
+static drawElementsIndirectCommand_t *R_BuildIndirectCommands( drawSurf_t *drawSurfs, int numDrawSurfs ) {
+	drawElementsIndirectCommand_t	*commands, *command;
+	int		i;
+
+	if ( !tr.world || !tr.world->vao || !numDrawSurfs ) {
+		return NULL;
+	}
+
+	commands = backEndData[tr.smpFrame]->indirectCommands + ( drawSurfs - backEndData[tr.smpFrame]->drawSurfs );
+
+	for ( i = 0, command = commands ; i < numDrawSurfs ; i++, command++ ) {
+		const srfBspSurface_t *bsp = (const srfBspSurface_t *)drawSurfs[i].surface;
+
+		if ( ( bsp->surfaceType == SF_FACE || bsp->surfaceType == SF_TRIANGLES ) && bsp->worldFirstIndex >= 0 ) {
+			command->count = bsp->numIndexes;
+			command->instanceCount = 1;
+			command->firstIndex = bsp->worldFirstIndex;
+			command->baseVertex = bsp->worldBaseVertex;
+			command->baseInstance = 0;
+		} else {
+			Com_Memset( command, 0, sizeof( *command ) );
+		}
+	}
+
+	return commands;
 }
 
 
@@ -175,6 +307,7 @@ void	R_AddDrawSurfCmd( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 
 	cmd->drawSurfs = drawSurfs;
 	cmd->numDrawSurfs = numDrawSurfs;
+	cmd->indirectCommands = R_BuildIndirectCommands( drawSurfs, numDrawSurfs );
 
 	cmd->refdef = tr.refdef;
 	cmd->viewParms = tr.viewParms;
@@ -220,6 +353,24 @@ void	R_AddPostProcessCmd( void ) {
 	cmd->viewParms = tr.viewParms;
 }
 
+/*
+=============
+R_AddMirrorProjectionCmd
+
+=============
+*/
+void	R_AddMirrorProjectionCmd( void ) {
+	mirrorProjectionCommand_t	*cmd;
+
+	cmd = R_GetCommandBuffer( sizeof( *cmd ) );
+	if ( !cmd ) {
+		return;
+	}
+	cmd->commandId = RC_MIRROR_PROJECTION;
+
+	Com_Memcpy( cmd->projectionEye, tr.vrParms.mirrorProjectionEye, sizeof( cmd->projectionEye ) );
+}
+
 /*
 =============
 RE_SetColor
@@ -338,7 +489,6 @@ void RE_BeginFrame( stereoFrame_t stereoFrame ) {
 	if ( !tr.registered ) {
 		return;
 	}
-	glState.finishCalled = qfalse;
 
 	tr.frameCount++;
 	tr.frameSceneNum = 0;
@@ -416,6 +566,16 @@ void RE_BeginFrame( stereoFrame_t stereoFrame ) {
 			ri.Error(ERR_FATAL, "RE_BeginFrame() - glGetError() failed (0x%x)!", err);
 	}
 
+	// the uniform buffers are filled by the back end, which may still
+	// be drawing the previous frame on the render thread
+	{
+		beginFrameCommand_t	*bfc;
+
+		if ( ( bfc = R_GetCommandBuffer( sizeof( *bfc ) ) ) != NULL ) {
+			bfc->commandId = RC_BEGIN_FRAME;
+		}
+	}
+
 	{
 		if (tr.renderFbo && tr.vrParms.renderBufferOriginal == 0) {
 			tr.vrParms.renderBufferOriginal = tr.renderFbo->frameBuffer;
@@ -428,14 +588,11 @@ void RE_BeginFrame( stereoFrame_t stereoFrame ) {
 					if (!(sec = R_GetCommandBuffer(sizeof(*sec))))
 						return;
 					sec->commandId = RC_SWITCH_EYE;
-					sec->eye = tr.vrParms.renderBuffer;
 					sec->stereoFrame = stereoFrame;
 				}
 			}
 		}
 	}
-
-	GLSL_PrepareUniformBuffers();
 }
 
 
@@ -452,15 +609,26 @@ void RE_EndFrame( int *frontEndMsec, int *backEndMsec ) {
 	if ( !tr.registered ) {
 		return;
 	}
-	cmd = R_GetCommandBufferReserved( sizeof( *cmd ), 0 );
+	cmd = R_GetCommandBufferReserved( sizeof( *cmd ), PAD( sizeof( frameEndCommand_t ), sizeof(void *) ) );
 	if ( !cmd ) {
 		return;
 	}
 	cmd->commandId = RC_SWAP_BUFFERS;
 
+	if ( frameEndCallback ) {
+		frameEndCommand_t	*fec;
+
+		fec = R_GetCommandBufferReserved( sizeof( *fec ), 0 );
+		fec->commandId = RC_FRAME_END;
+		fec->callback = frameEndCallback;
+		fec->data = frameCallbackData;
+		frameEndCallback = NULL;
+	}
+
 	R_IssueRenderCommands( qtrue );
 
-	if (r_useFlush->integer)
+	// with r_smp the render thread owns the context now
+	if (r_useFlush->integer && !glConfig.smpActive)
 	{
 		//FLush all open gl commands
 		qglFlush();
@@ -603,6 +771,32 @@ void RE_SetScreenOverlayBuffer( int overlayBuffer, int width, int height,
 	tr.vrParms.mainSceneHeight = mainSceneHeight;
 }
 
+void RE_SetVRRenderBuffer( int renderBuffer ) {
+	tr.vrParms.renderBuffer = renderBuffer;
+}
+
+/*
+=============
+RE_SetFrameCallbacks
+
+Registers functions to run around the GL work of the frame being built.
+begin runs on the calling thread, with the back end idle, right before
+the first commands of the frame are handed to the back end.  end runs in
+the back end after the frame's swap, on the render thread with r_smp.
+Both are used once.  Returns qtrue if a previously registered end
+callback was never reached; NULL callbacks just clear the registration.
+=============
+*/
+qboolean RE_SetFrameCallbacks( void (*begin)( void *data ), void (*end)( void *data ), void *data ) {
+	qboolean	pending = ( frameEndCallback != NULL );
+
+	frameBeginCallback = begin;
+	frameEndCallback = end;
+	frameCallbackData = data;
+
+	return pending;
+}
+
 /*
 =============
 RE_TakeVideoFrame
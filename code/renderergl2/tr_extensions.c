@@ -349,6 +349,88 @@ void GLimp_InitExtraExtensions(void)
 
 done:
 
+	// OpenGL 4.1, OpenGL ES 3.0 - GL_ARB_get_program_binary
+	extension = "GL_ARB_get_program_binary";
+	glRefConfig.programBinary = qfalse;
+	if (QGL_VERSION_ATLEAST(4, 1) || QGLES_VERSION_ATLEAST(3, 0) || SDL_GL_ExtensionSupported(extension))
+	{
+		GLint numFormats = 0;
+
+		QGL_ARB_get_program_binary_PROCS;
+
+		// some drivers expose the entry points but no format to save in
+		qglGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+		glRefConfig.programBinary = r_glslCache->integer && numFormats > 0;
+
+		ri.Printf(PRINT_ALL, result[glRefConfig.programBinary], extension);
+	}
+	else
+	{
+		ri.Printf(PRINT_ALL, result[2], extension);
+	}
+
+	// OpenGL 4.4 - GL_ARB_buffer_storage
+	// also needs the OpenGL 3.2 fences to know when the GPU is done with the storage
+	extension = "GL_ARB_buffer_storage";
+	glRefConfig.bufferStorage = qfalse;
+	if (QGL_VERSION_ATLEAST(3, 2) && (QGL_VERSION_ATLEAST(4, 4) || SDL_GL_ExtensionSupported(extension)))
+	{
+		glRefConfig.bufferStorage = !!r_arb_buffer_storage->integer;
+
+		QGL_ARB_buffer_storage_PROCS;
+
+		ri.Printf(PRINT_ALL, result[glRefConfig.bufferStorage], extension);
+	}
+	else
+	{
+		ri.Printf(PRINT_ALL, result[2], extension);
+	}
+
+	// OpenGL 4.3 - GL_ARB_multi_draw_indirect, OpenGL ES 3.1 - GL_EXT_multi_draw_indirect
+	extension = qglesMajorVersion ? "GL_EXT_multi_draw_indirect" : "GL_ARB_multi_draw_indirect";
+	glRefConfig.multiDrawIndirect = qfalse;
+	if (QGL_VERSION_ATLEAST(4, 3) || ((QGL_VERSION_ATLEAST(4, 0) || QGLES_VERSION_ATLEAST(3, 1)) && SDL_GL_ExtensionSupported(extension)))
+	{
+		glRefConfig.multiDrawIndirect = !!r_arb_multi_draw_indirect->integer;
+
+		if (!qglesMajorVersion) {
+			QGL_ARB_multi_draw_indirect_PROCS;
+		} else {
+			// GL_EXT_multi_draw_indirect uses EXT suffix
+#undef GLE
+#define GLE(ret, name, ...) qgl##name = (name##proc *) SDL_GL_GetProcAddress("gl" #name "EXT");
+
+			QGL_ARB_multi_draw_indirect_PROCS;
+
+#undef GLE
+#define GLE(ret, name, ...) qgl##name = (name##proc *) SDL_GL_GetProcAddress("gl" #name);
+		}
+
+		ri.Printf(PRINT_ALL, result[glRefConfig.multiDrawIndirect], extension);
+	}
+	else
+	{
+		ri.Printf(PRINT_ALL, result[2], extension);
+	}
+
+	// GL_KHR_parallel_shader_compile
+	extension = "GL_KHR_parallel_shader_compile";
+	glRefConfig.parallelShaderCompile = qfalse;
+	if (SDL_GL_ExtensionSupported(extension))
+	{
+		QGL_KHR_parallel_shader_compile_PROCS;
+
+		// let the driver pick how many threads to compile with
+		qglMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+		glRefConfig.parallelShaderCompile = qtrue;
+
+		ri.Printf(PRINT_ALL, result[glRefConfig.parallelShaderCompile], extension);
+	}
+	else
+	{
+		ri.Printf(PRINT_ALL, result[2], extension);
+	}
+
 	// Determine GLSL version
 	if (1)
 	{
@@ -368,5 +450,17 @@ done:
 		ri.Printf(PRINT_ALL, "...using GLSL version %s\n", version);
 	}
 
+	// OpenGL 3.0, OpenGL ES 3.0 - texture arrays
+	// sampler2DArray also needs GLSL 1.30 or GLSL ES 3.00
+	glRefConfig.textureArray = qfalse;
+	glRefConfig.maxArrayTextureLayers = 0;
+	if (qglTexSubImage3D && (glRefConfig.glslMajorVersion > 1 || (glRefConfig.glslMajorVersion == 1 && glRefConfig.glslMinorVersion >= 30)))
+	{
+		qglGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &glRefConfig.maxArrayTextureLayers);
+		glRefConfig.textureArray = qtrue;
+
+		ri.Printf(PRINT_ALL, "...using texture arrays, up to %d layers\n", glRefConfig.maxArrayTextureLayers);
+	}
+
 #undef GLE
 }
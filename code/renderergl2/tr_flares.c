@@ -40,6 +40,10 @@ After all opaque surfaces have been rendered, the depth buffer is read back for
 each flare in view.  If the point has not been obscured by a closer surface, the
 flare should be drawn.
 
+With r_flareQueries the depth buffer is never read back.  Instead a tiny quad
+is drawn at each flare inside an occlusion query, and the result is picked up
+a few frames later once the GPU has got to it.  The fading hides the latency.
+
 Surfaces that have a repeated texture should never be flagged as flaring, because
 there will only be a single flare added at the midpoint of the polygon.
 
@@ -75,15 +79,28 @@ typedef struct flare_s {
 	int			windowX, windowY;
 	float		eyeZ;
 
+	int			queryHead;			// next occlusion query to issue
+	int			queryTail;			// oldest occlusion query still in flight
+
 	vec3_t		origin;
 	vec3_t		color;
 } flare_t;
 
 #define		MAX_FLARES		256
 
+// occlusion queries in flight per flare, must be a power of two
+#define		FLARE_QUERIES	4
+
+// how far the query quad is pulled toward the viewer, so the surface
+// the flare sits on doesn't hide it
+#define		FLARE_QUERY_BIAS	24
+
 flare_t		r_flareStructs[MAX_FLARES];
 flare_t		*r_activeFlares, *r_inactiveFlares;
 
+static GLuint	r_flareQueryObjects[MAX_FLARES][FLARE_QUERIES];
+static qboolean	r_flareQueriesActive;
+
 int flareCoeff;
 
 /*
@@ -119,6 +136,34 @@ void R_ClearFlares( void ) {
 	R_SetFlareCoeff();
 }
 
+/*
+==================
+R_InitFlareQueries
+==================
+*/
+void R_InitFlareQueries( void ) {
+	if ( !r_flareQueries->integer ) {
+		return;
+	}
+
+	qglGenQueries( MAX_FLARES * FLARE_QUERIES, &r_flareQueryObjects[0][0] );
+	r_flareQueriesActive = qtrue;
+}
+
+/*
+==================
+R_ShutdownFlareQueries
+==================
+*/
+void R_ShutdownFlareQueries( void ) {
+	if ( !r_flareQueriesActive ) {
+		return;
+	}
+
+	qglDeleteQueries( MAX_FLARES * FLARE_QUERIES, &r_flareQueryObjects[0][0] );
+	r_flareQueriesActive = qfalse;
+}
+
 
 /*
 ==================
@@ -189,6 +234,9 @@ void RB_AddFlare( void *surface, int fogNum, vec3_t point, vec3_t color, vec3_t
 		f->frameSceneNum = backEnd.viewParms.frameSceneNum;
 		f->inPortal = backEnd.viewParms.isPortal;
 		f->addedFrame = -1;
+
+		// anything still in flight belongs to the previous owner
+		f->queryHead = f->queryTail = 0;
 	}
 
 	if ( f->addedFrame != backEnd.viewParms.frameCount - 1 ) {
@@ -267,6 +315,38 @@ FLARE BACK END
 ===============================================================================
 */
 
+/*
+==================
+RB_FadeFlare
+==================
+*/
+static void RB_FadeFlare( flare_t *f, qboolean visible ) {
+	float			fade;
+
+	if ( visible ) {
+		if ( !f->visible ) {
+			f->visible = qtrue;
+			f->fadeTime = backEnd.refdef.time - 1;
+		}
+		fade = ( ( backEnd.refdef.time - f->fadeTime ) /1000.0f ) * r_flareFade->value;
+	} else {
+		if ( f->visible ) {
+			f->visible = qfalse;
+			f->fadeTime = backEnd.refdef.time - 1;
+		}
+		fade = 1.0f - ( ( backEnd.refdef.time - f->fadeTime ) / 1000.0f ) * r_flareFade->value;
+	}
+
+	if ( fade < 0 ) {
+		fade = 0;
+	}
+	if ( fade > 1 ) {
+		fade = 1;
+	}
+
+	f->drawIntensity = fade;
+}
+
 /*
 ==================
 RB_TestFlare
@@ -275,12 +355,15 @@ RB_TestFlare
 void RB_TestFlare( flare_t *f ) {
 	float			depth;
 	qboolean		visible;
-	float			fade;
 	float			screenZ;
 	FBO_t           *oldFbo;
 
-  // Disable flares in VR
-  return;
+	// a single pixel of the layered VR depth can't tell for both eyes,
+	// flares in VR need r_flareQueries
+	if ( backEnd.vrParms.valid ) {
+		f->drawIntensity = 0;
+		return;
+	}
 
 	backEnd.pc.c_flareTests++;
 
@@ -309,28 +392,91 @@ void RB_TestFlare( flare_t *f ) {
 
 	visible = ( -f->eyeZ - -screenZ ) < 24;
 
-	if ( visible ) {
-		if ( !f->visible ) {
-			f->visible = qtrue;
-			f->fadeTime = backEnd.refdef.time - 1;
-		}
-		fade = ( ( backEnd.refdef.time - f->fadeTime ) /1000.0f ) * r_flareFade->value;
-	} else {
-		if ( f->visible ) {
-			f->visible = qfalse;
-			f->fadeTime = backEnd.refdef.time - 1;
+	RB_FadeFlare( f, visible );
+}
+
+/*
+==================
+RB_TestFlareQuery
+
+Picks up whatever occlusion queries the GPU has finished for this flare,
+without waiting on the ones it hasn't.  Until the first result comes back
+the flare keeps its last known state.
+==================
+*/
+static void RB_TestFlareQuery( flare_t *f ) {
+	GLuint			*queries;
+	GLuint			available, samples;
+	qboolean		visible;
+
+	backEnd.pc.c_flareTests++;
+
+	queries = r_flareQueryObjects[f - r_flareStructs];
+	visible = f->visible;
+
+	// results come back in order, so the newest finished one wins
+	while ( f->queryTail != f->queryHead ) {
+		GLuint query = queries[f->queryTail & ( FLARE_QUERIES - 1 )];
+
+		qglGetQueryObjectuiv( query, GL_QUERY_RESULT_AVAILABLE, &available );
+		if ( !available ) {
+			break;
 		}
-		fade = 1.0f - ( ( backEnd.refdef.time - f->fadeTime ) / 1000.0f ) * r_flareFade->value;
-	}
 
-	if ( fade < 0 ) {
-		fade = 0;
+		// Note: a sample count on desktop OpenGL, a boolean on OpenGL ES
+		qglGetQueryObjectuiv( query, GL_QUERY_RESULT, &samples );
+		visible = ( samples != 0 );
+		f->queryTail++;
 	}
-	if ( fade > 1 ) {
-		fade = 1;
+
+	RB_FadeFlare( f, visible );
+}
+
+/*
+==================
+RB_IssueFlareQuery
+
+Draws a quad a couple of pixels across at the flare, pulled a little toward
+the viewer, with depth testing on and color writes off.  The multiview draw
+lands in both eyes, so the flare counts as visible if either eye can see it.
+==================
+*/
+static void RB_IssueFlareQuery( flare_t *f ) {
+	vec3_t			toViewer, center, left, up;
+	vec4_t			quadVerts[4];
+	float			dist, bias, radius;
+
+	if ( f->queryHead - f->queryTail >= FLARE_QUERIES ) {
+		return;		// the GPU is behind, try again next frame
 	}
 
-	f->drawIntensity = fade;
+	VectorSubtract( backEnd.viewParms.or.origin, f->origin, toViewer );
+	dist = VectorNormalize( toViewer );
+	bias = MIN( FLARE_QUERY_BIAS, dist * 0.5f );
+	VectorMA( f->origin, bias, toViewer, center );
+	dist -= bias;
+
+	// one pixel in each direction
+	radius = 2.0f * dist / ( backEnd.viewParms.viewportWidth * backEnd.viewParms.projectionMatrix[0] );
+
+	VectorScale( backEnd.viewParms.or.axis[1], radius, left );
+	VectorScale( backEnd.viewParms.or.axis[2], radius, up );
+
+	VectorAdd( center, left, quadVerts[0] );
+	VectorAdd( quadVerts[0], up, quadVerts[0] );
+	VectorSubtract( center, left, quadVerts[1] );
+	VectorAdd( quadVerts[1], up, quadVerts[1] );
+	VectorSubtract( center, left, quadVerts[2] );
+	VectorSubtract( quadVerts[2], up, quadVerts[2] );
+	VectorAdd( center, left, quadVerts[3] );
+	VectorSubtract( quadVerts[3], up, quadVerts[3] );
+	quadVerts[0][3] = quadVerts[1][3] = quadVerts[2][3] = quadVerts[3][3] = 1.0f;
+
+	qglBeginQuery( glRefConfig.occlusionQueryTarget, r_flareQueryObjects[f - r_flareStructs][f->queryHead & ( FLARE_QUERIES - 1 )] );
+	RB_InstantQuad( quadVerts );
+	qglEndQuery( glRefConfig.occlusionQueryTarget );
+
+	f->queryHead++;
 }
 
 
@@ -340,9 +486,9 @@ RB_RenderFlare
 ==================
 */
 void RB_RenderFlare( flare_t *f ) {
-	float			size;
-	vec3_t			color;
-	int				iColor[3];
+	float			size, radius;
+	vec3_t			color, left, up;
+	vec4_t			fColor;
 	float distance, intensity, factor;
 	byte fogFactors[3] = {255, 255, 255};
 
@@ -398,59 +544,21 @@ void RB_RenderFlare( flare_t *f ) {
 			return;
 	}
 
-	iColor[0] = color[0] * fogFactors[0] * 257;
-	iColor[1] = color[1] * fogFactors[1] * 257;
-	iColor[2] = color[2] * fogFactors[2] * 257;
-	
+	// the flare is a camera facing quad at its world position, so each eye
+	// of the multiview draw gets it in the right place
+	radius = size * 2.0f * distance / ( backEnd.viewParms.viewportWidth * backEnd.viewParms.projectionMatrix[0] );
+
+	VectorScale( backEnd.viewParms.or.axis[1], radius, left );
+	VectorScale( backEnd.viewParms.or.axis[2], radius, up );
+
+	fColor[0] = color[0] * fogFactors[0] / 255.0f;
+	fColor[1] = color[1] * fogFactors[1] / 255.0f;
+	fColor[2] = color[2] * fogFactors[2] / 255.0f;
+	fColor[3] = 1.0f;
+
 	RB_BeginSurface( tr.flareShader, f->fogNum, 0 );
 
-	// FIXME: use quadstamp?
-	tess.xyz[tess.numVertexes][0] = f->windowX - size;
-	tess.xyz[tess.numVertexes][1] = f->windowY - size;
-	tess.texCoords[tess.numVertexes][0] = 0;
-	tess.texCoords[tess.numVertexes][1] = 0;
-	tess.color[tess.numVertexes][0] = iColor[0];
-	tess.color[tess.numVertexes][1] = iColor[1];
-	tess.color[tess.numVertexes][2] = iColor[2];
-	tess.color[tess.numVertexes][3] = 65535;
-	tess.numVertexes++;
-
-	tess.xyz[tess.numVertexes][0] = f->windowX - size;
-	tess.xyz[tess.numVertexes][1] = f->windowY + size;
-	tess.texCoords[tess.numVertexes][0] = 0;
-	tess.texCoords[tess.numVertexes][1] = 1;
-	tess.color[tess.numVertexes][0] = iColor[0];
-	tess.color[tess.numVertexes][1] = iColor[1];
-	tess.color[tess.numVertexes][2] = iColor[2];
-	tess.color[tess.numVertexes][3] = 65535;
-	tess.numVertexes++;
-
-	tess.xyz[tess.numVertexes][0] = f->windowX + size;
-	tess.xyz[tess.numVertexes][1] = f->windowY + size;
-	tess.texCoords[tess.numVertexes][0] = 1;
-	tess.texCoords[tess.numVertexes][1] = 1;
-	tess.color[tess.numVertexes][0] = iColor[0];
-	tess.color[tess.numVertexes][1] = iColor[1];
-	tess.color[tess.numVertexes][2] = iColor[2];
-	tess.color[tess.numVertexes][3] = 65535;
-	tess.numVertexes++;
-
-	tess.xyz[tess.numVertexes][0] = f->windowX + size;
-	tess.xyz[tess.numVertexes][1] = f->windowY - size;
-	tess.texCoords[tess.numVertexes][0] = 1;
-	tess.texCoords[tess.numVertexes][1] = 0;
-	tess.color[tess.numVertexes][0] = iColor[0];
-	tess.color[tess.numVertexes][1] = iColor[1];
-	tess.color[tess.numVertexes][2] = iColor[2];
-	tess.color[tess.numVertexes][3] = 65535;
-	tess.numVertexes++;
-
-	tess.indexes[tess.numIndexes++] = 0;
-	tess.indexes[tess.numIndexes++] = 1;
-	tess.indexes[tess.numIndexes++] = 2;
-	tess.indexes[tess.numIndexes++] = 0;
-	tess.indexes[tess.numIndexes++] = 2;
-	tess.indexes[tess.numIndexes++] = 3;
+	RB_AddQuadStamp( f->origin, left, up, fColor );
 
 	RB_EndSurface();
 }
@@ -474,15 +582,17 @@ extend past the portal edge will be overwritten.
 void RB_RenderFlares (void) {
 	flare_t		*f;
 	flare_t		**prev;
-	qboolean	draw;
-	mat4_t    oldmodelmatrix, oldprojection, matrix;
+	qboolean	draw, useQueries;
+	mat4_t    oldmodelmatrix, oldprojection;
 
 	if ( !r_flares->integer ) {
 		return;
 	}
 
+	useQueries = r_flareQueriesActive;
+
 	if ( r_flares->modified ) {
-		if ( qglesMajorVersion >= 1 && !glRefConfig.readDepth ) {
+		if ( !useQueries && qglesMajorVersion >= 1 && !glRefConfig.readDepth ) {
 			ri.Printf( PRINT_WARNING, "OpenGL ES needs GL_NV_read_depth to read depth to determine if flares are visible\n" );
 			ri.Cvar_Set( "r_flares", "0" );
 		}
@@ -502,7 +612,7 @@ void RB_RenderFlares (void) {
 
 //	RB_AddDlightFlares();
 
-	// perform z buffer readback on each flare in this view
+	// test each flare in this view
 	draw = qfalse;
 	prev = &r_activeFlares;
 	while ( ( f = *prev ) != NULL ) {
@@ -518,47 +628,62 @@ void RB_RenderFlares (void) {
 		f->drawIntensity = 0;
 		if ( f->frameSceneNum == backEnd.viewParms.frameSceneNum
 			&& f->inPortal == backEnd.viewParms.isPortal ) {
-			RB_TestFlare( f );
+			if ( useQueries ) {
+				// keep hidden flares on the chain so their queries can
+				// tell when they come back into view
+				RB_TestFlareQuery( f );
+			} else {
+				RB_TestFlare( f );
+				if ( !f->drawIntensity ) {
+					// this flare has completely faded out, so remove it from the chain
+					*prev = f->next;
+					f->next = r_inactiveFlares;
+					r_inactiveFlares = f;
+					continue;
+				}
+			}
 			if ( f->drawIntensity ) {
 				draw = qtrue;
-			} else {
-				// this flare has completely faded out, so remove it from the chain
-				*prev = f->next;
-				f->next = r_inactiveFlares;
-				r_inactiveFlares = f;
-				continue;
 			}
 		}
 
 		prev = &f->next;
 	}
 
-	if ( !draw ) {
-		return;		// none visible
-	}
-
 	Mat4Copy(glState.projection, oldprojection);
 	Mat4Copy(glState.modelMatrix, oldmodelmatrix);
-	Mat4Identity(matrix);
-	GL_SetModelMatrix(matrix);
-	Mat4Ortho( backEnd.viewParms.viewportX, backEnd.viewParms.viewportX + backEnd.viewParms.viewportWidth,
-	               backEnd.viewParms.viewportY, backEnd.viewParms.viewportY + backEnd.viewParms.viewportHeight,
-	               -99999, 99999, matrix );
-	GL_SetProjectionMatrix(matrix);
+	GL_SetModelMatrix(backEnd.viewParms.world.modelMatrix);
+	GL_SetProjectionMatrix(backEnd.viewParms.projectionMatrix);
+
+	// queue up the tests the next frames will read, against this
+	// view's depth before any flare is drawn over it
+	if ( useQueries ) {
+		GL_State( 0 );
+		GL_Cull( CT_TWO_SIDED );
+		GL_BindToTMU( tr.whiteImage, TB_COLORMAP );
+		qglColorMask( GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE );
+
+		for ( f = r_activeFlares ; f ; f = f->next ) {
+			if ( f->frameSceneNum == backEnd.viewParms.frameSceneNum
+				&& f->inPortal == backEnd.viewParms.isPortal ) {
+				RB_IssueFlareQuery( f );
+			}
+		}
 
-	for ( f = r_activeFlares ; f ; f = f->next ) {
-		if ( f->frameSceneNum == backEnd.viewParms.frameSceneNum
-			&& f->inPortal == backEnd.viewParms.isPortal
-			&& f->drawIntensity ) {
-			RB_RenderFlare( f );
+		qglColorMask( !backEnd.colorMask[0], !backEnd.colorMask[1], !backEnd.colorMask[2], !backEnd.colorMask[3] );
+		R_BindNullVao();
+	}
+
+	if ( draw ) {
+		for ( f = r_activeFlares ; f ; f = f->next ) {
+			if ( f->frameSceneNum == backEnd.viewParms.frameSceneNum
+				&& f->inPortal == backEnd.viewParms.isPortal
+				&& f->drawIntensity ) {
+				RB_RenderFlare( f );
+			}
 		}
 	}
 
 	GL_SetProjectionMatrix(oldprojection);
 	GL_SetModelMatrix(oldmodelmatrix);
 }
-
-
-
-
-
@@ -42,6 +42,8 @@ extern const char *fallbackShader_fogpass_vp;
 extern const char *fallbackShader_fogpass_fp;
 extern const char *fallbackShader_generic_vp;
 extern const char *fallbackShader_generic_fp;
+extern const char *fallbackShader_hiz_vp;
+extern const char *fallbackShader_hiz_fp;
 extern const char *fallbackShader_lightall_vp;
 extern const char *fallbackShader_lightall_fp;
 extern const char *fallbackShader_pshadow_vp;
@@ -81,6 +83,60 @@ GLuint		projectionMatricesBuffer[PROJECTION_COUNT];
 
 float       orthoProjectionMatrix[16];
 
+static qboolean glslAsyncLink;		// leave compile and link status to GLSL_WarmupShaders
+
+static int glslErrorCode;
+static char glslError[MAX_STRING_CHARS];	// held for GLSL_CheckErrors
+
+/*
+====================
+GLSL_Printf
+
+Lazy permutations can be compiled by the r_smp render thread, which
+can't touch the console, so anything printed from there is dropped.
+====================
+*/
+static Q_PRINTF_FUNC(2, 3) void QDECL GLSL_Printf(int printLevel, const char *fmt, ...)
+{
+	va_list argptr;
+	char msg[MAX_STRING_CHARS];
+
+	if (renderThreadActive)
+		return;
+
+	va_start(argptr, fmt);
+	Q_vsnprintf(msg, sizeof(msg), fmt, argptr);
+	va_end(argptr);
+
+	ri.Printf(printLevel, "%s", msg);
+}
+
+/*
+====================
+GLSL_Error
+
+Errors from the render thread can't unwind it, so they are held until
+GLSL_CheckErrors and the caller has to back out on its own.
+====================
+*/
+static Q_PRINTF_FUNC(2, 3) void QDECL GLSL_Error(int code, const char *fmt, ...)
+{
+	va_list argptr;
+	char msg[MAX_STRING_CHARS];
+
+	va_start(argptr, fmt);
+	Q_vsnprintf(msg, sizeof(msg), fmt, argptr);
+	va_end(argptr);
+
+	if (!renderThreadActive)
+		ri.Error(code, "%s", msg);
+
+	if (!glslError[0])
+	{
+		glslErrorCode = code;
+		Q_strncpyz(glslError, msg, sizeof(glslError));
+	}
+}
 
 // These must be in the same order as in uniform_t in tr_local.h.
 static uniformInfo_t uniformsInfo[] =
@@ -292,12 +348,13 @@ static void GLSL_ProjectionMatricesUniformBuffer(GLint projectionMatricesBuffer,
 GLSL_UpdateMirrorProjection
 
 Updates just the mirror projection buffer after oblique near-plane clipping is calculated.
-Called from R_SetupProjectionZ when a portal is encountered.
+Called from RB_MirrorProjection for the command queued by R_SetupProjectionZ
+when a portal is encountered.
 ====================
 */
-void GLSL_UpdateMirrorProjection(void) {
+void GLSL_UpdateMirrorProjection(const float projectionEye[2][16]) {
 	GLSL_ProjectionMatricesUniformBuffer(projectionMatricesBuffer[MIRROR_VR_PROJECTION],
-		tr.vrParms.mirrorProjectionEye[0], tr.vrParms.mirrorProjectionEye[1]);
+		projectionEye[0], projectionEye[1]);
 }
 
 /*
@@ -321,6 +378,10 @@ static void GLSL_PrintLog(GLuint programOrShader, glslPrintLog_t type, qboolean
 	int             i;
 	int             printLevel = developerOnly ? PRINT_DEVELOPER : PRINT_ALL;
 
+	// nothing would be printed, and msgPart and ri.Malloc aren't thread safe
+	if (renderThreadActive)
+		return;
+
 	switch (type)
 	{
 		case GLSL_PRINTLOG_PROGRAM_INFO:
@@ -389,6 +450,7 @@ static void GLSL_PrintLog(GLuint programOrShader, glslPrintLog_t type, qboolean
 
 static void GLSL_GetShaderHeader( GLenum shaderType, const GLchar *extra, char *dest, int size )
 {
+	char line[1024];
 	float fbufWidthScale, fbufHeightScale;
 
 	dest[0] = '\0';
@@ -421,6 +483,7 @@ static void GLSL_GetShaderHeader( GLenum shaderType, const GLchar *extra, char *
 		{
 			Q_strcat(dest, size, "precision mediump float;\n");
 			Q_strcat(dest, size, "precision mediump sampler2DShadow;\n");
+			Q_strcat(dest, size, "precision mediump sampler2DArray;\n");
 		}
 
 		if(shaderType == GL_VERTEX_SHADER)
@@ -484,8 +547,8 @@ static void GLSL_GetShaderHeader( GLenum shaderType, const GLchar *extra, char *
 
 	//Q_strcat(dest, size, va("#ifndef MAX_SHADOWMAPS\n#define MAX_SHADOWMAPS %i\n#endif\n", MAX_SHADOWMAPS));
 
-	Q_strcat(dest, size,
-					 va("#ifndef deformGen_t\n"
+	Com_sprintf(line, sizeof(line),
+						"#ifndef deformGen_t\n"
 						"#define deformGen_t\n"
 						"#define DGEN_WAVE_SIN %i\n"
 						"#define DGEN_WAVE_SQUARE %i\n"
@@ -501,10 +564,11 @@ static void GLSL_GetShaderHeader( GLenum shaderType, const GLchar *extra, char *
 						DGEN_WAVE_SAWTOOTH,
 						DGEN_WAVE_INVERSE_SAWTOOTH,
 						DGEN_BULGE,
-						DGEN_MOVE));
+						DGEN_MOVE);
+	Q_strcat(dest, size, line);
 
-	Q_strcat(dest, size,
-					 va("#ifndef tcGen_t\n"
+	Com_sprintf(line, sizeof(line),
+						"#ifndef tcGen_t\n"
 						"#define tcGen_t\n"
 						"#define TCGEN_LIGHTMAP %i\n"
 						"#define TCGEN_TEXTURE %i\n"
@@ -516,28 +580,31 @@ static void GLSL_GetShaderHeader( GLenum shaderType, const GLchar *extra, char *
 						TCGEN_TEXTURE,
 						TCGEN_ENVIRONMENT_MAPPED,
 						TCGEN_FOG,
-						TCGEN_VECTOR));
+						TCGEN_VECTOR);
+	Q_strcat(dest, size, line);
 
-	Q_strcat(dest, size,
-					 va("#ifndef colorGen_t\n"
+	Com_sprintf(line, sizeof(line),
+						"#ifndef colorGen_t\n"
 						"#define colorGen_t\n"
 						"#define CGEN_LIGHTING_DIFFUSE %i\n"
 						"#endif\n",
-						CGEN_LIGHTING_DIFFUSE));
+						CGEN_LIGHTING_DIFFUSE);
+	Q_strcat(dest, size, line);
 
-	Q_strcat(dest, size,
-							 va("#ifndef alphaGen_t\n"
+	Com_sprintf(line, sizeof(line),
+								"#ifndef alphaGen_t\n"
 								"#define alphaGen_t\n"
 								"#define AGEN_LIGHTING_SPECULAR %i\n"
 								"#define AGEN_PORTAL %i\n"
 								"#endif\n",
 								AGEN_LIGHTING_SPECULAR,
-								AGEN_PORTAL));
+								AGEN_PORTAL);
+	Q_strcat(dest, size, line);
 
 	fbufWidthScale = 1.0f / ((float)glConfig.vidWidth);
 	fbufHeightScale = 1.0f / ((float)glConfig.vidHeight);
-	Q_strcat(dest, size,
-			 va("#ifndef r_FBufScale\n#define r_FBufScale vec2(%f, %f)\n#endif\n", fbufWidthScale, fbufHeightScale));
+	Com_sprintf(line, sizeof(line), "#ifndef r_FBufScale\n#define r_FBufScale vec2(%f, %f)\n#endif\n", fbufWidthScale, fbufHeightScale);
+	Q_strcat(dest, size, line);
 
 	if (r_pbr->integer)
 		Q_strcat(dest, size, "#define USE_PBR\n");
@@ -553,7 +620,8 @@ static void GLSL_GetShaderHeader( GLenum shaderType, const GLchar *extra, char *
 			numRoughnessMips++;
 		}
 		numRoughnessMips = MAX(1, numRoughnessMips - 2);
-		Q_strcat(dest, size, va("#define ROUGHNESS_MIPS float(%d)\n", numRoughnessMips));
+		Com_sprintf(line, sizeof(line), "#define ROUGHNESS_MIPS float(%d)\n", numRoughnessMips);
+		Q_strcat(dest, size, line);
 	}
 
 	// OK we added a lot of stuff but if we do something bad in the GLSL shaders then we want the proper line
@@ -573,14 +641,18 @@ static int GLSL_CompileGPUShader(GLuint program, GLuint *prevShader, const GLcha
 	// compile shader
 	qglCompileShader(shader);
 
-	// check if shader compiled
-	qglGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-	if(!compiled)
+	// check if shader compiled, unless that would wait for a background compile
+	if (!glslAsyncLink)
 	{
-		GLSL_PrintLog(shader, GLSL_PRINTLOG_SHADER_SOURCE, qfalse);
-		GLSL_PrintLog(shader, GLSL_PRINTLOG_SHADER_INFO, qfalse);
-		ri.Error(ERR_DROP, "Couldn't compile shader");
-		return 0;
+		qglGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+		if(!compiled)
+		{
+			GLSL_PrintLog(shader, GLSL_PRINTLOG_SHADER_SOURCE, qfalse);
+			GLSL_PrintLog(shader, GLSL_PRINTLOG_SHADER_INFO, qfalse);
+			qglDeleteShader(shader);
+			GLSL_Error(ERR_DROP, "Couldn't compile shader");
+			return 0;
+		}
 	}
 
 	if (*prevShader)
@@ -626,19 +698,19 @@ static int GLSL_LoadGPUShaderText(const char *name, const char *fallback,
 	{
 		if (fallback)
 		{
-			ri.Printf(PRINT_DEVELOPER, "...loading built-in '%s'\n", filename);
+			GLSL_Printf(PRINT_DEVELOPER, "...loading built-in '%s'\n", filename);
 			shaderText = fallback;
 			size = strlen(shaderText);
 		}
 		else
 		{
-			ri.Printf(PRINT_DEVELOPER, "couldn't load '%s'\n", filename);
+			GLSL_Printf(PRINT_DEVELOPER, "couldn't load '%s'\n", filename);
 			return 0;
 		}
 	}
 	else
 	{
-		ri.Printf(PRINT_DEVELOPER, "...loading '%s'\n", filename);
+		GLSL_Printf(PRINT_DEVELOPER, "...loading '%s'\n", filename);
 		shaderText = buffer;
 	}
 
@@ -660,7 +732,7 @@ static int GLSL_LoadGPUShaderText(const char *name, const char *fallback,
 	return result;
 }
 
-static void GLSL_LinkProgram(GLuint program)
+static int GLSL_LinkProgram(GLuint program)
 {
 	GLint           linked;
 
@@ -670,8 +742,11 @@ static void GLSL_LinkProgram(GLuint program)
 	if(!linked)
 	{
 		GLSL_PrintLog(program, GLSL_PRINTLOG_PROGRAM_INFO, qfalse);
-		ri.Error(ERR_DROP, "shaders failed to link");
+		GLSL_Error(ERR_DROP, "shaders failed to link");
+		return 0;
 	}
+
+	return 1;
 }
 
 static void GLSL_ShowProgramUniforms(GLuint program)
@@ -688,17 +763,201 @@ static void GLSL_ShowProgramUniforms(GLuint program)
 	{
 		qglGetActiveUniform(program, i, sizeof(uniformName), NULL, &size, &type, uniformName);
 
-		ri.Printf(PRINT_DEVELOPER, "active uniform: '%s'\n", uniformName);
+		GLSL_Printf(PRINT_DEVELOPER, "active uniform: '%s'\n", uniformName);
+	}
+}
+
+/*
+====================
+GLSL program binary cache
+
+Linked programs are saved to glslcache/ under fs_homepath, one file per
+program, named after the program and a hash of its final source.  They are
+read and written as raw files, so a pk3 can never supply one and pure
+servers don't hide them.  The file
+also records which driver built it.  A different driver, or a binary the
+driver refuses to load, means compiling from source as usual and writing the
+file again.
+====================
+*/
+
+#define GLSL_CACHE_IDENT	(('C'<<24)+('S'<<16)+('L'<<8)+'G')
+#define GLSL_CACHE_VERSION	1
+
+#define GLSL_HASH_BASIS		2166136261u
+
+typedef struct {
+	int			ident;
+	int			version;
+	unsigned	driverHash;
+	unsigned	sourceHash;		// second hash to catch file name collisions
+	int			sourceLength;
+	int			attribs;
+	GLenum		binaryFormat;
+	int			binaryLength;
+} glslCacheHeader_t;
+
+static int numCachedShaders;
+
+// programs GLSL_WarmupShaders has handed to the driver
+typedef struct {
+	shaderProgram_t		*program;
+	glslCacheHeader_t	cacheHeader;
+	char				cacheName[MAX_QPATH];	// empty when it can't be saved
+} glslPending_t;
+
+static glslPending_t glslPending[GENERICDEF_COUNT + LIGHTDEF_COUNT];
+static int numGlslPending;
+
+static qboolean glslLazy;
+static qboolean glslMenuLight;
+static int glslWarmupNext;
+
+#define GLSL_WARMUP_PER_FRAME	4	// permutations handed to the driver each frame
+
+static unsigned GLSL_HashString(unsigned hash, const char *s)
+{
+	// FNV-1a
+	while (*s)
+	{
+		hash ^= (byte)*s++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+static unsigned GLSL_DriverHash(void)
+{
+	unsigned hash = GLSL_HASH_BASIS;
+
+	hash = GLSL_HashString(hash, glConfig.vendor_string);
+	hash = GLSL_HashString(hash, glConfig.renderer_string);
+	hash = GLSL_HashString(hash, glConfig.version_string);
+
+	return hash;
+}
+
+static void GLSL_SetupProgramCache(glslCacheHeader_t *header, char *filename, int size,
+	const char *name, int attribs, const char *vpCode, const char *fpCode)
+{
+	unsigned fileHash;
+
+	fileHash = GLSL_HashString(GLSL_HASH_BASIS, vpCode);
+	fileHash = GLSL_HashString(fileHash, fpCode ? fpCode : "");
+	fileHash = (fileHash ^ attribs) * 16777619u;
+
+	Com_Memset(header, 0, sizeof(*header));
+	header->ident = GLSL_CACHE_IDENT;
+	header->version = GLSL_CACHE_VERSION;
+	header->driverHash = GLSL_DriverHash();
+	header->sourceHash = GLSL_HashString(GLSL_HashString(~GLSL_HASH_BASIS, vpCode), fpCode ? fpCode : "");
+	header->sourceLength = strlen(vpCode) + (fpCode ? strlen(fpCode) : 0);
+	header->attribs = attribs;
+
+	Com_sprintf(filename, size, "glslcache/%s_%08x.bin", name, fileHash);
+}
+
+static qboolean GLSL_LoadProgramBinary(shaderProgram_t *program, const char *filename, const glslCacheHeader_t *expected)
+{
+	glslCacheHeader_t *header;
+	fileHandle_t    f;
+	long            size;
+	GLint           linked;
+
+	size = ri.FS_BaseDir_FOpenCacheFileRead(filename, &f);
+	if (!f)
+	{
+		return qfalse;
+	}
+
+	if (size < sizeof(*header))
+	{
+		ri.FS_FCloseFile(f);
+		return qfalse;
+	}
+
+	header = ri.Malloc(size);
+	if (ri.FS_Read(header, size, f) != size)
+	{
+		ri.FS_FCloseFile(f);
+		ri.Free(header);
+		return qfalse;
+	}
+	ri.FS_FCloseFile(f);
+
+	if (header->ident != expected->ident
+		|| header->version != expected->version
+		|| header->driverHash != expected->driverHash
+		|| header->sourceHash != expected->sourceHash
+		|| header->sourceLength != expected->sourceLength
+		|| header->attribs != expected->attribs
+		|| header->binaryLength != size - sizeof(*header))
+	{
+		ri.Printf(PRINT_DEVELOPER, "...%s is out of date\n", filename);
+		ri.Free(header);
+		return qfalse;
+	}
+
+	qglProgramBinary(program->program, header->binaryFormat, header + 1, header->binaryLength);
+	ri.Free(header);
+
+	// the driver may still turn it down, e.g. after an update that kept the version string
+	qglGetProgramiv(program->program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		ri.Printf(PRINT_DEVELOPER, "...%s was rejected by the driver\n", filename);
+		return qfalse;
+	}
+
+	ri.Printf(PRINT_DEVELOPER, "...loading '%s'\n", filename);
+	numCachedShaders++;
+
+	return qtrue;
+}
+
+static void GLSL_SaveProgramBinary(shaderProgram_t *program, const char *filename, const glslCacheHeader_t *expected)
+{
+	glslCacheHeader_t *header;
+	GLint           length = 0;
+
+	qglGetProgramiv(program->program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	header = ri.Malloc(sizeof(*header) + length);
+	*header = *expected;
+
+	qglGetProgramBinary(program->program, length, &length, &header->binaryFormat, header + 1);
+	header->binaryLength = length;
+
+	if (length > 0)
+	{
+		fileHandle_t f = ri.FS_BaseDir_FOpenFileWrite(filename);
+
+		if (f)
+		{
+			ri.FS_Write(header, sizeof(*header) + length, f);
+			ri.FS_FCloseFile(f);
+		}
 	}
+
+	ri.Free(header);
 }
 
 static int GLSL_InitGPUShader2(shaderProgram_t * program, const char *name, int attribs, const char *vpCode, const char *fpCode)
 {
-	ri.Printf(PRINT_DEVELOPER, "------- GPU shader -------\n");
+	glslCacheHeader_t cacheHeader;
+	char            cacheName[MAX_QPATH];
+
+	GLSL_Printf(PRINT_DEVELOPER, "------- GPU shader -------\n");
 
 	if(strlen(name) >= MAX_QPATH)
 	{
-		ri.Error(ERR_DROP, "GLSL_InitGPUShader2: \"%s\" is too long", name);
+		GLSL_Error(ERR_DROP, "GLSL_InitGPUShader2: \"%s\" is too long", name);
+		return 0;
 	}
 
 	Q_strncpyz(program->name, name, sizeof(program->name));
@@ -706,10 +965,26 @@ static int GLSL_InitGPUShader2(shaderProgram_t * program, const char *name, int
 	program->program = qglCreateProgram();
 	program->attribs = attribs;
 
+	cacheName[0] = '\0';
+
+	// the file system isn't safe to use from the r_smp render thread
+	if (glRefConfig.programBinary && !renderThreadActive)
+	{
+		GLSL_SetupProgramCache(&cacheHeader, cacheName, sizeof(cacheName), name, attribs, vpCode, fpCode);
+
+		if (GLSL_LoadProgramBinary(program, cacheName, &cacheHeader))
+		{
+			return 1;
+		}
+
+		qglProgramParameteri(program->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+
 	if (!(GLSL_CompileGPUShader(program->program, &program->vertexShader, vpCode, strlen(vpCode), GL_VERTEX_SHADER)))
 	{
-		ri.Printf(PRINT_ALL, "GLSL_InitGPUShader2: Unable to load \"%s\" as GL_VERTEX_SHADER\n", name);
+		GLSL_Printf(PRINT_ALL, "GLSL_InitGPUShader2: Unable to load \"%s\" as GL_VERTEX_SHADER\n", name);
 		qglDeleteProgram(program->program);
+		program->program = 0;
 		return 0;
 	}
 
@@ -717,8 +992,9 @@ static int GLSL_InitGPUShader2(shaderProgram_t * program, const char *name, int
 	{
 		if(!(GLSL_CompileGPUShader(program->program, &program->fragmentShader, fpCode, strlen(fpCode), GL_FRAGMENT_SHADER)))
 		{
-			ri.Printf(PRINT_ALL, "GLSL_InitGPUShader2: Unable to load \"%s\" as GL_FRAGMENT_SHADER\n", name);
+			GLSL_Printf(PRINT_ALL, "GLSL_InitGPUShader2: Unable to load \"%s\" as GL_FRAGMENT_SHADER\n", name);
 			qglDeleteProgram(program->program);
+			program->program = 0;
 			return 0;
 		}
 	}
@@ -768,7 +1044,31 @@ static int GLSL_InitGPUShader2(shaderProgram_t * program, const char *name, int
 	if(attribs & ATTR_TANGENT2)
 		qglBindAttribLocation(program->program, ATTR_INDEX_TANGENT2, "attr_Tangent2");
 
-	GLSL_LinkProgram(program->program);
+	if (glslAsyncLink)
+	{
+		glslPending_t *pending = &glslPending[numGlslPending++];
+
+		qglLinkProgram(program->program);
+
+		pending->program = program;
+		pending->cacheHeader = cacheHeader;
+		Q_strncpyz(pending->cacheName, cacheName, sizeof(pending->cacheName));
+
+		program->pending = qtrue;
+		return 1;
+	}
+
+	if (!GLSL_LinkProgram(program->program))
+	{
+		qglDeleteProgram(program->program);
+		program->program = 0;
+		return 0;
+	}
+
+	if (cacheName[0])
+	{
+		GLSL_SaveProgramBinary(program, cacheName, &cacheHeader);
+	}
 
 	return 1;
 }
@@ -825,6 +1125,31 @@ static int GLSL_InitGPUShader(shaderProgram_t * program, const char *name,
 	return result;
 }
 
+static int GLSL_UniformSize(int uniformNum)
+{
+	switch(uniformsInfo[uniformNum].type)
+	{
+		case GLSL_INT:
+			return sizeof(GLint);
+		case GLSL_FLOAT:
+			return sizeof(GLfloat);
+		case GLSL_FLOAT5:
+			return sizeof(vec_t) * 5;
+		case GLSL_VEC2:
+			return sizeof(vec_t) * 2;
+		case GLSL_VEC3:
+			return sizeof(vec_t) * 3;
+		case GLSL_VEC4:
+			return sizeof(vec_t) * 4;
+		case GLSL_MAT16:
+			return sizeof(vec_t) * 16;
+		case GLSL_MAT16_BONEMATRIX:
+			return sizeof(vec_t) * 16 * glRefConfig.glslMaxAnimatedBones;
+		default:
+			return 0;
+	}
+}
+
 void GLSL_InitUniforms(shaderProgram_t *program)
 {
 	int i, size;
@@ -858,38 +1183,14 @@ void GLSL_InitUniforms(shaderProgram_t *program)
 		 
 		program->uniformBufferOffsets[i] = size;
 
-		switch(uniformsInfo[i].type)
-		{
-			case GLSL_INT:
-				size += sizeof(GLint);
-				break;
-			case GLSL_FLOAT:
-				size += sizeof(GLfloat);
-				break;
-			case GLSL_FLOAT5:
-				size += sizeof(vec_t) * 5;
-				break;
-			case GLSL_VEC2:
-				size += sizeof(vec_t) * 2;
-				break;
-			case GLSL_VEC3:
-				size += sizeof(vec_t) * 3;
-				break;
-			case GLSL_VEC4:
-				size += sizeof(vec_t) * 4;
-				break;
-			case GLSL_MAT16:
-				size += sizeof(vec_t) * 16;
-				break;
-			case GLSL_MAT16_BONEMATRIX:
-				size += sizeof(vec_t) * 16 * glRefConfig.glslMaxAnimatedBones;
-				break;
-			default:
-				break;
-		}
+		size += GLSL_UniformSize(i);
 	}
 
-	program->uniformBuffer = ri.Malloc(size);
+	// lazy permutations have theirs already, see GLSL_ReserveUniformBuffer
+	if (!program->uniformBuffer)
+	{
+		program->uniformBuffer = ri.Malloc(size);
+	}
 }
 
 void GLSL_FinishGPUShader(shaderProgram_t *program)
@@ -1116,363 +1417,769 @@ void GLSL_DeleteGPUShader(shaderProgram_t *program)
 		}
 
 		qglDeleteProgram(program->program);
+	}
 
-		if (program->uniformBuffer)
-		{
-			ri.Free(program->uniformBuffer);
-		}
-
-		Com_Memset(program, 0, sizeof(*program));
+	if (program->uniformBuffer)
+	{
+		ri.Free(program->uniformBuffer);
 	}
+
+	Com_Memset(program, 0, sizeof(*program));
 }
 
-void GLSL_InitGPUShaders(void)
+/*
+====================
+Lazy permutations
+
+With r_glslLazy the generic and lightall permutations aren't compiled up
+front.  GLSL_CompileReferencedShaders builds the ones the loaded shaders ask
+for, GLSL_WarmupShaders has the driver build the rest in the background when
+it supports KHR_parallel_shader_compile, and GLSL_BindProgram builds anything
+still missing on first use.
+====================
+*/
+
+static qboolean GLSL_GenericShaderValid(int i)
 {
-	int             startTime, endTime;
-	int i;
-	char extradefines[1024];
-	int attribs;
-	int numGenShaders = 0, numLightShaders = 0, numEtcShaders = 0;
+	if ((i & GENERICDEF_USE_VERTEX_ANIMATION) && (i & GENERICDEF_USE_BONE_ANIMATION))
+		return qfalse;
 
-	ri.Printf(PRINT_ALL, "------- GLSL_InitGPUShaders -------\n");
+	if ((i & GENERICDEF_USE_BONE_ANIMATION) && !glRefConfig.glslMaxAnimatedBones)
+		return qfalse;
 
-	for (int i = 0; i < PROJECTION_COUNT; ++i)
+	if ((i & GENERICDEF_USE_VERTEX_ANIMATION) && !glRefConfig.gpuVertexAnimation)
+		return qfalse;
+
+	if (i & GENERICDEF_USE_LIGHTMAP_ARRAY)
 	{
-		//Generate buffer for 2 * view matrices
-		qglGenBuffers(1, &viewMatricesBuffer[i]);
-		qglBindBuffer(GL_UNIFORM_BUFFER, viewMatricesBuffer[i]);
-		qglBufferData(
-				GL_UNIFORM_BUFFER,
-				2 * 16 * sizeof(float),
-				NULL,
-				GL_STATIC_DRAW);
-		qglBindBuffer(GL_UNIFORM_BUFFER, 0);
+		if (!r_lightmapArray->integer || !glRefConfig.textureArray)
+			return qfalse;
 
-		qglGenBuffers(1, &projectionMatricesBuffer[i]);
-		qglBindBuffer(GL_UNIFORM_BUFFER, projectionMatricesBuffer[i]);
-		qglBufferData(
-				GL_UNIFORM_BUFFER,
-				2 * 16 * sizeof(float),  // Per-eye projection matrices
-				NULL,
-				GL_STATIC_DRAW);
-		qglBindBuffer(GL_UNIFORM_BUFFER, 0);
+		// lightmap arrays are only used by the world and its brush models
+		if (i & (GENERICDEF_USE_VERTEX_ANIMATION | GENERICDEF_USE_BONE_ANIMATION))
+			return qfalse;
 	}
 
-	R_IssuePendingRenderCommands();
+	return qtrue;
+}
 
-	startTime = ri.Milliseconds();
+static void GLSL_SetupGenericShader(shaderProgram_t *program)
+{
+	GLSL_InitUniforms(program);
 
-	// OpenGL ES may not have enough attributes to fit ones used for vertex animation
-	if ( glRefConfig.maxVertexAttribs > ATTR_INDEX_NORMAL2 ) {
-		ri.Printf(PRINT_ALL, "Using GPU vertex animation\n");
-		glRefConfig.gpuVertexAnimation = qtrue;
-	} else {
-		ri.Printf(PRINT_ALL, "Using CPU vertex animation\n");
-		glRefConfig.gpuVertexAnimation = qfalse;
-	}
+	GLSL_SetUniformInt(program, UNIFORM_DIFFUSEMAP, TB_DIFFUSEMAP);
+	GLSL_SetUniformInt(program, UNIFORM_LIGHTMAP,   TB_LIGHTMAP);
 
-	for (i = 0; i < GENERICDEF_COUNT; i++)
-	{	
-		if ((i & GENERICDEF_USE_VERTEX_ANIMATION) && (i & GENERICDEF_USE_BONE_ANIMATION))
-			continue;
+	GLSL_FinishGPUShader(program);
+}
 
-		if ((i & GENERICDEF_USE_BONE_ANIMATION) && !glRefConfig.glslMaxAnimatedBones)
-			continue;
+static void GLSL_InitGenericShader(int i)
+{
+	char extradefines[1024];
+	char line[128];
+	int attribs;
 
-		attribs = ATTR_POSITION | ATTR_TEXCOORD | ATTR_LIGHTCOORD | ATTR_NORMAL | ATTR_COLOR;
-		extradefines[0] = '\0';
+	attribs = ATTR_POSITION | ATTR_TEXCOORD | ATTR_LIGHTCOORD | ATTR_NORMAL | ATTR_COLOR;
+	extradefines[0] = '\0';
 
-		if (i & GENERICDEF_USE_DEFORM_VERTEXES)
-			Q_strcat(extradefines, 1024, "#define USE_DEFORM_VERTEXES\n");
+	if (i & GENERICDEF_USE_DEFORM_VERTEXES)
+		Q_strcat(extradefines, 1024, "#define USE_DEFORM_VERTEXES\n");
 
-		if (i & GENERICDEF_USE_TCGEN_AND_TCMOD)
-		{
-			Q_strcat(extradefines, 1024, "#define USE_TCGEN\n");
-			Q_strcat(extradefines, 1024, "#define USE_TCMOD\n");
-		}
+	if (i & GENERICDEF_USE_TCGEN_AND_TCMOD)
+	{
+		Q_strcat(extradefines, 1024, "#define USE_TCGEN\n");
+		Q_strcat(extradefines, 1024, "#define USE_TCMOD\n");
+	}
 
-		if (i & GENERICDEF_USE_VERTEX_ANIMATION)
-		{
-			if (!glRefConfig.gpuVertexAnimation)
-				continue;
+	if (i & GENERICDEF_USE_VERTEX_ANIMATION)
+	{
+		Q_strcat(extradefines, 1024, "#define USE_VERTEX_ANIMATION\n");
+		attribs |= ATTR_POSITION2 | ATTR_NORMAL2;
+	}
+	else if (i & GENERICDEF_USE_BONE_ANIMATION)
+	{
+		Com_sprintf(line, sizeof(line), "#define USE_BONE_ANIMATION\n#define MAX_GLSL_BONES %d\n", glRefConfig.glslMaxAnimatedBones);
+		Q_strcat(extradefines, 1024, line);
+		attribs |= ATTR_BONE_INDEXES | ATTR_BONE_WEIGHTS;
+	}
 
-			Q_strcat(extradefines, 1024, "#define USE_VERTEX_ANIMATION\n");
-			attribs |= ATTR_POSITION2 | ATTR_NORMAL2;
-		}
-		else if (i & GENERICDEF_USE_BONE_ANIMATION)
-		{
-			Q_strcat(extradefines, 1024, va("#define USE_BONE_ANIMATION\n#define MAX_GLSL_BONES %d\n", glRefConfig.glslMaxAnimatedBones));
-			attribs |= ATTR_BONE_INDEXES | ATTR_BONE_WEIGHTS;
-		}
+	if (i & GENERICDEF_USE_FOG)
+		Q_strcat(extradefines, 1024, "#define USE_FOG\n");
 
-		if (i & GENERICDEF_USE_FOG)
-			Q_strcat(extradefines, 1024, "#define USE_FOG\n");
+	if (i & GENERICDEF_USE_RGBAGEN)
+		Q_strcat(extradefines, 1024, "#define USE_RGBAGEN\n");
 
-		if (i & GENERICDEF_USE_RGBAGEN)
-			Q_strcat(extradefines, 1024, "#define USE_RGBAGEN\n");
+	if (i & GENERICDEF_USE_LIGHTMAP_ARRAY)
+		Q_strcat(extradefines, 1024, "#define USE_LIGHTMAP_ARRAY\n");
 
-		if (!GLSL_InitGPUShader(&tr.genericShader[i], "generic", attribs, qtrue, extradefines, qtrue, fallbackShader_generic_vp, fallbackShader_generic_fp))
-		{
-			ri.Error(ERR_FATAL, "Could not load generic shader!");
-		}
+	if (!GLSL_InitGPUShader(&tr.genericShader[i], "generic", attribs, qtrue, extradefines, qtrue, fallbackShader_generic_vp, fallbackShader_generic_fp))
+	{
+		GLSL_Error(ERR_FATAL, "Could not load generic shader!");
+		return;
+	}
 
-		GLSL_InitUniforms(&tr.genericShader[i]);
+	if (!tr.genericShader[i].pending)
+	{
+		GLSL_SetupGenericShader(&tr.genericShader[i]);
+	}
+}
 
-		GLSL_SetUniformInt(&tr.genericShader[i], UNIFORM_DIFFUSEMAP, TB_DIFFUSEMAP);
-		GLSL_SetUniformInt(&tr.genericShader[i], UNIFORM_LIGHTMAP,   TB_LIGHTMAP);
+static qboolean GLSL_LightallShaderValid(int i)
+{
+	int lightType = i & LIGHTDEF_LIGHTTYPE_MASK;
 
-		GLSL_FinishGPUShader(&tr.genericShader[i]);
+	// skip impossible combos
+	if ((i & LIGHTDEF_USE_PARALLAXMAP) && !r_parallaxMapping->integer)
+		return qfalse;
 
-		numGenShaders++;
-	}
+	if ((i & LIGHTDEF_USE_SHADOWMAP) && (!lightType || !r_sunlightMode->integer))
+		return qfalse;
 
+	if ((i & LIGHTDEF_ENTITY_VERTEX_ANIMATION) && (i & LIGHTDEF_ENTITY_BONE_ANIMATION))
+		return qfalse;
 
-	attribs = ATTR_POSITION | ATTR_TEXCOORD;
+	if ((i & LIGHTDEF_ENTITY_BONE_ANIMATION) && !glRefConfig.glslMaxAnimatedBones)
+		return qfalse;
 
-	if (!GLSL_InitGPUShader(&tr.textureColorShader, "texturecolor", attribs, qtrue, extradefines, qtrue, fallbackShader_texturecolor_vp, fallbackShader_texturecolor_fp))
+	if (i & LIGHTDEF_USE_LIGHTMAP_ARRAY)
 	{
-		ri.Error(ERR_FATAL, "Could not load texturecolor shader!");
-	}
-	
-	GLSL_InitUniforms(&tr.textureColorShader);
+		if (!r_lightmapArray->integer || !glRefConfig.textureArray)
+			return qfalse;
 
-	GLSL_SetUniformInt(&tr.textureColorShader, UNIFORM_TEXTUREMAP, TB_DIFFUSEMAP);
+		// lightmap arrays are only used by the world and its brush models
+		if (i & LIGHTDEF_ENTITY_BONE_ANIMATION)
+			return qfalse;
 
-	GLSL_FinishGPUShader(&tr.textureColorShader);
+		// lightmapped, or r_lightmap drawing the array as the diffuse map
+		if (lightType != LIGHTDEF_USE_LIGHTMAP && (lightType || !(i & LIGHTDEF_USE_TCGEN_AND_TCMOD)))
+			return qfalse;
+	}
 
-	numEtcShaders++;
+	return qtrue;
+}
 
-	for (i = 0; i < FOGDEF_COUNT; i++)
-	{
-		if ((i & FOGDEF_USE_VERTEX_ANIMATION) && (i & FOGDEF_USE_BONE_ANIMATION))
-			continue;
+static void GLSL_SetupLightallShader(shaderProgram_t *program)
+{
+	GLSL_InitUniforms(program);
 
-		if ((i & FOGDEF_USE_VERTEX_ANIMATION) && !glRefConfig.gpuVertexAnimation)
-			continue;
+	GLSL_SetUniformInt(program, UNIFORM_DIFFUSEMAP,  TB_DIFFUSEMAP);
+	GLSL_SetUniformInt(program, UNIFORM_LIGHTMAP,    TB_LIGHTMAP);
+	GLSL_SetUniformInt(program, UNIFORM_NORMALMAP,   TB_NORMALMAP);
+	GLSL_SetUniformInt(program, UNIFORM_DELUXEMAP,   TB_DELUXEMAP);
+	GLSL_SetUniformInt(program, UNIFORM_SPECULARMAP, TB_SPECULARMAP);
+	GLSL_SetUniformInt(program, UNIFORM_SHADOWMAP,   TB_SHADOWMAP);
+	GLSL_SetUniformInt(program, UNIFORM_CUBEMAP,     TB_CUBEMAP);
 
-		if ((i & FOGDEF_USE_BONE_ANIMATION) && !glRefConfig.glslMaxAnimatedBones)
-			continue;
+	GLSL_FinishGPUShader(program);
+}
 
-		attribs = ATTR_POSITION | ATTR_NORMAL | ATTR_TEXCOORD;
-		extradefines[0] = '\0';
+static void GLSL_InitLightallShader(int i)
+{
+	char extradefines[1024];
+	char line[128];
+	int attribs;
+	int lightType = i & LIGHTDEF_LIGHTTYPE_MASK;
+	qboolean fastLight = !(r_normalMapping->integer || r_specularMapping->integer);
 
-		if (i & FOGDEF_USE_DEFORM_VERTEXES)
-			Q_strcat(extradefines, 1024, "#define USE_DEFORM_VERTEXES\n");
+	attribs = ATTR_POSITION | ATTR_TEXCOORD | ATTR_COLOR | ATTR_NORMAL;
 
-		if (i & FOGDEF_USE_VERTEX_ANIMATION)
+	extradefines[0] = '\0';
+
+	if (r_dlightMode->integer >= 2)
+		Q_strcat(extradefines, 1024, "#define USE_SHADOWMAP\n");
+
+	if (glRefConfig.swizzleNormalmap)
+		Q_strcat(extradefines, 1024, "#define SWIZZLE_NORMALMAP\n");
+
+
+	// HACK: use in main menu simple light model (to prevent issue with missing models textures)
+	if (glslMenuLight)
+	{
+		Q_strcat(extradefines, 1024, "#define USE_MENU_LIGHT\n");
+	}
+
+	if (lightType)
+	{
+		Q_strcat(extradefines, 1024, "#define USE_LIGHT\n");
+
+		if (fastLight)
+			Q_strcat(extradefines, 1024, "#define USE_FAST_LIGHT\n");
+
+		switch (lightType)
 		{
-			Q_strcat(extradefines, 1024, "#define USE_VERTEX_ANIMATION\n");
-			attribs |= ATTR_POSITION2 | ATTR_NORMAL2;
+			case LIGHTDEF_USE_LIGHTMAP:
+				Q_strcat(extradefines, 1024, "#define USE_LIGHTMAP\n");
+				if (r_deluxeMapping->integer && !fastLight)
+					Q_strcat(extradefines, 1024, "#define USE_DELUXEMAP\n");
+				attribs |= ATTR_LIGHTCOORD | ATTR_LIGHTDIRECTION;
+				break;
+			case LIGHTDEF_USE_LIGHT_VECTOR:
+				Q_strcat(extradefines, 1024, "#define USE_LIGHT_VECTOR\n");
+				break;
+			case LIGHTDEF_USE_LIGHT_VERTEX:
+				Q_strcat(extradefines, 1024, "#define USE_LIGHT_VERTEX\n");
+				attribs |= ATTR_LIGHTDIRECTION;
+				break;
+			default:
+				break;
 		}
-		else if (i & FOGDEF_USE_BONE_ANIMATION)
+
+		if (r_normalMapping->integer)
 		{
-			Q_strcat(extradefines, 1024, va("#define USE_BONE_ANIMATION\n#define MAX_GLSL_BONES %d\n", glRefConfig.glslMaxAnimatedBones));
-			attribs |= ATTR_BONE_INDEXES | ATTR_BONE_WEIGHTS;
+			Q_strcat(extradefines, 1024, "#define USE_NORMALMAP\n");
+
+			attribs |= ATTR_TANGENT;
+
+			if ((i & LIGHTDEF_USE_PARALLAXMAP) && !(i & LIGHTDEF_ENTITY_VERTEX_ANIMATION) && !(i & LIGHTDEF_ENTITY_BONE_ANIMATION) && r_parallaxMapping->integer)
+			{
+				Q_strcat(extradefines, 1024, "#define USE_PARALLAXMAP\n");
+				if (r_parallaxMapping->integer > 1)
+					Q_strcat(extradefines, 1024, "#define USE_RELIEFMAP\n");
+
+				if (r_parallaxMapShadows->integer)
+					Q_strcat(extradefines, 1024, "#define USE_PARALLAXMAP_SHADOWS\n");
+
+				Com_sprintf(line, sizeof(line), "#define r_parallaxMapOffset %f\n", r_parallaxMapOffset->value);
+				Q_strcat(extradefines, 1024, line);
+			}
 		}
 
-		if (!GLSL_InitGPUShader(&tr.fogShader[i], "fogpass", attribs, qtrue, extradefines, qtrue, fallbackShader_fogpass_vp, fallbackShader_fogpass_fp))
+		if (r_specularMapping->integer)
+			Q_strcat(extradefines, 1024, "#define USE_SPECULARMAP\n");
+
+		if (r_cubeMapping->integer)
 		{
-			ri.Error(ERR_FATAL, "Could not load fogpass shader!");
+			Q_strcat(extradefines, 1024, "#define USE_CUBEMAP\n");
+			if (r_cubeMapping->integer == 2)
+				Q_strcat(extradefines, 1024, "#define USE_BOX_CUBEMAP_PARALLAX\n");
+		}
+		else if (r_deluxeSpecular->value > 0.000001f)
+		{
+			Com_sprintf(line, sizeof(line), "#define r_deluxeSpecular %f\n", r_deluxeSpecular->value);
+			Q_strcat(extradefines, 1024, line);
 		}
 
-		GLSL_InitUniforms(&tr.fogShader[i]);
-		GLSL_FinishGPUShader(&tr.fogShader[i]);
+		switch (r_glossType->integer)
+		{
+			case 0:
+			default:
+				Q_strcat(extradefines, 1024, "#define GLOSS_IS_GLOSS\n");
+				break;
+			case 1:
+				Q_strcat(extradefines, 1024, "#define GLOSS_IS_SMOOTHNESS\n");
+				break;
+			case 2:
+				Q_strcat(extradefines, 1024, "#define GLOSS_IS_ROUGHNESS\n");
+				break;
+			case 3:
+				Q_strcat(extradefines, 1024, "#define GLOSS_IS_SHININESS\n");
+				break;
+		}
+	}
 
-		numEtcShaders++;
+	if (i & LIGHTDEF_USE_SHADOWMAP)
+	{
+		Q_strcat(extradefines, 1024, "#define USE_SHADOWMAP\n");
+
+		if (r_sunlightMode->integer == 1)
+			Q_strcat(extradefines, 1024, "#define SHADOWMAP_MODULATE\n");
+		else if (r_sunlightMode->integer == 2)
+			Q_strcat(extradefines, 1024, "#define USE_PRIMARY_LIGHT\n");
 	}
 
+	if (i & LIGHTDEF_USE_TCGEN_AND_TCMOD)
+	{
+		Q_strcat(extradefines, 1024, "#define USE_TCGEN\n");
+		Q_strcat(extradefines, 1024, "#define USE_TCMOD\n");
+	}
 
-	for (i = 0; i < DLIGHTDEF_COUNT; i++)
+	if (i & LIGHTDEF_USE_LIGHTMAP_ARRAY)
 	{
-		attribs = ATTR_POSITION | ATTR_NORMAL | ATTR_TEXCOORD;
-		extradefines[0] = '\0';
+		Q_strcat(extradefines, 1024, "#define USE_LIGHTMAP_ARRAY\n");
+		attribs |= ATTR_LIGHTCOORD;
+	}
 
-		if (i & DLIGHTDEF_USE_DEFORM_VERTEXES)
+	if (i & LIGHTDEF_ENTITY_VERTEX_ANIMATION)
+	{
+		Q_strcat(extradefines, 1024, "#define USE_MODELMATRIX\n");
+
+		if (glRefConfig.gpuVertexAnimation)
 		{
-			Q_strcat(extradefines, 1024, "#define USE_DEFORM_VERTEXES\n");
+			Q_strcat(extradefines, 1024, "#define USE_VERTEX_ANIMATION\n");
+			attribs |= ATTR_POSITION2 | ATTR_NORMAL2;
+
+			if (r_normalMapping->integer)
+			{
+				attribs |= ATTR_TANGENT2;
+			}
 		}
+	}
+	else if (i & LIGHTDEF_ENTITY_BONE_ANIMATION)
+	{
+		Q_strcat(extradefines, 1024, "#define USE_MODELMATRIX\n");
+		Com_sprintf(line, sizeof(line), "#define USE_BONE_ANIMATION\n#define MAX_GLSL_BONES %d\n", glRefConfig.glslMaxAnimatedBones);
+		Q_strcat(extradefines, 1024, line);
+		attribs |= ATTR_BONE_INDEXES | ATTR_BONE_WEIGHTS;
+	}
 
-		if (!GLSL_InitGPUShader(&tr.dlightShader[i], "dlight", attribs, qtrue, extradefines, qtrue, fallbackShader_dlight_vp, fallbackShader_dlight_fp))
+	if (!GLSL_InitGPUShader(&tr.lightallShader[i], "lightall", attribs, qtrue, extradefines, qtrue, fallbackShader_lightall_vp, fallbackShader_lightall_fp))
+	{
+		GLSL_Error(ERR_FATAL, "Could not load lightall shader!");
+		return;
+	}
+
+	if (!tr.lightallShader[i].pending)
+	{
+		GLSL_SetupLightallShader(&tr.lightallShader[i]);
+	}
+}
+
+
+static void GLSL_ReserveUniformBuffer(shaderProgram_t *program)
+{
+	int i, size = 0;
+
+	// the render thread can't allocate, so size for every uniform up front
+	for (i = 0; i < UNIFORM_COUNT; i++)
+		size += GLSL_UniformSize(i);
+
+	program->uniformBuffer = ri.Malloc(size);
+}
+
+static void GLSL_FinishPendingShader(int num)
+{
+	glslPending_t *pending = &glslPending[num];
+	shaderProgram_t *program = pending->program;
+	GLint linked;
+
+	qglGetProgramiv(program->program, GL_LINK_STATUS, &linked);
+	if (!linked)
+	{
+		GLSL_PrintLog(program->program, GLSL_PRINTLOG_PROGRAM_INFO, qfalse);
+		GLSL_Error(ERR_DROP, "shaders failed to link");
+
+		qglDeleteProgram(program->program);
+		program->program = 0;
+		program->pending = qfalse;
+		glslPending[num] = glslPending[--numGlslPending];
+		return;
+	}
+
+	if (pending->cacheName[0])
+	{
+		GLSL_SaveProgramBinary(program, pending->cacheName, &pending->cacheHeader);
+	}
+
+	program->pending = qfalse;
+
+	if (program >= tr.genericShader && program < tr.genericShader + GENERICDEF_COUNT)
+		GLSL_SetupGenericShader(program);
+	else
+		GLSL_SetupLightallShader(program);
+
+	glslPending[num] = glslPending[--numGlslPending];
+}
+
+static void GLSL_ReadyShader(shaderProgram_t *program)
+{
+	int i;
+
+	for (i = 0; i < numGlslPending; i++)
+	{
+		if (glslPending[i].program == program)
 		{
-			ri.Error(ERR_FATAL, "Could not load dlight shader!");
+			GLSL_FinishPendingShader(i);
+			return;
 		}
+	}
 
-		GLSL_InitUniforms(&tr.dlightShader[i]);
-		
-		GLSL_SetUniformInt(&tr.dlightShader[i], UNIFORM_DIFFUSEMAP, TB_DIFFUSEMAP);
+	// don't keep retrying a failed compile until GLSL_CheckErrors raises it
+	if (!glslLazy || glslError[0])
+		return;
 
-		GLSL_FinishGPUShader(&tr.dlightShader[i]);
+	if (program >= tr.genericShader && program < tr.genericShader + GENERICDEF_COUNT)
+	{
+		i = program - tr.genericShader;
+		if (!GLSL_GenericShaderValid(i))
+			return;
 
-		numEtcShaders++;
+		GLSL_Printf(PRINT_DEVELOPER, "compiling generic permutation %d on first use\n", i);
+		GLSL_InitGenericShader(i);
 	}
+	else if (program >= tr.lightallShader && program < tr.lightallShader + LIGHTDEF_COUNT)
+	{
+		i = program - tr.lightallShader;
+		if (!GLSL_LightallShaderValid(i))
+			return;
 
+		GLSL_Printf(PRINT_DEVELOPER, "compiling lightall permutation %d on first use\n", i);
+		GLSL_InitLightallShader(i);
+	}
+}
 
-	for (i = 0; i < LIGHTDEF_COUNT; i++)
+/*
+====================
+GLSL_WarmupShaders
+
+Called once a frame from the back end.  Finishes background links the
+driver is done with and hands it a few more permutations.
+====================
+*/
+void GLSL_WarmupShaders(void)
+{
+	int i, started;
+
+	for (i = numGlslPending - 1; i >= 0; i--)
 	{
-		int lightType = i & LIGHTDEF_LIGHTTYPE_MASK;
-		qboolean fastLight = !(r_normalMapping->integer || r_specularMapping->integer);
+		GLint done;
 
-		// skip impossible combos
-		if ((i & LIGHTDEF_USE_PARALLAXMAP) && !r_parallaxMapping->integer)
-			continue;
+		qglGetProgramiv(glslPending[i].program->program, GL_COMPLETION_STATUS_KHR, &done);
+		if (done)
+			GLSL_FinishPendingShader(i);
+	}
 
-		if ((i & LIGHTDEF_USE_SHADOWMAP) && (!lightType || !r_sunlightMode->integer))
-			continue;
+	if (!glslLazy || !glRefConfig.parallelShaderCompile || glslError[0])
+		return;
 
-		if ((i & LIGHTDEF_ENTITY_VERTEX_ANIMATION) && (i & LIGHTDEF_ENTITY_BONE_ANIMATION))
-			continue;
+	glslAsyncLink = qtrue;
+
+	for (started = 0; started < GLSL_WARMUP_PER_FRAME && glslWarmupNext < GENERICDEF_COUNT + LIGHTDEF_COUNT; glslWarmupNext++)
+	{
+		i = glslWarmupNext;
+
+		if (i < GENERICDEF_COUNT)
+		{
+			if (tr.genericShader[i].program || !GLSL_GenericShaderValid(i))
+				continue;
+
+			GLSL_InitGenericShader(i);
+		}
+		else
+		{
+			i -= GENERICDEF_COUNT;
+
+			if (tr.lightallShader[i].program || !GLSL_LightallShaderValid(i))
+				continue;
+
+			GLSL_InitLightallShader(i);
+		}
+
+		started++;
+	}
 
-		if ((i & LIGHTDEF_ENTITY_BONE_ANIMATION) && !glRefConfig.glslMaxAnimatedBones)
+	glslAsyncLink = qfalse;
+}
+
+/*
+====================
+GLSL_CheckErrors
+
+Raises an error GLSL_Error held back on the render thread.  Called from
+the main thread once the render thread is idle.
+====================
+*/
+void GLSL_CheckErrors(void)
+{
+	char msg[MAX_STRING_CHARS];
+
+	if (!glslError[0])
+		return;
+
+	Q_strncpyz(msg, glslError, sizeof(msg));
+	glslError[0] = '\0';
+
+	ri.Error(glslErrorCode, "%s", msg);
+}
+
+static int GLSL_GenericStageAttribs(const shader_t *shader, const shaderStage_t *pStage);
+
+/*
+====================
+GLSL_BoneAnimationUsed
+
+True if a loaded IQM model will be skinned on the GPU.  The shaders don't
+say which models use them, so every model shader gets the bone permutations.
+====================
+*/
+static qboolean GLSL_BoneAnimationUsed(void)
+{
+	int i;
+
+	if (!glRefConfig.glslMaxAnimatedBones)
+		return qfalse;
+
+	for (i = 1; i < tr.numModels; i++)
+	{
+		iqmData_t *data;
+
+		if (tr.models[i]->type != MOD_IQM)
 			continue;
 
-		attribs = ATTR_POSITION | ATTR_TEXCOORD | ATTR_COLOR | ATTR_NORMAL;
+		data = tr.models[i]->modelData;
+		if (data->numVaoSurfaces && data->num_poses)
+			return qtrue;
+	}
 
-		extradefines[0] = '\0';
+	return qfalse;
+}
 
-		if (r_dlightMode->integer >= 2)
-			Q_strcat(extradefines, 1024, "#define USE_SHADOWMAP\n");
+/*
+====================
+GLSL_CompileReferencedShaders
 
-		if (glRefConfig.swizzleNormalmap)
-			Q_strcat(extradefines, 1024, "#define SWIZZLE_NORMALMAP\n");
+Compiles the permutations the registered shaders will ask for, so a level
+doesn't hitch the first time it draws each of them.
+====================
+*/
+void GLSL_CompileReferencedShaders(void)
+{
+	int i, j, startTime, numCompiled = 0;
+	qboolean boneAnimation;
 
+	if (!glslLazy)
+		return;
 
-		// HACK: use in main menu simple light model (to prevent issue with missing models textures)
-		if (Cvar_Get("r_uiFullScreen", "1", 0)->integer)
-		{
-			Q_strcat(extradefines, 1024, "#define USE_MENU_LIGHT\n");
-		}
+	R_IssuePendingRenderCommands();
 
-		if (lightType)
+	startTime = ri.Milliseconds();
+
+	boneAnimation = GLSL_BoneAnimationUsed();
+
+	for (i = 0; i < tr.numShaders; i++)
+	{
+		shader_t *shader = tr.shaders[i];
+
+		for (j = 0; j < MAX_SHADER_STAGES; j++)
 		{
-			Q_strcat(extradefines, 1024, "#define USE_LIGHT\n");
+			shaderStage_t *pStage = shader->stages[j];
+			shaderProgram_t *programs[8];
+			int k, numPrograms = 0;
 
-			if (fastLight)
-				Q_strcat(extradefines, 1024, "#define USE_FAST_LIGHT\n");
+			if (!pStage || !pStage->active)
+				break;
 
-			switch (lightType)
+			if (pStage->glslShaderGroup == tr.lightallShader)
 			{
-				case LIGHTDEF_USE_LIGHTMAP:
-					Q_strcat(extradefines, 1024, "#define USE_LIGHTMAP\n");
-					if (r_deluxeMapping->integer && !fastLight)
-						Q_strcat(extradefines, 1024, "#define USE_DELUXEMAP\n");
-					attribs |= ATTR_LIGHTCOORD | ATTR_LIGHTDIRECTION;
-					break;
-				case LIGHTDEF_USE_LIGHT_VECTOR:
-					Q_strcat(extradefines, 1024, "#define USE_LIGHT_VECTOR\n");
-					break;
-				case LIGHTDEF_USE_LIGHT_VERTEX:
-					Q_strcat(extradefines, 1024, "#define USE_LIGHT_VERTEX\n");
-					attribs |= ATTR_LIGHTDIRECTION;
-					break;
-				default:
-					break;
-			}
+				int index = pStage->glslShaderIndex;
 
-			if (r_normalMapping->integer)
-			{
-				Q_strcat(extradefines, 1024, "#define USE_NORMALMAP\n");
+				if (r_sunlightMode->integer && (index & LIGHTDEF_LIGHTTYPE_MASK))
+					index |= LIGHTDEF_USE_SHADOWMAP;
 
-				attribs |= ATTR_TANGENT;
+				programs[numPrograms++] = &tr.lightallShader[index];
 
-				if ((i & LIGHTDEF_USE_PARALLAXMAP) && !(i & LIGHTDEF_ENTITY_VERTEX_ANIMATION) && !(i & LIGHTDEF_ENTITY_BONE_ANIMATION) && r_parallaxMapping->integer)
+				// models and vertex lit world surfaces share these
+				if (shader->lightmapIndex == LIGHTMAP_NONE)
 				{
-					Q_strcat(extradefines, 1024, "#define USE_PARALLAXMAP\n");
-					if (r_parallaxMapping->integer > 1)
-						Q_strcat(extradefines, 1024, "#define USE_RELIEFMAP\n");
+					programs[numPrograms++] = &tr.lightallShader[index | LIGHTDEF_ENTITY_VERTEX_ANIMATION];
 
-					if (r_parallaxMapShadows->integer)
-						Q_strcat(extradefines, 1024, "#define USE_PARALLAXMAP_SHADOWS\n");
-
-					Q_strcat(extradefines, 1024, va("#define r_parallaxMapOffset %f\n", r_parallaxMapOffset->value));
+					if (boneAnimation)
+						programs[numPrograms++] = &tr.lightallShader[index | LIGHTDEF_ENTITY_BONE_ANIMATION];
 				}
 			}
+			else
+			{
+				int attribs = GLSL_GenericStageAttribs(shader, pStage);
 
-			if (r_specularMapping->integer)
-				Q_strcat(extradefines, 1024, "#define USE_SPECULARMAP\n");
+				programs[numPrograms++] = &tr.genericShader[attribs];
 
-			if (r_cubeMapping->integer)
-			{
-				Q_strcat(extradefines, 1024, "#define USE_CUBEMAP\n");
-				if (r_cubeMapping->integer == 2)
-					Q_strcat(extradefines, 1024, "#define USE_BOX_CUBEMAP_PARALLAX\n");
-			}
-			else if (r_deluxeSpecular->value > 0.000001f)
-			{
-				Q_strcat(extradefines, 1024, va("#define r_deluxeSpecular %f\n", r_deluxeSpecular->value));
+				if (pStage->adjustColorsForFog && tr.world && tr.world->numfogs > 1)
+					programs[numPrograms++] = &tr.genericShader[attribs | GENERICDEF_USE_FOG];
+
+				if (shader->lightmapIndex == LIGHTMAP_NONE)
+				{
+					int k0, n = numPrograms;
+
+					for (k0 = 0; k0 < n; k0++)
+					{
+						if (glRefConfig.gpuVertexAnimation)
+							programs[numPrograms++] = programs[k0] + GENERICDEF_USE_VERTEX_ANIMATION;
+
+						if (boneAnimation)
+							programs[numPrograms++] = programs[k0] + GENERICDEF_USE_BONE_ANIMATION;
+					}
+				}
 			}
 
-			switch (r_glossType->integer)
+			for (k = 0; k < numPrograms; k++)
 			{
-				case 0:
-				default:
-					Q_strcat(extradefines, 1024, "#define GLOSS_IS_GLOSS\n");
-					break;
-				case 1:
-					Q_strcat(extradefines, 1024, "#define GLOSS_IS_SMOOTHNESS\n");
-					break;
-				case 2:
-					Q_strcat(extradefines, 1024, "#define GLOSS_IS_ROUGHNESS\n");
-					break;
-				case 3:
-					Q_strcat(extradefines, 1024, "#define GLOSS_IS_SHININESS\n");
-					break;
+				if (programs[k]->program)
+					continue;
+
+				GLSL_ReadyShader(programs[k]);
+
+				if (programs[k]->program)
+					numCompiled++;
 			}
 		}
+	}
 
-		if (i & LIGHTDEF_USE_SHADOWMAP)
-		{
-			Q_strcat(extradefines, 1024, "#define USE_SHADOWMAP\n");
+	ri.Printf(PRINT_ALL, "compiled %i referenced GLSL permutations in %5.2f seconds\n",
+		numCompiled, (ri.Milliseconds() - startTime) / 1000.0);
+}
 
-			if (r_sunlightMode->integer == 1)
-				Q_strcat(extradefines, 1024, "#define SHADOWMAP_MODULATE\n");
-			else if (r_sunlightMode->integer == 2)
-				Q_strcat(extradefines, 1024, "#define USE_PRIMARY_LIGHT\n");
-		}
+void GLSL_InitGPUShaders(void)
+{
+	int             startTime, endTime;
+	int i;
+	char extradefines[1024];
+	int attribs;
+	int numGenShaders = 0, numLightShaders = 0, numEtcShaders = 0;
+
+	ri.Printf(PRINT_ALL, "------- GLSL_InitGPUShaders -------\n");
 
-		if (i & LIGHTDEF_USE_TCGEN_AND_TCMOD)
+	for (int i = 0; i < PROJECTION_COUNT; ++i)
+	{
+		//Generate buffer for 2 * view matrices
+		qglGenBuffers(1, &viewMatricesBuffer[i]);
+		qglBindBuffer(GL_UNIFORM_BUFFER, viewMatricesBuffer[i]);
+		qglBufferData(
+				GL_UNIFORM_BUFFER,
+				2 * 16 * sizeof(float),
+				NULL,
+				GL_STATIC_DRAW);
+		qglBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		qglGenBuffers(1, &projectionMatricesBuffer[i]);
+		qglBindBuffer(GL_UNIFORM_BUFFER, projectionMatricesBuffer[i]);
+		qglBufferData(
+				GL_UNIFORM_BUFFER,
+				2 * 16 * sizeof(float),  // Per-eye projection matrices
+				NULL,
+				GL_STATIC_DRAW);
+		qglBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	R_IssuePendingRenderCommands();
+
+	startTime = ri.Milliseconds();
+	numCachedShaders = 0;
+
+	// lights are baked into the permutations, so read it now rather than at compile time
+	glslMenuLight = Cvar_Get("r_uiFullScreen", "1", 0)->integer;
+	glslLazy = r_glslLazy->integer && !r_externalGLSL->integer;
+	glslWarmupNext = 0;
+	numGlslPending = 0;
+
+	// OpenGL ES may not have enough attributes to fit ones used for vertex animation
+	if ( glRefConfig.maxVertexAttribs > ATTR_INDEX_NORMAL2 ) {
+		ri.Printf(PRINT_ALL, "Using GPU vertex animation\n");
+		glRefConfig.gpuVertexAnimation = qtrue;
+	} else {
+		ri.Printf(PRINT_ALL, "Using CPU vertex animation\n");
+		glRefConfig.gpuVertexAnimation = qfalse;
+	}
+
+	for (i = 0; i < GENERICDEF_COUNT; i++)
+	{
+		if (!GLSL_GenericShaderValid(i))
+			continue;
+
+		// compiled on first use or by GLSL_WarmupShaders
+		if (glslLazy)
 		{
-			Q_strcat(extradefines, 1024, "#define USE_TCGEN\n");
-			Q_strcat(extradefines, 1024, "#define USE_TCMOD\n");
+			GLSL_ReserveUniformBuffer(&tr.genericShader[i]);
+			continue;
 		}
 
-		if (i & LIGHTDEF_ENTITY_VERTEX_ANIMATION)
-		{
-			Q_strcat(extradefines, 1024, "#define USE_MODELMATRIX\n");
+		GLSL_InitGenericShader(i);
 
-			if (glRefConfig.gpuVertexAnimation)
-			{
-				Q_strcat(extradefines, 1024, "#define USE_VERTEX_ANIMATION\n");
-				attribs |= ATTR_POSITION2 | ATTR_NORMAL2;
+		numGenShaders++;
+	}
 
-				if (r_normalMapping->integer)
-				{
-					attribs |= ATTR_TANGENT2;
-				}
-			}
+
+	attribs = ATTR_POSITION | ATTR_TEXCOORD;
+
+	if (!GLSL_InitGPUShader(&tr.textureColorShader, "texturecolor", attribs, qtrue, extradefines, qtrue, fallbackShader_texturecolor_vp, fallbackShader_texturecolor_fp))
+	{
+		ri.Error(ERR_FATAL, "Could not load texturecolor shader!");
+	}
+	
+	GLSL_InitUniforms(&tr.textureColorShader);
+
+	GLSL_SetUniformInt(&tr.textureColorShader, UNIFORM_TEXTUREMAP, TB_DIFFUSEMAP);
+
+	GLSL_FinishGPUShader(&tr.textureColorShader);
+
+	numEtcShaders++;
+
+	for (i = 0; i < FOGDEF_COUNT; i++)
+	{
+		if ((i & FOGDEF_USE_VERTEX_ANIMATION) && (i & FOGDEF_USE_BONE_ANIMATION))
+			continue;
+
+		if ((i & FOGDEF_USE_VERTEX_ANIMATION) && !glRefConfig.gpuVertexAnimation)
+			continue;
+
+		if ((i & FOGDEF_USE_BONE_ANIMATION) && !glRefConfig.glslMaxAnimatedBones)
+			continue;
+
+		attribs = ATTR_POSITION | ATTR_NORMAL | ATTR_TEXCOORD;
+		extradefines[0] = '\0';
+
+		if (i & FOGDEF_USE_DEFORM_VERTEXES)
+			Q_strcat(extradefines, 1024, "#define USE_DEFORM_VERTEXES\n");
+
+		if (i & FOGDEF_USE_VERTEX_ANIMATION)
+		{
+			Q_strcat(extradefines, 1024, "#define USE_VERTEX_ANIMATION\n");
+			attribs |= ATTR_POSITION2 | ATTR_NORMAL2;
 		}
-		else if (i & LIGHTDEF_ENTITY_BONE_ANIMATION)
+		else if (i & FOGDEF_USE_BONE_ANIMATION)
 		{
-			Q_strcat(extradefines, 1024, "#define USE_MODELMATRIX\n");
 			Q_strcat(extradefines, 1024, va("#define USE_BONE_ANIMATION\n#define MAX_GLSL_BONES %d\n", glRefConfig.glslMaxAnimatedBones));
 			attribs |= ATTR_BONE_INDEXES | ATTR_BONE_WEIGHTS;
 		}
 
-		if (!GLSL_InitGPUShader(&tr.lightallShader[i], "lightall", attribs, qtrue, extradefines, qtrue, fallbackShader_lightall_vp, fallbackShader_lightall_fp))
+		if (!GLSL_InitGPUShader(&tr.fogShader[i], "fogpass", attribs, qtrue, extradefines, qtrue, fallbackShader_fogpass_vp, fallbackShader_fogpass_fp))
 		{
-			ri.Error(ERR_FATAL, "Could not load lightall shader!");
+			ri.Error(ERR_FATAL, "Could not load fogpass shader!");
 		}
 
-		GLSL_InitUniforms(&tr.lightallShader[i]);
+		GLSL_InitUniforms(&tr.fogShader[i]);
+		GLSL_FinishGPUShader(&tr.fogShader[i]);
+
+		numEtcShaders++;
+	}
 
-		GLSL_SetUniformInt(&tr.lightallShader[i], UNIFORM_DIFFUSEMAP,  TB_DIFFUSEMAP);
-		GLSL_SetUniformInt(&tr.lightallShader[i], UNIFORM_LIGHTMAP,    TB_LIGHTMAP);
-		GLSL_SetUniformInt(&tr.lightallShader[i], UNIFORM_NORMALMAP,   TB_NORMALMAP);
-		GLSL_SetUniformInt(&tr.lightallShader[i], UNIFORM_DELUXEMAP,   TB_DELUXEMAP);
-		GLSL_SetUniformInt(&tr.lightallShader[i], UNIFORM_SPECULARMAP, TB_SPECULARMAP);
-		GLSL_SetUniformInt(&tr.lightallShader[i], UNIFORM_SHADOWMAP,   TB_SHADOWMAP);
-		GLSL_SetUniformInt(&tr.lightallShader[i], UNIFORM_CUBEMAP,     TB_CUBEMAP);
 
-		GLSL_FinishGPUShader(&tr.lightallShader[i]);
+	for (i = 0; i < DLIGHTDEF_COUNT; i++)
+	{
+		attribs = ATTR_POSITION | ATTR_NORMAL | ATTR_TEXCOORD;
+		extradefines[0] = '\0';
+
+		if (i & DLIGHTDEF_USE_DEFORM_VERTEXES)
+		{
+			Q_strcat(extradefines, 1024, "#define USE_DEFORM_VERTEXES\n");
+		}
+
+		if (!GLSL_InitGPUShader(&tr.dlightShader[i], "dlight", attribs, qtrue, extradefines, qtrue, fallbackShader_dlight_vp, fallbackShader_dlight_fp))
+		{
+			ri.Error(ERR_FATAL, "Could not load dlight shader!");
+		}
+
+		GLSL_InitUniforms(&tr.dlightShader[i]);
+		
+		GLSL_SetUniformInt(&tr.dlightShader[i], UNIFORM_DIFFUSEMAP, TB_DIFFUSEMAP);
+
+		GLSL_FinishGPUShader(&tr.dlightShader[i]);
+
+		numEtcShaders++;
+	}
+
+
+	for (i = 0; i < LIGHTDEF_COUNT; i++)
+	{
+		if (!GLSL_LightallShaderValid(i))
+			continue;
+
+		// compiled on first use or by GLSL_WarmupShaders
+		if (glslLazy)
+		{
+			GLSL_ReserveUniformBuffer(&tr.lightallShader[i]);
+			continue;
+		}
+
+		GLSL_InitLightallShader(i);
 
 		numLightShaders++;
 	}
@@ -1713,6 +2420,25 @@ void GLSL_InitGPUShaders(void)
 		}
 	}
 
+	if (r_occlusionCull->integer)
+	{
+		attribs = ATTR_POSITION | ATTR_TEXCOORD;
+		extradefines[0] = '\0';
+
+		if (!GLSL_InitGPUShader(&tr.hizShader, "hiz", attribs, qtrue, extradefines, qtrue, fallbackShader_hiz_vp, fallbackShader_hiz_fp))
+		{
+			ri.Error(ERR_FATAL, "Could not load hiz shader!");
+		}
+
+		GLSL_InitUniforms(&tr.hizShader);
+
+		GLSL_SetUniformInt(&tr.hizShader, UNIFORM_TEXTUREMAP, TB_COLORMAP);
+
+		GLSL_FinishGPUShader(&tr.hizShader);
+
+		numEtcShaders++;
+	}
+
 #if 0
 	attribs = ATTR_POSITION | ATTR_TEXCOORD;
 	extradefines[0] = '\0';
@@ -1737,6 +2463,11 @@ void GLSL_InitGPUShaders(void)
 	ri.Printf(PRINT_ALL, "loaded %i GLSL shaders (%i gen %i light %i etc) in %5.2f seconds\n", 
 		numGenShaders + numLightShaders + numEtcShaders, numGenShaders, numLightShaders, 
 		numEtcShaders, (endTime - startTime) / 1000.0);
+
+	if (glRefConfig.programBinary)
+	{
+		ri.Printf(PRINT_ALL, "...%i of them from the program binary cache\n", numCachedShaders);
+	}
 }
 
 void GLSL_ShutdownGPUShaders(void)
@@ -1750,6 +2481,8 @@ void GLSL_ShutdownGPUShaders(void)
 
 	GL_BindNullProgram();
 
+	numGlslPending = 0;
+
 	for ( i = 0; i < GENERICDEF_COUNT; i++)
 		GLSL_DeleteGPUShader(&tr.genericShader[i]);
 
@@ -1781,6 +2514,8 @@ void GLSL_ShutdownGPUShaders(void)
 	for ( i = 0; i < 4; i++)
 		GLSL_DeleteGPUShader(&tr.depthBlurShader[i]);
 
+	GLSL_DeleteGPUShader(&tr.hizShader);
+
 	//Clean up buffers
 	qglDeleteBuffers(PROJECTION_COUNT, viewMatricesBuffer);
 	qglDeleteBuffers(PROJECTION_COUNT, projectionMatricesBuffer);
@@ -1816,38 +2551,45 @@ void GLSL_PrepareUniformBuffers(void)
   //VR projection matrix - use per-eye projections from OpenXR
   //When weapon is zoomed or virtual screen is active, use symmetric projection for true mono rendering
   //Virtual screen captures from left eye only, so asymmetric projection would cause offset
-  if (vr.weapon_zoomed || vr.virtual_screen)
+  if (backEnd.vrWeaponZoomed || backEnd.vrVirtualScreen)
   {
     GLSL_ProjectionMatricesUniformBuffer(projectionMatricesBuffer[VR_PROJECTION],
-            tr.vrParms.projection, tr.vrParms.projection);
+            backEnd.vrParms.projection, backEnd.vrParms.projection);
   }
   else
   {
     GLSL_ProjectionMatricesUniformBuffer(projectionMatricesBuffer[VR_PROJECTION],
-            tr.vrParms.projectionEye[0], tr.vrParms.projectionEye[1]);
+            backEnd.vrParms.projectionEye[0], backEnd.vrParms.projectionEye[1]);
   }
 
   //Mirror VR projection matrix - use per-eye projections for proper stereo in portals/mirrors
   GLSL_ProjectionMatricesUniformBuffer(projectionMatricesBuffer[MIRROR_VR_PROJECTION],
-          tr.vrParms.mirrorProjectionEye[0], tr.vrParms.mirrorProjectionEye[1]);
+          backEnd.vrParms.mirrorProjectionEye[0], backEnd.vrParms.mirrorProjectionEye[1]);
 
   //Used for drawing models (same for both eyes - mono rendering)
   GLSL_ProjectionMatricesUniformBuffer(projectionMatricesBuffer[MONO_VR_PROJECTION],
-          tr.vrParms.monoVRProjection, tr.vrParms.monoVRProjection);
+          backEnd.vrParms.monoVRProjection, backEnd.vrParms.monoVRProjection);
 
   //Menu projection - built from refdef FOV for menu 3D models (same for both eyes)
   GLSL_ProjectionMatricesUniformBuffer(projectionMatricesBuffer[MENU_PROJECTION],
-          tr.vrParms.menuProjection, tr.vrParms.menuProjection);
+          backEnd.vrParms.menuProjection, backEnd.vrParms.menuProjection);
 
   //Set all view matrices
-	GLSL_ViewMatricesUniformBuffer(tr.viewParms.world.eyeViewMatrix, tr.viewParms.world.modelView);
+	GLSL_ViewMatricesUniformBuffer(backEnd.viewParms.world.eyeViewMatrix, backEnd.viewParms.world.modelView);
 }
 
 void GLSL_BindProgram(shaderProgram_t * program)
 {
-	GLuint programObject = program ? program->program : 0;
+	GLuint programObject;
 	char *name = program ? program->name : "NULL";
 
+	if (program && (!program->program || program->pending))
+	{
+		GLSL_ReadyShader(program);
+	}
+
+	programObject = program ? program->program : 0;
+
 	if(r_logFile->integer)
 	{
 		// don't just call LogComment, or we will get a call to va() every frame!
@@ -1917,16 +2659,10 @@ void GLSL_BindBuffers( shaderProgram_t * program )
 }
 
 
-shaderProgram_t *GLSL_GetGenericShaderProgram(int stage)
+static int GLSL_GenericStageAttribs(const shader_t *shader, const shaderStage_t *pStage)
 {
-	shaderStage_t *pStage = tess.xstages[stage];
 	int shaderAttribs = 0;
 
-	if (tess.fogNum && pStage->adjustColorsForFog)
-	{
-		shaderAttribs |= GENERICDEF_USE_FOG;
-	}
-
 	switch (pStage->rgbGen)
 	{
 		case CGEN_LIGHTING_DIFFUSE:
@@ -1951,11 +2687,34 @@ shaderProgram_t *GLSL_GetGenericShaderProgram(int stage)
 		shaderAttribs |= GENERICDEF_USE_TCGEN_AND_TCMOD;
 	}
 
-	if (tess.shader->numDeforms && !ShaderRequiresCPUDeforms(tess.shader))
+	if (shader->numDeforms && !ShaderRequiresCPUDeforms(shader))
 	{
 		shaderAttribs |= GENERICDEF_USE_DEFORM_VERTEXES;
 	}
 
+	if (pStage->bundle[0].numTexMods)
+	{
+		shaderAttribs |= GENERICDEF_USE_TCGEN_AND_TCMOD;
+	}
+
+	if (pStage->bundle[0].image[0] && (pStage->bundle[0].image[0]->flags & IMGFLAG_ARRAY))
+	{
+		shaderAttribs |= GENERICDEF_USE_LIGHTMAP_ARRAY;
+	}
+
+	return shaderAttribs;
+}
+
+shaderProgram_t *GLSL_GetGenericShaderProgram(int stage)
+{
+	shaderStage_t *pStage = tess.xstages[stage];
+	int shaderAttribs = GLSL_GenericStageAttribs(tess.shader, pStage);
+
+	if (tess.fogNum && pStage->adjustColorsForFog)
+	{
+		shaderAttribs |= GENERICDEF_USE_FOG;
+	}
+
 	if (glState.vertexAnimation)
 	{
 		shaderAttribs |= GENERICDEF_USE_VERTEX_ANIMATION;
@@ -1965,10 +2724,5 @@ shaderProgram_t *GLSL_GetGenericShaderProgram(int stage)
 		shaderAttribs |= GENERICDEF_USE_BONE_ANIMATION;
 	}
 
-	if (pStage->bundle[0].numTexMods)
-	{
-		shaderAttribs |= GENERICDEF_USE_TCGEN_AND_TCMOD;
-	}
-
 	return &tr.genericShader[shaderAttribs];
 }
@@ -1303,6 +1303,60 @@ void R_LightScaleTexture (byte *in, int inwidth, int inheight, qboolean only_gam
 }
 
 
+#define DOWNMIP_GUESS_SIZE	4096
+
+static float	downmipSrgbLookup[256];				// (x / 255) ^ 2.2 / 4, one corner of a 2x2 block
+static float	downmipSrgbThreshold[256];			// smallest block total that comes out as x
+static byte		downmipSrgbGuess[DOWNMIP_GUESS_SIZE];	// largest x at or below each total bucket
+
+/*
+================
+R_InitDownmipTables
+
+Done up front so R_MipMapsRGB() can run on the job pool
+================
+*/
+static void R_InitDownmipTables( void )
+{
+	int x, i;
+
+	for (x = 0; x < 256; x++)
+	{
+		downmipSrgbLookup[x] = powf(x / 255.0f, 2.2f) * 0.25f;
+		downmipSrgbThreshold[x] = powf(x / 255.0f, 2.2f);
+	}
+
+	for (i = 0, x = 0; i < DOWNMIP_GUESS_SIZE; i++)
+	{
+		while (x < 255 && downmipSrgbThreshold[x + 1] <= (float)i / DOWNMIP_GUESS_SIZE)
+			x++;
+
+		downmipSrgbGuess[i] = x;
+	}
+}
+
+/*
+================
+R_DownmipSrgb
+
+(byte)(powf(total, 1.0f / 2.2f) * 255.0f) without the powf, walks the
+threshold table up from a guess.  Can differ by one right on a threshold.
+================
+*/
+static ID_INLINE byte R_DownmipSrgb( float total )
+{
+	int x;
+
+	if (total >= 1.0f)
+		return 255;
+
+	x = downmipSrgbGuess[(int)(total * DOWNMIP_GUESS_SIZE)];
+	while (x < 255 && downmipSrgbThreshold[x + 1] <= total)
+		x++;
+
+	return x;
+}
+
 /*
 ================
 R_MipMapsRGB
@@ -1316,16 +1370,8 @@ static void R_MipMapsRGB( byte *in, int inWidth, int inHeight)
 	int x, y, c, stride;
 	const byte *in2;
 	float total;
-	static float downmipSrgbLookup[256];
-	static int downmipSrgbLookupSet = 0;
 	byte *out = in;
 
-	if (!downmipSrgbLookupSet) {
-		for (x = 0; x < 256; x++)
-			downmipSrgbLookup[x] = powf(x / 255.0f, 2.2f) * 0.25f;
-		downmipSrgbLookupSet = 1;
-	}
-
 	if (inWidth == 1 && inHeight == 1)
 		return;
 
@@ -1334,7 +1380,7 @@ static void R_MipMapsRGB( byte *in, int inWidth, int inHeight)
 			for (c = 3; c; c--, in++) {
 				total  = (downmipSrgbLookup[*(in)] + downmipSrgbLookup[*(in + 4)]) * 2.0f;
 
-				*out++ = (byte)(powf(total, 1.0f / 2.2f) * 255.0f);
+				*out++ = R_DownmipSrgb(total);
 			}
 			*out++ = (*(in) + *(in + 4)) >> 1; in += 5;
 		}
@@ -1352,7 +1398,7 @@ static void R_MipMapsRGB( byte *in, int inWidth, int inHeight)
 				total = downmipSrgbLookup[*(in)]  + downmipSrgbLookup[*(in + 4)]
 				      + downmipSrgbLookup[*(in2)] + downmipSrgbLookup[*(in2 + 4)];
 
-				*out++ = (byte)(powf(total, 1.0f / 2.2f) * 255.0f);
+				*out++ = R_DownmipSrgb(total);
 			}
 
 			*out++ = (*(in) + *(in + 4) + *(in2) + *(in2 + 4)) >> 2; in += 5, in2 += 5;
@@ -1572,20 +1618,22 @@ static void RawImage_SwizzleRA( byte *data, int width, int height )
 
 /*
 ===============
-RawImage_ScaleToPower2
+RawImage_ResampleSize
 
+Works out the size RawImage_ScaleToPower2() resamples to and returns
+how many bytes of resample buffer it needs, 0 if it works in place.
+upsampleWidth and upsampleHeight are 0 when the image isn't upsampled.
 ===============
 */
-static qboolean RawImage_ScaleToPower2( byte **data, int *inout_width, int *inout_height, imgType_t type, imgFlags_t flags, byte **resampledBuffer)
+static int RawImage_ResampleSize( int width, int height, imgFlags_t flags, int *scaledWidth, int *scaledHeight, int *upsampleWidth, int *upsampleHeight )
 {
-	int width =         *inout_width;
-	int height =        *inout_height;
 	int scaled_width;
 	int scaled_height;
 	qboolean picmip = !!(flags & IMGFLAG_PICMIP);
 	qboolean mipmap = !!(flags & IMGFLAG_MIPMAP);
-	qboolean clampToEdge = !!(flags & IMGFLAG_CLAMPTOEDGE);
-	qboolean scaled;
+
+	*upsampleWidth = 0;
+	*upsampleHeight = 0;
 
 	//
 	// convert to exact power of 2 sizes
@@ -1606,13 +1654,13 @@ static qboolean RawImage_ScaleToPower2( byte **data, int *inout_width, int *inou
 	if ( r_roundImagesDown->integer && scaled_height > height )
 		scaled_height >>= 1;
 
-	if ( picmip && data && resampledBuffer && r_imageUpsample->integer && 
+	*scaledWidth = scaled_width;
+	*scaledHeight = scaled_height;
+
+	if ( picmip && r_imageUpsample->integer && 
 	     scaled_width < r_imageUpsampleMaxSize->integer && scaled_height < r_imageUpsampleMaxSize->integer)
 	{
 		int finalwidth, finalheight;
-		//int startTime, endTime;
-
-		//startTime = ri.Milliseconds();
 
 		finalwidth = scaled_width << r_imageUpsample->integer;
 		finalheight = scaled_height << r_imageUpsample->integer;
@@ -1629,42 +1677,79 @@ static qboolean RawImage_ScaleToPower2( byte **data, int *inout_width, int *inou
 			finalheight >>= 1;
 		}
 
-		*resampledBuffer = ri.Hunk_AllocateTempMemory( finalwidth * finalheight * 4 );
+		*upsampleWidth = finalwidth;
+		*upsampleHeight = finalheight;
+
+		return finalwidth * finalheight * 4;
+	}
+
+	if ( scaled_width != width || scaled_height != height )
+		return scaled_width * scaled_height * 4;
+
+	return 0;
+}
+
+
+/*
+===============
+RawImage_ScaleToPower2
+
+resampledBuffer must hold the RawImage_ResampleSize() bytes if data is given.
+Doesn't allocate, so it can run on the job pool.
+===============
+*/
+static qboolean RawImage_ScaleToPower2( byte **data, int *inout_width, int *inout_height, imgType_t type, imgFlags_t flags, byte *resampledBuffer)
+{
+	int width =         *inout_width;
+	int height =        *inout_height;
+	int scaled_width;
+	int scaled_height;
+	int finalwidth, finalheight;
+	qboolean picmip = !!(flags & IMGFLAG_PICMIP);
+	qboolean clampToEdge = !!(flags & IMGFLAG_CLAMPTOEDGE);
+	qboolean scaled;
+
+	RawImage_ResampleSize(width, height, flags, &scaled_width, &scaled_height, &finalwidth, &finalheight);
+
+	if ( data && resampledBuffer && finalwidth )
+	{
+		//int startTime, endTime;
+
+		//startTime = ri.Milliseconds();
 
 		if (scaled_width != width || scaled_height != height)
-			ResampleTexture (*data, width, height, *resampledBuffer, scaled_width, scaled_height);
+			ResampleTexture (*data, width, height, resampledBuffer, scaled_width, scaled_height);
 		else
-			Com_Memcpy(*resampledBuffer, *data, width * height * 4);
+			Com_Memcpy(resampledBuffer, *data, width * height * 4);
 
 		if (type == IMGTYPE_COLORALPHA)
-			RGBAtoYCoCgA(*resampledBuffer, *resampledBuffer, scaled_width, scaled_height);
+			RGBAtoYCoCgA(resampledBuffer, resampledBuffer, scaled_width, scaled_height);
 
 		while (scaled_width < finalwidth || scaled_height < finalheight)
 		{
 			scaled_width <<= 1;
 			scaled_height <<= 1;
 
-			FCBIByBlock(*resampledBuffer, scaled_width, scaled_height, clampToEdge, (type == IMGTYPE_NORMAL || type == IMGTYPE_NORMALHEIGHT));
+			FCBIByBlock(resampledBuffer, scaled_width, scaled_height, clampToEdge, (type == IMGTYPE_NORMAL || type == IMGTYPE_NORMALHEIGHT));
 		}
 
 		if (type == IMGTYPE_COLORALPHA)
-			YCoCgAtoRGBA(*resampledBuffer, *resampledBuffer, scaled_width, scaled_height);
+			YCoCgAtoRGBA(resampledBuffer, resampledBuffer, scaled_width, scaled_height);
 		else if (type == IMGTYPE_NORMAL || type == IMGTYPE_NORMALHEIGHT)
-			FillInNormalizedZ(*resampledBuffer, *resampledBuffer, scaled_width, scaled_height);
+			FillInNormalizedZ(resampledBuffer, resampledBuffer, scaled_width, scaled_height);
 
 		//endTime = ri.Milliseconds();
 
 		//ri.Printf(PRINT_ALL, "upsampled %dx%d to %dx%d in %dms\n", width, height, scaled_width, scaled_height, endTime - startTime);
 
-		*data = *resampledBuffer;
+		*data = resampledBuffer;
 	}
 	else if ( scaled_width != width || scaled_height != height )
 	{
 		if (data && resampledBuffer)
 		{
-			*resampledBuffer = ri.Hunk_AllocateTempMemory( scaled_width * scaled_height * 4 );
-			ResampleTexture (*data, width, height, *resampledBuffer, scaled_width, scaled_height);
-			*data = *resampledBuffer;
+			ResampleTexture (*data, width, height, resampledBuffer, scaled_width, scaled_height);
+			*data = resampledBuffer;
 		}
 	}
 
@@ -2044,7 +2129,15 @@ static GLenum PixelDataFormatFromInternalFormat(GLenum internalFormat)
 	}
 }
 
-static void RawImage_UploadTexture(GLuint texture, byte *data, int x, int y, int width, int height, GLenum target, GLenum picFormat, GLenum dataFormat, GLenum dataType, int numMips, GLenum internalFormat, imgType_t type, imgFlags_t flags, qboolean subtexture )
+static void RawImage_SubImage(GLuint texture, GLenum target, int miplevel, int x, int y, int layer, int width, int height, GLenum dataFormat, GLenum dataType, const byte *data)
+{
+	if (target == GL_TEXTURE_2D_ARRAY)
+		qglTextureSubImage3DEXT(texture, target, miplevel, x, y, layer, width, height, 1, dataFormat, dataType, data);
+	else
+		qglTextureSubImage2DEXT(texture, target, miplevel, x, y, width, height, dataFormat, dataType, data);
+}
+
+static void RawImage_UploadTexture(GLuint texture, byte *data, int x, int y, int layer, int width, int height, GLenum target, GLenum picFormat, GLenum dataFormat, GLenum dataType, int numMips, GLenum internalFormat, imgType_t type, imgFlags_t flags, qboolean subtexture )
 {
 	qboolean rgtc = internalFormat == GL_COMPRESSED_RG_RGTC2;
 	qboolean rgba8 = picFormat == GL_RGBA8 || picFormat == GL_SRGB8_ALPHA8_EXT;
@@ -2079,10 +2172,10 @@ static void RawImage_UploadTexture(GLuint texture, byte *data, int x, int y, int
 			else if (formatBuffer)
 			{
 				R_ConvertTextureFormat(data, width, height, dataFormat, dataType, formatBuffer);
-				qglTextureSubImage2DEXT(texture, target, miplevel, x, y, width, height, dataFormat, dataType, formatBuffer);
+				RawImage_SubImage(texture, target, miplevel, x, y, layer, width, height, dataFormat, dataType, formatBuffer);
 			}
 			else
-				qglTextureSubImage2DEXT(texture, target, miplevel, x, y, width, height, dataFormat, dataType, data);
+				RawImage_SubImage(texture, target, miplevel, x, y, layer, width, height, dataFormat, dataType, data);
 		}
 
 		if (!lastMip && numMips < 2)
@@ -2122,18 +2215,17 @@ static void RawImage_UploadTexture(GLuint texture, byte *data, int x, int y, int
 
 /*
 ===============
-Upload32
+RawImage_ProcessPixels
 
+Applies greyscale, light scale and normal map swizzling before upload.
+Only touches data, so it can run on the job pool.
 ===============
 */
-static void Upload32(byte *data, int x, int y, int width, int height, GLenum picFormat, GLenum dataFormat, GLenum dataType, int numMips, image_t *image, qboolean scaled)
+static void RawImage_ProcessPixels(byte *data, int width, int height, GLenum picFormat, int numMips, imgType_t type, imgFlags_t flags, qboolean scaled)
 {
 	int			i, c;
 	byte		*scan;
 
-	imgType_t type = image->type;
-	imgFlags_t flags = image->flags;
-	GLenum internalFormat = image->internalFormat;
 	qboolean rgba8 = picFormat == GL_RGBA8 || picFormat == GL_SRGB8_ALPHA8_EXT;
 	qboolean mipmap = !!(flags & IMGFLAG_MIPMAP) && (rgba8 || numMips > 1);
 	qboolean cubemap = !!(flags & IMGFLAG_CUBEMAP);
@@ -2175,13 +2267,31 @@ static void Upload32(byte *data, int x, int y, int width, int height, GLenum pic
 		if (glRefConfig.swizzleNormalmap && (type == IMGTYPE_NORMAL || type == IMGTYPE_NORMALHEIGHT))
 			RawImage_SwizzleRA(data, width, height);
 	}
+}
+
+
+/*
+===============
+Upload32
+
+Expects data already run through RawImage_ProcessPixels()
+===============
+*/
+static void Upload32(byte *data, int x, int y, int layer, int width, int height, GLenum picFormat, GLenum dataFormat, GLenum dataType, int numMips, image_t *image)
+{
+	int			i, c;
+
+	imgType_t type = image->type;
+	imgFlags_t flags = image->flags;
+	GLenum internalFormat = image->internalFormat;
+	qboolean cubemap = !!(flags & IMGFLAG_CUBEMAP);
 
 	if (cubemap)
 	{
 		for (i = 0; i < 6; i++)
 		{
 			int w2 = width, h2 = height;
-			RawImage_UploadTexture(image->texnum, data, x, y, width, height, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, picFormat, dataFormat, dataType, numMips, internalFormat, type, flags, qfalse);
+			RawImage_UploadTexture(image->texnum, data, x, y, 0, width, height, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, picFormat, dataFormat, dataType, numMips, internalFormat, type, flags, qfalse);
 			for (c = numMips; c; c--)
 			{
 				data += CalculateMipSize(w2, h2, picFormat);
@@ -2192,7 +2302,9 @@ static void Upload32(byte *data, int x, int y, int width, int height, GLenum pic
 	}
 	else
 	{
-		RawImage_UploadTexture(image->texnum, data, x, y, width, height, GL_TEXTURE_2D, picFormat, dataFormat, dataType, numMips, internalFormat, type, flags, qfalse);
+		GLenum target = (flags & IMGFLAG_ARRAY) ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+
+		RawImage_UploadTexture(image->texnum, data, x, y, layer, width, height, target, picFormat, dataFormat, dataType, numMips, internalFormat, type, flags, qfalse);
 	}
 
 	GL_CheckErrors();
@@ -2201,31 +2313,18 @@ static void Upload32(byte *data, int x, int y, int width, int height, GLenum pic
 
 /*
 ================
-R_CreateImage2
+R_AllocImage
 
-This is the only way any image_t are created
+Sets up a named image_t and its texture object, without any storage
 ================
 */
-image_t *R_CreateImage2( const char *name, byte *pic, int width, int height, GLenum picFormat, int numMips, imgType_t type, imgFlags_t flags, int internalFormat ) {
-	byte       *resampledBuffer = NULL;
+static image_t *R_AllocImage( const char *name, int width, int height, imgType_t type, imgFlags_t flags ) {
 	image_t    *image;
-	qboolean    isLightmap = qfalse, scaled = qfalse;
 	long        hash;
-	int         glWrapClampMode, mipWidth, mipHeight, miplevel;
-	qboolean    rgba8 = picFormat == GL_RGBA8 || picFormat == GL_SRGB8_ALPHA8_EXT;
-	qboolean    mipmap = !!(flags & IMGFLAG_MIPMAP);
-	qboolean    cubemap = !!(flags & IMGFLAG_CUBEMAP);
-	qboolean    picmip = !!(flags & IMGFLAG_PICMIP);
-	qboolean    lastMip;
-	GLenum textureTarget = cubemap ? GL_TEXTURE_CUBE_MAP : GL_TEXTURE_2D;
-	GLenum dataFormat, dataType;
 
 	if (strlen(name) >= MAX_QPATH ) {
 		ri.Error (ERR_DROP, "R_CreateImage: \"%s\" is too long", name);
 	}
-	if ( !strncmp( name, "*lightmap", 9 ) ) {
-		isLightmap = qtrue;
-	}
 
 	if ( tr.numImages == MAX_DRAWIMAGES ) {
 		ri.Error( ERR_DROP, "R_CreateImage: MAX_DRAWIMAGES hit");
@@ -2242,14 +2341,89 @@ image_t *R_CreateImage2( const char *name, byte *pic, int width, int height, GLe
 
 	image->width = width;
 	image->height = height;
+	image->uploadWidth = width;
+	image->uploadHeight = height;
+
+	hash = generateHashValue(name);
+	image->next = hashTable[hash];
+	hashTable[hash] = image;
+
+	return image;
+}
+
+
+/*
+================
+R_PrepareImage
+
+Picks the internal format, scales the image and processes its pixels.
+Touches no GL or engine state, so it can run on the job pool.
+resampledBuffer must hold the RawImage_ResampleSize() bytes for rgba8 images.
+================
+*/
+static void R_PrepareImage( image_t *image, byte **pic, int *width, int *height, GLenum picFormat, int *numMips, int internalFormat, byte *resampledBuffer ) {
+	qboolean    rgba8 = picFormat == GL_RGBA8 || picFormat == GL_SRGB8_ALPHA8_EXT;
+	qboolean    cubemap = !!(image->flags & IMGFLAG_CUBEMAP);
+	qboolean    picmip = !!(image->flags & IMGFLAG_PICMIP);
+	qboolean    isLightmap = !strncmp( image->imgName, "*lightmap", 9 );
+	qboolean    scaled = qfalse;
+	int         miplevel;
+
+	if (!internalFormat)
+		internalFormat = RawImage_GetFormat(*pic, *width * *height, picFormat, isLightmap, image->type, image->flags);
+
+	image->internalFormat = internalFormat;
+
+	// Possibly scale image before uploading.
+	// if not rgba8 and uploading an image, skip picmips.
+	if (!cubemap)
+	{
+		if (rgba8)
+			scaled = RawImage_ScaleToPower2(pic, width, height, image->type, image->flags, resampledBuffer);
+		else if (*pic && picmip)
+		{
+			for (miplevel = r_picmip->integer; miplevel > 0 && *numMips > 1; miplevel--, (*numMips)--)
+			{
+				int size = CalculateMipSize(*width, *height, picFormat);
+				*width = MAX(1, *width >> 1);
+				*height = MAX(1, *height >> 1);
+				*pic += size;
+			}
+		}
+	}
+
+	image->uploadWidth = *width;
+	image->uploadHeight = *height;
+
+	if (*pic)
+		RawImage_ProcessPixels(*pic, *width, *height, picFormat, *numMips, image->type, image->flags, scaled);
+}
+
+
+/*
+================
+R_UploadImage
+
+Allocates storage for an image R_PrepareImage() has been run on,
+uploads pic and sets the texture parameters
+================
+*/
+static void R_UploadImage( image_t *image, byte *pic, GLenum picFormat, int numMips ) {
+	int         glWrapClampMode, mipWidth, mipHeight, miplevel;
+	imgFlags_t  flags = image->flags;
+	qboolean    mipmap = !!(flags & IMGFLAG_MIPMAP);
+	qboolean    cubemap = !!(flags & IMGFLAG_CUBEMAP);
+	qboolean    array = !!(flags & IMGFLAG_ARRAY);
+	qboolean    lastMip;
+	GLenum textureTarget = cubemap ? GL_TEXTURE_CUBE_MAP : (array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D);
+	GLenum internalFormat = image->internalFormat;
+	GLenum dataFormat, dataType;
+
 	if (flags & IMGFLAG_CLAMPTOEDGE)
 		glWrapClampMode = GL_CLAMP_TO_EDGE;
 	else
 		glWrapClampMode = GL_REPEAT;
 
-	if (!internalFormat)
-		internalFormat = RawImage_GetFormat(pic, width * height, picFormat, isLightmap, image->type, image->flags);
-
 	dataFormat = PixelDataFormatFromInternalFormat(internalFormat);
 	dataType = picFormat == GL_RGBA16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
 
@@ -2293,39 +2467,22 @@ image_t *R_CreateImage2( const char *name, byte *pic, int width, int height, GLe
 				dataType = GL_UNSIGNED_SHORT_4_4_4_4;
 				break;
 			default:
-				ri.Error( ERR_DROP, "Missing OpenGL ES support for image '%s' with internal format 0x%X\n", name, internalFormat );
+				ri.Error( ERR_DROP, "Missing OpenGL ES support for image '%s' with internal format 0x%X\n", image->imgName, internalFormat );
 		}
 	}
 
 	image->internalFormat = internalFormat;
 
-	// Possibly scale image before uploading.
-	// if not rgba8 and uploading an image, skip picmips.
-	if (!cubemap)
-	{
-		if (rgba8)
-			scaled = RawImage_ScaleToPower2(&pic, &width, &height, type, flags, &resampledBuffer);
-		else if (pic && picmip)
-		{
-			for (miplevel = r_picmip->integer; miplevel > 0 && numMips > 1; miplevel--, numMips--)
-			{
-				int size = CalculateMipSize(width, height, picFormat);
-				width = MAX(1, width >> 1);
-				height = MAX(1, height >> 1);
-				pic += size;
-			}
-		}
-	}
-
-	image->uploadWidth = width;
-	image->uploadHeight = height;
-
 	// Allocate texture storage so we don't have to worry about it later.
-	mipWidth = width;
-	mipHeight = height;
+	// Arrays don't know their layer count here, R_CreateImageArray() allocates them.
+	mipWidth = image->uploadWidth;
+	mipHeight = image->uploadHeight;
 	miplevel = 0;
 	do
 	{
+		if (array)
+			break;
+
 		lastMip = !mipmap || (mipWidth == 1 && mipHeight == 1);
 		if (cubemap)
 		{
@@ -2347,10 +2504,7 @@ image_t *R_CreateImage2( const char *name, byte *pic, int width, int height, GLe
 
 	// Upload data.
 	if (pic)
-		Upload32(pic, 0, 0, width, height, picFormat, dataFormat, dataType, numMips, image, scaled);
-
-	if (resampledBuffer != NULL)
-		ri.Hunk_FreeTempMemory(resampledBuffer);
+		Upload32(pic, 0, 0, 0, image->uploadWidth, image->uploadHeight, picFormat, dataFormat, dataType, numMips, image);
 
 	// Set all necessary texture parameters.
 	qglTextureParameterfEXT(image->texnum, textureTarget, GL_TEXTURE_WRAP_S, glWrapClampMode);
@@ -2384,10 +2538,54 @@ image_t *R_CreateImage2( const char *name, byte *pic, int width, int height, GLe
 	}
 
 	GL_CheckErrors();
+}
 
-	hash = generateHashValue(name);
-	image->next = hashTable[hash];
-	hashTable[hash] = image;
+
+/*
+================
+R_ResampleBufferSize
+
+Bytes of resample buffer R_PrepareImage() needs for this image
+================
+*/
+static int R_ResampleBufferSize( int width, int height, GLenum picFormat, imgFlags_t flags, int *scaledWidth ) {
+	int scaledHeight, upsampleWidth, upsampleHeight;
+
+	*scaledWidth = width;
+
+	if (picFormat != GL_RGBA8 && picFormat != GL_SRGB8_ALPHA8_EXT)
+		return 0;
+
+	if (flags & IMGFLAG_CUBEMAP)
+		return 0;
+
+	return RawImage_ResampleSize(width, height, flags, scaledWidth, &scaledHeight, &upsampleWidth, &upsampleHeight);
+}
+
+
+/*
+================
+R_CreateImage2
+
+This is the only way any image_t are created
+================
+*/
+image_t *R_CreateImage2( const char *name, byte *pic, int width, int height, GLenum picFormat, int numMips, imgType_t type, imgFlags_t flags, int internalFormat ) {
+	byte       *resampledBuffer = NULL;
+	image_t    *image;
+	int         size, scaledWidth;
+
+	image = R_AllocImage(name, width, height, type, flags);
+
+	size = R_ResampleBufferSize(width, height, picFormat, flags, &scaledWidth);
+	if (pic && size)
+		resampledBuffer = ri.Hunk_AllocateTempMemory(size);
+
+	R_PrepareImage(image, &pic, &width, &height, picFormat, &numMips, internalFormat, resampledBuffer);
+	R_UploadImage(image, pic, picFormat, numMips);
+
+	if (resampledBuffer != NULL)
+		ri.Hunk_FreeTempMemory(resampledBuffer);
 
 	return image;
 }
@@ -2414,9 +2612,214 @@ void R_UpdateSubImage( image_t *image, byte *pic, int x, int y, int width, int h
 	dataFormat = PixelDataFormatFromInternalFormat(image->internalFormat);
 	dataType = picFormat == GL_RGBA16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
 
-	Upload32(pic, x, y, width, height, picFormat, dataFormat, dataType, 0, image, qfalse);
+	RawImage_ProcessPixels(pic, width, height, picFormat, 0, image->type, image->flags, qfalse);
+	Upload32(pic, x, y, 0, width, height, picFormat, dataFormat, dataType, 0, image);
+}
+
+
+/*
+================
+R_CreateImageArray
+
+Creates an empty, unmipped GL_TEXTURE_2D_ARRAY of numLayers images.
+Fill the layers in with R_UpdateImageLayer().
+================
+*/
+image_t *R_CreateImageArray(const char *name, int width, int height, int numLayers, imgType_t type, imgFlags_t flags, int internalFormat)
+{
+	image_t *image;
+	GLenum dataType;
+
+	image = R_CreateImage2(name, NULL, width, height, GL_RGBA8, 0, type, (flags | IMGFLAG_ARRAY) & ~IMGFLAG_MIPMAP, internalFormat);
+
+	dataType = image->internalFormat == GL_RGBA16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+	qglTextureImage3DEXT(image->texnum, GL_TEXTURE_2D_ARRAY, 0, image->internalFormat, width, height, numLayers, 0, PixelDataFormatFromInternalFormat(image->internalFormat), dataType, NULL);
+
+	GL_CheckErrors();
+
+	return image;
+}
+
+
+void R_UpdateImageLayer( image_t *image, byte *pic, int layer, int width, int height, GLenum picFormat )
+{
+	GLenum dataFormat, dataType;
+
+	dataFormat = PixelDataFormatFromInternalFormat(image->internalFormat);
+	dataType = picFormat == GL_RGBA16 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+
+	RawImage_ProcessPixels(pic, width, height, picFormat, 0, image->type, image->flags, qfalse);
+	Upload32(pic, 0, 0, layer, width, height, picFormat, dataFormat, dataType, 0, image);
+}
+
+/*
+===============================================================================
+
+DEFERRED IMAGE LOADS
+
+Between RE_BeginRegistration and RE_EndRegistration R_FindImageFile only
+reads and decodes image files, as the file system and zone allocator aren't
+thread safe.  Everything R_PrepareImage does to them then runs on the job
+pool (r_imageThreads) for a whole batch at a time, and the GL uploads
+follow on this thread.  A batch is finished when it fills up and before
+any render commands are issued, so nothing is drawn with an empty texture.
+
+===============================================================================
+*/
+
+#define	MAX_IMAGE_LOADS		256
+#define	MAX_IMAGE_LOAD_BYTES	( 64 * 1024 * 1024 )	// decoded pixels held before a batch is finished
+
+typedef struct {
+	image_t		*image;
+	byte		*pic;				// as decoded, freed once uploaded
+	byte		*data;				// what gets uploaded, into pic or resampled
+	byte		*resampled;
+	int			width, height;
+	GLenum		picFormat;
+	int			numMips;
+} imageLoad_t;
+
+static struct {
+	qboolean	active;
+	int			numLoads;
+	int			bytes;
+	imageLoad_t	loads[MAX_IMAGE_LOADS];
+} imageLoads;
+
+/*
+================
+R_PrepareImageJob
+================
+*/
+static void R_PrepareImageJob( void *data, int index ) {
+	imageLoad_t *load = (imageLoad_t *)data + index;
+
+	R_PrepareImage( load->image, &load->data, &load->width, &load->height, load->picFormat, &load->numMips, 0, load->resampled );
+}
+
+/*
+================
+R_BeginImageLoads
+================
+*/
+void R_BeginImageLoads( void ) {
+	imageLoads.active = ( r_imageThreads->integer > 1 );
+}
+
+/*
+================
+R_FinishImageLoads
+
+Prepares and uploads every queued image
+================
+*/
+void R_FinishImageLoads( void ) {
+	imageLoad_t	*load;
+	int			i;
+
+	if ( !imageLoads.numLoads ) {
+		return;
+	}
+
+	ri.Job_ParallelFor( R_PrepareImageJob, imageLoads.loads, imageLoads.numLoads, r_imageThreads->integer );
+
+	for ( i = 0, load = imageLoads.loads ; i < imageLoads.numLoads ; i++, load++ ) {
+		R_UploadImage( load->image, load->data, load->picFormat, load->numMips );
+
+		ri.Free( load->pic );
+		load->pic = NULL;
+		if ( load->resampled ) {
+			ri.Free( load->resampled );
+			load->resampled = NULL;
+		}
+	}
+
+	imageLoads.numLoads = 0;
+	imageLoads.bytes = 0;
+}
+
+/*
+================
+R_EndImageLoads
+================
+*/
+void R_EndImageLoads( void ) {
+	R_FinishImageLoads();
+	imageLoads.active = qfalse;
+}
+
+/*
+================
+R_CancelImageLoads
+
+Drops the queue when the images it points at are going away
+================
+*/
+static void R_CancelImageLoads( void ) {
+	imageLoad_t	*load;
+	int			i;
+
+	for ( i = 0, load = imageLoads.loads ; i < imageLoads.numLoads ; i++, load++ ) {
+		if ( load->pic ) {
+			ri.Free( load->pic );
+		}
+		if ( load->resampled ) {
+			ri.Free( load->resampled );
+		}
+	}
+
+	imageLoads.numLoads = 0;
+	imageLoads.bytes = 0;
+	imageLoads.active = qfalse;
 }
 
+/*
+================
+R_QueueImage
+
+Takes over pic and returns an image_t that gets its contents when the
+batch is finished, or NULL if the image has to be created right away
+================
+*/
+static image_t *R_QueueImage( const char *name, byte *pic, int width, int height, GLenum picFormat, int numMips, imgType_t type, imgFlags_t flags ) {
+	imageLoad_t	*load;
+	int			size, scaledWidth, bytes;
+
+	if ( !imageLoads.active || ( flags & IMGFLAG_CUBEMAP ) ) {
+		return NULL;
+	}
+
+	// ResampleTexture() errors out past 2048 wide, do that here and not on a worker
+	size = R_ResampleBufferSize( width, height, picFormat, flags, &scaledWidth );
+	if ( size && scaledWidth > 2048 ) {
+		return NULL;
+	}
+
+	bytes = width * height * 4 + size;
+	if ( imageLoads.numLoads == MAX_IMAGE_LOADS
+		|| ( imageLoads.numLoads && imageLoads.bytes + bytes > MAX_IMAGE_LOAD_BYTES ) ) {
+		R_FinishImageLoads();
+	}
+
+	load = &imageLoads.loads[imageLoads.numLoads];
+	load->image = R_AllocImage( name, width, height, type, flags );
+	load->pic = pic;
+	load->data = pic;
+	load->resampled = size ? ri.Malloc( size ) : NULL;
+	load->width = width;
+	load->height = height;
+	load->picFormat = picFormat;
+	load->numMips = numMips;
+
+	imageLoads.numLoads++;
+	imageLoads.bytes += bytes;
+
+	return load->image;
+}
+
+//===================================================================
+
 //===================================================================
 
 // Prototype for dds loader function which isn't common to both renderers
@@ -2709,6 +3112,11 @@ image_t	*R_FindImageFile( const char *name, imgType_t type, imgFlags_t flags )
 			flags &= ~IMGFLAG_MIPMAP;
 	}
 
+	image = R_QueueImage( name, pic, width, height, picFormat, picNumMips, type, flags );
+	if ( image ) {
+		return image;
+	}
+
 	image = R_CreateImage2( ( char * ) name, pic, width, height, picFormat, picNumMips, type, flags, 0 );
 	ri.Free( pic );
 	return image;
@@ -3079,6 +3487,8 @@ void	R_InitImages( void ) {
 	// build brightness translation tables
 	R_SetColorMappings();
 
+	R_InitDownmipTables();
+
 	// create default texture and white texture
 	R_CreateBuiltinImages();
 }
@@ -3091,6 +3501,8 @@ R_DeleteTextures
 void R_DeleteTextures( void ) {
 	int		i;
 
+	R_CancelImageLoads();
+
 	for ( i=0; i<tr.numImages ; i++ ) {
 		qglDeleteTextures( 1, &tr.images[i]->texnum );
 	}
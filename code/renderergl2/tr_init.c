@@ -44,6 +44,7 @@ cvar_t  *com_altivec;
 cvar_t	*r_flareSize;
 cvar_t	*r_flareFade;
 cvar_t	*r_flareCoeff;
+cvar_t	*r_flareQueries;
 
 cvar_t	*r_railWidth;
 cvar_t	*r_railCoreWidth;
@@ -64,6 +65,9 @@ cvar_t	*r_useFlush;
 
 cvar_t	*r_skipBackEnd;
 
+cvar_t	*r_smp;
+cvar_t	*r_showSmp;
+
 cvar_t	*r_stereoEnabled;
 cvar_t	*r_anaglyphMode;
 
@@ -85,6 +89,7 @@ cvar_t	*r_lodscale;
 cvar_t	*r_norefresh;
 cvar_t	*r_drawentities;
 cvar_t	*r_drawworld;
+cvar_t	*r_cullThreads;
 cvar_t	*r_speeds;
 cvar_t	*r_fullbright;
 cvar_t	*r_novis;
@@ -108,10 +113,14 @@ cvar_t  *r_ext_framebuffer_multisample;
 cvar_t  *r_arb_seamless_cube_map;
 cvar_t  *r_arb_vertex_array_object;
 cvar_t  *r_ext_direct_state_access;
+cvar_t  *r_arb_buffer_storage;
+cvar_t  *r_arb_multi_draw_indirect;
 
 cvar_t  *r_cameraExposure;
 
 cvar_t  *r_externalGLSL;
+cvar_t  *r_glslCache;
+cvar_t  *r_glslLazy;
 
 cvar_t  *r_hdr;
 cvar_t  *r_floatLightmap;
@@ -148,12 +157,14 @@ cvar_t  *r_baseSpecular;
 cvar_t  *r_baseGloss;
 cvar_t  *r_glossType;
 cvar_t  *r_mergeLightmaps;
+cvar_t  *r_lightmapArray;
 cvar_t  *r_dlightMode;
 cvar_t  *r_pshadowDist;
 cvar_t  *r_imageUpsample;
 cvar_t  *r_imageUpsampleMaxSize;
 cvar_t  *r_imageUpsampleType;
 cvar_t  *r_genNormalMaps;
+cvar_t  *r_imageThreads;
 cvar_t  *r_forceSun;
 cvar_t  *r_forceSunLightScale;
 cvar_t  *r_forceSunAmbientScale;
@@ -203,6 +214,8 @@ cvar_t	*r_gamma;
 cvar_t	*r_intensity;
 cvar_t	*r_lockpvs;
 cvar_t	*r_noportals;
+cvar_t	*r_portalScissor;
+cvar_t	*r_occlusionCull;
 cvar_t	*r_portalOnly;
 
 cvar_t	*r_subdivisions;
@@ -1255,6 +1268,8 @@ void R_Register( void )
 	r_arb_seamless_cube_map = ri.Cvar_Get( "r_arb_seamless_cube_map", "0", CVAR_ARCHIVE | CVAR_LATCH);
 	r_arb_vertex_array_object = ri.Cvar_Get( "r_arb_vertex_array_object", "1", CVAR_ARCHIVE | CVAR_LATCH);
 	r_ext_direct_state_access = ri.Cvar_Get("r_ext_direct_state_access", "1", CVAR_ARCHIVE | CVAR_LATCH);
+	r_arb_buffer_storage = ri.Cvar_Get("r_arb_buffer_storage", "1", CVAR_ARCHIVE | CVAR_LATCH);
+	r_arb_multi_draw_indirect = ri.Cvar_Get("r_arb_multi_draw_indirect", "1", CVAR_ARCHIVE | CVAR_LATCH);
 
 	r_ext_texture_filter_anisotropic = ri.Cvar_Get( "r_ext_texture_filter_anisotropic",
 			"1", CVAR_ARCHIVE | CVAR_LATCH );
@@ -1290,6 +1305,8 @@ void R_Register( void )
 	ri.Cvar_CheckRange(r_greyscale, 0, 1, qfalse);
 
 	r_externalGLSL = ri.Cvar_Get( "r_externalGLSL", "0", CVAR_LATCH );
+	r_glslCache = ri.Cvar_Get( "r_glslCache", "1", CVAR_ARCHIVE | CVAR_LATCH );
+	r_glslLazy = ri.Cvar_Get( "r_glslLazy", "1", CVAR_ARCHIVE | CVAR_LATCH );
 
 	r_hdr = ri.Cvar_Get( "r_hdr", "1", CVAR_ARCHIVE | CVAR_LATCH );
 	r_floatLightmap = ri.Cvar_Get( "r_floatLightmap", "0", CVAR_ARCHIVE | CVAR_LATCH );
@@ -1330,10 +1347,13 @@ void R_Register( void )
 	r_dlightMode = ri.Cvar_Get( "r_dlightMode", "0", CVAR_ARCHIVE | CVAR_LATCH );
 	r_pshadowDist = ri.Cvar_Get( "r_pshadowDist", "128", CVAR_ARCHIVE );
 	r_mergeLightmaps = ri.Cvar_Get( "r_mergeLightmaps", "1", CVAR_ARCHIVE | CVAR_LATCH );
+	r_lightmapArray = ri.Cvar_Get( "r_lightmapArray", "0", CVAR_ARCHIVE | CVAR_LATCH );
 	r_imageUpsample = ri.Cvar_Get( "r_imageUpsample", "0", CVAR_ARCHIVE | CVAR_LATCH );
 	r_imageUpsampleMaxSize = ri.Cvar_Get( "r_imageUpsampleMaxSize", "1024", CVAR_ARCHIVE | CVAR_LATCH );
 	r_imageUpsampleType = ri.Cvar_Get( "r_imageUpsampleType", "1", CVAR_ARCHIVE | CVAR_LATCH );
 	r_genNormalMaps = ri.Cvar_Get( "r_genNormalMaps", "0", CVAR_ARCHIVE | CVAR_LATCH );
+	r_imageThreads = ri.Cvar_Get( "r_imageThreads", "1", CVAR_ARCHIVE );
+	ri.Cvar_CheckRange( r_imageThreads, 1, MAX_JOB_THREADS, qtrue );
 
 	r_forceSun = ri.Cvar_Get( "r_forceSun", "0", CVAR_CHEAT );
 	r_forceSunLightScale = ri.Cvar_Get( "r_forceSunLightScale", "1.0", CVAR_CHEAT );
@@ -1359,6 +1379,7 @@ void R_Register( void )
 	r_mapOverBrightBits = ri.Cvar_Get ("r_mapOverBrightBits", "2", CVAR_LATCH );
 	r_intensity = ri.Cvar_Get ("r_intensity", "1", CVAR_LATCH );
 	r_singleShader = ri.Cvar_Get ("r_singleShader", "0", CVAR_CHEAT | CVAR_LATCH );
+	r_smp = ri.Cvar_Get( "r_smp", "0", CVAR_ARCHIVE | CVAR_LATCH );
 
 	//
 	// archived variables that can change at any time
@@ -1391,6 +1412,8 @@ void R_Register( void )
 #endif
 	r_gamma = ri.Cvar_Get( "r_gamma", "1", CVAR_ARCHIVE );
 	r_facePlaneCull = ri.Cvar_Get ("r_facePlaneCull", "1", CVAR_ARCHIVE );
+	r_cullThreads = ri.Cvar_Get( "r_cullThreads", "1", CVAR_ARCHIVE );
+	ri.Cvar_CheckRange( r_cullThreads, 1, MAX_JOB_THREADS, qtrue );
 
 	r_railWidth = ri.Cvar_Get( "r_railWidth", "16", CVAR_ARCHIVE );
 	r_railCoreWidth = ri.Cvar_Get( "r_railCoreWidth", "6", CVAR_ARCHIVE );
@@ -1419,8 +1442,10 @@ void R_Register( void )
 	r_flareSize = ri.Cvar_Get ("r_flareSize", "40", CVAR_CHEAT);
 	r_flareFade = ri.Cvar_Get ("r_flareFade", "7", CVAR_CHEAT);
 	r_flareCoeff = ri.Cvar_Get ("r_flareCoeff", FLARE_STDCOEFF, CVAR_CHEAT);
+	r_flareQueries = ri.Cvar_Get ("r_flareQueries", "1", CVAR_ARCHIVE | CVAR_LATCH);
 
 	r_skipBackEnd = ri.Cvar_Get ("r_skipBackEnd", "0", CVAR_CHEAT);
+	r_showSmp = ri.Cvar_Get ("r_showSmp", "0", CVAR_CHEAT);
 
 	r_measureOverdraw = ri.Cvar_Get( "r_measureOverdraw", "0", CVAR_CHEAT );
 	r_lodscale = ri.Cvar_Get( "r_lodscale", "5", CVAR_CHEAT );
@@ -1444,6 +1469,8 @@ void R_Register( void )
 	r_drawBuffer = ri.Cvar_Get( "r_drawBuffer", "GL_BACK", CVAR_CHEAT );
 	r_lockpvs = ri.Cvar_Get ("r_lockpvs", "0", CVAR_CHEAT);
 	r_noportals = ri.Cvar_Get ("r_noportals", "0", CVAR_CHEAT);
+	r_portalScissor = ri.Cvar_Get ("r_portalScissor", "1", CVAR_ARCHIVE);
+	r_occlusionCull = ri.Cvar_Get ("r_occlusionCull", "0", CVAR_ARCHIVE | CVAR_LATCH);
 	r_shadows = ri.Cvar_Get( "cg_shadows", "1", 0 );
 	r_playerShadow = ri.Cvar_Get( "cg_playerShadow", "1", 0);
 
@@ -1479,6 +1506,8 @@ void R_InitQueries(void)
 
 	if (r_drawSunRays->integer)
 		qglGenQueries(ARRAY_LEN(tr.sunFlareQuery), tr.sunFlareQuery);
+
+	R_InitFlareQueries();
 }
 
 void R_ShutDownQueries(void)
@@ -1488,6 +1517,8 @@ void R_ShutDownQueries(void)
 
 	if (r_drawSunRays->integer)
 		qglDeleteQueries(ARRAY_LEN(tr.sunFlareQuery), tr.sunFlareQuery);
+
+	R_ShutdownFlareQueries();
 }
 
 /*
@@ -1558,10 +1589,17 @@ void R_Init( void ) {
 	if (max_polyverts < MAX_POLYVERTS)
 		max_polyverts = MAX_POLYVERTS;
 
-	ptr = ri.Hunk_Alloc( sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts, h_low);
-	backEndData = (backEndData_t *) ptr;
-	backEndData->polys = (srfPoly_t *) ((char *) ptr + sizeof( *backEndData ));
-	backEndData->polyVerts = (polyVert_t *) ((char *) ptr + sizeof( *backEndData ) + sizeof(srfPoly_t) * max_polys);
+	for ( i = 0; i < SMP_FRAMES; i++ ) {
+		// the second set is only needed when the back end has its own thread
+		if ( i > 0 && !r_smp->integer ) {
+			backEndData[i] = NULL;
+			continue;
+		}
+		ptr = ri.Hunk_Alloc( sizeof( *backEndData[i] ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts, h_low);
+		backEndData[i] = (backEndData_t *) ptr;
+		backEndData[i]->polys = (srfPoly_t *) ((char *) ptr + sizeof( *backEndData[i] ));
+		backEndData[i]->polyVerts = (polyVert_t *) ((char *) ptr + sizeof( *backEndData[i] ) + sizeof(srfPoly_t) * max_polys);
+	}
 	R_InitNextFrame();
 
 	InitOpenGL();
@@ -1585,6 +1623,9 @@ void R_Init( void ) {
 
 	R_InitQueries();
 
+	R_InitOcclusion();
+
+	R_InitCommandBuffers();
 
 	err = qglGetError();
 	if ( err != GL_NO_ERROR )
@@ -1620,6 +1661,7 @@ void RE_Shutdown( qboolean destroyWindow ) {
 	if ( tr.registered ) {
 		R_IssuePendingRenderCommands();
 		R_ShutDownQueries();
+		R_ShutdownOcclusion();
 		if (glRefConfig.framebufferObject)
 		{
 			if (tr.vrParms.renderBufferOriginal != 0)
@@ -1633,6 +1675,8 @@ void RE_Shutdown( qboolean destroyWindow ) {
 		GLSL_ShutdownGPUShaders();
 	}
 
+	R_ShutdownCommandBuffers();
+
 	R_DoneFreeType();
 
 	// shut down platform specific OpenGL stuff
@@ -1661,7 +1705,9 @@ Touch all images to make sure they are resident
 =============
 */
 void RE_EndRegistration( void ) {
+	R_EndImageLoads();
 	R_IssuePendingRenderCommands();
+	GLSL_CompileReferencedShaders();
 	if (!ri.Sys_LowPhysicalMemory()) {
 		RB_ShowImages();
 	}
@@ -1724,6 +1770,9 @@ refexport_t *GetRefAPI ( int apiVersion, refimport_t *rimp ) {
 	re.HUDBufferEnd = RE_HUDBufferEnd;
 	re.SetVRHeadsetParms = RE_SetVRHeadsetParms;
 	re.SetScreenOverlayBuffer = RE_SetScreenOverlayBuffer;
+	re.SetVRRenderBuffer = RE_SetVRRenderBuffer;
+	re.SyncRenderThread = R_SyncRenderThread;
+	re.SetFrameCallbacks = RE_SetFrameCallbacks;
 	re.ScreenOverlayBufferStart = RE_ScreenOverlayBufferStart;
 	re.ScreenOverlayBufferEnd = RE_ScreenOverlayBufferEnd;
 
@@ -60,6 +60,10 @@ QGL_4_2_PROCS;
 QGL_4_3_PROCS;
 QGL_4_5_PROCS;
 QGL_OVR_multiview_PROCS;
+QGL_ARB_get_program_binary_PROCS;
+QGL_ARB_buffer_storage_PROCS;
+QGL_ARB_multi_draw_indirect_PROCS;
+QGL_KHR_parallel_shader_compile_PROCS;
 #undef GLE
 
 #define GL_INDEX_TYPE		GL_UNSIGNED_SHORT
@@ -571,8 +575,9 @@ enum
 	GENERICDEF_USE_FOG              = 0x0008,
 	GENERICDEF_USE_RGBAGEN          = 0x0010,
 	GENERICDEF_USE_BONE_ANIMATION   = 0x0020,
-	GENERICDEF_ALL                  = 0x003F,
-	GENERICDEF_COUNT                = 0x0040,
+	GENERICDEF_USE_LIGHTMAP_ARRAY   = 0x0040,
+	GENERICDEF_ALL                  = 0x007F,
+	GENERICDEF_COUNT                = 0x0080,
 };
 
 enum
@@ -602,8 +607,9 @@ enum
 	LIGHTDEF_USE_PARALLAXMAP     = 0x0010,
 	LIGHTDEF_USE_SHADOWMAP       = 0x0020,
 	LIGHTDEF_ENTITY_BONE_ANIMATION = 0x0040,
-	LIGHTDEF_ALL                 = 0x007F,
-	LIGHTDEF_COUNT               = 0x0080
+	LIGHTDEF_USE_LIGHTMAP_ARRAY  = 0x0080,
+	LIGHTDEF_ALL                 = 0x00FF,
+	LIGHTDEF_COUNT               = 0x0100
 };
 
 enum
@@ -746,6 +752,8 @@ typedef struct shaderProgram_s
 	GLint uniforms[UNIFORM_COUNT];
 	short uniformBufferOffsets[UNIFORM_COUNT]; // max 32767/64=511 uniforms
 	char  *uniformBuffer;
+
+	qboolean pending;	// linked in the background, see GLSL_WarmupShaders
 } shaderProgram_t;
 
 // trRefdef_t holds everything that comes in refdef_t,
@@ -841,7 +849,8 @@ typedef enum {
 	VPF_ORTHOGRAPHIC    = 0x10,
 	VPF_USESUNLIGHT     = 0x20,
 	VPF_FARPLANEFRUSTUM = 0x40,
-	VPF_NOCUBEMAPS      = 0x80
+	VPF_NOCUBEMAPS      = 0x80,
+	VPF_OCCLUSIONCULL   = 0x100
 } viewParmFlags_t;
 
 typedef struct {
@@ -855,6 +864,9 @@ typedef struct {
 	int			frameCount;			// copied from tr.frameCount
 	cplane_t	portalPlane;		// clip anything behind this if mirroring
 	int			viewportX, viewportY, viewportWidth, viewportHeight;
+	int			scissorX, scissorY, scissorWidth, scissorHeight;	// 0 width for the whole viewport
+	qboolean	portalFrustum;		// fit the frustum sides to portalTangents
+	float		portalTangents[4];	// min and max of left / forward, then of up / forward
 	FBO_t		*targetFbo;
 	int         targetFboLayer;
 	int         targetFboCubemapIndex;
@@ -922,6 +934,15 @@ typedef struct drawSurf_s {
 	surfaceType_t		*surface;		// any of surface*_t
 } drawSurf_t;
 
+// laid out the way glMultiDrawElementsIndirect reads it
+typedef struct drawElementsIndirectCommand_s {
+	GLuint		count;
+	GLuint		instanceCount;
+	GLuint		firstIndex;
+	GLint		baseVertex;
+	GLuint		baseInstance;
+} drawElementsIndirectCommand_t;
+
 #define	MAX_FACE_POINTS		64
 
 #define	MAX_PATCH_SIZE		32			// max dimensions of a patch mesh in map file
@@ -949,7 +970,7 @@ typedef struct
 {
 	vec3_t          xyz;
 	vec2_t          st;
-	vec2_t          lightmap;
+	vec3_t          lightmap;	// s, t, lightmap array layer
 	int16_t         normal[4];
 	int16_t         tangent[4];
 	int16_t         lightdir[4];
@@ -960,7 +981,7 @@ typedef struct
 #endif
 } srfVert_t;
 
-#define srfVert_t_cleared(x) srfVert_t (x) = {{0, 0, 0}, {0, 0}, {0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}}
+#define srfVert_t_cleared(x) srfVert_t (x) = {{0, 0, 0}, {0, 0}, {0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}, {0, 0, 0, 0}}
 
 // srfBspSurface_t covers SF_GRID, SF_TRIANGLES, and SF_POLY
 typedef struct srfBspSurface_s
@@ -984,6 +1005,10 @@ typedef struct srfBspSurface_s
 	// vertexes
 	int             numVerts;
 	srfVert_t      *verts;
+
+	// SF_FACE and SF_TRIANGLES copy in the world VAO, -1 when not in it
+	int             worldFirstIndex;
+	int             worldBaseVertex;
 	
 	// SF_GRID specific variables after here
 
@@ -1187,6 +1212,14 @@ typedef struct {
 	int			numSurfaces;
 } bmodel_t;
 
+// a PVS leaf and what the threaded world cull found out about it
+typedef struct {
+	mnode_t		*node;
+	qboolean	visible;		// inside the frustum
+	uint32_t	dlightBits;		// dlights and pshadows reaching the leaf
+	uint32_t	pshadowBits;
+} cullLeaf_t;
+
 typedef struct {
 	char		name[MAX_QPATH];		// ie: maps/tim_dm2.bsp
 	char		baseName[MAX_QPATH];	// ie: tim_dm2
@@ -1217,9 +1250,19 @@ typedef struct {
 	int			nummarksurfaces;
 	int         *marksurfaces;
 
+	// scratch space for the threaded world cull (r_cullThreads)
+	int			numCullLeafs;
+	int			cullLeafsVisIndex;		// which R_MarkLeaves result cullLeafs holds
+	int			cullLeafsVisCount;
+	cullLeaf_t	*cullLeafs;				// one per leaf
+	int			*cullSurfaces;			// one per surface
+	byte		*cullSurfaceFlags;
+
 	int			numfogs;
 	fog_t		*fogs;
 
+	vao_t		*vao;		// static faces and triangles for multi-draw indirect, may be NULL
+
 	vec3_t		lightGridOrigin;
 	vec3_t		lightGridSize;
 	vec3_t		lightGridInverseSize;
@@ -1473,6 +1516,12 @@ typedef struct {
 
 	qboolean vertexArrayObject;
 	qboolean directStateAccess;
+	qboolean programBinary;
+	qboolean parallelShaderCompile;
+	qboolean bufferStorage;
+	qboolean multiDrawIndirect;
+	qboolean textureArray;
+	int maxArrayTextureLayers;
 
 	int maxVertexAttribs;
 	qboolean gpuVertexAnimation;
@@ -1499,6 +1548,7 @@ typedef struct {
 
 	int     c_staticVaoDraws;
 	int     c_dynamicVaoDraws;
+	int     c_dynamicVaoBytes;	// streamed to the tess and cache VAOs
 
 	int		c_dlightVertexes;
 	int		c_dlightIndexes;
@@ -1535,6 +1585,14 @@ typedef struct {
 	FBO_t *last2DFBO;
 	qboolean    colorMask[4];
 	qboolean    depthFill;
+
+	// world surface draws for the current view, see RB_SurfaceIndirect
+	const drawElementsIndirectCommand_t *indirectCommands;
+	int         currentDrawSurf;
+
+	vrParms_t	vrParms;			// copied from tr.vrParms when the commands are issued
+	qboolean	vrWeaponZoomed;		// copied from vr.weapon_zoomed at the same time
+	qboolean	vrVirtualScreen;	// copied from vr.virtual_screen at the same time
 } backEndState_t;
 
 /*
@@ -1548,6 +1606,8 @@ typedef struct {
 typedef struct {
 	qboolean				registered;		// cleared at shutdown, set at beginRegistration
 
+	int						smpFrame;		// backEndData[] the front end is filling
+
 	int						visIndex;
 	int						visClusters[MAX_VISCOUNTS];
 	int						visCounts[MAX_VISCOUNTS];	// incremented every time a new vis cluster is entered
@@ -1632,6 +1692,7 @@ typedef struct {
 
 	int						fatLightmapCols;
 	int						fatLightmapRows;
+	int						numLightmapLayers;		// lightmaps[0] is a texture array if non-zero
 
 	int                     numCubemaps;
 	cubemap_t               *cubemaps;
@@ -1661,6 +1722,7 @@ typedef struct {
 	shaderProgram_t shadowmaskShader;
 	shaderProgram_t ssaoShader;
 	shaderProgram_t depthBlurShader[4];
+	shaderProgram_t hizShader;
 	shaderProgram_t testcubeShader;
 
 
@@ -1741,6 +1803,7 @@ extern cvar_t	*r_flareFade;
 // coefficient for the flare intensity falloff function.
 #define FLARE_STDCOEFF "150"
 extern cvar_t	*r_flareCoeff;
+extern cvar_t	*r_flareQueries;
 
 extern cvar_t	*r_railWidth;
 extern cvar_t	*r_railCoreWidth;
@@ -1770,6 +1833,7 @@ extern cvar_t	*r_dlightBacks;			// dlight non-facing surfaces for continuity
 extern	cvar_t	*r_norefresh;			// bypasses the ref rendering
 extern	cvar_t	*r_drawentities;		// disable/enable entity rendering
 extern	cvar_t	*r_drawworld;			// disable/enable world rendering
+extern	cvar_t	*r_cullThreads;			// threads culling the world surfaces
 extern	cvar_t	*r_speeds;				// various levels of information display
 extern  cvar_t	*r_detailTextures;		// enables/disables detail texturing stages
 extern	cvar_t	*r_novis;				// disable/enable usage of PVS
@@ -1787,6 +1851,8 @@ extern  cvar_t  *r_ext_framebuffer_multisample;
 extern  cvar_t  *r_arb_seamless_cube_map;
 extern  cvar_t  *r_arb_vertex_array_object;
 extern  cvar_t  *r_ext_direct_state_access;
+extern  cvar_t  *r_arb_buffer_storage;
+extern  cvar_t  *r_arb_multi_draw_indirect;
 
 extern	cvar_t	*r_nobind;						// turns off binding to appropriate textures
 extern	cvar_t	*r_singleShader;				// make most world faces use default shader
@@ -1817,15 +1883,22 @@ extern	cvar_t	*r_intensity;
 
 extern	cvar_t	*r_lockpvs;
 extern	cvar_t	*r_noportals;
+extern	cvar_t	*r_portalScissor;		// restrict portal views to the portal surface's screen bounds
+extern	cvar_t	*r_occlusionCull;		// cull what last frame's depth hides
 extern	cvar_t	*r_portalOnly;
 
 extern	cvar_t	*r_subdivisions;
 extern	cvar_t	*r_lodCurveError;
 extern	cvar_t	*r_skipBackEnd;
 
+extern	cvar_t	*r_smp;
+extern	cvar_t	*r_showSmp;
+
 extern	cvar_t	*r_anaglyphMode;
 
 extern  cvar_t  *r_externalGLSL;
+extern  cvar_t  *r_glslCache;
+extern  cvar_t  *r_glslLazy;
 
 extern  cvar_t  *r_hdr;
 extern  cvar_t  *r_floatLightmap;
@@ -1866,10 +1939,12 @@ extern  cvar_t  *r_glossType;
 extern  cvar_t  *r_dlightMode;
 extern  cvar_t  *r_pshadowDist;
 extern  cvar_t  *r_mergeLightmaps;
+extern  cvar_t  *r_lightmapArray;
 extern  cvar_t  *r_imageUpsample;
 extern  cvar_t  *r_imageUpsampleMaxSize;
 extern  cvar_t  *r_imageUpsampleType;
 extern  cvar_t  *r_genNormalMaps;
+extern  cvar_t  *r_imageThreads;
 extern  cvar_t  *r_forceSun;
 extern  cvar_t  *r_forceSunLightScale;
 extern  cvar_t  *r_forceSunAmbientScale;
@@ -2039,6 +2114,12 @@ model_t		*R_AllocModel( void );
 
 void    	R_Init( void );
 void		R_UpdateSubImage( image_t *image, byte *pic, int x, int y, int width, int height, GLenum picFormat );
+image_t		*R_CreateImageArray( const char *name, int width, int height, int numLayers, imgType_t type, imgFlags_t flags, int internalFormat );
+void		R_UpdateImageLayer( image_t *image, byte *pic, int layer, int width, int height, GLenum picFormat );
+
+void		R_BeginImageLoads( void );
+void		R_FinishImageLoads( void );
+void		R_EndImageLoads( void );
 
 void		R_SetColorMappings( void );
 void		R_GammaCorrect( byte *buffer, int bufSize );
@@ -2105,7 +2186,7 @@ typedef struct shaderCommands_s
 	int16_t		normal[SHADER_MAX_VERTEXES][4] Q_ALIGN(16);
 	int16_t		tangent[SHADER_MAX_VERTEXES][4] Q_ALIGN(16);
 	vec2_t		texCoords[SHADER_MAX_VERTEXES] Q_ALIGN(16);
-	vec2_t		lightCoords[SHADER_MAX_VERTEXES] Q_ALIGN(16);
+	vec3_t		lightCoords[SHADER_MAX_VERTEXES] Q_ALIGN(16);
 	uint16_t	color[SHADER_MAX_VERTEXES][4] Q_ALIGN(16);
 	int16_t		lightdir[SHADER_MAX_VERTEXES][4] Q_ALIGN(16);
 	//int			vertexDlightBits[SHADER_MAX_VERTEXES] Q_ALIGN(16);
@@ -2114,6 +2195,9 @@ typedef struct shaderCommands_s
 	vao_t       *vao;
 	qboolean    useInternalVao;
 	qboolean    useCacheVao;
+	int         indexesOffset;	// of tess.indexes in tess.vao, moves with the ring buffer
+	int         firstIndirectCommand;	// of the world surfaces drawn from the world VAO
+	int         numIndirectCommands;
 
 	stageVars_t	svars Q_ALIGN(16);
 
@@ -2181,6 +2265,8 @@ FLARES
 */
 
 void R_ClearFlares( void );
+void R_InitFlareQueries( void );
+void R_ShutdownFlareQueries( void );
 
 void RB_AddFlare( void *surface, int fogNum, vec3_t point, vec3_t color, vec3_t normal );
 void RB_AddDlightFlares( void );
@@ -2189,6 +2275,22 @@ void RB_RenderFlares (void);
 /*
 ============================================================
 
+OCCLUSION CULLING
+
+============================================================
+*/
+
+void R_InitOcclusion( void );
+void R_ShutdownOcclusion( void );
+void R_LatchOcclusion( void );
+void R_SetupOcclusionView( void );
+qboolean R_OccludedBox( const vec3_t mins, const vec3_t maxs );
+
+void RB_CaptureOcclusion( void );
+
+/*
+============================================================
+
 LIGHTS
 
 ============================================================
@@ -2293,6 +2395,8 @@ void VaoCache_RecycleIndexBuffer(void);
 void VaoCache_InitQueue(void);
 void VaoCache_AddSurface(srfVert_t *verts, int numVerts, glIndex_t *indexes, int numIndexes);
 
+void RB_UploadIndirectCommands(const drawElementsIndirectCommand_t *commands, int numCommands);
+
 /*
 ============================================================
 
@@ -2303,11 +2407,14 @@ GLSL
 
 void GLSL_InitGPUShaders(void);
 void GLSL_PrepareUniformBuffers(void);
-void GLSL_UpdateMirrorProjection(void);
+void GLSL_UpdateMirrorProjection(const float projectionEye[2][16]);
 void GLSL_UpdateMenuProjection(void);
 void GLSL_ShutdownGPUShaders(void);
 void GLSL_VertexAttribPointers(uint32_t attribBits);
 void GLSL_BindProgram(shaderProgram_t * program);
+void GLSL_CompileReferencedShaders(void);
+void GLSL_WarmupShaders(void);
+void GLSL_CheckErrors(void);
 void GLSL_BindBuffers( shaderProgram_t * program );
 
 void GLSL_SetUniformInt(shaderProgram_t *program, int uniformNum, GLint value);
@@ -2467,6 +2574,7 @@ typedef struct {
 	viewParms_t	viewParms;
 	drawSurf_t *drawSurfs;
 	int		numDrawSurfs;
+	drawElementsIndirectCommand_t *indirectCommands;	// one per drawSurf, NULL without a world VAO
 } drawSurfsCommand_t;
 
 typedef struct {
@@ -2518,7 +2626,21 @@ typedef struct {
 
 typedef struct {
 	int commandId;
-	int eye;
+} beginFrameCommand_t;
+
+typedef struct {
+	int commandId;
+	float	projectionEye[2][16];
+} mirrorProjectionCommand_t;
+
+typedef struct {
+	int commandId;
+	void	(*callback)( void *data );
+	void	*data;
+} frameEndCommand_t;
+
+typedef struct {
+	int commandId;
 	stereoFrame_t stereoFrame;
 } switchEyeCommand_t;
 
@@ -2550,7 +2672,10 @@ typedef enum {
 	RC_EXPORT_CUBEMAPS,
 	RC_SWITCH_EYE,
 	RC_HUD_BUFFER,
-	RC_SCREEN_OVERLAY_BUFFER
+	RC_SCREEN_OVERLAY_BUFFER,
+	RC_BEGIN_FRAME,
+	RC_MIRROR_PROJECTION,
+	RC_FRAME_END
 } renderCommand_t;
 
 
@@ -2560,10 +2685,15 @@ typedef enum {
 #define	MAX_POLYS		600
 #define	MAX_POLYVERTS	3000
 
+// with r_smp the front end fills one set of buffers while the
+// render thread draws from the other
+#define	SMP_FRAMES		2
+
 // all of the information needed by the back end must be
 // contained in a backEndData_t
 typedef struct {
 	drawSurf_t	drawSurfs[MAX_DRAWSURFS];
+	drawElementsIndirectCommand_t	indirectCommands[MAX_DRAWSURFS];	// built by R_AddDrawSurfCmd
 	dlight_t	dlights[MAX_DLIGHTS];
 	trRefEntity_t	entities[MAX_REFENTITIES];
 	srfPoly_t	*polys;//[MAX_POLYS];
@@ -2575,17 +2705,24 @@ typedef struct {
 extern	int		max_polys;
 extern	int		max_polyverts;
 
-extern	backEndData_t	*backEndData;	// the second one may not be allocated
+extern	backEndData_t	*backEndData[SMP_FRAMES];	// the second one may not be allocated
 
 
 void *R_GetCommandBuffer( int bytes );
 void RB_ExecuteRenderCommands( const void *data );
+void RB_RenderThread( void );
+
+extern	volatile qboolean	renderThreadActive;
 
+void R_InitCommandBuffers( void );
+void R_ShutdownCommandBuffers( void );
+void R_SyncRenderThread( void );
 void R_IssuePendingRenderCommands( void );
 
 void R_AddDrawSurfCmd( drawSurf_t *drawSurfs, int numDrawSurfs );
 void R_AddCapShadowmapCmd( int dlight, int cubeSide );
 void R_AddPostProcessCmd (void);
+void R_AddMirrorProjectionCmd( void );
 
 void RE_SetColor( const float *rgba );
 void RE_StretchPic ( float x, float y, float w, float h, 
@@ -2605,6 +2742,8 @@ void RE_ScreenOverlayBufferStart( qboolean clear );
 void RE_ScreenOverlayBufferEnd( void );
 void RE_SetScreenOverlayBuffer( int overlayBuffer, int width, int height,
 								int mainSceneReadBuffer, int mainSceneWidth, int mainSceneHeight );
+void RE_SetVRRenderBuffer( int renderBuffer );
+qboolean RE_SetFrameCallbacks( void (*begin)( void *data ), void (*end)( void *data ), void *data );
 
 void RE_SaveJPG(char * filename, int quality, int image_width, int image_height,
                 unsigned char *image_buffer, int padding);
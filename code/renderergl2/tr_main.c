@@ -257,7 +257,7 @@ int R_CullLocalBox(vec3_t localBounds[2]) {
 
 	return CULL_CLIP;		// partially clipped
 #else
-	int             j;
+	int             j, cull;
 	vec3_t          transformed;
 	vec3_t          v;
 	vec3_t          worldBounds[2];
@@ -281,7 +281,16 @@ int R_CullLocalBox(vec3_t localBounds[2]) {
 		AddPointToBounds(transformed, worldBounds[0], worldBounds[1]);
 	}
 
-	return R_CullBox(worldBounds);
+	cull = R_CullBox(worldBounds);
+
+	// the view model is drawn over everything
+	if(cull != CULL_OUT && tr.currentEntity && !(tr.currentEntity->e.renderfx & (RF_DEPTHHACK | RF_FIRST_PERSON))
+		&& R_OccludedBox(worldBounds[0], worldBounds[1]))
+	{
+		return CULL_OUT;
+	}
+
+	return cull;
 #endif
 }
 
@@ -819,6 +828,48 @@ static void R_SetFarClip( void )
 	tr.viewParms.zFar = sqrt( farthestCornerDistance );
 }
 
+/*
+=================
+R_FitFrustumToPortal
+
+Replaces the frustum side normals with ones through the portal
+surface's bounds, which R_MirrorViewBySurface measured as tangents
+along the view axes.  The result never reaches outside of the fov.
+=================
+*/
+static void R_FitFrustumToPortal( float fovX, float fovY ) {
+	const float	*t = tr.viewParms.portalTangents;
+	const vec3_t	*axis = tr.viewParms.or.axis;
+	float		tanX, tanY;
+	float		right, left, bottom, top;
+
+	tanX = tanf( DEG2RAD( fovX * 0.5f ) );
+	tanY = tanf( DEG2RAD( fovY * 0.5f ) );
+
+	right = MAX( t[0], -tanX );
+	left = MIN( t[1], tanX );
+	bottom = MAX( t[2], -tanY );
+	top = MIN( t[3], tanY );
+
+	if ( right >= left || bottom >= top ) {
+		return;
+	}
+
+	VectorMA( axis[1], -right, axis[0], tr.viewParms.frustum[0].normal );
+	VectorNormalize( tr.viewParms.frustum[0].normal );
+
+	VectorScale( axis[0], left, tr.viewParms.frustum[1].normal );
+	VectorSubtract( tr.viewParms.frustum[1].normal, axis[1], tr.viewParms.frustum[1].normal );
+	VectorNormalize( tr.viewParms.frustum[1].normal );
+
+	VectorMA( axis[2], -bottom, axis[0], tr.viewParms.frustum[2].normal );
+	VectorNormalize( tr.viewParms.frustum[2].normal );
+
+	VectorScale( axis[0], top, tr.viewParms.frustum[3].normal );
+	VectorSubtract( tr.viewParms.frustum[3].normal, axis[2], tr.viewParms.frustum[3].normal );
+	VectorNormalize( tr.viewParms.frustum[3].normal );
+}
+
 /*
 =================
 R_SetupFrustum
@@ -870,6 +921,11 @@ void R_SetupFrustum( void ) {
 	VectorScale( tr.viewParms.or.axis[0], xs, tr.viewParms.frustum[3].normal );
 	VectorMA( tr.viewParms.frustum[3].normal, -xc, tr.viewParms.or.axis[2], tr.viewParms.frustum[3].normal );
 
+	// a portal view only has to see what is behind the portal surface
+	if ( tr.viewParms.portalFrustum ) {
+		R_FitFrustumToPortal( fovX, fovY );
+	}
+
 	for ( i = 0 ; i < 4 ; i++ ) {
 		tr.viewParms.frustum[i].type = PLANE_NON_AXIAL;
 		tr.viewParms.frustum[i].dist = DotProduct( tr.viewParms.or.origin, tr.viewParms.frustum[i].normal );
@@ -882,6 +938,13 @@ void R_SetupFrustum( void ) {
 	if (halfIpdWorldUnits > 0.0f) {
 		tr.viewParms.frustum[0].dist -= halfIpdWorldUnits;  // Push right plane outward (more negative = further right)
 		tr.viewParms.frustum[1].dist -= halfIpdWorldUnits;  // Push left plane outward (more negative = further left)
+
+		// Tangents fitted to a portal are taken from the center of the head, so the
+		// top and bottom planes need the same margin for the eyes' offsets
+		if (tr.viewParms.portalFrustum) {
+			tr.viewParms.frustum[2].dist -= halfIpdWorldUnits;
+			tr.viewParms.frustum[3].dist -= halfIpdWorldUnits;
+		}
 	}
 }
 
@@ -977,8 +1040,9 @@ void R_SetupProjectionZ(viewParms_t *dest)
 			tr.vrParms.mirrorProjectionEye[eye][14] = c[3];
 		}
 
-		// Update the GPU buffer with the newly calculated mirror projection
-		GLSL_UpdateMirrorProjection();
+		// Have the back end update the GPU buffer with the newly calculated
+		// mirror projection before it draws this view
+		R_AddMirrorProjectionCmd();
 	}
 
 }
@@ -1319,37 +1383,177 @@ static qboolean IsMirror( const drawSurf_t *drawSurf, int entityNum )
 	return qfalse;
 }
 
+#define	MAX_PORTAL_VERTS	128
+#define	MAX_PORTAL_INDEXES	( MAX_PORTAL_VERTS * 3 )
+
+// the triangles of a portal or mirror surface, just the bounds if
+// there are too many of them
+typedef struct {
+	shader_t	*shader;
+	int			entityNum;
+	vec3_t		bounds[2];
+	int			numVerts;
+	vec3_t		xyz[MAX_PORTAL_VERTS];
+	int16_t		normal[MAX_PORTAL_VERTS][4];
+	int			numIndexes;
+	glIndex_t	indexes[MAX_PORTAL_INDEXES];
+} portalSurface_t;
+
+/*
+** R_GetPortalSurface
+**
+** Brush faces and triangle soups are read straight from the surface.
+** Anything else is tessellated, and with r_smp that has to wait until
+** the render thread is done with tess.
+** Returns qfalse if the surface is too big to copy, only the bounds are
+** filled in then.
+*/
+static qboolean R_GetPortalSurface( const drawSurf_t *drawSurf, portalSurface_t *portal ) {
+	int		fogNum;
+	int		dlighted;
+	int		pshadowed;
+	int		i;
+
+	R_DecomposeSort( drawSurf->sort, &portal->entityNum, &portal->shader, &fogNum, &dlighted, &pshadowed );
+
+	if ( *drawSurf->surface == SF_FACE || *drawSurf->surface == SF_TRIANGLES ) {
+		const srfBspSurface_t *bsp = (const srfBspSurface_t *)drawSurf->surface;
+
+		VectorCopy( bsp->cullBounds[0], portal->bounds[0] );
+		VectorCopy( bsp->cullBounds[1], portal->bounds[1] );
+
+		if ( bsp->numVerts > MAX_PORTAL_VERTS || bsp->numIndexes > MAX_PORTAL_INDEXES ) {
+			portal->numVerts = 0;
+			return qfalse;
+		}
+
+		portal->numVerts = bsp->numVerts;
+		for ( i = 0; i < bsp->numVerts; i++ ) {
+			VectorCopy( bsp->verts[i].xyz, portal->xyz[i] );
+			Com_Memcpy( portal->normal[i], bsp->verts[i].normal, sizeof( portal->normal[i] ) );
+		}
+		portal->numIndexes = bsp->numIndexes;
+		Com_Memcpy( portal->indexes, bsp->indexes, bsp->numIndexes * sizeof( glIndex_t ) );
+		return qtrue;
+	}
+
+	R_SyncRenderThread();
+
+	RB_BeginSurface( portal->shader, fogNum, drawSurf->cubemapIndex );
+	rb_surfaceTable[ *drawSurf->surface ]( drawSurf->surface );
+
+	ClearBounds( portal->bounds[0], portal->bounds[1] );
+	for ( i = 0; i < tess.numVertexes; i++ ) {
+		AddPointToBounds( tess.xyz[i], portal->bounds[0], portal->bounds[1] );
+	}
+
+	if ( tess.numVertexes > MAX_PORTAL_VERTS || tess.numIndexes > MAX_PORTAL_INDEXES ) {
+		portal->numVerts = 0;
+		return qfalse;
+	}
+
+	portal->numVerts = tess.numVertexes;
+	for ( i = 0; i < tess.numVertexes; i++ ) {
+		VectorCopy( tess.xyz[i], portal->xyz[i] );
+		Com_Memcpy( portal->normal[i], tess.normal[i], sizeof( portal->normal[i] ) );
+	}
+	portal->numIndexes = tess.numIndexes;
+	Com_Memcpy( portal->indexes, tess.indexes, tess.numIndexes * sizeof( glIndex_t ) );
+	return qtrue;
+}
+
+/*
+** SurfBoundsIsOffscreen
+**
+** Conservative SurfIsOffscreen for surfaces only known by their bounds,
+** no backface test and the portal range is measured to the box.
+*/
+static qboolean SurfBoundsIsOffscreen( const drawSurf_t *drawSurf, const portalSurface_t *portal ) {
+	vec4_t clip, eye;
+	vec3_t corner, nearest;
+	int i, j;
+	unsigned int pointAnd = (unsigned int)~0;
+
+	// nothing was tessellated
+	if ( portal->bounds[0][0] > portal->bounds[1][0] )
+	{
+		return qtrue;
+	}
+
+	R_RotateForViewer();
+
+	for ( i = 0; i < 8; i++ )
+	{
+		unsigned int pointFlags = 0;
+
+		corner[0] = portal->bounds[(i >> 0) & 1][0];
+		corner[1] = portal->bounds[(i >> 1) & 1][1];
+		corner[2] = portal->bounds[(i >> 2) & 1][2];
+
+		R_TransformModelToClip( corner, tr.or.modelView, tr.viewParms.projectionMatrix, eye, clip );
+
+		for ( j = 0; j < 3; j++ )
+		{
+			if ( clip[j] >= clip[3] )
+			{
+				pointFlags |= (1 << (j*2));
+			}
+			else if ( clip[j] <= -clip[3] )
+			{
+				pointFlags |= ( 1 << (j*2+1));
+			}
+		}
+		pointAnd &= pointFlags;
+	}
+
+	if ( pointAnd )
+	{
+		return qtrue;
+	}
+
+	if ( IsMirror( drawSurf, portal->entityNum ) )
+	{
+		return qfalse;
+	}
+
+	for ( j = 0; j < 3; j++ )
+	{
+		nearest[j] = Com_Clamp( portal->bounds[0][j], portal->bounds[1][j], tr.viewParms.or.origin[j] );
+	}
+
+	if ( Distance( nearest, tr.viewParms.or.origin ) > portal->shader->portalRange )
+	{
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
 /*
 ** SurfIsOffscreen
 **
 ** Determines if a surface is completely offscreen.
 */
-static qboolean SurfIsOffscreen( const drawSurf_t *drawSurf, vec4_t clipDest[128] ) {
+static qboolean SurfIsOffscreen( const drawSurf_t *drawSurf, const portalSurface_t *portal ) {
 	float shortest = 100000000;
-	int entityNum;
 	int numTriangles;
-	shader_t *shader;
-	int		fogNum;
-	int dlighted;
-	int pshadowed;
 	vec4_t clip, eye;
 	int i;
 	unsigned int pointAnd = (unsigned int)~0;
 
-	R_RotateForViewer();
-
-	R_DecomposeSort( drawSurf->sort, &entityNum, &shader, &fogNum, &dlighted, &pshadowed );
-	RB_BeginSurface( shader, fogNum, drawSurf->cubemapIndex);
-	rb_surfaceTable[ *drawSurf->surface ]( drawSurf->surface );
+	if ( !portal->numVerts )
+	{
+		return SurfBoundsIsOffscreen( drawSurf, portal );
+	}
 
-	assert( tess.numVertexes < 128 );
+	R_RotateForViewer();
 
-	for ( i = 0; i < tess.numVertexes; i++ )
+	for ( i = 0; i < portal->numVerts; i++ )
 	{
 		int j;
 		unsigned int pointFlags = 0;
 
-		R_TransformModelToClip( tess.xyz[i], tr.or.modelView, tr.viewParms.projectionMatrix, eye, clip );
+		R_TransformModelToClip( portal->xyz[i], tr.or.modelView, tr.viewParms.projectionMatrix, eye, clip );
 
 		for ( j = 0; j < 3; j++ )
 		{
@@ -1376,15 +1580,15 @@ static qboolean SurfIsOffscreen( const drawSurf_t *drawSurf, vec4_t clipDest[128
 	// based on vertex distance isn't 100% correct (we should be checking for
 	// range to the surface), but it's good enough for the types of portals
 	// we have in the game right now.
-	numTriangles = tess.numIndexes / 3;
+	numTriangles = portal->numIndexes / 3;
 
-	for ( i = 0; i < tess.numIndexes; i += 3 )
+	for ( i = 0; i < portal->numIndexes; i += 3 )
 	{
 		vec3_t normal, tNormal;
 
 		float len;
 
-		VectorSubtract( tess.xyz[tess.indexes[i]], tr.viewParms.or.origin, normal );
+		VectorSubtract( portal->xyz[portal->indexes[i]], tr.viewParms.or.origin, normal );
 
 		len = VectorLengthSquared( normal );			// lose the sqrt
 		if ( len < shortest )
@@ -1392,7 +1596,7 @@ static qboolean SurfIsOffscreen( const drawSurf_t *drawSurf, vec4_t clipDest[128
 			shortest = len;
 		}
 
-		R_VaoUnpackNormal(tNormal, tess.normal[tess.indexes[i]]);
+		R_VaoUnpackNormal(tNormal, (int16_t *)portal->normal[portal->indexes[i]]);
 
 		if ( DotProduct( normal, tNormal ) >= 0 )
 		{
@@ -1406,12 +1610,12 @@ static qboolean SurfIsOffscreen( const drawSurf_t *drawSurf, vec4_t clipDest[128
 
 	// mirrors can early out at this point, since we don't do a fade over distance
 	// with them (although we could)
-	if ( IsMirror( drawSurf, entityNum ) )
+	if ( IsMirror( drawSurf, portal->entityNum ) )
 	{
 		return qfalse;
 	}
 
-	if ( shortest > (tess.shader->portalRange*tess.shader->portalRange) )
+	if ( shortest > (portal->shader->portalRange*portal->shader->portalRange) )
 	{
 		return qtrue;
 	}
@@ -1419,6 +1623,113 @@ static qboolean SurfIsOffscreen( const drawSurf_t *drawSurf, vec4_t clipDest[128
 	return qfalse;
 }
 
+/*
+** R_PortalScissor
+**
+** Finds the pixels the portal surface covers in the current view, for
+** both eyes and for the mono projection a zoomed weapon switches to.
+** Returns qfalse if the whole viewport has to be drawn.
+*/
+static qboolean R_PortalScissor( const portalSurface_t *portal, viewParms_t *dest ) {
+	const orientationr_t	*world = &tr.viewParms.world;
+	const float	*views[4], *projections[4];
+	vec4_t		eye, clip;
+	vec2_t		bounds[2];
+	int			numViews;
+	int			i, j;
+	int			x0, y0, x1, y1;
+
+	if ( tr.vrParms.valid ) {
+		views[0] = views[2] = world->eyeViewMatrix[0];
+		views[1] = views[3] = world->eyeViewMatrix[1];
+		projections[0] = tr.vrParms.projectionEye[0];
+		projections[1] = tr.vrParms.projectionEye[1];
+		projections[2] = projections[3] = tr.vrParms.projection;
+		numViews = 4;
+	} else {
+		views[0] = world->modelView;
+		projections[0] = tr.viewParms.projectionMatrix;
+		numViews = 1;
+	}
+
+	bounds[0][0] = bounds[0][1] = 1.0f;
+	bounds[1][0] = bounds[1][1] = -1.0f;
+
+	for ( i = 0; i < numViews; i++ ) {
+		for ( j = 0; j < portal->numVerts; j++ ) {
+			R_TransformModelToClip( portal->xyz[j], views[i], projections[i], eye, clip );
+
+			// the surface reaches behind the eye, no sensible bounds
+			if ( clip[3] <= 0.001f ) {
+				return qfalse;
+			}
+
+			bounds[0][0] = MIN( bounds[0][0], clip[0] / clip[3] );
+			bounds[0][1] = MIN( bounds[0][1], clip[1] / clip[3] );
+			bounds[1][0] = MAX( bounds[1][0], clip[0] / clip[3] );
+			bounds[1][1] = MAX( bounds[1][1], clip[1] / clip[3] );
+		}
+	}
+
+	// a pixel of slack for rounding
+	x0 = dest->viewportX + (int)floorf( ( bounds[0][0] + 1.0f ) * 0.5f * dest->viewportWidth ) - 1;
+	y0 = dest->viewportY + (int)floorf( ( bounds[0][1] + 1.0f ) * 0.5f * dest->viewportHeight ) - 1;
+	x1 = dest->viewportX + (int)ceilf( ( bounds[1][0] + 1.0f ) * 0.5f * dest->viewportWidth ) + 1;
+	y1 = dest->viewportY + (int)ceilf( ( bounds[1][1] + 1.0f ) * 0.5f * dest->viewportHeight ) + 1;
+
+	x0 = MAX( x0, dest->viewportX );
+	y0 = MAX( y0, dest->viewportY );
+	x1 = MIN( x1, dest->viewportX + dest->viewportWidth );
+	y1 = MIN( y1, dest->viewportY + dest->viewportHeight );
+
+	if ( x1 <= x0 || y1 <= y0 ) {
+		return qfalse;
+	}
+
+	dest->scissorX = x0;
+	dest->scissorY = y0;
+	dest->scissorWidth = x1 - x0;
+	dest->scissorHeight = y1 - y0;
+	return qtrue;
+}
+
+/*
+** R_PortalTangents
+**
+** Measures the portal surface, as seen through the portal, along the
+** axes of the portal view for R_FitFrustumToPortal.  Returns qfalse if
+** part of it is too close to the view origin for that.
+*/
+static qboolean R_PortalTangents( const portalSurface_t *portal, orientation_t *surface, orientation_t *camera,
+		viewParms_t *dest ) {
+	vec3_t	point, dir;
+	float	forward, tangent;
+	int		i;
+
+	dest->portalTangents[0] = dest->portalTangents[2] = 100000.0f;
+	dest->portalTangents[1] = dest->portalTangents[3] = -100000.0f;
+
+	for ( i = 0; i < portal->numVerts; i++ ) {
+		R_MirrorPoint( (float *)portal->xyz[i], surface, camera, point );
+		VectorSubtract( point, dest->or.origin, dir );
+
+		forward = DotProduct( dir, dest->or.axis[0] );
+		if ( forward < 1.0f ) {
+			return qfalse;
+		}
+
+		tangent = DotProduct( dir, dest->or.axis[1] ) / forward;
+		dest->portalTangents[0] = MIN( dest->portalTangents[0], tangent );
+		dest->portalTangents[1] = MAX( dest->portalTangents[1], tangent );
+
+		tangent = DotProduct( dir, dest->or.axis[2] ) / forward;
+		dest->portalTangents[2] = MIN( dest->portalTangents[2], tangent );
+		dest->portalTangents[3] = MAX( dest->portalTangents[3], tangent );
+	}
+
+	return qtrue;
+}
+
 /*
 ========================
 R_MirrorViewBySurface
@@ -1427,10 +1738,11 @@ Returns qtrue if another view has been rendered
 ========================
 */
 qboolean R_MirrorViewBySurface (drawSurf_t *drawSurf, int entityNum) {
-	vec4_t			clipDest[128];
+	portalSurface_t	portal;
 	viewParms_t		newParms;
 	viewParms_t		oldParms;
 	orientation_t	surface, camera;
+	qboolean		haveSurface;
 
 	// don't recursively mirror
 	if (tr.viewParms.isPortal) {
@@ -1443,7 +1755,8 @@ qboolean R_MirrorViewBySurface (drawSurf_t *drawSurf, int entityNum) {
 	}
 
 	// trivially reject portal/mirror
-	if ( SurfIsOffscreen( drawSurf, clipDest ) ) {
+	haveSurface = R_GetPortalSurface( drawSurf, &portal );
+	if ( SurfIsOffscreen( drawSurf, &portal ) ) {
 		return qfalse;
 	}
 
@@ -1453,7 +1766,7 @@ qboolean R_MirrorViewBySurface (drawSurf_t *drawSurf, int entityNum) {
 	newParms = tr.viewParms;
 	newParms.isPortal = qtrue;
 	newParms.zFar = 0.0f;
-	newParms.flags &= ~VPF_FARPLANEFRUSTUM;
+	newParms.flags &= ~( VPF_FARPLANEFRUSTUM | VPF_OCCLUSIONCULL );
 	if ( !R_GetPortalOrientations( drawSurf, entityNum, &surface, &camera, 
 		newParms.pvsOrigin, &newParms.isMirror ) ) {
 		return qfalse;		// bad portal, no portalentity
@@ -1471,7 +1784,16 @@ qboolean R_MirrorViewBySurface (drawSurf_t *drawSurf, int entityNum) {
 	R_MirrorVector (oldParms.or.axis[1], &surface, &camera, newParms.or.axis[1]);
 	R_MirrorVector (oldParms.or.axis[2], &surface, &camera, newParms.or.axis[2]);
 
-	// OPTIMIZE: restrict the viewport on the mirrored view
+	// restrict the mirrored view to the part of the screen the portal
+	// covers, and cull everything that can't be seen through it.
+	// The portal vertices are in world space only for world surfaces.
+	newParms.scissorWidth = 0;
+	newParms.portalFrustum = qfalse;
+	if ( haveSurface && r_portalScissor->integer && portal.entityNum == REFENTITYNUM_WORLD ) {
+		if ( R_PortalScissor( &portal, &newParms ) ) {
+			newParms.portalFrustum = R_PortalTangents( &portal, &surface, &camera, &newParms );
+		}
+	}
 
 	// render the mirror view
 	R_RenderView (&newParms);
@@ -1778,6 +2100,8 @@ R_GenerateDrawSurfs
 ====================
 */
 void R_GenerateDrawSurfs( void ) {
+	R_SetupOcclusionView ();
+
 	R_AddWorldSurfaces ();
 
 	R_AddPolygonSurfaces();
@@ -1187,6 +1187,8 @@ void RE_BeginRegistration( glconfig_t *glconfigOut ) {
 	R_ClearFlares();
 	RE_ClearScene();
 
+	R_BeginImageLoads();
+
 	tr.registered = qtrue;
 }
 
@@ -0,0 +1,616 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+// tr_occlusion.c
+
+#include "tr_local.h"
+#include "tr_dsa.h"
+
+/*
+=============================================================================
+
+OCCLUSION CULLING
+
+The PVS and the frustum leave every room that could be seen from the
+view cluster, even when a wall right in front of the eyes hides it.
+With r_occlusionCull the depth of the main view is reused to throw
+those away.
+
+After the main view has been drawn, the back end reduces both eyes of
+the swapchain depth to a small max-depth image on the GPU, 16x16 pixels
+to a texel, and reads it back through a pixel buffer.  The readback is
+collected a frame later, so it never stalls, and is turned into a
+max-depth pyramid on the CPU.  The front end picks it up while the back
+end is idle and tests world leaves and entities against it: the bounds
+are projected with the view and projection the depth was drawn with,
+which reprojects them across the head motion since then, and a box is
+occluded if its nearest point is behind the farthest depth under it in
+both eyes.
+
+The depth is a few frames old, so anything that was off screen or in
+front of the near plane back then is kept, the boxes are grown by how
+far the view has moved since, which covers the parallax the old depth
+can't show, and depth closer than OCCLUSION_NEAR_DIST never occludes,
+which keeps the weapon, the hands and the view model from hiding the
+world.  Past OCCLUSION_MAX_MOVE the depth isn't used at all.
+
+Only the VR path captures depth: the reduction samples the layered
+depth texture of the swapchain, both eyes at once.  The flat screen
+view has no capture path, so it is never culled.
+
+=============================================================================
+*/
+
+#define	OCCLUSION_REDUCE			4		// each reduction pass is 4x4 texels to one
+#define	OCCLUSION_MAX_LEVELS		12
+#define	OCCLUSION_READBACKS			2		// readbacks that can be in flight
+#define	OCCLUSION_NEAR_DIST			64.0f	// depth closer than this never occludes
+#define	OCCLUSION_MAX_MOVE			64.0f	// further than this and the depth isn't used
+#define	OCCLUSION_EYE_MOVE			8.0f	// head turns move the eyes around the origin
+#define	OCCLUSION_MAX_AGE			8		// frames an unrefreshed buffer stays in use
+
+typedef struct {
+	int			numLevels;
+	int			width[OCCLUSION_MAX_LEVELS];
+	int			height[OCCLUSION_MAX_LEVELS];
+	float		*levels[2][OCCLUSION_MAX_LEVELS];	// [eye][level], max depth
+
+	float		viewProjection[2][16];	// world to clip space of each eye
+	vec3_t		origin;
+} occlusionBuffer_t;
+
+typedef struct {
+	GLuint		pixelBuffer;
+	GLsync		fence;
+
+	float		viewProjection[2][16];
+	vec3_t		origin;
+} occlusionReadback_t;
+
+static struct {
+	// back end
+	GLuint				textures[2];			// quarter size and sixteenth size, one layer per eye
+	FBO_t				*fbos[2];
+	int					width[2], height[2];
+
+	occlusionReadback_t	readbacks[OCCLUSION_READBACKS];
+	int					nextReadback;
+
+	occlusionBuffer_t	buffers[2];
+	int					backBuffer;				// the one the back end fills
+	qboolean			backBufferReady;
+
+	// front end
+	const occlusionBuffer_t	*frontBuffer;
+	int					frontBufferFrame;
+	const occlusionBuffer_t	*view;				// set for the views that may be culled
+	float				viewMove;				// how far the view moved since the depth was drawn
+} occlusion;
+
+
+/*
+===============
+R_InitOcclusion
+===============
+*/
+void R_InitOcclusion( void ) {
+	int		i, j, level, size;
+	float	*ptr;
+
+	Com_Memset( &occlusion, 0, sizeof( occlusion ) );
+
+	if ( !r_occlusionCull->integer ) {
+		return;
+	}
+
+	if ( !glRefConfig.framebufferObject || !tr.hizShader.program || !qglFramebufferTextureMultiviewOVR
+		|| !qglTexStorage3D || !qglFenceSync || !qglGetTextureImage || !qglMapBufferRange ) {
+		ri.Printf( PRINT_WARNING, "WARNING: r_occlusionCull needs OpenGL 4.5 with multiview\n" );
+		return;
+	}
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		int		srcWidth = i ? occlusion.width[0] : glConfig.vidWidth;
+		int		srcHeight = i ? occlusion.height[0] : glConfig.vidHeight;
+
+		occlusion.width[i] = ( srcWidth + OCCLUSION_REDUCE - 1 ) / OCCLUSION_REDUCE;
+		occlusion.height[i] = ( srcHeight + OCCLUSION_REDUCE - 1 ) / OCCLUSION_REDUCE;
+
+		qglGenTextures( 1, &occlusion.textures[i] );
+		qglBindTexture( GL_TEXTURE_2D_ARRAY, occlusion.textures[i] );
+		qglTexStorage3D( GL_TEXTURE_2D_ARRAY, 1, GL_R32F, occlusion.width[i], occlusion.height[i], 2 );
+		qglTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+		qglTexParameteri( GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+		qglBindTexture( GL_TEXTURE_2D_ARRAY, 0 );
+
+		occlusion.fbos[i] = FBO_Create( va( "_occlusion%d", i ), occlusion.width[i], occlusion.height[i] );
+		FBO_Bind( occlusion.fbos[i] );
+		qglFramebufferTextureMultiviewOVR( GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, occlusion.textures[i], 0, 0, 2 );
+		R_CheckFBO( occlusion.fbos[i] );
+	}
+
+	FBO_Bind( NULL );
+
+	size = occlusion.width[1] * occlusion.height[1] * 2 * sizeof( float );
+
+	for ( i = 0 ; i < OCCLUSION_READBACKS ; i++ ) {
+		qglGenBuffers( 1, &occlusion.readbacks[i].pixelBuffer );
+		qglBindBuffer( GL_PIXEL_PACK_BUFFER, occlusion.readbacks[i].pixelBuffer );
+		qglBufferData( GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ );
+	}
+
+	qglBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	// the max-depth pyramids, down to a single texel
+	for ( i = 0 ; i < 2 ; i++ ) {
+		occlusionBuffer_t	*ob = &occlusion.buffers[i];
+
+		ob->width[0] = occlusion.width[1];
+		ob->height[0] = occlusion.height[1];
+		size = ob->width[0] * ob->height[0];
+
+		for ( level = 1 ; level < OCCLUSION_MAX_LEVELS ; level++ ) {
+			if ( ob->width[level - 1] == 1 && ob->height[level - 1] == 1 ) {
+				break;
+			}
+			ob->width[level] = ( ob->width[level - 1] + 1 ) >> 1;
+			ob->height[level] = ( ob->height[level - 1] + 1 ) >> 1;
+			size += ob->width[level] * ob->height[level];
+		}
+		ob->numLevels = level;
+
+		ptr = ri.Malloc( size * 2 * sizeof( float ) );
+		for ( j = 0 ; j < 2 ; j++ ) {
+			for ( level = 0 ; level < ob->numLevels ; level++ ) {
+				ob->levels[j][level] = ptr;
+				ptr += ob->width[level] * ob->height[level];
+			}
+		}
+	}
+}
+
+/*
+===============
+R_ShutdownOcclusion
+===============
+*/
+void R_ShutdownOcclusion( void ) {
+	int		i;
+
+	for ( i = 0 ; i < OCCLUSION_READBACKS ; i++ ) {
+		if ( occlusion.readbacks[i].fence ) {
+			qglDeleteSync( occlusion.readbacks[i].fence );
+		}
+		if ( occlusion.readbacks[i].pixelBuffer ) {
+			qglDeleteBuffers( 1, &occlusion.readbacks[i].pixelBuffer );
+		}
+	}
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		if ( occlusion.textures[i] ) {
+			qglDeleteTextures( 1, &occlusion.textures[i] );
+		}
+		if ( occlusion.buffers[i].levels[0][0] ) {
+			ri.Free( occlusion.buffers[i].levels[0][0] );
+		}
+	}
+
+	// the FBOs go with FBO_Shutdown
+	Com_Memset( &occlusion, 0, sizeof( occlusion ) );
+}
+
+
+/*
+=============================================================================
+
+BACK END
+
+=============================================================================
+*/
+
+/*
+===============
+RB_BuildOcclusionLevels
+
+Each texel of a level is the farthest of the up to four under it
+===============
+*/
+static void RB_BuildOcclusionLevels( occlusionBuffer_t *ob ) {
+	int		eye, level, x, y, x1, y1;
+	int		srcWidth, srcHeight, width, height;
+	const float	*src;
+	float	*dst, d;
+
+	for ( eye = 0 ; eye < 2 ; eye++ ) {
+		for ( level = 1 ; level < ob->numLevels ; level++ ) {
+			src = ob->levels[eye][level - 1];
+			dst = ob->levels[eye][level];
+			srcWidth = ob->width[level - 1];
+			srcHeight = ob->height[level - 1];
+			width = ob->width[level];
+			height = ob->height[level];
+
+			for ( y = 0 ; y < height ; y++ ) {
+				y1 = MIN( y * 2 + 1, srcHeight - 1 );
+
+				for ( x = 0 ; x < width ; x++ ) {
+					x1 = MIN( x * 2 + 1, srcWidth - 1 );
+
+					d = MAX( src[y * 2 * srcWidth + x * 2], src[y * 2 * srcWidth + x1] );
+					d = MAX( d, src[y1 * srcWidth + x * 2] );
+					d = MAX( d, src[y1 * srcWidth + x1] );
+					*dst++ = d;
+				}
+			}
+		}
+	}
+}
+
+/*
+===============
+RB_CollectOcclusion
+
+Copies the oldest readback into the back buffer once the GPU is done
+with it, without waiting
+===============
+*/
+static void RB_CollectOcclusion( void ) {
+	occlusionReadback_t	*rb = NULL;
+	occlusionBuffer_t	*ob = &occlusion.buffers[occlusion.backBuffer];
+	const float			*data;
+	GLenum				status;
+	int					i, size;
+
+	// the oldest one in flight
+	for ( i = 0 ; i < OCCLUSION_READBACKS ; i++ ) {
+		rb = &occlusion.readbacks[( occlusion.nextReadback + i ) % OCCLUSION_READBACKS];
+		if ( rb->fence ) {
+			break;
+		}
+	}
+
+	if ( i == OCCLUSION_READBACKS ) {
+		return;
+	}
+
+	status = qglClientWaitSync( rb->fence, 0, 0 );
+	if ( status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED ) {
+		return;
+	}
+
+	qglDeleteSync( rb->fence );
+	rb->fence = NULL;
+
+	size = ob->width[0] * ob->height[0] * sizeof( float );
+
+	qglBindBuffer( GL_PIXEL_PACK_BUFFER, rb->pixelBuffer );
+	data = qglMapBufferRange( GL_PIXEL_PACK_BUFFER, 0, size * 2, GL_MAP_READ_BIT );
+	if ( data ) {
+		Com_Memcpy( ob->levels[0][0], data, size );
+		Com_Memcpy( ob->levels[1][0], (const byte *)data + size, size );
+		qglUnmapBuffer( GL_PIXEL_PACK_BUFFER );
+	}
+	qglBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	if ( !data ) {
+		return;
+	}
+
+	RB_BuildOcclusionLevels( ob );
+
+	Com_Memcpy( ob->viewProjection, rb->viewProjection, sizeof( ob->viewProjection ) );
+	VectorCopy( rb->origin, ob->origin );
+	occlusion.backBufferReady = qtrue;
+}
+
+/*
+===============
+RB_ReduceOcclusionDepth
+
+One 4x4 max pass into the FBO, both eyes at once
+===============
+*/
+static void RB_ReduceOcclusionDepth( GLuint texture, int width, int height, float nearDepth, FBO_t *dst ) {
+	vec4_t		quadVerts[4];
+	vec2_t		texCoords[4];
+	vec4_t		viewInfo;
+
+	FBO_Bind( dst );
+	qglViewport( 0, 0, dst->width, dst->height );
+	qglScissor( 0, 0, dst->width, dst->height );
+
+	VectorSet4( quadVerts[0], -1,  1, 0, 1 );
+	VectorSet4( quadVerts[1],  1,  1, 0, 1 );
+	VectorSet4( quadVerts[2],  1, -1, 0, 1 );
+	VectorSet4( quadVerts[3], -1, -1, 0, 1 );
+
+	texCoords[0][0] = 0; texCoords[0][1] = 1;
+	texCoords[1][0] = 1; texCoords[1][1] = 1;
+	texCoords[2][0] = 1; texCoords[2][1] = 0;
+	texCoords[3][0] = 0; texCoords[3][1] = 0;
+
+	VectorSet4( viewInfo, width, height, nearDepth, 0 );
+
+	GLSL_BindProgram( &tr.hizShader );
+	GL_BindMultiTexture( GL_TEXTURE0 + TB_COLORMAP, GL_TEXTURE_2D_ARRAY, texture );
+	GLSL_SetUniformVec4( &tr.hizShader, UNIFORM_VIEWINFO, viewInfo );
+
+	RB_InstantQuad2( quadVerts, texCoords );
+}
+
+/*
+===============
+RB_CaptureOcclusion
+
+Called after the main view has been drawn into the swapchain image
+===============
+*/
+void RB_CaptureOcclusion( void ) {
+	occlusionReadback_t	*rb;
+	FBO_t		*oldFbo = glState.currentFBO;
+	GLint		type = GL_NONE, depthTexture = 0;
+	const float	*projection;
+	float		nearDepth;
+	int			i;
+
+	if ( !occlusion.fbos[0] || !r_occlusionCull->integer ) {
+		return;
+	}
+
+	if ( !backEnd.vrParms.valid || !( backEnd.viewParms.flags & VPF_OCCLUSIONCULL ) ) {
+		return;
+	}
+
+	if ( backEnd.viewParms.viewportX || backEnd.viewParms.viewportY
+		|| backEnd.viewParms.viewportWidth != glConfig.vidWidth || backEnd.viewParms.viewportHeight != glConfig.vidHeight ) {
+		return;
+	}
+
+	RB_CollectOcclusion();
+
+	// both readbacks still in flight
+	rb = &occlusion.readbacks[occlusion.nextReadback];
+	if ( rb->fence ) {
+		return;
+	}
+
+	// the depth is the layered texture the swapchain image was bound with
+	qglGetFramebufferAttachmentParameteriv( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_TYPE, &type );
+	if ( type != GL_TEXTURE ) {
+		return;
+	}
+	qglGetFramebufferAttachmentParameteriv( GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_FRAMEBUFFER_ATTACHMENT_OBJECT_NAME, &depthTexture );
+	if ( !depthTexture ) {
+		return;
+	}
+
+	for ( i = 0 ; i < 2 ; i++ ) {
+		if ( backEnd.vrWeaponZoomed || backEnd.vrVirtualScreen ) {
+			projection = backEnd.vrParms.projection;
+		} else {
+			projection = backEnd.vrParms.projectionEye[i];
+		}
+
+		Mat4Multiply( projection, backEnd.viewParms.world.eyeViewMatrix[i], rb->viewProjection[i] );
+	}
+	VectorCopy( backEnd.viewParms.or.origin, rb->origin );
+
+	// window depth of OCCLUSION_NEAR_DIST, closer depth is dropped
+	projection = backEnd.vrParms.projectionEye[0];
+	nearDepth = 0.5f * ( -projection[10] * OCCLUSION_NEAR_DIST + projection[14] ) / OCCLUSION_NEAR_DIST + 0.5f;
+
+	// swapchain images aren't set up for texelFetch
+	qglTextureParameteriEXT( depthTexture, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+	qglTextureParameteriEXT( depthTexture, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+	qglTextureParameteriEXT( depthTexture, GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_NONE );
+
+	GL_State( GLS_DEPTHTEST_DISABLE );
+	GL_Cull( CT_TWO_SIDED );
+
+	RB_ReduceOcclusionDepth( depthTexture, glConfig.vidWidth, glConfig.vidHeight, nearDepth, occlusion.fbos[0] );
+	RB_ReduceOcclusionDepth( occlusion.textures[0], occlusion.width[0], occlusion.height[0], 0.0f, occlusion.fbos[1] );
+
+	GL_BindMultiTexture( GL_TEXTURE0 + TB_COLORMAP, GL_TEXTURE_2D_ARRAY, 0 );
+
+	// both layers, one after the other
+	qglBindBuffer( GL_PIXEL_PACK_BUFFER, rb->pixelBuffer );
+	qglGetTextureImage( occlusion.textures[1], 0, GL_RED, GL_FLOAT,
+		occlusion.width[1] * occlusion.height[1] * 2 * sizeof( float ), NULL );
+	qglBindBuffer( GL_PIXEL_PACK_BUFFER, 0 );
+
+	rb->fence = qglFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+	occlusion.nextReadback = ( occlusion.nextReadback + 1 ) % OCCLUSION_READBACKS;
+
+	// reset viewport and scissor
+	FBO_Bind( oldFbo );
+	qglViewport( backEnd.viewParms.viewportX, backEnd.viewParms.viewportY,
+		backEnd.viewParms.viewportWidth, backEnd.viewParms.viewportHeight );
+	qglScissor( backEnd.viewParms.viewportX, backEnd.viewParms.viewportY,
+		backEnd.viewParms.viewportWidth, backEnd.viewParms.viewportHeight );
+}
+
+
+/*
+=============================================================================
+
+FRONT END
+
+=============================================================================
+*/
+
+/*
+===============
+R_LatchOcclusion
+
+Called with the back end idle, hands the front end the newest buffer
+the back end has finished
+===============
+*/
+void R_LatchOcclusion( void ) {
+	if ( occlusion.backBufferReady ) {
+		occlusion.frontBuffer = &occlusion.buffers[occlusion.backBuffer];
+		occlusion.frontBufferFrame = tr.frameCount;
+		occlusion.backBuffer ^= 1;
+		occlusion.backBufferReady = qfalse;
+	} else if ( occlusion.frontBuffer && tr.frameCount - occlusion.frontBufferFrame > OCCLUSION_MAX_AGE ) {
+		occlusion.frontBuffer = NULL;
+	}
+}
+
+/*
+===============
+R_SetupOcclusionView
+
+Decides if R_OccludedBox may cull in the view being set up
+===============
+*/
+void R_SetupOcclusionView( void ) {
+	const occlusionBuffer_t	*ob = occlusion.frontBuffer;
+
+	occlusion.view = NULL;
+
+	if ( !ob || !r_occlusionCull->integer || r_nocull->integer ) {
+		return;
+	}
+
+	if ( tr.viewParms.isPortal || !( tr.viewParms.flags & VPF_OCCLUSIONCULL ) ) {
+		return;
+	}
+
+	occlusion.viewMove = Distance( tr.viewParms.or.origin, ob->origin );
+	if ( occlusion.viewMove > OCCLUSION_MAX_MOVE ) {
+		return;
+	}
+
+	occlusion.viewMove += OCCLUSION_EYE_MOVE;
+	occlusion.view = ob;
+}
+
+/*
+===============
+R_OccludedInEye
+===============
+*/
+static qboolean R_OccludedInEye( const occlusionBuffer_t *ob, int eye, const vec3_t mins, const vec3_t maxs ) {
+	const float	*m = ob->viewProjection[eye];
+	const float	*level;
+	vec4_t		clip;
+	vec3_t		corner;
+	float		minX, minY, maxX, maxY, minZ;
+	float		x, y, z;
+	int			x0, y0, x1, y1, width;
+	int			i, l, tx, ty;
+
+	minX = minY = minZ = 1.0f;
+	maxX = maxY = -1.0f;
+
+	for ( i = 0 ; i < 8 ; i++ ) {
+		corner[0] = ( i & 1 ) ? maxs[0] : mins[0];
+		corner[1] = ( i & 2 ) ? maxs[1] : mins[1];
+		corner[2] = ( i & 4 ) ? maxs[2] : mins[2];
+
+		clip[0] = m[0] * corner[0] + m[4] * corner[1] + m[ 8] * corner[2] + m[12];
+		clip[1] = m[1] * corner[0] + m[5] * corner[1] + m[ 9] * corner[2] + m[13];
+		clip[2] = m[2] * corner[0] + m[6] * corner[1] + m[10] * corner[2] + m[14];
+		clip[3] = m[3] * corner[0] + m[7] * corner[1] + m[11] * corner[2] + m[15];
+
+		// reaches behind the eye
+		if ( clip[3] <= 0.001f ) {
+			return qfalse;
+		}
+
+		x = clip[0] / clip[3];
+		y = clip[1] / clip[3];
+		z = clip[2] / clip[3];
+
+		minX = MIN( minX, x );
+		maxX = MAX( maxX, x );
+		minY = MIN( minY, y );
+		maxY = MAX( maxY, y );
+		minZ = MIN( minZ, z );
+	}
+
+	// only what was on screen can have been hidden
+	if ( minX < -1.0f || maxX > 1.0f || minY < -1.0f || maxY > 1.0f || minZ < -1.0f ) {
+		return qfalse;
+	}
+
+	z = minZ * 0.5f + 0.5f;
+
+	// grow by a texel for rounding
+	x0 = (int)( ( minX * 0.5f + 0.5f ) * ob->width[0] ) - 1;
+	x1 = (int)( ( maxX * 0.5f + 0.5f ) * ob->width[0] ) + 1;
+	y0 = (int)( ( minY * 0.5f + 0.5f ) * ob->height[0] ) - 1;
+	y1 = (int)( ( maxY * 0.5f + 0.5f ) * ob->height[0] ) + 1;
+
+	x0 = MAX( x0, 0 );
+	y0 = MAX( y0, 0 );
+	x1 = MIN( x1, ob->width[0] - 1 );
+	y1 = MIN( y1, ob->height[0] - 1 );
+
+	// the level where it covers at most 2x2 texels
+	for ( l = 0 ; l < ob->numLevels - 1 && ( x1 - x0 > 1 || y1 - y0 > 1 ) ; l++ ) {
+		x0 >>= 1;
+		y0 >>= 1;
+		x1 >>= 1;
+		y1 >>= 1;
+	}
+
+	level = ob->levels[eye][l];
+	width = ob->width[l];
+
+	for ( ty = y0 ; ty <= y1 ; ty++ ) {
+		for ( tx = x0 ; tx <= x1 ; tx++ ) {
+			if ( z <= level[ty * width + tx] ) {
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+===============
+R_OccludedBox
+
+Returns qtrue if the world space box was hidden in both eyes.  The box
+is grown by the view motion since the depth was drawn, as whatever it
+hid from there can be seen around its edges from here.  Safe to call
+from the job pool.
+===============
+*/
+qboolean R_OccludedBox( const vec3_t mins, const vec3_t maxs ) {
+	const occlusionBuffer_t	*ob = occlusion.view;
+	vec3_t		bigMins, bigMaxs;
+	int			i;
+
+	if ( !ob ) {
+		return qfalse;
+	}
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		bigMins[i] = mins[i] - occlusion.viewMove;
+		bigMaxs[i] = maxs[i] + occlusion.viewMove;
+	}
+
+	return R_OccludedInEye( ob, 0, bigMins, bigMaxs ) && R_OccludedInEye( ob, 1, bigMins, bigMaxs );
+}
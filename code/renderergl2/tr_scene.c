@@ -43,7 +43,14 @@ R_InitNextFrame
 ====================
 */
 void R_InitNextFrame( void ) {
-	backEndData->commands.used = 0;
+	// fill the other buffer while the render thread draws this one
+	if ( glConfig.smpActive ) {
+		tr.smpFrame ^= 1;
+	} else {
+		tr.smpFrame = 0;
+	}
+
+	backEndData[tr.smpFrame]->commands.used = 0;
 
 	r_firstSceneDrawSurf = 0;
 
@@ -139,11 +146,11 @@ void RE_AddPolyToScene( qhandle_t hShader, int numVerts, const polyVert_t *verts
 			return;
 		}
 
-		poly = &backEndData->polys[r_numpolys];
+		poly = &backEndData[tr.smpFrame]->polys[r_numpolys];
 		poly->surfaceType = SF_POLY;
 		poly->hShader = hShader;
 		poly->numVerts = numVerts;
-		poly->verts = &backEndData->polyVerts[r_numpolyverts];
+		poly->verts = &backEndData[tr.smpFrame]->polyVerts[r_numpolyverts];
 		
 		Com_Memcpy( poly->verts, &verts[numVerts*j], numVerts * sizeof( *verts ) );
 
@@ -222,11 +229,11 @@ void RE_AddRefEntityToScene( const refEntity_t *ent ) {
 		ri.Error( ERR_DROP, "RE_AddRefEntityToScene: bad reType %i", ent->reType );
 	}
 
-	backEndData->entities[r_numentities].e = *ent;
-	backEndData->entities[r_numentities].lightingCalculated = qfalse;
+	backEndData[tr.smpFrame]->entities[r_numentities].e = *ent;
+	backEndData[tr.smpFrame]->entities[r_numentities].lightingCalculated = qfalse;
 
 	CrossProduct(ent->axis[0], ent->axis[1], cross);
-	backEndData->entities[r_numentities].mirrored = (DotProduct(ent->axis[2], cross) < 0.f);
+	backEndData[tr.smpFrame]->entities[r_numentities].mirrored = (DotProduct(ent->axis[2], cross) < 0.f);
 
 	r_numentities++;
 }
@@ -254,7 +261,7 @@ void RE_AddDynamicLightToScene( const vec3_t org, float intensity, float r, floa
 	if ( glConfig.hardwareType == GLHW_RIVA128 || glConfig.hardwareType == GLHW_PERMEDIA2 ) {
 		return;
 	}
-	dl = &backEndData->dlights[r_numdlights++];
+	dl = &backEndData[tr.smpFrame]->dlights[r_numdlights++];
 	VectorCopy (org, dl->origin);
 	dl->radius = intensity;
 	dl->color[0] = r;
@@ -404,19 +411,19 @@ void RE_BeginScene(const refdef_t *fd)
 	tr.refdef.floatTime = tr.refdef.time * 0.001;
 
 	tr.refdef.numDrawSurfs = r_firstSceneDrawSurf;
-	tr.refdef.drawSurfs = backEndData->drawSurfs;
+	tr.refdef.drawSurfs = backEndData[tr.smpFrame]->drawSurfs;
 
 	tr.refdef.num_entities = r_numentities - r_firstSceneEntity;
-	tr.refdef.entities = &backEndData->entities[r_firstSceneEntity];
+	tr.refdef.entities = &backEndData[tr.smpFrame]->entities[r_firstSceneEntity];
 
 	tr.refdef.num_dlights = r_numdlights - r_firstSceneDlight;
-	tr.refdef.dlights = &backEndData->dlights[r_firstSceneDlight];
+	tr.refdef.dlights = &backEndData[tr.smpFrame]->dlights[r_firstSceneDlight];
 
 	tr.refdef.numPolys = r_numpolys - r_firstScenePoly;
-	tr.refdef.polys = &backEndData->polys[r_firstScenePoly];
+	tr.refdef.polys = &backEndData[tr.smpFrame]->polys[r_firstScenePoly];
 
 	tr.refdef.num_pshadows = 0;
-	tr.refdef.pshadows = &backEndData->pshadows[0];
+	tr.refdef.pshadows = &backEndData[tr.smpFrame]->pshadows[0];
 
 	// turn off dynamic lighting globally by clearing all the
 	// dlights if it needs to be disabled or if vertex lighting is enabled
@@ -576,6 +583,12 @@ void RE_RenderScene( const refdef_t *fd ) {
 		parms.flags = VPF_USESUNLIGHT;
 	}
 
+	// the view whose depth r_occlusionCull reads back and culls against
+	if ( !( fd->rdflags & RDF_NOWORLDMODEL ) && !tr.refdef.isHUD )
+	{
+		parms.flags |= VPF_OCCLUSIONCULL;
+	}
+
 	R_RenderView( &parms );
 
 	if(!( fd->rdflags & RDF_NOWORLDMODEL ))
@@ -44,9 +44,19 @@ void R_DrawElements( int numIndexes, int firstIndex )
 	{
 		VaoCache_DrawElements(numIndexes, firstIndex);
 	}
+	else if (tess.numIndirectCommands)
+	{
+		qglMultiDrawElementsIndirect(GL_TRIANGLES, GL_INDEX_TYPE,
+			BUFFER_OFFSET(tess.firstIndirectCommand * sizeof(drawElementsIndirectCommand_t)), tess.numIndirectCommands, 0);
+	}
 	else
 	{
-		qglDrawElements(GL_TRIANGLES, numIndexes, GL_INDEX_TYPE, BUFFER_OFFSET(firstIndex * sizeof(glIndex_t)));
+		int offset = firstIndex * sizeof(glIndex_t);
+
+		if (glState.currentVao == tess.vao)
+			offset += tess.indexesOffset;
+
+		qglDrawElements(GL_TRIANGLES, numIndexes, GL_INDEX_TYPE, BUFFER_OFFSET(offset));
 	}
 }
 
@@ -171,6 +181,7 @@ void RB_BeginSurface( shader_t *shader, int fogNum, int cubemapIndex ) {
 	tess.currentStageIteratorFunc = state->optimalStageIteratorFunc;
 	tess.useInternalVao = qtrue;
 	tess.useCacheVao = qfalse;
+	tess.numIndirectCommands = 0;
 
 	tess.shaderTime = backEnd.refdef.floatTime - tess.shader->timeOffset;
 	if (tess.shader->clampTime && tess.shaderTime >= tess.shader->clampTime) {
@@ -719,7 +730,7 @@ static void ForwardDlight( void ) {
 		{
 			int index = pStage->glslShaderIndex;
 
-			index &= ~LIGHTDEF_LIGHTTYPE_MASK;
+			index &= ~(LIGHTDEF_LIGHTTYPE_MASK | LIGHTDEF_USE_LIGHTMAP_ARRAY);
 			index |= LIGHTDEF_USE_LIGHT_VECTOR;
 
 			sp = &tr.lightallShader[index];
@@ -1097,6 +1108,9 @@ static void RB_IterateStagesGeneric( shaderCommands_t *input )
 				if (pStage->stateBits & GLS_ATEST_BITS)
 				{
 					shaderAttribs |= GENERICDEF_USE_TCGEN_AND_TCMOD;
+
+					if (pStage->bundle[TB_COLORMAP].image[0] && (pStage->bundle[TB_COLORMAP].image[0]->flags & IMGFLAG_ARRAY))
+						shaderAttribs |= GENERICDEF_USE_LIGHTMAP_ARRAY;
 				}
 
 				sp = &tr.genericShader[shaderAttribs];
@@ -1125,7 +1139,7 @@ static void RB_IterateStagesGeneric( shaderCommands_t *input )
 
 			if (r_lightmap->integer && ((index & LIGHTDEF_LIGHTTYPE_MASK) == LIGHTDEF_USE_LIGHTMAP))
 			{
-				index = LIGHTDEF_USE_TCGEN_AND_TCMOD;
+				index = LIGHTDEF_USE_TCGEN_AND_TCMOD | (index & LIGHTDEF_USE_LIGHTMAP_ARRAY);
 			}
 
 			sp = &pStage->glslShaderGroup[index];
@@ -1738,6 +1752,7 @@ void RB_EndSurface( void ) {
 	tess.numVertexes = 0;
 	tess.firstIndex = 0;
 	tess.useCacheVao = qfalse;
+	tess.numIndirectCommands = 0;
 	tess.useInternalVao = qfalse;
 
 	GLimp_LogComment( "----------\n" );
@@ -2160,6 +2160,10 @@ static void ComputeVertexAttribs(void)
 				continue;
 			}
 
+			// the lightmap array layer rides along with the lightmap texcoords
+			if (pStage->bundle[i].image[0]->flags & IMGFLAG_ARRAY)
+				shader.vertexAttribs |= ATTR_LIGHTCOORD;
+
 			switch(pStage->bundle[i].tcGen)
 			{
 				case TCGEN_TEXTURE:
@@ -2229,6 +2233,9 @@ static void CollapseStagesToLightall(shaderStage_t *diffuse,
 		//ri.Printf(PRINT_ALL, ", lightmap");
 		diffuse->bundle[TB_LIGHTMAP] = lightmap->bundle[0];
 		defs |= LIGHTDEF_USE_LIGHTMAP;
+
+		if (lightmap->bundle[0].image[0] && (lightmap->bundle[0].image[0]->flags & IMGFLAG_ARRAY))
+			defs |= LIGHTDEF_USE_LIGHTMAP_ARRAY;
 	}
 	else if (useLightVector)
 	{
@@ -2616,6 +2623,8 @@ static int CollapseStagesToGLSL(void)
 			pStage->glslShaderGroup = tr.lightallShader;
 			pStage->glslShaderIndex = LIGHTDEF_USE_LIGHTMAP;
 			pStage->bundle[TB_LIGHTMAP] = pStage->bundle[TB_DIFFUSEMAP];
+			if (pStage->bundle[TB_LIGHTMAP].image[0]->flags & IMGFLAG_ARRAY)
+				pStage->glslShaderIndex |= LIGHTDEF_USE_LIGHTMAP_ARRAY;
 			pStage->bundle[TB_DIFFUSEMAP].image[0] = tr.whiteImage;
 			pStage->bundle[TB_DIFFUSEMAP].isLightmap = qfalse;
 			pStage->bundle[TB_DIFFUSEMAP].tcGen = TCGEN_TEXTURE;
@@ -2661,7 +2670,7 @@ sortedIndex.
 ==============
 */
 static void FixRenderCommandList( int newShader ) {
-	renderCommandList_t	*cmdList = &backEndData->commands;
+	renderCommandList_t	*cmdList = &backEndData[tr.smpFrame]->commands;
 
 	if( cmdList ) {
 		const void *curCmd = cmdList->cmds;
@@ -2717,6 +2726,18 @@ static void FixRenderCommandList( int newShader ) {
 				curCmd = (const void *)(sb_cmd + 1);
 				break;
 				}
+			case RC_BEGIN_FRAME:
+				{
+				const beginFrameCommand_t *bf_cmd = (const beginFrameCommand_t *)curCmd;
+				curCmd = (const void *)(bf_cmd + 1);
+				break;
+				}
+			case RC_MIRROR_PROJECTION:
+				{
+				const mirrorProjectionCommand_t *mp_cmd = (const mirrorProjectionCommand_t *)curCmd;
+				curCmd = (const void *)(mp_cmd + 1);
+				break;
+				}
 			case RC_END_OF_LIST:
 			default:
 				return;
@@ -3409,6 +3430,10 @@ shader_t *R_FindShaderEx( const char *name, int lightmapIndex, qboolean mipRawIm
 		}
 	}
 
+	// make sure the render thread is stopped, because we are probably
+	// going to have to upload an image, and the new shader gets sorted in
+	R_SyncRenderThread();
+
 	InitShaderEx( strippedName, lightmapIndex, realLightmapIndex );
 
 	//
@@ -3544,6 +3569,9 @@ qhandle_t RE_RegisterShaderFromImage(const char *name, int lightmapIndex, image_
 		}
 	}
 
+	// make sure the render thread is stopped, the new shader gets sorted in
+	R_SyncRenderThread();
+
 	InitShader( name, lightmapIndex );
 
 	//
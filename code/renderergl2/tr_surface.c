@@ -133,16 +133,16 @@ void RB_AddQuadStampExt( vec3_t origin, vec3_t left, vec3_t up, float color[4],
 
 	// standard square texture coordinates
 	VectorSet2(tess.texCoords[ndx], s1, t1);
-	VectorSet2(tess.lightCoords[ndx], s1, t1);
+	VectorSet(tess.lightCoords[ndx], s1, t1, 0);
 
 	VectorSet2(tess.texCoords[ndx+1], s2, t1);
-	VectorSet2(tess.lightCoords[ndx+1], s2, t1);
+	VectorSet(tess.lightCoords[ndx+1], s2, t1, 0);
 
 	VectorSet2(tess.texCoords[ndx+2], s2, t2);
-	VectorSet2(tess.lightCoords[ndx+2], s2, t2);
+	VectorSet(tess.lightCoords[ndx+2], s2, t2, 0);
 
 	VectorSet2(tess.texCoords[ndx+3], s1, t2);
-	VectorSet2(tess.lightCoords[ndx+3], s1, t2);
+	VectorSet(tess.lightCoords[ndx+3], s1, t2, 0);
 
 	// constant color all the way around
 	// should this be identity and let the shader specify from entity?
@@ -381,8 +381,8 @@ static void RB_SurfaceVertsAndIndexes( int numVerts, srfVert_t *verts, int numIn
 	{
 		dv = verts;
 		lightCoords = tess.lightCoords[ tess.numVertexes ];
-		for ( i = 0 ; i < numVerts ; i++, dv++, lightCoords+=2 )
-			VectorCopy2(dv->lightmap, lightCoords);
+		for ( i = 0 ; i < numVerts ; i++, dv++, lightCoords+=3 )
+			VectorCopy(dv->lightmap, lightCoords);
 	}
 
 	if ( tess.shader->vertexAttribs & ATTR_COLOR )
@@ -413,6 +413,46 @@ static void RB_SurfaceVertsAndIndexes( int numVerts, srfVert_t *verts, int numIn
 	tess.numVertexes += numVerts;
 }
 
+/*
+=============
+RB_SurfaceIndirect
+
+Adds a world surface to the batch as a draw from the world VAO, using the
+command R_AddDrawSurfCmd made for it.  Runs of these go to the GPU as one
+glMultiDrawElementsIndirect in R_DrawElements.
+=============
+*/
+static qboolean RB_SurfaceIndirect(srfBspSurface_t *srf)
+{
+	const drawElementsIndirectCommand_t *command;
+
+	if (!backEnd.indirectCommands)
+		return qfalse;
+
+	command = &backEnd.indirectCommands[backEnd.currentDrawSurf];
+	if (!command->count)
+		return qfalse;
+
+	if (ShaderRequiresCPUDeforms(tess.shader) || tess.shader->isSky || tess.shader->isPortal)
+		return qfalse;
+
+	// ends the batch if it holds other geometry
+	RB_CheckVao(tr.world->vao);
+
+	// skipped drawSurfs in between have empty commands
+	if (!tess.numIndirectCommands)
+		tess.firstIndirectCommand = backEnd.currentDrawSurf;
+
+	tess.numIndirectCommands = backEnd.currentDrawSurf + 1 - tess.firstIndirectCommand;
+
+	tess.numIndexes += srf->numIndexes;
+	tess.numVertexes += srf->numVerts;
+	tess.dlightBits |= srf->dlightBits;
+	tess.pshadowBits |= srf->pshadowBits;
+
+	return qtrue;
+}
+
 static qboolean RB_SurfaceVaoCached(int numVerts, srfVert_t *verts, int numIndexes, glIndex_t *indexes, int dlightBits, int pshadowBits)
 {
 	qboolean recycleVertexBuffer = qfalse;
@@ -428,6 +468,12 @@ static qboolean RB_SurfaceVaoCached(int numVerts, srfVert_t *verts, int numIndex
 	if (!numIndexes || !numVerts)
 		return qfalse;
 
+	if (tess.numIndirectCommands)
+	{
+		RB_EndSurface();
+		RB_BeginSurface(tess.shader, tess.fogNum, tess.cubemapIndex);
+	}
+
 	VaoCache_BindVao();
 
 	tess.dlightBits |= dlightBits;
@@ -467,6 +513,11 @@ RB_SurfaceTriangles
 =============
 */
 static void RB_SurfaceTriangles( srfBspSurface_t *srf ) {
+	if (RB_SurfaceIndirect(srf))
+	{
+		return;
+	}
+
 	if (RB_SurfaceVaoCached(srf->numVerts, srf->verts, srf->numIndexes,
 		srf->indexes, srf->dlightBits, srf->pshadowBits))
 	{
@@ -933,6 +984,11 @@ RB_SurfaceFace
 ==============
 */
 static void RB_SurfaceFace( srfBspSurface_t *srf ) {
+	if (RB_SurfaceIndirect(srf))
+	{
+		return;
+	}
+
 	if (RB_SurfaceVaoCached(srf->numVerts, srf->verts, srf->numIndexes,
 		srf->indexes, srf->dlightBits, srf->pshadowBits))
 	{
@@ -1112,8 +1168,8 @@ static void RB_SurfaceGrid( srfBspSurface_t *srf ) {
 
 				if ( tess.shader->vertexAttribs & ATTR_LIGHTCOORD )
 				{
-					VectorCopy2(dv->lightmap, lightCoords);
-					lightCoords += 2;
+					VectorCopy(dv->lightmap, lightCoords);
+					lightCoords += 3;
 				}
 
 				if ( tess.shader->vertexAttribs & ATTR_COLOR )
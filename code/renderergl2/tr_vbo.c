@@ -218,7 +218,7 @@ vao_t *R_CreateVao2(const char *name, int numVertexes, srfVert_t *verts, int num
 	vao->attribs[ATTR_INDEX_NORMAL        ].count = 4;
 	vao->attribs[ATTR_INDEX_TANGENT       ].count = 4;
 	vao->attribs[ATTR_INDEX_TEXCOORD      ].count = 2;
-	vao->attribs[ATTR_INDEX_LIGHTCOORD    ].count = 2;
+	vao->attribs[ATTR_INDEX_LIGHTCOORD    ].count = 3;
 	vao->attribs[ATTR_INDEX_COLOR         ].count = 4;
 	vao->attribs[ATTR_INDEX_LIGHTDIRECTION].count = 4;
 
@@ -410,6 +410,122 @@ void R_BindNullVao(void)
 }
 
 
+// world surface draws for glMultiDrawElementsIndirect, see RB_UploadIndirectCommands
+static GLuint indirectBuffer;
+
+/*
+============
+Tess ring buffer
+
+With GL_ARB_buffer_storage the tess VAO's buffers are persistently mapped
+and split into TESSRING_SEGMENTS segments.  RB_UpdateTessVao copies each
+batch to the next free spot of the current segment.  When a segment fills
+up a fence goes in behind it and the next segment is waited on, which the
+GPU has normally finished with long ago.
+============
+*/
+#define TESSRING_SEGMENTS 3
+#define TESSRING_VERTEX_SEGMENT_SIZE (2 * 1024 * 1024)
+#define TESSRING_INDEX_SEGMENT_SIZE (512 * 1024)
+#define TESSRING_MAP_FLAGS (GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT)
+
+static struct
+{
+	byte *vertexes;
+	byte *indexes;
+	GLsync fences[TESSRING_SEGMENTS];
+	int segment;
+	int vertexOffset;
+	int indexOffset;
+}
+tessRing;
+
+static void R_InitTessRing(void)
+{
+	Com_Memset(&tessRing, 0, sizeof(tessRing));
+
+	if (!glRefConfig.bufferStorage)
+		return;
+
+	// buffer storage is immutable, so replace the buffers R_CreateVao made
+	qglDeleteBuffers(1, &tess.vao->vertexesVBO);
+	qglGenBuffers(1, &tess.vao->vertexesVBO);
+	qglBindBuffer(GL_ARRAY_BUFFER, tess.vao->vertexesVBO);
+	qglBufferStorage(GL_ARRAY_BUFFER, TESSRING_VERTEX_SEGMENT_SIZE * TESSRING_SEGMENTS, NULL, TESSRING_MAP_FLAGS);
+	tessRing.vertexes = qglMapBufferRange(GL_ARRAY_BUFFER, 0, TESSRING_VERTEX_SEGMENT_SIZE * TESSRING_SEGMENTS, TESSRING_MAP_FLAGS);
+
+	qglDeleteBuffers(1, &tess.vao->indexesIBO);
+	qglGenBuffers(1, &tess.vao->indexesIBO);
+	qglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tess.vao->indexesIBO);
+	qglBufferStorage(GL_ELEMENT_ARRAY_BUFFER, TESSRING_INDEX_SEGMENT_SIZE * TESSRING_SEGMENTS, NULL, TESSRING_MAP_FLAGS);
+	tessRing.indexes = qglMapBufferRange(GL_ELEMENT_ARRAY_BUFFER, 0, TESSRING_INDEX_SEGMENT_SIZE * TESSRING_SEGMENTS, TESSRING_MAP_FLAGS);
+
+	if (!tessRing.vertexes || !tessRing.indexes)
+	{
+		ri.Printf(PRINT_WARNING, "WARNING: couldn't map the tess ring buffer\n");
+
+		// fall back to buffers that can be orphaned
+		qglBindBuffer(GL_ARRAY_BUFFER, 0);
+		qglDeleteBuffers(1, &tess.vao->vertexesVBO);
+		qglGenBuffers(1, &tess.vao->vertexesVBO);
+		qglBindBuffer(GL_ARRAY_BUFFER, tess.vao->vertexesVBO);
+		qglBufferData(GL_ARRAY_BUFFER, tess.vao->vertexesSize, NULL, GL_DYNAMIC_DRAW);
+
+		qglDeleteBuffers(1, &tess.vao->indexesIBO);
+		qglGenBuffers(1, &tess.vao->indexesIBO);
+		qglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tess.vao->indexesIBO);
+		qglBufferData(GL_ELEMENT_ARRAY_BUFFER, tess.vao->indexesSize, NULL, GL_DYNAMIC_DRAW);
+
+		tessRing.vertexes = NULL;
+		tessRing.indexes = NULL;
+		return;
+	}
+
+	ri.Printf(PRINT_ALL, "Streaming dynamic geometry through a %d KB ring buffer\n",
+		(TESSRING_VERTEX_SEGMENT_SIZE + TESSRING_INDEX_SEGMENT_SIZE) * TESSRING_SEGMENTS / 1024);
+}
+
+static void R_ShutdownTessRing(void)
+{
+	int i;
+
+	for (i = 0; i < TESSRING_SEGMENTS; i++)
+	{
+		if (tessRing.fences[i])
+			qglDeleteSync(tessRing.fences[i]);
+	}
+
+	// deleting the buffers unmaps them
+	Com_Memset(&tessRing, 0, sizeof(tessRing));
+}
+
+static void RB_NextTessRingSegment(void)
+{
+	GLsync *fence;
+
+	tessRing.fences[tessRing.segment] = qglFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	tessRing.segment = (tessRing.segment + 1) % TESSRING_SEGMENTS;
+	tessRing.vertexOffset = 0;
+	tessRing.indexOffset = 0;
+
+	fence = &tessRing.fences[tessRing.segment];
+	if (*fence)
+	{
+		GLenum result = qglClientWaitSync(*fence, 0, 0);
+
+		if (result == GL_TIMEOUT_EXPIRED)
+		{
+			// wait for as long as it takes
+			GLimp_LogComment("--- RB_NextTessRingSegment: waiting on the GPU ---\n");
+			qglClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+		}
+
+		qglDeleteSync(*fence);
+		*fence = NULL;
+	}
+}
+
 /*
 ============
 R_InitVaos
@@ -451,7 +567,7 @@ void R_InitVaos(void)
 	tess.vao->attribs[ATTR_INDEX_NORMAL        ].count = 4;
 	tess.vao->attribs[ATTR_INDEX_TANGENT       ].count = 4;
 	tess.vao->attribs[ATTR_INDEX_TEXCOORD      ].count = 2;
-	tess.vao->attribs[ATTR_INDEX_LIGHTCOORD    ].count = 2;
+	tess.vao->attribs[ATTR_INDEX_LIGHTCOORD    ].count = 3;
 	tess.vao->attribs[ATTR_INDEX_COLOR         ].count = 4;
 	tess.vao->attribs[ATTR_INDEX_LIGHTDIRECTION].count = 4;
 
@@ -495,12 +611,17 @@ void R_InitVaos(void)
 	tess.attribPointers[ATTR_INDEX_COLOR]          = tess.color;
 	tess.attribPointers[ATTR_INDEX_LIGHTDIRECTION] = tess.lightdir;
 
+	R_InitTessRing();
+
 	Vao_SetVertexPointers(tess.vao);
 
 	R_BindNullVao();
 
 	VaoCache_Init();
 
+	if (glRefConfig.multiDrawIndirect)
+		qglGenBuffers(1, &indirectBuffer);
+
 	GL_CheckErrors();
 }
 
@@ -518,6 +639,15 @@ void R_ShutdownVaos(void)
 
 	R_BindNullVao();
 
+	R_ShutdownTessRing();
+
+	if (indirectBuffer)
+	{
+		qglBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		qglDeleteBuffers(1, &indirectBuffer);
+		indirectBuffer = 0;
+	}
+
 	for(i = 0; i < tr.numVaos; i++)
 	{
 		vao = tr.vaos[i];
@@ -582,6 +712,77 @@ void R_VaoList_f(void)
 }
 
 
+/*
+==============
+RB_UpdateTessRing
+
+Copies tess into the next free spot of the ring buffer and points the
+tess VAO at it.  Only the attributes being drawn are copied, packed one
+after the other.
+==============
+*/
+static void RB_UpdateTessRing(unsigned int attribBits)
+{
+	int attribIndex;
+	int vertexesSize = 0;
+	int indexesSize = tess.numIndexes * sizeof(tess.indexes[0]);
+	int offset;
+
+	for (attribIndex = 0; attribIndex < ATTR_INDEX_COUNT; attribIndex++)
+	{
+		if (attribBits & (1 << attribIndex))
+			vertexesSize += PAD(tess.numVertexes * tess.vao->attribs[attribIndex].stride, 16);
+	}
+
+	if (tessRing.vertexOffset + vertexesSize > TESSRING_VERTEX_SEGMENT_SIZE
+		|| tessRing.indexOffset + indexesSize > TESSRING_INDEX_SEGMENT_SIZE)
+	{
+		RB_NextTessRingSegment();
+	}
+
+	offset = tessRing.segment * TESSRING_VERTEX_SEGMENT_SIZE + tessRing.vertexOffset;
+
+	for (attribIndex = 0; attribIndex < ATTR_INDEX_COUNT; attribIndex++)
+	{
+		uint32_t attribBit = 1 << attribIndex;
+		vaoAttrib_t *vAtb = &tess.vao->attribs[attribIndex];
+
+		if (attribBits & attribBit)
+		{
+			int size = tess.numVertexes * vAtb->stride;
+
+			Com_Memcpy(tessRing.vertexes + offset, tess.attribPointers[attribIndex], size);
+
+			// the VAO keeps the offset, so this is needed even with one bound
+			qglVertexAttribPointer(attribIndex, vAtb->count, vAtb->type, vAtb->normalized, vAtb->stride, BUFFER_OFFSET(offset));
+
+			if (!(glState.vertexAttribsEnabled & attribBit))
+			{
+				qglEnableVertexAttribArray(attribIndex);
+				glState.vertexAttribsEnabled |= attribBit;
+			}
+
+			offset += PAD(size, 16);
+		}
+		else
+		{
+			if ((glState.vertexAttribsEnabled & attribBit))
+			{
+				qglDisableVertexAttribArray(attribIndex);
+				glState.vertexAttribsEnabled &= ~attribBit;
+			}
+		}
+	}
+
+	tess.indexesOffset = tessRing.segment * TESSRING_INDEX_SEGMENT_SIZE + tessRing.indexOffset;
+	Com_Memcpy(tessRing.indexes + tess.indexesOffset, tess.indexes, indexesSize);
+
+	tessRing.vertexOffset += vertexesSize;
+	tessRing.indexOffset += PAD(indexesSize, 16);
+
+	backEnd.pc.c_dynamicVaoBytes += vertexesSize + indexesSize;
+}
+
 /*
 ==============
 RB_UpdateTessVao
@@ -605,13 +806,19 @@ void RB_UpdateTessVao(unsigned int attribBits)
 
 		R_BindVao(tess.vao);
 
-		// orphan old vertex buffer so we don't stall on it
-		qglBufferData(GL_ARRAY_BUFFER, tess.vao->vertexesSize, NULL, GL_DYNAMIC_DRAW);
-
 		// if nothing to set, set everything
 		if(!(attribBits & ATTR_BITS))
 			attribBits = ATTR_BITS;
 
+		if (tessRing.vertexes)
+		{
+			RB_UpdateTessRing(attribBits);
+			return;
+		}
+
+		// orphan old vertex buffer so we don't stall on it
+		qglBufferData(GL_ARRAY_BUFFER, tess.vao->vertexesSize, NULL, GL_DYNAMIC_DRAW);
+
 		attribUpload = attribBits;
 
 		for (attribIndex = 0; attribIndex < ATTR_INDEX_COUNT; attribIndex++)
@@ -623,6 +830,7 @@ void RB_UpdateTessVao(unsigned int attribBits)
 			{
 				// note: tess has a VBO where stride == size
 				qglBufferSubData(GL_ARRAY_BUFFER, vAtb->offset, tess.numVertexes * vAtb->stride, tess.attribPointers[attribIndex]);
+				backEnd.pc.c_dynamicVaoBytes += tess.numVertexes * vAtb->stride;
 			}
 
 			if (attribBits & attribBit)
@@ -650,6 +858,9 @@ void RB_UpdateTessVao(unsigned int attribBits)
 		qglBufferData(GL_ELEMENT_ARRAY_BUFFER, tess.vao->indexesSize, NULL, GL_DYNAMIC_DRAW);
 
 		qglBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, tess.numIndexes * sizeof(tess.indexes[0]), tess.indexes);
+		backEnd.pc.c_dynamicVaoBytes += tess.numIndexes * sizeof(tess.indexes[0]);
+
+		tess.indexesOffset = 0;
 	}
 }
 
@@ -684,9 +895,9 @@ vcq;
 #define VAOCACHE_MAX_SURFACES (1 << 16)
 #define VAOCACHE_MAX_BATCHES (1 << 10)
 
-// srfVert_t is 60 bytes
+// srfVert_t is 64 bytes
 // assuming each vert is referenced 4 times, need 16 bytes (4 glIndex_t) per vert
-// -> need about 4/15ths the space for indexes as vertexes
+// -> need about 1/4th the space for indexes as vertexes
 #define VAOCACHE_VERTEX_BUFFER_SIZE (16 * 1024 * 1024)
 #define VAOCACHE_INDEX_BUFFER_SIZE (5 * 1024 * 1024)
 
@@ -802,6 +1013,7 @@ void VaoCache_Commit(void)
 		{
 			qglBindBuffer(GL_ARRAY_BUFFER, vc.vao->vertexesVBO);
 			qglBufferSubData(GL_ARRAY_BUFFER, vc.vertexOffset, vcq.vertexCommitSize, vcq.vertexes);
+			backEnd.pc.c_dynamicVaoBytes += vcq.vertexCommitSize;
 			vc.vertexOffset += vcq.vertexCommitSize;
 		}
 
@@ -809,6 +1021,7 @@ void VaoCache_Commit(void)
 		{
 			qglBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vc.vao->indexesIBO);
 			qglBufferSubData(GL_ELEMENT_ARRAY_BUFFER, vc.indexOffset, vcq.indexCommitSize, vcq.indexes);
+			backEnd.pc.c_dynamicVaoBytes += vcq.indexCommitSize;
 			vc.indexOffset += vcq.indexCommitSize;
 		}
 	}
@@ -849,7 +1062,7 @@ void VaoCache_Init(void)
 
 	vc.vao->attribs[ATTR_INDEX_POSITION].count       = 3;
 	vc.vao->attribs[ATTR_INDEX_TEXCOORD].count       = 2;
-	vc.vao->attribs[ATTR_INDEX_LIGHTCOORD].count     = 2;
+	vc.vao->attribs[ATTR_INDEX_LIGHTCOORD].count     = 3;
 	vc.vao->attribs[ATTR_INDEX_NORMAL].count         = 4;
 	vc.vao->attribs[ATTR_INDEX_TANGENT].count        = 4;
 	vc.vao->attribs[ATTR_INDEX_LIGHTDIRECTION].count = 4;
@@ -991,3 +1204,21 @@ void VaoCache_AddSurface(srfVert_t *verts, int numVerts, glIndex_t *indexes, int
 	vcq.vertexCommitSize += sizeof(srfVert_t) * numVerts;
 	vcq.indexCommitSize += glRefConfig.vaoCacheGlIndexSize * numIndexes;
 }
+
+/*
+==============
+RB_UploadIndirectCommands
+
+Hands the GPU the view's world surface draws, which R_AddDrawSurfCmd
+built one per drawSurf.  The buffer stays bound for R_DrawElements.
+==============
+*/
+void RB_UploadIndirectCommands(const drawElementsIndirectCommand_t *commands, int numCommands)
+{
+	qglBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+
+	// orphan the last view's commands so we don't stall on them
+	qglBufferData(GL_DRAW_INDIRECT_BUFFER, numCommands * sizeof(*commands), commands, GL_STREAM_DRAW);
+
+	backEnd.pc.c_dynamicVaoBytes += numCommands * sizeof(*commands);
+}
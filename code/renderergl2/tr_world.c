@@ -21,6 +21,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 */
 #include "tr_local.h"
 
+// the threaded world cull tests leaf bounds against four frustum planes at once
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#include <emmintrin.h>
+#define TR_SIMD_SSE2
+#elif defined( __aarch64__ ) || defined( _M_ARM64 )
+#include <arm_neon.h>
+#define TR_SIMD_NEON
+#endif
+
 extern cvar_t *vr_worldscale;
 extern cvar_t *vr_worldscaleScaler;
 
@@ -235,12 +244,6 @@ static int R_DlightSurface( msurface_t *surf, int dlightBits ) {
 			break;
 	}
 
-	if ( dlightBits ) {
-		tr.pc.c_dlightSurfaces++;
-	} else {
-		tr.pc.c_dlightSurfacesCulled++;
-	}
-
 	return dlightBits;
 }
 
@@ -330,32 +333,63 @@ static int R_PshadowSurface( msurface_t *surf, int pshadowBits ) {
 
 /*
 ======================
-R_AddWorldSurface
+R_CullWorldSurface
+
+Returns qfalse if the surface is culled, otherwise narrows the
+dlight and pshadow bits down to whether any reach it.  Only writes
+to the surface itself, so the threaded world cull calls it from
+the job pool.
 ======================
 */
-static void R_AddWorldSurface( msurface_t *surf, int dlightBits, int pshadowBits ) {
-	// FIXME: bmodel fog?
-
+static qboolean R_CullWorldSurface( msurface_t *surf, int *dlightBits, int *pshadowBits ) {
 	// try to cull before dlighting or adding
 	if ( R_CullSurface( surf ) ) {
-		return;
+		return qfalse;
 	}
 
 	// check for dlighting
 	/*if ( dlightBits ) */{
-		dlightBits = R_DlightSurface( surf, dlightBits );
-		dlightBits = ( dlightBits != 0 );
+		*dlightBits = ( R_DlightSurface( surf, *dlightBits ) != 0 );
 	}
 
 	// check for pshadows
 	/*if ( pshadowBits ) */{
-		pshadowBits = R_PshadowSurface( surf, pshadowBits);
-		pshadowBits = ( pshadowBits != 0 );
+		*pshadowBits = ( R_PshadowSurface( surf, *pshadowBits ) != 0 );
+	}
+
+	return qtrue;
+}
+
+/*
+======================
+R_AddCulledWorldSurface
+
+Adds a surface that made it through R_CullWorldSurface
+======================
+*/
+static void R_AddCulledWorldSurface( msurface_t *surf, int dlightBits, int pshadowBits ) {
+	if ( dlightBits ) {
+		tr.pc.c_dlightSurfaces++;
+	} else {
+		tr.pc.c_dlightSurfacesCulled++;
 	}
 
 	R_AddDrawSurf( surf->data, surf->shader, surf->fogIndex, dlightBits, pshadowBits, surf->cubemapIndex );
 }
 
+/*
+======================
+R_AddWorldSurface
+======================
+*/
+static void R_AddWorldSurface( msurface_t *surf, int dlightBits, int pshadowBits ) {
+	// FIXME: bmodel fog?
+
+	if ( R_CullWorldSurface( surf, &dlightBits, &pshadowBits ) ) {
+		R_AddCulledWorldSurface( surf, dlightBits, pshadowBits );
+	}
+}
+
 /*
 =============================================================
 
@@ -408,6 +442,63 @@ void R_AddBrushModelSurfaces ( trRefEntity_t *ent ) {
 */
 
 
+/*
+================
+R_MarkLeafSurfaces
+
+Flags the surfaces of a visible leaf for R_AddWorldSurfaces
+================
+*/
+static void R_MarkLeafSurfaces( mnode_t *node, uint32_t dlightBits, uint32_t pshadowBits ) {
+	int			c;
+	int			surf, *view;
+
+	tr.pc.c_leafs++;
+
+	// add to z buffer bounds
+	if ( node->mins[0] < tr.viewParms.visBounds[0][0] ) {
+		tr.viewParms.visBounds[0][0] = node->mins[0];
+	}
+	if ( node->mins[1] < tr.viewParms.visBounds[0][1] ) {
+		tr.viewParms.visBounds[0][1] = node->mins[1];
+	}
+	if ( node->mins[2] < tr.viewParms.visBounds[0][2] ) {
+		tr.viewParms.visBounds[0][2] = node->mins[2];
+	}
+
+	if ( node->maxs[0] > tr.viewParms.visBounds[1][0] ) {
+		tr.viewParms.visBounds[1][0] = node->maxs[0];
+	}
+	if ( node->maxs[1] > tr.viewParms.visBounds[1][1] ) {
+		tr.viewParms.visBounds[1][1] = node->maxs[1];
+	}
+	if ( node->maxs[2] > tr.viewParms.visBounds[1][2] ) {
+		tr.viewParms.visBounds[1][2] = node->maxs[2];
+	}
+
+	// add surfaces
+	view = tr.world->marksurfaces + node->firstmarksurface;
+
+	c = node->nummarksurfaces;
+	while (c--) {
+		// just mark it as visible, so we don't jump out of the cache derefencing the surface
+		surf = *view;
+		if (tr.world->surfacesViewCount[surf] != tr.viewCount)
+		{
+			tr.world->surfacesViewCount[surf] = tr.viewCount;
+			tr.world->surfacesDlightBits[surf] = dlightBits;
+			tr.world->surfacesPshadowBits[surf] = pshadowBits;
+		}
+		else
+		{
+			tr.world->surfacesDlightBits[surf] |= dlightBits;
+			tr.world->surfacesPshadowBits[surf] |= pshadowBits;
+		}
+		view++;
+	}
+}
+
+
 /*
 ================
 R_RecursiveWorldNode
@@ -545,56 +636,13 @@ static void R_RecursiveWorldNode( mnode_t *node, uint32_t planeBits, uint32_t dl
 		pshadowBits = newPShadows[1];
 	} while ( 1 );
 
-	{
-		// leaf node, so add mark surfaces
-		int			c;
-		int surf, *view;
-
-		tr.pc.c_leafs++;
-
-		// add to z buffer bounds
-		if ( node->mins[0] < tr.viewParms.visBounds[0][0] ) {
-			tr.viewParms.visBounds[0][0] = node->mins[0];
-		}
-		if ( node->mins[1] < tr.viewParms.visBounds[0][1] ) {
-			tr.viewParms.visBounds[0][1] = node->mins[1];
-		}
-		if ( node->mins[2] < tr.viewParms.visBounds[0][2] ) {
-			tr.viewParms.visBounds[0][2] = node->mins[2];
-		}
-
-		if ( node->maxs[0] > tr.viewParms.visBounds[1][0] ) {
-			tr.viewParms.visBounds[1][0] = node->maxs[0];
-		}
-		if ( node->maxs[1] > tr.viewParms.visBounds[1][1] ) {
-			tr.viewParms.visBounds[1][1] = node->maxs[1];
-		}
-		if ( node->maxs[2] > tr.viewParms.visBounds[1][2] ) {
-			tr.viewParms.visBounds[1][2] = node->maxs[2];
-		}
-
-		// add surfaces
-		view = tr.world->marksurfaces + node->firstmarksurface;
-
-		c = node->nummarksurfaces;
-		while (c--) {
-			// just mark it as visible, so we don't jump out of the cache derefencing the surface
-			surf = *view;
-			if (tr.world->surfacesViewCount[surf] != tr.viewCount)
-			{
-				tr.world->surfacesViewCount[surf] = tr.viewCount;
-				tr.world->surfacesDlightBits[surf] = dlightBits;
-				tr.world->surfacesPshadowBits[surf] = pshadowBits;
-			}
-			else
-			{
-				tr.world->surfacesDlightBits[surf] |= dlightBits;
-				tr.world->surfacesPshadowBits[surf] |= pshadowBits;
-			}
-			view++;
-		}
+	// hidden behind last frame's depth
+	if ( R_OccludedBox( node->mins, node->maxs ) ) {
+		return;
 	}
 
+	// leaf node, so add mark surfaces
+	R_MarkLeafSurfaces( node, dlightBits, pshadowBits );
 }
 
 
@@ -747,6 +795,306 @@ static void R_MarkLeaves (void) {
 }
 
 
+/*
+=============================================================
+
+	THREADED WORLD CULL
+
+With r_cullThreads > 1 the BSP isn't walked.  The leaves in the
+PVS are kept in a flat list that only changes with R_MarkLeaves,
+the leaves and then the surfaces they flag are culled in chunks on
+the job pool, and the surviving surfaces are added in the same
+order as the serial loop adds them.
+
+=============================================================
+*/
+
+#define	CULL_LEAFS_PER_JOB		64
+#define	CULL_SURFACES_PER_JOB	128
+
+#define	CULLSURF_VISIBLE		1
+#define	CULLSURF_DLIGHT			2
+#define	CULLSURF_PSHADOW		4
+
+typedef struct {
+	float		normal[3][4];	// [axis][plane], frustum planes 0 to 3
+	float		dist[4];
+	qboolean	farPlane;		// frustum[4] has to be tested as well
+	qboolean	noCull;
+
+	uint32_t	dlightBits;
+	uint32_t	pshadowBits;
+	int			numSurfaces;
+} worldCull_t;
+
+static worldCull_t	worldCull;
+
+/*
+================
+R_UpdateCullLeafs
+
+Rebuilds the list of PVS leaves if R_MarkLeaves marked a new set
+================
+*/
+static void R_UpdateCullLeafs( qboolean allLeafs ) {
+	world_t		*w = tr.world;
+	mnode_t		*leaf;
+	int			visIndex, visCount;
+	int			i;
+
+	// depth shadows and the spectator camera skip the PVS
+	if ( allLeafs ) {
+		visIndex = -2;
+		visCount = 0;
+	} else {
+		visIndex = tr.visIndex;
+		visCount = tr.visCounts[tr.visIndex];
+	}
+
+	if ( w->cullLeafsVisIndex == visIndex && w->cullLeafsVisCount == visCount ) {
+		return;
+	}
+	w->cullLeafsVisIndex = visIndex;
+	w->cullLeafsVisCount = visCount;
+
+	w->numCullLeafs = 0;
+	for ( i = w->numDecisionNodes, leaf = w->nodes + i ; i < w->numnodes ; i++, leaf++ ) {
+		if ( !allLeafs && leaf->visCounts[visIndex] != visCount ) {
+			continue;
+		}
+		w->cullLeafs[w->numCullLeafs++].node = leaf;
+	}
+}
+
+/*
+================
+R_CullLeafBox
+
+Returns qtrue if the leaf is completely outside the frustum, the
+same test BoxOnPlaneSide makes for R_RecursiveWorldNode
+================
+*/
+static qboolean R_CullLeafBox( const worldCull_t *wc, const mnode_t *leaf ) {
+	if ( wc->noCull ) {
+		return qfalse;
+	}
+
+#if defined( TR_SIMD_SSE2 )
+	{
+		__m128	nx, ny, nz, d;
+
+		// the box corner furthest along each plane normal
+		nx = _mm_loadu_ps( wc->normal[0] );
+		ny = _mm_loadu_ps( wc->normal[1] );
+		nz = _mm_loadu_ps( wc->normal[2] );
+		d = _mm_add_ps( _mm_add_ps(
+				_mm_max_ps( _mm_mul_ps( nx, _mm_set1_ps( leaf->mins[0] ) ), _mm_mul_ps( nx, _mm_set1_ps( leaf->maxs[0] ) ) ),
+				_mm_max_ps( _mm_mul_ps( ny, _mm_set1_ps( leaf->mins[1] ) ), _mm_mul_ps( ny, _mm_set1_ps( leaf->maxs[1] ) ) ) ),
+				_mm_max_ps( _mm_mul_ps( nz, _mm_set1_ps( leaf->mins[2] ) ), _mm_mul_ps( nz, _mm_set1_ps( leaf->maxs[2] ) ) ) );
+
+		if ( _mm_movemask_ps( _mm_cmplt_ps( d, _mm_loadu_ps( wc->dist ) ) ) ) {
+			return qtrue;
+		}
+	}
+#elif defined( TR_SIMD_NEON )
+	{
+		float32x4_t	nx, ny, nz, d;
+
+		// the box corner furthest along each plane normal
+		nx = vld1q_f32( wc->normal[0] );
+		ny = vld1q_f32( wc->normal[1] );
+		nz = vld1q_f32( wc->normal[2] );
+		d = vaddq_f32( vaddq_f32(
+				vmaxq_f32( vmulq_f32( nx, vdupq_n_f32( leaf->mins[0] ) ), vmulq_f32( nx, vdupq_n_f32( leaf->maxs[0] ) ) ),
+				vmaxq_f32( vmulq_f32( ny, vdupq_n_f32( leaf->mins[1] ) ), vmulq_f32( ny, vdupq_n_f32( leaf->maxs[1] ) ) ) ),
+				vmaxq_f32( vmulq_f32( nz, vdupq_n_f32( leaf->mins[2] ) ), vmulq_f32( nz, vdupq_n_f32( leaf->maxs[2] ) ) ) );
+
+		if ( vmaxvq_u32( vcltq_f32( d, vld1q_f32( wc->dist ) ) ) ) {
+			return qtrue;
+		}
+	}
+#else
+	{
+		int		i;
+		float	d;
+
+		for ( i = 0 ; i < 4 ; i++ ) {
+			d = MAX( wc->normal[0][i] * leaf->mins[0], wc->normal[0][i] * leaf->maxs[0] )
+				+ MAX( wc->normal[1][i] * leaf->mins[1], wc->normal[1][i] * leaf->maxs[1] )
+				+ MAX( wc->normal[2][i] * leaf->mins[2], wc->normal[2][i] * leaf->maxs[2] );
+			if ( d < wc->dist[i] ) {
+				return qtrue;
+			}
+		}
+	}
+#endif
+
+	if ( wc->farPlane && BoxOnPlaneSide( (float *)leaf->mins, (float *)leaf->maxs, &tr.viewParms.frustum[4] ) == 2 ) {
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
+/*
+================
+R_LeafLightBits
+
+Walks up from a leaf to find the dlights and pshadows that
+R_RecursiveWorldNode would have passed down to it
+================
+*/
+static void R_LeafLightBits( cullLeaf_t *cl, uint32_t dlightBits, uint32_t pshadowBits ) {
+	const mnode_t	*child, *node;
+	const cplane_t	*plane;
+	qboolean		front;
+	float			dist;
+	int				i;
+
+	for ( child = cl->node, node = child->parent ; node && ( dlightBits || pshadowBits ) ; child = node, node = node->parent ) {
+		plane = node->plane;
+		front = ( node->children[0] == child );
+
+		for ( i = 0 ; i < tr.refdef.num_dlights ; i++ ) {
+			if ( dlightBits & ( 1 << i ) ) {
+				const dlight_t	*dl = &tr.refdef.dlights[i];
+
+				dist = DotProduct( dl->origin, plane->normal ) - plane->dist;
+				if ( front ? !( dist > -dl->radius ) : !( dist < dl->radius ) ) {
+					dlightBits &= ~( 1 << i );
+				}
+			}
+		}
+
+		for ( i = 0 ; i < tr.refdef.num_pshadows ; i++ ) {
+			if ( pshadowBits & ( 1 << i ) ) {
+				const pshadow_t	*shadow = &tr.refdef.pshadows[i];
+
+				dist = DotProduct( shadow->lightOrigin, plane->normal ) - plane->dist;
+				if ( front ? !( dist > -shadow->lightRadius ) : !( dist < shadow->lightRadius ) ) {
+					pshadowBits &= ~( 1 << i );
+				}
+			}
+		}
+	}
+
+	cl->dlightBits = dlightBits;
+	cl->pshadowBits = pshadowBits;
+}
+
+/*
+================
+R_CullLeafsJob
+================
+*/
+static void R_CullLeafsJob( void *data, int index ) {
+	const worldCull_t	*wc = (const worldCull_t *)data;
+	cullLeaf_t			*cl, *end;
+
+	cl = tr.world->cullLeafs + index * CULL_LEAFS_PER_JOB;
+	end = tr.world->cullLeafs + MIN( ( index + 1 ) * CULL_LEAFS_PER_JOB, tr.world->numCullLeafs );
+
+	for ( ; cl < end ; cl++ ) {
+		cl->visible = !R_CullLeafBox( wc, cl->node ) && !R_OccludedBox( cl->node->mins, cl->node->maxs );
+		if ( cl->visible ) {
+			R_LeafLightBits( cl, wc->dlightBits, wc->pshadowBits );
+		}
+	}
+}
+
+/*
+================
+R_CullSurfacesJob
+================
+*/
+static void R_CullSurfacesJob( void *data, int index ) {
+	const worldCull_t	*wc = (const worldCull_t *)data;
+	world_t				*w = tr.world;
+	int					i, end, surf;
+	int					dlightBits, pshadowBits;
+
+	i = index * CULL_SURFACES_PER_JOB;
+	end = MIN( i + CULL_SURFACES_PER_JOB, wc->numSurfaces );
+
+	for ( ; i < end ; i++ ) {
+		surf = w->cullSurfaces[i];
+		dlightBits = w->surfacesDlightBits[surf];
+		pshadowBits = w->surfacesPshadowBits[surf];
+
+		if ( !R_CullWorldSurface( w->surfaces + surf, &dlightBits, &pshadowBits ) ) {
+			w->cullSurfaceFlags[i] = 0;
+			continue;
+		}
+
+		w->cullSurfaceFlags[i] = CULLSURF_VISIBLE
+			| ( dlightBits ? CULLSURF_DLIGHT : 0 )
+			| ( pshadowBits ? CULLSURF_PSHADOW : 0 );
+	}
+}
+
+/*
+================
+R_AddWorldSurfacesThreaded
+================
+*/
+static void R_AddWorldSurfacesThreaded( uint32_t planeBits, uint32_t dlightBits, uint32_t pshadowBits ) {
+	worldCull_t	*wc = &worldCull;
+	world_t		*w = tr.world;
+	cullLeaf_t	*cl;
+	int			i, j, flags;
+
+	R_UpdateCullLeafs( vr_thirdPersonSpectator->integer || ( tr.viewParms.flags & VPF_DEPTHSHADOW ) );
+
+	for ( i = 0 ; i < 4 ; i++ ) {
+		for ( j = 0 ; j < 3 ; j++ ) {
+			wc->normal[j][i] = tr.viewParms.frustum[i].normal[j];
+		}
+		wc->dist[i] = tr.viewParms.frustum[i].dist;
+	}
+	wc->farPlane = ( planeBits & 16 ) != 0;
+	wc->noCull = ( r_nocull->integer != 0 );
+	wc->dlightBits = dlightBits;
+	wc->pshadowBits = pshadowBits;
+
+	ri.Job_ParallelFor( R_CullLeafsJob, wc, ( w->numCullLeafs + CULL_LEAFS_PER_JOB - 1 ) / CULL_LEAFS_PER_JOB,
+		r_cullThreads->integer );
+
+	// flag the surfaces of the visible leaves
+	for ( i = 0, cl = w->cullLeafs ; i < w->numCullLeafs ; i++, cl++ ) {
+		if ( cl->visible ) {
+			R_MarkLeafSurfaces( cl->node, cl->dlightBits, cl->pshadowBits );
+		}
+	}
+
+	// gather them in the order the serial loop adds them
+	// also mask invisible dlights for next frame
+	wc->numSurfaces = 0;
+	tr.refdef.dlightMask = 0;
+
+	for ( i = 0 ; i < w->numWorldSurfaces ; i++ ) {
+		if ( w->surfacesViewCount[i] != tr.viewCount ) {
+			continue;
+		}
+
+		w->cullSurfaces[wc->numSurfaces++] = i;
+		tr.refdef.dlightMask |= w->surfacesDlightBits[i];
+	}
+
+	tr.refdef.dlightMask = ~tr.refdef.dlightMask;
+
+	ri.Job_ParallelFor( R_CullSurfacesJob, wc, ( wc->numSurfaces + CULL_SURFACES_PER_JOB - 1 ) / CULL_SURFACES_PER_JOB,
+		r_cullThreads->integer );
+
+	for ( i = 0 ; i < wc->numSurfaces ; i++ ) {
+		flags = w->cullSurfaceFlags[i];
+		if ( flags & CULLSURF_VISIBLE ) {
+			R_AddCulledWorldSurface( w->surfaces + w->cullSurfaces[i],
+				( flags & CULLSURF_DLIGHT ) != 0, ( flags & CULLSURF_PSHADOW ) != 0 );
+		}
+	}
+}
+
+
 /*
 =============
 R_AddWorldSurfaces
@@ -800,6 +1148,11 @@ void R_AddWorldSurfaces (void) {
 		pshadowBits = 0;
 	}
 
+	if ( r_cullThreads->integer > 1 ) {
+		R_AddWorldSurfacesThreaded( planeBits, dlightBits, pshadowBits );
+		return;
+	}
+
 	R_RecursiveWorldNode( tr.world->nodes, planeBits, dlightBits, pshadowBits);
 
 	// now add all the potentially visible surfaces
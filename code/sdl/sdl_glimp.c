@@ -85,6 +85,10 @@ QGL_4_2_PROCS;
 QGL_4_3_PROCS;
 QGL_4_5_PROCS;
 QGL_OVR_multiview_PROCS;
+QGL_ARB_get_program_binary_PROCS;
+QGL_ARB_buffer_storage_PROCS;
+QGL_ARB_multi_draw_indirect_PROCS;
+QGL_KHR_parallel_shader_compile_PROCS;
 QGL_ARB_occlusion_query_PROCS;
 QGL_ARB_framebuffer_object_PROCS;
 QGL_ARB_vertex_array_object_PROCS;
@@ -412,6 +416,10 @@ static void GLimp_ClearProcAddresses( void ) {
 	QGL_1_5_PROCS;
 	QGL_2_0_PROCS;
 	QGL_3_0_PROCS;
+	QGL_ARB_get_program_binary_PROCS;
+	QGL_ARB_buffer_storage_PROCS;
+	QGL_ARB_multi_draw_indirect_PROCS;
+	QGL_KHR_parallel_shader_compile_PROCS;
 	QGL_ARB_occlusion_query_PROCS;
 	QGL_ARB_framebuffer_object_PROCS;
 	QGL_ARB_vertex_array_object_PROCS;
@@ -1264,19 +1272,30 @@ void GLimp_InitVR(void)
 
 /*
 ===============
-GLimp_EndFrame
+GLimp_SwapBuffers
 
-Responsible for doing a swapbuffers
+Flips the desktop window, from whichever thread owns the context
 ===============
 */
-void GLimp_EndFrame( void )
+void GLimp_SwapBuffers( void )
 {
 	// don't flip if drawing to front buffer
 	if ( Q_stricmp( r_drawBuffer->string, "GL_FRONT" ) != 0 )
 	{
 		SDL_GL_SwapWindow( SDL_window );
 	}
+}
 
+
+/*
+===============
+GLimp_UpdateFullscreen
+
+Applies r_fullscreen changes; main thread only
+===============
+*/
+void GLimp_UpdateFullscreen( void )
+{
 	if( r_fullscreen->modified )
 	{
 		int         fullscreen;
@@ -1298,6 +1317,9 @@ void GLimp_EndFrame( void )
 
 		if( needToToggle )
 		{
+			// keep the r_smp render thread away from the window
+			GLimp_FrontEndSleep();
+
 			sdlToggled = SDL_SetWindowFullscreen( SDL_window, r_fullscreen->integer ) >= 0;
 
 			// SDL_WM_ToggleFullScreen didn't work, so do it the slow way
@@ -1310,3 +1332,190 @@ void GLimp_EndFrame( void )
 		r_fullscreen->modified = qfalse;
 	}
 }
+
+
+/*
+===============
+GLimp_EndFrame
+
+Responsible for doing a swapbuffers
+===============
+*/
+void GLimp_EndFrame( void )
+{
+	GLimp_SwapBuffers();
+	GLimp_UpdateFullscreen();
+}
+
+
+/*
+===========================================================
+
+SMP acceleration
+
+The GL context is current on exactly one thread at a time: the render
+thread while it executes a command list, the main thread otherwise.
+
+===========================================================
+*/
+
+static SDL_mutex	*smpMutex = NULL;
+static SDL_cond		*renderCommandsEvent = NULL;
+static SDL_cond		*renderCompletedEvent = NULL;
+static SDL_Thread	*renderThread = NULL;
+static void			(*glimpRenderThread)( void ) = NULL;
+
+static void			*smpData = NULL;
+static qboolean		smpDataReady = qfalse;
+static qboolean		smpRendering = qfalse;
+
+static int GLimp_RenderThreadWrapper( void *arg )
+{
+	glimpRenderThread();
+	return 0;
+}
+
+/*
+===============
+GLimp_SpawnRenderThread
+===============
+*/
+qboolean GLimp_SpawnRenderThread( void (*function)( void ) )
+{
+	if ( renderThread ) {
+		ri.Printf( PRINT_WARNING, "GLimp_SpawnRenderThread: render thread already running\n" );
+		return qfalse;
+	}
+
+	smpMutex = SDL_CreateMutex();
+	renderCommandsEvent = SDL_CreateCond();
+	renderCompletedEvent = SDL_CreateCond();
+	if ( !smpMutex || !renderCommandsEvent || !renderCompletedEvent ) {
+		ri.Printf( PRINT_ALL, "GLimp_SpawnRenderThread: %s\n", SDL_GetError() );
+		GLimp_ShutdownRenderThread();
+		return qfalse;
+	}
+
+	smpData = NULL;
+	smpDataReady = qfalse;
+	smpRendering = qfalse;
+	glimpRenderThread = function;
+
+	renderThread = SDL_CreateThread( GLimp_RenderThreadWrapper, "render", NULL );
+	if ( !renderThread ) {
+		ri.Printf( PRINT_ALL, "GLimp_SpawnRenderThread: %s\n", SDL_GetError() );
+		GLimp_ShutdownRenderThread();
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+/*
+===============
+GLimp_ShutdownRenderThread
+
+Stops the render thread and takes the context back
+===============
+*/
+void GLimp_ShutdownRenderThread( void )
+{
+	if ( renderThread ) {
+		GLimp_FrontEndSleep();
+		GLimp_WakeRenderer( NULL );
+		SDL_WaitThread( renderThread, NULL );
+		renderThread = NULL;
+
+		SDL_GL_MakeCurrent( SDL_window, SDL_glContext );
+	}
+
+	if ( renderCompletedEvent ) {
+		SDL_DestroyCond( renderCompletedEvent );
+		renderCompletedEvent = NULL;
+	}
+	if ( renderCommandsEvent ) {
+		SDL_DestroyCond( renderCommandsEvent );
+		renderCommandsEvent = NULL;
+	}
+	if ( smpMutex ) {
+		SDL_DestroyMutex( smpMutex );
+		smpMutex = NULL;
+	}
+	glimpRenderThread = NULL;
+}
+
+/*
+===============
+GLimp_RendererSleep
+
+Called on the render thread: gives up the context, reports the last
+command list as done and waits for the next one.  NULL means quit.
+===============
+*/
+void *GLimp_RendererSleep( void )
+{
+	void	*data;
+
+	SDL_GL_MakeCurrent( SDL_window, NULL );
+
+	SDL_LockMutex( smpMutex );
+	smpRendering = qfalse;
+	// after this, the front end can exit GLimp_FrontEndSleep
+	SDL_CondSignal( renderCompletedEvent );
+
+	while ( !smpDataReady ) {
+		SDL_CondWait( renderCommandsEvent, smpMutex );
+	}
+	data = smpData;
+	smpDataReady = qfalse;
+	SDL_UnlockMutex( smpMutex );
+
+	if ( data ) {
+		SDL_GL_MakeCurrent( SDL_window, SDL_glContext );
+	}
+
+	return data;
+}
+
+/*
+===============
+GLimp_FrontEndSleep
+
+Waits for the render thread to go idle and takes the context back
+===============
+*/
+void GLimp_FrontEndSleep( void )
+{
+	if ( !renderThread ) {
+		return;
+	}
+
+	SDL_LockMutex( smpMutex );
+	while ( smpRendering ) {
+		SDL_CondWait( renderCompletedEvent, smpMutex );
+	}
+	SDL_UnlockMutex( smpMutex );
+
+	SDL_GL_MakeCurrent( SDL_window, SDL_glContext );
+}
+
+/*
+===============
+GLimp_WakeRenderer
+
+Hands a command list and the context to the render thread.
+The render thread must be idle (see GLimp_FrontEndSleep).
+===============
+*/
+void GLimp_WakeRenderer( void *data )
+{
+	SDL_GL_MakeCurrent( SDL_window, NULL );
+
+	SDL_LockMutex( smpMutex );
+	smpData = data;
+	smpDataReady = qtrue;
+	smpRendering = ( data != NULL );
+	// after this, the renderer can continue through GLimp_RendererSleep
+	SDL_CondSignal( renderCommandsEvent );
+	SDL_UnlockMutex( smpMutex );
+}
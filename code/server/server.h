@@ -48,16 +48,29 @@ typedef struct voipServerPacket_s
 } voipServerPacket_t;
 #endif
 
+// the parts of an entity that traces depend on, as of its last link
+typedef struct {
+	qboolean	linked;
+	int			contents;
+	int			ownerNum;
+	int			capsule;
+	int			bmodel;
+	int			modelindex;
+	vec3_t		mins, maxs;
+	vec3_t		origin, angles;
+} svTraceLink_t;
+
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
 	struct svEntity_s *nextEntityInWorldSector;
+	struct worldNode_s *worldNode;		// leaf in the world tree used with sv_broadphase 1
+	svTraceLink_t	traceLink;		// for sv_traceCache invalidation
 	
 	entityState_t	baseline;		// for delta compression of initial sighting
 	int			numClusters;		// if -1, use headnode instead
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
 typedef enum {
@@ -75,7 +88,6 @@ typedef struct {
 	// https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=475
 	// the serverId associated with the current checksumFeed (always <= serverId)
 	int       checksumFeedServerId;	
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	int				nextFrameTime;		// when time > nextFrameTime, process world
 	char			*configstrings[MAX_CONFIGSTRINGS];
@@ -238,6 +250,7 @@ typedef struct {
 	int			numSnapshotEntities;		// sv_maxclients->integer*PACKET_BACKUP*MAX_SNAPSHOT_ENTITIES
 	int			nextSnapshotEntities;		// next snapshotEntities to use
 	entityState_t	*snapshotEntities;		// [numSnapshotEntities]
+	struct snapshotJob_s	*snapshotJobs;	// [sv_maxclients->integer], for sv_snapshotThreads
 	int			nextHeartbeatTime;
 	challenge_t	challenges[MAX_CHALLENGES];	// to prevent invalid IPs from connecting
 	netadr_t	redirectAddress;			// for rcon return messages
@@ -291,6 +304,9 @@ extern	cvar_t	*sv_gametype;
 extern	cvar_t	*sv_pure;
 extern	cvar_t	*sv_floodProtect;
 extern	cvar_t	*sv_lanForceRate;
+extern	cvar_t	*sv_snapshotThreads;
+extern	cvar_t	*sv_broadphase;
+extern	cvar_t	*sv_traceCache;
 #ifndef STANDALONE
 extern	cvar_t	*sv_strictAuth;
 #endif
@@ -400,6 +416,9 @@ void SV_WriteFrameToClient (client_t *client, msg_t *msg);
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_AllocSnapshotJobs( void );
+void SV_ShutdownSnapshots( void );
+void SV_DeltaBench_f( void );
 
 //
 // sv_game.c
@@ -440,6 +459,9 @@ void SV_BotInitBotLib(void);
 void SV_ClearWorld (void);
 // called after the world model has been loaded, before linking any entities
 
+void SV_NewTraceFrame( void );
+// called before every game frame, drops the traces remembered by sv_traceCache
+
 void SV_UnlinkEntity( sharedEntity_t *ent );
 // call before removing an entity, and before trying to move one,
 // so it doesn't clip against itself
@@ -456,6 +478,9 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_TraceBench_f( void );
+void SV_TraceStress_f( void );
+void SV_TraceCache_f( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -1539,6 +1539,10 @@ void SV_AddOperatorCommands( void ) {
 	Cmd_AddCommand ("dumpuser", SV_DumpUser_f);
 	Cmd_AddCommand ("map_restart", SV_MapRestart_f);
 	Cmd_AddCommand ("sectorlist", SV_SectorList_f);
+	Cmd_AddCommand ("tracebench", SV_TraceBench_f);
+	Cmd_AddCommand ("tracestress", SV_TraceStress_f);
+	Cmd_AddCommand ("tracecache", SV_TraceCache_f);
+	Cmd_AddCommand ("deltabench", SV_DeltaBench_f);
 	Cmd_AddCommand ("map", SV_Map_f);
 	Cmd_SetCommandCompletionFunc( "map", SV_CompleteMapName );
 #ifndef PRE_RELEASE_DEMO
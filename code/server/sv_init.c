@@ -437,6 +437,7 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	// allocate the snapshot entities on the hunk
 	svs.snapshotEntities = Hunk_Alloc( sizeof(entityState_t)*svs.numSnapshotEntities, h_high );
 	svs.nextSnapshotEntities = 0;
+	SV_AllocSnapshotJobs();
 
 	// toggle the server bit so clients can detect that a
 	// server has changed
@@ -684,6 +685,12 @@ void SV_Init (void)
 	sv_killserver = Cvar_Get ("sv_killserver", "0", 0);
 	sv_mapChecksum = Cvar_Get ("sv_mapChecksum", "", CVAR_ROM);
 	sv_lanForceRate = Cvar_Get ("sv_lanForceRate", "1", CVAR_ARCHIVE );
+	sv_snapshotThreads = Cvar_Get ("sv_snapshotThreads", "1", CVAR_ARCHIVE );
+	Cvar_CheckRange( sv_snapshotThreads, 1, MAX_JOB_THREADS, qtrue );
+	sv_broadphase = Cvar_Get ("sv_broadphase", "0", CVAR_ARCHIVE );
+	Cvar_CheckRange( sv_broadphase, 0, 1, qtrue );
+	sv_traceCache = Cvar_Get ("sv_traceCache", "0", CVAR_ARCHIVE );
+	Cvar_CheckRange( sv_traceCache, 0, 1, qtrue );
 #ifndef STANDALONE
 	sv_strictAuth = Cvar_Get ("sv_strictAuth", "0", CVAR_ARCHIVE );
 #endif
@@ -759,6 +766,7 @@ void SV_Shutdown( char *finalmsg ) {
 
 	// free current level
 	SV_ClearServer();
+	SV_ShutdownSnapshots();
 
 	// free server static data
 	if(svs.clients)
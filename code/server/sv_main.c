@@ -58,6 +58,9 @@ cvar_t	*sv_gametype;
 cvar_t	*sv_pure;
 cvar_t	*sv_floodProtect;
 cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
+cvar_t	*sv_snapshotThreads;	// number of threads building client snapshots
+cvar_t	*sv_broadphase;			// 0 = world sectors, 1 = world tree for area queries
+cvar_t	*sv_traceCache;			// remember identical SV_Trace calls within a game frame
 #ifndef STANDALONE
 cvar_t	*sv_strictAuth;
 #endif
@@ -1137,7 +1140,10 @@ void SV_Frame( int msec ) {
 	// update ping based on the all received frames
 	SV_CalcPings();
 
-	if (com_dedicated->integer) SV_BotFrame (sv.time);
+	if (com_dedicated->integer) {
+		SV_NewTraceFrame();
+		SV_BotFrame (sv.time);
+	}
 
 	// run the game simulation in chunks
 	while ( sv.timeResidual >= frameMsec ) {
@@ -1145,6 +1151,8 @@ void SV_Frame( int msec ) {
 		svs.time += frameMsec;
 		sv.time += frameMsec;
 
+		SV_NewTraceFrame();
+
 		// let everything in the world think and move
 		VM_Call (gvm, GAME_RUN_FRAME, sv.time);
 	}
@@ -52,7 +52,7 @@ SV_EmitPacketEntities
 Writes a delta update of an entityState_t list to the message.
 =============
 */
-static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to, msg_t *msg ) {
+static void SV_EmitPacketEntities( clientSnapshot_t *from, entityState_t **newents, int numNewents, msg_t *msg ) {
 	entityState_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		oldnum, newnum;
@@ -69,11 +69,11 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 	oldent = NULL;
 	newindex = 0;
 	oldindex = 0;
-	while ( newindex < to->num_entities || oldindex < from_num_entities ) {
-		if ( newindex >= to->num_entities ) {
+	while ( newindex < numNewents || oldindex < from_num_entities ) {
+		if ( newindex >= numNewents ) {
 			newnum = 9999;
 		} else {
-			newent = &svs.snapshotEntities[(to->first_entity+newindex) % svs.numSnapshotEntities];
+			newent = newents[newindex];
 			newnum = newent->number;
 		}
 
@@ -113,45 +113,62 @@ static void SV_EmitPacketEntities( clientSnapshot_t *from, clientSnapshot_t *to,
 }
 
 
-
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_SnapshotDeltaFrame
+
+Picks the previous frame the snapshot being created will be delta
+compressed against, NULL if it has to be sent in full.
 ==================
 */
-static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
-	clientSnapshot_t	*frame, *oldframe;
-	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+static clientSnapshot_t *SV_SnapshotDeltaFrame( client_t *client, int *lastframe ) {
+	clientSnapshot_t	*oldframe;
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
 		// client is asking for a retransmit
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage 
 		>= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
 		Com_DPrintf ("%s: Delta request from out of date packet.\n", client->name);
 		oldframe = NULL;
-		lastframe = 0;
+		*lastframe = 0;
 	} else {
 		// we have a valid snapshot to delta from
 		oldframe = &client->frames[ client->deltaMessage & PACKET_MASK ];
-		lastframe = client->netchan.outgoingSequence - client->deltaMessage;
+		*lastframe = client->netchan.outgoingSequence - client->deltaMessage;
 
 		// the snapshot's entities may still have rolled off the buffer, though
 		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
 			Com_DPrintf ("%s: Delta request from out of date entities.\n", client->name);
 			oldframe = NULL;
-			lastframe = 0;
+			*lastframe = 0;
 		}
 	}
 
+	return oldframe;
+}
+
+/*
+==================
+SV_WriteSnapshot
+
+Writes the snapshot for the current outgoing frame, newents are the
+frame's entity states in increasing entity number order.
+Doesn't touch anything shared with other clients.
+==================
+*/
+static void SV_WriteSnapshot( client_t *client, clientSnapshot_t *oldframe, int lastframe,
+							 entityState_t **newents, msg_t *msg ) {
+	clientSnapshot_t	*frame;
+	int					i;
+	int					snapFlags;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
 	MSG_WriteByte (msg, svc_snapshot);
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -197,7 +214,7 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	}
 
 	// delta encode the entities
-	SV_EmitPacketEntities (oldframe, frame, msg);
+	SV_EmitPacketEntities (oldframe, newents, frame->num_entities, msg);
 
 	// padding for rate debugging
 	if ( sv_padPackets->integer ) {
@@ -207,6 +224,29 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	}
 }
 
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
+	clientSnapshot_t	*frame, *oldframe;
+	entityState_t		*newents[MAX_SNAPSHOT_ENTITIES];
+	int					lastframe;
+	int					i;
+
+	// this is the snapshot we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	oldframe = SV_SnapshotDeltaFrame( client, &lastframe );
+
+	for ( i = 0 ; i < frame->num_entities ; i++ ) {
+		newents[i] = &svs.snapshotEntities[(frame->first_entity+i) % svs.numSnapshotEntities];
+	}
+
+	SV_WriteSnapshot( client, oldframe, lastframe, newents, msg );
+}
+
 
 /*
 ==================
@@ -230,60 +270,294 @@ void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
 /*
 =============================================================================
 
-Build a client snapshot structure
+Visibility cache
+
+Whether an entity passes the area and PVS tests only depends on the
+cluster and area of the viewpoint, so the list of entities that do is
+built once per server frame for every (cluster, area) pair that gets
+looked at and shared by all the viewpoints in it.  The per client
+filters are still applied while walking the list.
 
 =============================================================================
 */
 
+#define	MAX_SNAPSHOT_VIS	(MAX_CLIENTS*2)
+
 typedef struct {
-	int		numSnapshotEntities;
-	int		snapshotEntities[MAX_SNAPSHOT_ENTITIES];	
-} snapshotEntityNumbers_t;
+	int				cluster;
+	int				area;
+	qboolean		ready;		// still being filled in when qfalse, guarded by lock
+	int				numEntities;
+	unsigned short	entityNums[MAX_GENTITIES];	// sorted
+} snapshotVis_t;
+
+typedef struct {
+	void			*lock;
+	qboolean		clientMask;		// some entity is sent by SVF_CLIENTMASK
+	int				numVis;
+	snapshotVis_t	vis[MAX_SNAPSHOT_VIS];
+} snapshotVisCache_t;
+
+static snapshotVisCache_t	sv_snapshotVis;
 
 /*
-=======================
-SV_QsortEntityNumbers
-=======================
+===============
+SV_BeginSnapshots
+
+Called on the main thread before a batch of snapshots is built
+===============
 */
-static int QDECL SV_QsortEntityNumbers( const void *a, const void *b ) {
-	int	*ea, *eb;
+static void SV_BeginSnapshots( void ) {
+	sharedEntity_t	*ent;
+	int				e;
 
-	ea = (int *)a;
-	eb = (int *)b;
+	sv_snapshotVis.clientMask = qfalse;
 
-	if ( *ea == *eb ) {
-		Com_Error( ERR_DROP, "SV_QsortEntityStates: duplicated entity" );
+	// the visibility walk used to fix up entity numbers as it went,
+	// do that here so building the snapshots only reads the game entities
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum( e );
+		if ( !ent->r.linked ) {
+			continue;
+		}
+		if ( ent->s.number != e ) {
+			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
+			ent->s.number = e;
+		}
+		if ( ( ent->r.svFlags & ( SVF_CLIENTMASK | SVF_NOCLIENT ) ) == SVF_CLIENTMASK ) {
+			sv_snapshotVis.clientMask = qtrue;
+		}
 	}
 
-	if ( *ea < *eb ) {
-		return -1;
+	if ( !sv_snapshotVis.lock ) {
+		sv_snapshotVis.lock = Sys_CreateMutex();
 	}
 
-	return 1;
+	// entities may have moved since the last batch
+	sv_snapshotVis.numVis = 0;
 }
 
+/*
+===============
+SV_SnapshotEntityVisible
+
+The area and PVS checks, which are the same for every viewpoint in
+the cluster and area
+===============
+*/
+static qboolean SV_SnapshotEntityVisible( sharedEntity_t *ent, int area, const byte *bitvector ) {
+	svEntity_t	*svEnt;
+	int		i, l;
+
+	// never send entities that aren't linked in
+	if ( !ent->r.linked ) {
+		return qfalse;
+	}
+
+	// entities can be flagged to explicitly not be sent to the client
+	if ( ent->r.svFlags & SVF_NOCLIENT ) {
+		return qfalse;
+	}
+
+	// broadcast entities are always sent
+	if ( ent->r.svFlags & SVF_BROADCAST ) {
+		return qtrue;
+	}
+
+	svEnt = SV_SvEntityForGentity( ent );
+
+	// ignore if not touching a PV leaf
+	// check area
+	if ( !CM_AreasConnected( area, svEnt->areanum ) ) {
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !CM_AreasConnected( area, svEnt->areanum2 ) ) {
+			return qfalse;		// blocked by a door
+		}
+	}
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			break;
+		}
+	}
+
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( i == svEnt->numClusters ) {
+		if ( svEnt->lastCluster ) {
+			for ( ; l <= svEnt->lastCluster ; l++ ) {
+				if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+					break;
+				}
+			}
+			if ( l == svEnt->lastCluster ) {
+				return qfalse;	// not visible
+			}
+		} else {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+===============
+SV_FillSnapshotVis
+
+Collects the entities that can be seen from vis->cluster and vis->area
+===============
+*/
+static void SV_FillSnapshotVis( snapshotVis_t *vis ) {
+	int		e;
+	byte	*bitvector;
+
+	vis->numEntities = 0;
+	bitvector = CM_ClusterPVS (vis->cluster);
+
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		if ( SV_SnapshotEntityVisible( SV_GentityNum(e), vis->area, bitvector ) ) {
+			vis->entityNums[ vis->numEntities++ ] = e;
+		}
+	}
+}
+
+/*
+===============
+SV_SnapshotVis
+
+Returns the cached entity list for a cluster and area, filling it in
+first if this frame hasn't needed it yet.  Returns NULL if another
+thread is still filling in the entry, or the cache is full, and the
+caller has to do the checks itself.
+===============
+*/
+static snapshotVis_t *SV_SnapshotVis( int cluster, int area ) {
+	snapshotVis_t	*vis;
+	int				i;
+
+	vis = NULL;
+
+	Sys_LockMutex( sv_snapshotVis.lock );
+
+	for ( i = 0 ; i < sv_snapshotVis.numVis ; i++ ) {
+		if ( sv_snapshotVis.vis[i].cluster == cluster && sv_snapshotVis.vis[i].area == area ) {
+			break;
+		}
+	}
+
+	if ( i < sv_snapshotVis.numVis ) {
+		if ( sv_snapshotVis.vis[i].ready ) {
+			Sys_UnlockMutex( sv_snapshotVis.lock );
+			return &sv_snapshotVis.vis[i];
+		}
+	} else if ( sv_snapshotVis.numVis < MAX_SNAPSHOT_VIS ) {
+		// claim a new entry, it's filled in without holding the lock
+		vis = &sv_snapshotVis.vis[ sv_snapshotVis.numVis++ ];
+		vis->cluster = cluster;
+		vis->area = area;
+		vis->ready = qfalse;
+	}
+
+	Sys_UnlockMutex( sv_snapshotVis.lock );
+
+	if ( !vis ) {
+		return NULL;
+	}
+
+	SV_FillSnapshotVis( vis );
+
+	Sys_LockMutex( sv_snapshotVis.lock );
+	vis->ready = qtrue;
+	Sys_UnlockMutex( sv_snapshotVis.lock );
+
+	return vis;
+}
+
+/*
+===============
+SV_ShutdownSnapshots
+
+Called from SV_Shutdown after the final snapshots went out
+===============
+*/
+void SV_ShutdownSnapshots( void ) {
+	if ( sv_snapshotVis.lock ) {
+		Sys_DestroyMutex( sv_snapshotVis.lock );
+		sv_snapshotVis.lock = NULL;
+	}
+	sv_snapshotVis.numVis = 0;
+}
+
+/*
+=============================================================================
+
+Build a client snapshot structure
+
+=============================================================================
+*/
+
+#define	ENTITY_BITS_WORDS	( MAX_GENTITIES / 32 )
+
+#define	ENTITY_BIT_TEST( bits, n )	( ( bits )[( n ) >> 5] & ( 1u << ( ( n ) & 31 ) ) )
+#define	ENTITY_BIT_SET( bits, n )	( ( bits )[( n ) >> 5] |= ( 1u << ( ( n ) & 31 ) ) )
+
+typedef struct {
+	int				numSnapshotEntities;
+	int				snapshotEntities[MAX_SNAPSHOT_ENTITIES];	// sorted, filled in from added
+	unsigned int	visited[ENTITY_BITS_WORDS];	// prevents double adding from portal views
+	unsigned int	added[ENTITY_BITS_WORDS];	// visited and not discarded because the snapshot was full
+	char			*error;						// set instead of raising it, so this can run on any thread
+} snapshotEntityNumbers_t;
 
 /*
 ===============
 SV_AddEntToSnapshot
 ===============
 */
-static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddEntToSnapshot( sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	if ( ENTITY_BIT_TEST( eNums->visited, gEnt->s.number ) ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	ENTITY_BIT_SET( eNums->visited, gEnt->s.number );
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
 		return;
 	}
 
-	eNums->snapshotEntities[ eNums->numSnapshotEntities ] = gEnt->s.number;
+	ENTITY_BIT_SET( eNums->added, gEnt->s.number );
 	eNums->numSnapshotEntities++;
 }
 
+/*
+===============
+SV_SortedSnapshotEntities
+
+Lists the added entities in increasing order, which is what the
+delta compression needs, even if portals added them out of order
+===============
+*/
+static void SV_SortedSnapshotEntities( snapshotEntityNumbers_t *eNums ) {
+	unsigned int	bits;
+	int				i, num;
+
+	num = 0;
+	for ( i = 0 ; i < ENTITY_BITS_WORDS ; i++ ) {
+		for ( bits = eNums->added[i] ; bits ; bits &= bits - 1 ) {
+			eNums->snapshotEntities[num++] = ( i << 5 ) + Q_ctz( bits );
+		}
+	}
+}
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -291,13 +565,11 @@ SV_AddEntitiesVisibleFromPoint
 */
 static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *frame, 
 									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
+	int		e, i, numEntities;
 	sharedEntity_t *ent;
-	svEntity_t	*svEnt;
-	int		l;
 	int		clientarea, clientcluster;
 	int		leafnum;
-	byte	*clientpvs;
+	snapshotVis_t	*vis;
 	byte	*bitvector;
 
 	// during an error shutdown message we may need to transmit
@@ -314,24 +586,33 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 	// calculate the visible areas
 	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
 
-	clientpvs = CM_ClusterPVS (clientcluster);
-
-	for ( e = 0 ; e < sv.num_entities ; e++ ) {
-		ent = SV_GentityNum(e);
-
-		// never send entities that aren't linked in
-		if ( !ent->r.linked ) {
-			continue;
-		}
+	// the mask only has room for the first 32 clients, this is checked
+	// before anything is known about the entity's visibility
+	if ( sv_snapshotVis.clientMask && frame->ps.clientNum >= 32 ) {
+		eNums->error = "SVF_CLIENTMASK: clientNum >= 32";
+		return;
+	}
 
-		if (ent->s.number != e) {
-			Com_DPrintf ("FIXING ENT->S.NUMBER!!!\n");
-			ent->s.number = e;
-		}
+	// everything that passes the area and PVS checks
+	vis = SV_SnapshotVis( clientcluster, clientarea );
+	if ( vis ) {
+		numEntities = vis->numEntities;
+		bitvector = NULL;
+	} else {
+		numEntities = sv.num_entities;
+		bitvector = CM_ClusterPVS( clientcluster );
+	}
 
-		// entities can be flagged to explicitly not be sent to the client
-		if ( ent->r.svFlags & SVF_NOCLIENT ) {
-			continue;
+	for ( i = 0 ; i < numEntities ; i++ ) {
+		if ( vis ) {
+			e = vis->entityNums[i];
+			ent = SV_GentityNum(e);
+		} else {
+			e = i;
+			ent = SV_GentityNum(e);
+			if ( !SV_SnapshotEntityVisible( ent, clientarea, bitvector ) ) {
+				continue;
+			}
 		}
 
 		// entities can be flagged to be sent to only one client
@@ -348,68 +629,22 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 		}
 		// entities can be flagged to be sent to a given mask of clients
 		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if (frame->ps.clientNum >= 32)
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
 			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
 				continue;
 		}
 
-		svEnt = SV_SvEntityForGentity( ent );
-
 		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
-			continue;
-		}
-
-		// broadcast entities are always sent
-		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddEntToSnapshot( svEnt, ent, eNums );
+		if ( ENTITY_BIT_TEST( eNums->visited, e ) ) {
 			continue;
 		}
 
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
-			}
-		}
-
-		bitvector = clientpvs;
+		// add it
+		SV_AddEntToSnapshot( ent, eNums );
 
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
+		// broadcast entities don't open up portal views
+		if ( ent->r.svFlags & SVF_BROADCAST ) {
 			continue;
 		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
-			}
-		}
-
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
-				}
-			} else {
-				continue;
-			}
-		}
-
-		// add it
-		SV_AddEntToSnapshot( svEnt, ent, eNums );
 
 		// if it's a portal entity, add everything visible from its camera position
 		if ( ent->r.svFlags & SVF_PORTAL ) {
@@ -421,17 +656,23 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 				}
 			}
 			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue );
+			if ( eNums->error ) {
+				return;
+			}
 		}
-
 	}
 }
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_BuildSnapshotEntities
 
 Decides which entities are going to be visible to the client, and
-copies off the playerstate and areabits.
+copies off the playerstate and areabits.  The entity numbers are
+returned sorted in eNums, the entity states aren't stored yet.
+
+Only writes to the client's own frame and eNums, so snapshots for
+different clients can be built at the same time.
 
 This properly handles multiple recursive portals, but the render
 currently doesn't.
@@ -439,26 +680,22 @@ currently doesn't.
 For viewing through other player's eyes, clent can be something other than client->gentity
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
+static void SV_BuildSnapshotEntities( client_t *client, snapshotEntityNumbers_t *entityNumbers ) {
 	vec3_t						org;
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
 	int							i;
-	sharedEntity_t				*ent;
-	entityState_t				*state;
-	svEntity_t					*svEnt;
 	sharedEntity_t				*clent;
 	int							clientNum;
 	playerState_t				*ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	entityNumbers->numSnapshotEntities = 0;
+	entityNumbers->error = NULL;
+	Com_Memset( entityNumbers->visited, 0, sizeof( entityNumbers->visited ) );
+	Com_Memset( entityNumbers->added, 0, sizeof( entityNumbers->added ) );
 	Com_Memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
   // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=62
@@ -477,11 +714,11 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// be regenerated from the playerstate
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+		entityNumbers->error = "SV_SvEntityForGentity: bad gEnt";
+		return;
 	}
-	svEnt = &sv.svEntities[ clientNum ];
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	ENTITY_BIT_SET( entityNumbers->visited, clientNum );
 
 	// find the client's viewpoint
 	VectorCopy( ps->origin, org );
@@ -489,35 +726,79 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
+	SV_AddEntitiesVisibleFromPoint( org, frame, entityNumbers, qfalse );
+	if ( entityNumbers->error ) {
+		return;
+	}
 
-	// if there were portals visible, there may be out of order entities
-	// in the list which will need to be resorted for the delta compression
-	// to work correctly.  This also catches the error condition
-	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities, 
-		sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	// if there were portals visible, entities were added out of order,
+	// the bitset gives them back sorted for the delta compression
+	SV_SortedSnapshotEntities( entityNumbers );
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
 	for ( i = 0 ; i < MAX_MAP_AREA_BYTES/4 ; i++ ) {
 		((int *)frame->areabits)[i] = ((int *)frame->areabits)[i] ^ -1;
 	}
+}
 
-	// copy the entity states out
-	frame->num_entities = 0;
+/*
+=============
+SV_AllocSnapshotEntities
+
+Reserves the frame's range of the circular svs.snapshotEntities
+=============
+*/
+static void SV_AllocSnapshotEntities( clientSnapshot_t *frame, int numEntities ) {
+	frame->num_entities = numEntities;
 	frame->first_entity = svs.nextSnapshotEntities;
-	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum(entityNumbers.snapshotEntities[i]);
-		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
-		*state = ent->s;
-		svs.nextSnapshotEntities++;
-		// this should never hit, map should always be restarted first in SV_Frame
-		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
-			Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
-		}
-		frame->num_entities++;
+	svs.nextSnapshotEntities += numEntities;
+
+	// this should never hit, map should always be restarted first in SV_Frame
+	if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
+		Com_Error(ERR_FATAL, "svs.nextSnapshotEntities wrapped");
+	}
+}
+
+/*
+=============
+SV_StoreSnapshotEntities
+
+Copies the entity states out into the frame's range
+=============
+*/
+static void SV_StoreSnapshotEntities( clientSnapshot_t *frame, snapshotEntityNumbers_t *entityNumbers ) {
+	int		i;
+
+	for ( i = 0 ; i < frame->num_entities ; i++ ) {
+		svs.snapshotEntities[(frame->first_entity+i) % svs.numSnapshotEntities] =
+			SV_GentityNum(entityNumbers->snapshotEntities[i])->s;
+	}
+}
+
+/*
+=============
+SV_BuildClientSnapshot
+=============
+*/
+static void SV_BuildClientSnapshot( client_t *client ) {
+	snapshotEntityNumbers_t		entityNumbers;
+	clientSnapshot_t			*frame;
+
+	// this is the frame we are creating
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	SV_BuildSnapshotEntities( client, &entityNumbers );
+	if ( entityNumbers.error ) {
+		Com_Error( ERR_DROP, "%s", entityNumbers.error );
+	}
+
+	if ( !client->gentity || client->state == CS_ZOMBIE ) {
+		return;
 	}
+
+	SV_AllocSnapshotEntities( frame, entityNumbers.numSnapshotEntities );
+	SV_StoreSnapshotEntities( frame, &entityNumbers );
 }
 
 #ifdef USE_VOIP
@@ -588,13 +869,10 @@ void SV_SendMessageToClient(msg_t *msg, client_t *client)
 
 /*
 =======================
-SV_SendClientSnapshot
-
-Also called by SV_FinalMessage
-
+SV_SendSnapshotToClient
 =======================
 */
-void SV_SendClientSnapshot( client_t *client ) {
+static void SV_SendSnapshotToClient( client_t *client ) {
 	byte		msg_buf[MAX_MSGLEN];
 	msg_t		msg;
 
@@ -634,6 +912,301 @@ void SV_SendClientSnapshot( client_t *client ) {
 	SV_SendMessageToClient( &msg, client );
 }
 
+/*
+=======================
+SV_SendClientSnapshot
+
+Also called by SV_FinalMessage
+
+=======================
+*/
+void SV_SendClientSnapshot( client_t *client ) {
+	SV_BeginSnapshots();
+	SV_SendSnapshotToClient( client );
+}
+
+
+/*
+=============================================================================
+
+Snapshot jobs
+
+With sv_snapshotThreads > 1 the visibility walk and the delta encoding
+of every client's snapshot run on the job pool.  Everything that is
+shared between clients (the circular svs.snapshotEntities, printing,
+errors, the netchan) is handled on the main thread in client order, so
+the messages are byte for byte the ones SV_SendClientSnapshot creates.
+
+=============================================================================
+*/
+
+typedef struct snapshotJob_s {
+	client_t				*client;
+	snapshotEntityNumbers_t	entityNumbers;
+	clientSnapshot_t		*oldframe;
+	int						lastframe;
+	msg_t					msg;
+	byte					msgBuffer[MAX_MSGLEN];
+	char					error[128];		// raised on the main thread once the jobs are done
+} snapshotJob_t;
+
+static snapshotJob_t	*sv_buildSnapshotJobs[MAX_CLIENTS];
+static snapshotJob_t	*sv_writeSnapshotJobs[MAX_CLIENTS];
+
+/*
+=======================
+SV_AllocSnapshotJobs
+
+Called from SV_SpawnServer after the hunk has been cleared
+=======================
+*/
+void SV_AllocSnapshotJobs( void ) {
+	svs.snapshotJobs = Hunk_Alloc( sizeof( snapshotJob_t ) * sv_maxclients->integer, h_high );
+}
+
+/*
+=======================
+SV_BuildSnapshotJob
+=======================
+*/
+static void SV_BuildSnapshotJob( void *data, int index ) {
+	snapshotJob_t *job = ((snapshotJob_t **)data)[index];
+
+	SV_BuildSnapshotEntities( job->client, &job->entityNumbers );
+}
+
+/*
+=======================
+SV_WriteSnapshotJob
+=======================
+*/
+static void SV_WriteSnapshotJob( void *data, int index ) {
+	snapshotJob_t		*job = ((snapshotJob_t **)data)[index];
+	client_t			*client = job->client;
+	clientSnapshot_t	*frame;
+	entityState_t		*newents[MAX_SNAPSHOT_ENTITIES];
+	int					i;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	// the states haven't been copied out to svs.snapshotEntities yet, doing
+	// that now could overwrite the frames other clients are delta'ing from
+	for ( i = 0 ; i < frame->num_entities ; i++ ) {
+		newents[i] = &SV_GentityNum( job->entityNumbers.snapshotEntities[i] )->s;
+
+		// MSG_WriteDeltaEntity would raise this from the worker thread
+		if ( newents[i]->number < 0 || newents[i]->number >= MAX_GENTITIES ) {
+			Com_sprintf( job->error, sizeof( job->error ),
+				"MSG_WriteDeltaEntity: Bad entity number: %i", newents[i]->number );
+			return;
+		}
+	}
+
+	// NOTE, MRE: all server->client messages now acknowledge
+	// let the client know which reliable clientCommands we have received
+	MSG_WriteLong( &job->msg, client->lastClientCommand );
+
+	// (re)send any reliable server commands
+	SV_UpdateServerCommandsToClient( client, &job->msg );
+
+	// send over all the relevant entityState_t
+	// and the playerState_t, an overflow only sets job->msg.overflowed
+	SV_WriteSnapshot( client, job->oldframe, job->lastframe, newents, &job->msg );
+}
+
+/*
+=======================
+SV_SendClientSnapshots
+
+Threaded equivalent of calling SV_SendClientSnapshot for each of the clients
+=======================
+*/
+static void SV_SendClientSnapshots( client_t **clients, int numClients ) {
+	snapshotJob_t		*job;
+	client_t			*client;
+	clientSnapshot_t	*frame;
+	int					numWriteJobs;
+	int					i;
+
+	for ( i = 0 ; i < numClients ; i++ ) {
+		job = &svs.snapshotJobs[ clients[i] - svs.clients ];
+		job->client = clients[i];
+		sv_buildSnapshotJobs[i] = job;
+	}
+
+	Job_ParallelFor( SV_BuildSnapshotJob, sv_buildSnapshotJobs, numClients, sv_snapshotThreads->integer );
+
+	// reserve the entity ranges and pick the delta frames in the
+	// same order SV_SendClientMessages would have built them in
+	numWriteJobs = 0;
+	for ( i = 0 ; i < numClients ; i++ ) {
+		job = sv_buildSnapshotJobs[i];
+		client = job->client;
+
+		if ( job->entityNumbers.error ) {
+			Com_Error( ERR_DROP, "%s", job->entityNumbers.error );
+		}
+
+		if ( client->gentity && client->state != CS_ZOMBIE ) {
+			frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+			SV_AllocSnapshotEntities( frame, job->entityNumbers.numSnapshotEntities );
+		}
+
+		// bots need to have their snapshots build, but
+		// the query them directly without needing to be sent
+		if ( client->gentity && client->gentity->r.svFlags & SVF_BOT ) {
+			continue;
+		}
+
+		job->oldframe = SV_SnapshotDeltaFrame( client, &job->lastframe );
+
+		MSG_Init( &job->msg, job->msgBuffer, sizeof( job->msgBuffer ) );
+		job->msg.allowoverflow = qtrue;
+		job->error[0] = '\0';
+
+		sv_writeSnapshotJobs[numWriteJobs++] = job;
+	}
+
+	Job_ParallelFor( SV_WriteSnapshotJob, sv_writeSnapshotJobs, numWriteJobs, sv_snapshotThreads->integer );
+
+	// the workers can't raise errors, do it for the first one in client order
+	for ( i = 0 ; i < numWriteJobs ; i++ ) {
+		if ( sv_writeSnapshotJobs[i]->error[0] ) {
+			Com_Error( ERR_FATAL, "%s", sv_writeSnapshotJobs[i]->error );
+		}
+	}
+
+	// all messages are written, the old frames aren't needed anymore
+	for ( i = 0 ; i < numClients ; i++ ) {
+		job = sv_buildSnapshotJobs[i];
+		client = job->client;
+
+		if ( client->gentity && client->state != CS_ZOMBIE ) {
+			frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+			SV_StoreSnapshotEntities( frame, &job->entityNumbers );
+		}
+	}
+
+	for ( i = 0 ; i < numWriteJobs ; i++ ) {
+		job = sv_writeSnapshotJobs[i];
+		client = job->client;
+
+#ifdef USE_VOIP
+		SV_WriteVoipToClient( client, &job->msg );
+#endif
+
+		// check for overflow
+		if ( job->msg.overflowed ) {
+			Com_Printf ("WARNING: msg overflowed for %s\n", client->name);
+			MSG_Clear (&job->msg);
+		}
+
+		SV_SendMessageToClient( &job->msg, client );
+	}
+}
+
+/*
+=======================
+SV_DeltaBench_f
+
+Replays the entity deltas between the snapshots still in the
+clients' frame history through MSG_BenchmarkDeltas
+=======================
+*/
+#define	MAX_BENCH_DELTAS	65536
+
+void SV_DeltaBench_f( void ) {
+	entityState_t		**from, **to;
+	entityState_t		*oldent, *newent;
+	clientSnapshot_t	*oldframe, *frame;
+	client_t			*cl;
+	int					oldindex, newindex;
+	int					oldnum, newnum;
+	int					firstValid;
+	int					numDeltas;
+	int					iterations;
+	int					i, seq;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	iterations = 100;
+	if ( Cmd_Argc() > 1 ) {
+		iterations = atoi( Cmd_Argv( 1 ) );
+		if ( iterations < 1 ) {
+			iterations = 1;
+		}
+	}
+
+	from = Z_Malloc( sizeof( *from ) * MAX_BENCH_DELTAS );
+	to = Z_Malloc( sizeof( *to ) * MAX_BENCH_DELTAS );
+	numDeltas = 0;
+
+	// only frames whose entities haven't been overwritten yet
+	firstValid = svs.nextSnapshotEntities - svs.numSnapshotEntities;
+
+	for ( i = 0, cl = svs.clients ; i < sv_maxclients->integer ; i++, cl++ ) {
+		if ( cl->state != CS_ACTIVE ) {
+			continue;
+		}
+
+		for ( seq = cl->netchan.outgoingSequence - PACKET_BACKUP + 2 ; seq < cl->netchan.outgoingSequence ; seq++ ) {
+			oldframe = &cl->frames[ ( seq - 1 ) & PACKET_MASK ];
+			frame = &cl->frames[ seq & PACKET_MASK ];
+			if ( seq - 1 <= 0 || oldframe->first_entity < firstValid || frame->first_entity < firstValid ) {
+				continue;
+			}
+
+			// the same walk SV_EmitPacketEntities does
+			oldindex = 0;
+			newindex = 0;
+			while ( ( newindex < frame->num_entities || oldindex < oldframe->num_entities )
+				&& numDeltas < MAX_BENCH_DELTAS ) {
+				if ( newindex >= frame->num_entities ) {
+					newent = NULL;
+					newnum = 9999;
+				} else {
+					newent = &svs.snapshotEntities[ ( frame->first_entity + newindex ) % svs.numSnapshotEntities ];
+					newnum = newent->number;
+				}
+
+				if ( oldindex >= oldframe->num_entities ) {
+					oldent = NULL;
+					oldnum = 9999;
+				} else {
+					oldent = &svs.snapshotEntities[ ( oldframe->first_entity + oldindex ) % svs.numSnapshotEntities ];
+					oldnum = oldent->number;
+				}
+
+				if ( newnum == oldnum ) {
+					from[numDeltas] = oldent;
+					to[numDeltas++] = newent;
+					oldindex++;
+					newindex++;
+				} else if ( newnum < oldnum ) {
+					from[numDeltas] = &sv.svEntities[newnum].baseline;
+					to[numDeltas++] = newent;
+					newindex++;
+				} else {
+					from[numDeltas] = oldent;
+					to[numDeltas++] = NULL;
+					oldindex++;
+				}
+			}
+		}
+	}
+
+	if ( !numDeltas ) {
+		Com_Printf( "No snapshots recorded yet.\n" );
+	} else {
+		MSG_BenchmarkDeltas( from, to, numDeltas, iterations );
+	}
+
+	Z_Free( to );
+	Z_Free( from );
+}
 
 /*
 =======================
@@ -644,6 +1217,12 @@ void SV_SendClientMessages(void)
 {
 	int		i;
 	client_t	*c;
+	client_t	*snapshotClients[MAX_CLIENTS];
+	int		numSnapshotClients;
+
+	numSnapshotClients = 0;
+
+	SV_BeginSnapshots();
 
 	// send a message to each connected client
 	for(i=0; i < sv_maxclients->integer; i++)
@@ -677,9 +1256,27 @@ void SV_SendClientMessages(void)
 			}
 		}
 
+		if(sv_snapshotThreads->integer > 1 && svs.snapshotJobs)
+		{
+			// generated and sent below, all at once
+			snapshotClients[numSnapshotClients++] = c;
+			continue;
+		}
+
 		// generate and send a new message
-		SV_SendClientSnapshot(c);
+		SV_SendSnapshotToClient(c);
 		c->lastSnapshotTime = svs.time;
 		c->rateDelayed = qfalse;
 	}
+
+	if(numSnapshotClients)
+	{
+		SV_SendClientSnapshots(snapshotClients, numSnapshotClients);
+
+		for(i=0; i < numSnapshotClients; i++)
+		{
+			snapshotClients[i]->lastSnapshotTime = svs.time;
+			snapshotClients[i]->rateDelayed = qfalse;
+		}
+	}
 }
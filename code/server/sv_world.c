@@ -138,6 +138,456 @@ static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs
 	return anode;
 }
 
+/*
+===============================================================================
+
+WORLD TREE
+
+With sv_broadphase 1 area queries use a dynamic bounding box tree instead
+of the sectors.  Every linked entity is a leaf with a box a little bigger
+than its absmin / absmax, so an entity that only moved a bit doesn't have
+to be reinserted, and every node is sized to fit its two children.  The
+tree is kept balanced by rotating nodes while refitting.
+
+Both structures are always kept up to date, so the cvar can be changed
+at any time.
+
+===============================================================================
+*/
+
+typedef struct worldNode_s {
+	vec3_t		mins, maxs;
+	struct worldNode_s	*parent;		// next free node when not in use
+	struct worldNode_s	*children[2];	// both NULL for leafs
+	int			height;					// 0 for leafs
+	svEntity_t	*entity;
+} worldNode_t;
+
+#define	MAX_WORLD_NODES		(MAX_GENTITIES*2)
+
+// how far the box of a leaf reaches past its entity
+#define	WORLD_NODE_MARGIN	16
+
+static worldNode_t	sv_worldNodes[MAX_WORLD_NODES];
+static worldNode_t	*sv_worldRoot;
+static worldNode_t	*sv_freeWorldNodes;
+
+/*
+===============
+SV_WorldNodeCost
+
+Half the surface area of the box, the chance of a random query hitting it
+===============
+*/
+static float SV_WorldNodeCost( const vec3_t mins, const vec3_t maxs ) {
+	vec3_t	size;
+
+	VectorSubtract( maxs, mins, size );
+	return size[0] * size[1] + size[1] * size[2] + size[2] * size[0];
+}
+
+/*
+===============
+SV_WorldNodeUnionCost
+===============
+*/
+static float SV_WorldNodeUnionCost( const worldNode_t *a, const worldNode_t *b ) {
+	vec3_t	mins, maxs;
+	int		i;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		mins[i] = MIN( a->mins[i], b->mins[i] );
+		maxs[i] = MAX( a->maxs[i], b->maxs[i] );
+	}
+	return SV_WorldNodeCost( mins, maxs );
+}
+
+/*
+===============
+SV_FitWorldNode
+
+Sizes an inner node to its children
+===============
+*/
+static void SV_FitWorldNode( worldNode_t *node ) {
+	worldNode_t	*a, *b;
+	int			i;
+
+	a = node->children[0];
+	b = node->children[1];
+	for ( i = 0 ; i < 3 ; i++ ) {
+		node->mins[i] = MIN( a->mins[i], b->mins[i] );
+		node->maxs[i] = MAX( a->maxs[i], b->maxs[i] );
+	}
+	node->height = 1 + MAX( a->height, b->height );
+}
+
+/*
+===============
+SV_ReplaceWorldChild
+===============
+*/
+static void SV_ReplaceWorldChild( worldNode_t *parent, worldNode_t *oldChild, worldNode_t *newChild ) {
+	newChild->parent = parent;
+	if ( !parent ) {
+		sv_worldRoot = newChild;
+	} else if ( parent->children[0] == oldChild ) {
+		parent->children[0] = newChild;
+	} else {
+		parent->children[1] = newChild;
+	}
+}
+
+/*
+===============
+SV_BalanceWorldNode
+
+If one side of node is more than one level deeper than the other, its
+child is rotated up to take node's place.  Returns the node now at the
+position of node.
+===============
+*/
+static worldNode_t *SV_BalanceWorldNode( worldNode_t *node ) {
+	worldNode_t	*low, *high;
+	worldNode_t	*keep, *move;
+	int			side;
+
+	if ( node->height < 2 ) {
+		return node;
+	}
+
+	if ( node->children[1]->height - node->children[0]->height > 1 ) {
+		side = 1;
+	} else if ( node->children[0]->height - node->children[1]->height > 1 ) {
+		side = 0;
+	} else {
+		return node;
+	}
+
+	high = node->children[side];
+	low = node->children[side^1];
+
+	// the deeper grandchild stays under high, the other one moves to node
+	if ( high->children[0]->height > high->children[1]->height ) {
+		keep = high->children[0];
+		move = high->children[1];
+	} else {
+		keep = high->children[1];
+		move = high->children[0];
+	}
+
+	SV_ReplaceWorldChild( node->parent, node, high );
+
+	high->children[0] = node;
+	high->children[1] = keep;
+	node->parent = high;
+
+	node->children[0] = low;
+	node->children[1] = move;
+	move->parent = node;
+
+	SV_FitWorldNode( node );
+	SV_FitWorldNode( high );
+
+	return high;
+}
+
+/*
+===============
+SV_RefitWorldNodes
+
+Walks up from node fixing the boxes and heights
+===============
+*/
+static void SV_RefitWorldNodes( worldNode_t *node ) {
+	while ( node ) {
+		node = SV_BalanceWorldNode( node );
+		SV_FitWorldNode( node );
+		node = node->parent;
+	}
+}
+
+/*
+===============
+SV_InsertWorldNode
+===============
+*/
+static void SV_InsertWorldNode( worldNode_t *leaf ) {
+	worldNode_t	*sibling, *parent;
+	float		cost, inherited, childCost[2];
+	int			i;
+
+	if ( !sv_worldRoot ) {
+		sv_worldRoot = leaf;
+		leaf->parent = NULL;
+		return;
+	}
+
+	// descend to the node that is cheapest to pair the leaf with
+	sibling = sv_worldRoot;
+	while ( sibling->height > 0 ) {
+		cost = 2 * SV_WorldNodeUnionCost( sibling, leaf );
+
+		// growing this node to fit the leaf costs all of the subtree
+		inherited = cost - 2 * SV_WorldNodeCost( sibling->mins, sibling->maxs );
+
+		for ( i = 0 ; i < 2 ; i++ ) {
+			worldNode_t *child = sibling->children[i];
+
+			childCost[i] = SV_WorldNodeUnionCost( child, leaf ) + inherited;
+			if ( child->height > 0 ) {
+				childCost[i] -= SV_WorldNodeCost( child->mins, child->maxs );
+			}
+		}
+
+		if ( cost < childCost[0] && cost < childCost[1] ) {
+			break;
+		}
+		sibling = sibling->children[ childCost[1] < childCost[0] ];
+	}
+
+	parent = sv_freeWorldNodes;
+	sv_freeWorldNodes = parent->parent;
+
+	SV_ReplaceWorldChild( sibling->parent, sibling, parent );
+	parent->children[0] = sibling;
+	parent->children[1] = leaf;
+	parent->entity = NULL;
+	sibling->parent = parent;
+	leaf->parent = parent;
+
+	SV_RefitWorldNodes( parent );
+}
+
+/*
+===============
+SV_RemoveWorldNode
+
+Takes the entity's leaf out of the tree and frees it
+===============
+*/
+static void SV_RemoveWorldNode( svEntity_t *ent ) {
+	worldNode_t	*leaf, *parent, *sibling;
+
+	leaf = ent->worldNode;
+	if ( !leaf ) {
+		return;
+	}
+	ent->worldNode = NULL;
+
+	parent = leaf->parent;
+	if ( parent ) {
+		sibling = parent->children[ parent->children[0] == leaf ];
+		SV_ReplaceWorldChild( parent->parent, parent, sibling );
+		SV_RefitWorldNodes( sibling->parent );
+
+		parent->parent = sv_freeWorldNodes;
+		sv_freeWorldNodes = parent;
+	} else {
+		sv_worldRoot = NULL;
+	}
+
+	leaf->parent = sv_freeWorldNodes;
+	sv_freeWorldNodes = leaf;
+}
+
+/*
+===============
+SV_MoveWorldNode
+
+Makes sure the entity has a leaf that contains absmin / absmax
+===============
+*/
+static void SV_MoveWorldNode( svEntity_t *ent, const vec3_t absmin, const vec3_t absmax ) {
+	worldNode_t	*leaf;
+	int			i;
+
+	leaf = ent->worldNode;
+	if ( leaf ) {
+		if ( absmin[0] >= leaf->mins[0] && absmin[1] >= leaf->mins[1] && absmin[2] >= leaf->mins[2]
+			&& absmax[0] <= leaf->maxs[0] && absmax[1] <= leaf->maxs[1] && absmax[2] <= leaf->maxs[2] ) {
+			return;		// still fits
+		}
+		SV_RemoveWorldNode( ent );
+	}
+
+	leaf = sv_freeWorldNodes;
+	sv_freeWorldNodes = leaf->parent;
+
+	for ( i = 0 ; i < 3 ; i++ ) {
+		leaf->mins[i] = absmin[i] - WORLD_NODE_MARGIN;
+		leaf->maxs[i] = absmax[i] + WORLD_NODE_MARGIN;
+	}
+	leaf->children[0] = leaf->children[1] = NULL;
+	leaf->height = 0;
+	leaf->entity = ent;
+	ent->worldNode = leaf;
+
+	SV_InsertWorldNode( leaf );
+}
+
+/*
+===============
+SV_ClearWorldNodes
+===============
+*/
+static void SV_ClearWorldNodes( void ) {
+	int		i;
+
+	Com_Memset( sv_worldNodes, 0, sizeof( sv_worldNodes ) );
+	sv_worldRoot = NULL;
+	sv_freeWorldNodes = NULL;
+	for ( i = MAX_WORLD_NODES - 1 ; i >= 0 ; i-- ) {
+		sv_worldNodes[i].parent = sv_freeWorldNodes;
+		sv_freeWorldNodes = &sv_worldNodes[i];
+	}
+}
+
+/*
+===============================================================================
+
+TRACE CACHE
+
+Game and bot code often make the same SV_Trace call several times in one
+frame, so with sv_traceCache 1 the results are remembered in a small hash
+table until something that could change them happens: a new game frame
+or a link / unlink that changed an entity as far as traces are concerned.
+Relinking an entity that didn't move is common and keeps the cache.
+
+The game has to relink an entity after changing its contents, owner or
+bounds for the cache to notice, which it does anyway for the sectors.
+Only the main thread may use the cache.
+
+===============================================================================
+*/
+
+typedef struct {
+	vec3_t		start, end;
+	vec3_t		mins, maxs;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;
+} traceKey_t;
+
+typedef struct {
+	traceKey_t	key;
+	int			generation;		// entry is valid while this matches sv_traceGeneration
+	trace_t		trace;
+} traceCacheEntry_t;
+
+#define	TRACE_CACHE_SIZE	2048	// must be a power of two
+
+static traceCacheEntry_t	sv_traceCacheEntries[TRACE_CACHE_SIZE];
+static int	sv_traceGeneration = 1;
+
+static int	sv_traceCacheHits;
+static int	sv_traceCacheMisses;
+static int	sv_traceCacheFlushes;
+
+/*
+===============
+SV_FlushTraceCache
+===============
+*/
+static void SV_FlushTraceCache( void ) {
+	sv_traceGeneration++;
+	if ( sv_traceGeneration <= 0 ) {
+		// wrapped, don't let old entries come back to life
+		Com_Memset( sv_traceCacheEntries, 0, sizeof( sv_traceCacheEntries ) );
+		sv_traceGeneration = 1;
+	}
+	sv_traceCacheFlushes++;
+}
+
+/*
+===============
+SV_NewTraceFrame
+===============
+*/
+void SV_NewTraceFrame( void ) {
+	SV_FlushTraceCache();
+}
+
+/*
+===============
+SV_UpdateTraceLink
+
+Flushes the cache if the entity looks different to traces than it did
+the last time it was linked or unlinked
+===============
+*/
+static void SV_UpdateTraceLink( const sharedEntity_t *gEnt, svEntity_t *ent ) {
+	svTraceLink_t	link;
+
+	Com_Memset( &link, 0, sizeof( link ) );
+	link.linked = gEnt->r.linked;
+	if ( link.linked ) {
+		link.contents = gEnt->r.contents;
+		link.ownerNum = gEnt->r.ownerNum;
+		link.capsule = gEnt->r.svFlags & SVF_CAPSULE;
+		link.bmodel = gEnt->r.bmodel;
+		link.modelindex = gEnt->s.modelindex;
+		VectorCopy( gEnt->r.mins, link.mins );
+		VectorCopy( gEnt->r.maxs, link.maxs );
+		VectorCopy( gEnt->r.currentOrigin, link.origin );
+		VectorCopy( gEnt->r.currentAngles, link.angles );
+	}
+
+	if ( !memcmp( &link, &ent->traceLink, sizeof( link ) ) ) {
+		return;
+	}
+
+	ent->traceLink = link;
+	SV_FlushTraceCache();
+}
+
+/*
+===============
+SV_TraceCacheEntry
+
+Returns the slot the trace would be stored in
+===============
+*/
+static traceCacheEntry_t *SV_TraceCacheEntry( const traceKey_t *key ) {
+	const unsigned int	*words;
+	unsigned int		hash;
+	int					i;
+
+	words = (const unsigned int *)key;
+	hash = 2166136261u;
+	for ( i = 0 ; i < (int)( sizeof( *key ) / sizeof( *words ) ) ; i++ ) {
+		hash = ( hash ^ words[i] ) * 16777619u;
+	}
+	hash ^= hash >> 16;
+
+	return &sv_traceCacheEntries[hash & ( TRACE_CACHE_SIZE - 1 )];
+}
+
+/*
+===============
+SV_TraceCache_f
+
+Prints how well sv_traceCache has been doing
+===============
+*/
+void SV_TraceCache_f( void ) {
+	int		total;
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		sv_traceCacheHits = 0;
+		sv_traceCacheMisses = 0;
+		sv_traceCacheFlushes = 0;
+		return;
+	}
+
+	total = sv_traceCacheHits + sv_traceCacheMisses;
+	Com_Printf( "sv_traceCache %i\n", sv_traceCache->integer );
+	Com_Printf( "%i traces, %i hits, %i misses (%.1f%% hit)\n", total,
+		sv_traceCacheHits, sv_traceCacheMisses,
+		total ? 100.0f * sv_traceCacheHits / total : 0.0f );
+	Com_Printf( "%i flushes\n", sv_traceCacheFlushes );
+}
+
 /*
 ===============
 SV_ClearWorld
@@ -151,28 +601,27 @@ void SV_ClearWorld( void ) {
 	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
 	sv_numworldSectors = 0;
 
+	SV_ClearWorldNodes();
+
 	// get world map bounds
 	h = CM_InlineModel( 0 );
 	CM_ModelBounds( h, mins, maxs );
 	SV_CreateworldSector( 0, mins, maxs );
+
+	SV_FlushTraceCache();
 }
 
 
 /*
 ===============
-SV_UnlinkEntity
+SV_UnlinkSector
 
 ===============
 */
-void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
-	svEntity_t		*ent;
+static void SV_UnlinkSector( svEntity_t *ent ) {
 	svEntity_t		*scan;
 	worldSector_t	*ws;
 
-	ent = SV_SvEntityForGentity( gEnt );
-
-	gEnt->r.linked = qfalse;
-
 	ws = ent->worldSector;
 	if ( !ws ) {
 		return;		// not linked in anywhere
@@ -194,6 +643,24 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
 }
 
+/*
+===============
+SV_UnlinkEntity
+
+===============
+*/
+void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
+	svEntity_t		*ent;
+
+	ent = SV_SvEntityForGentity( gEnt );
+
+	gEnt->r.linked = qfalse;
+
+	SV_UnlinkSector( ent );
+	SV_RemoveWorldNode( ent );
+	SV_UpdateTraceLink( gEnt, ent );
+}
+
 
 /*
 ===============
@@ -216,7 +683,10 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	ent = SV_SvEntityForGentity( gEnt );
 
 	if ( ent->worldSector ) {
-		SV_UnlinkEntity( gEnt );	// unlink from old position
+		// unlink from old position, the world tree
+		// leaf is only moved if it has to be
+		gEnt->r.linked = qfalse;
+		SV_UnlinkSector( ent );
 	}
 
 	// encode the size into the entityState_t for client prediction
@@ -291,6 +761,8 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	// if none of the leafs were inside the map, the
 	// entity is outside the world and can be considered unlinked
 	if ( !num_leafs ) {
+		SV_RemoveWorldNode( ent );
+		SV_UpdateTraceLink( gEnt, ent );
 		return;
 	}
 
@@ -351,7 +823,10 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 	ent->nextEntityInWorldSector = node->entities;
 	node->entities = ent;
 
+	SV_MoveWorldNode( ent, gEnt->r.absmin, gEnt->r.absmax );
+
 	gEnt->r.linked = qtrue;
+	SV_UpdateTraceLink( gEnt, ent );
 }
 
 /*
@@ -371,6 +846,9 @@ typedef struct {
 	int			count, maxcount;
 } areaParms_t;
 
+// entity boxes tested by area queries, for SV_TraceBench_f
+static int	sv_areaEntityChecks;
+
 
 /*
 ====================
@@ -387,6 +865,7 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 
 		gcheck = SV_GEntityForSvEntity( check );
 
+		sv_areaEntityChecks++;
 		if ( gcheck->r.absmin[0] > ap->maxs[0]
 		|| gcheck->r.absmin[1] > ap->maxs[1]
 		|| gcheck->r.absmin[2] > ap->maxs[2]
@@ -418,6 +897,67 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	}
 }
 
+/*
+====================
+SV_AreaEntitiesTree
+
+Same as SV_AreaEntities_r, on the world tree
+====================
+*/
+static void SV_AreaEntitiesTree( areaParms_t *ap ) {
+	worldNode_t	*stack[64];
+	worldNode_t	*node;
+	sharedEntity_t *gcheck;
+	int			depth;
+
+	if ( !sv_worldRoot ) {
+		return;
+	}
+
+	stack[0] = sv_worldRoot;
+	depth = 1;
+
+	while ( depth ) {
+		node = stack[--depth];
+
+		if ( node->mins[0] > ap->maxs[0]
+		|| node->mins[1] > ap->maxs[1]
+		|| node->mins[2] > ap->maxs[2]
+		|| node->maxs[0] < ap->mins[0]
+		|| node->maxs[1] < ap->mins[1]
+		|| node->maxs[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( node->height > 0 ) {
+			// the tree is balanced, so it is never deeper than 2 * log2(MAX_GENTITIES)
+			stack[depth++] = node->children[1];
+			stack[depth++] = node->children[0];
+			continue;
+		}
+
+		gcheck = SV_GEntityForSvEntity( node->entity );
+
+		sv_areaEntityChecks++;
+		if ( gcheck->r.absmin[0] > ap->maxs[0]
+		|| gcheck->r.absmin[1] > ap->maxs[1]
+		|| gcheck->r.absmin[2] > ap->maxs[2]
+		|| gcheck->r.absmax[0] < ap->mins[0]
+		|| gcheck->r.absmax[1] < ap->mins[1]
+		|| gcheck->r.absmax[2] < ap->mins[2]) {
+			continue;
+		}
+
+		if ( ap->count == ap->maxcount ) {
+			Com_Printf ("SV_AreaEntities: MAXCOUNT\n");
+			return;
+		}
+
+		ap->list[ap->count] = node->entity - sv.svEntities;
+		ap->count++;
+	}
+}
+
 /*
 ================
 SV_AreaEntities
@@ -432,7 +972,11 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	if ( sv_broadphase->integer ) {
+		SV_AreaEntitiesTree( &ap );
+	} else {
+		SV_AreaEntities_r( sv_worldSectors, &ap );
+	}
 
 	return ap.count;
 }
@@ -587,23 +1131,13 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 
 /*
 ==================
-SV_Trace
-
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+SV_TraceUncached
 ==================
 */
-void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+static void SV_TraceUncached( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
 	moveclip_t	clip;
 	int			i;
 
-	if ( !mins ) {
-		mins = vec3_origin;
-	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
-	}
-
 	Com_Memset ( &clip, 0, sizeof ( moveclip_t ) );
 
 	// clip to world
@@ -643,6 +1177,54 @@ void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, c
 	*results = clip.trace;
 }
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace( trace_t *results, const vec3_t start, vec3_t mins, vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, int capsule ) {
+	traceKey_t			key;
+	traceCacheEntry_t	*entry;
+
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	if ( !sv_traceCache->integer ) {
+		SV_TraceUncached( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+		return;
+	}
+
+	Com_Memset( &key, 0, sizeof( key ) );
+	VectorCopy( start, key.start );
+	VectorCopy( end, key.end );
+	VectorCopy( mins, key.mins );
+	VectorCopy( maxs, key.maxs );
+	key.passEntityNum = passEntityNum;
+	key.contentmask = contentmask;
+	key.capsule = capsule;
+
+	entry = SV_TraceCacheEntry( &key );
+	if ( entry->generation == sv_traceGeneration && !memcmp( &entry->key, &key, sizeof( key ) ) ) {
+		sv_traceCacheHits++;
+		*results = entry->trace;
+		return;
+	}
+
+	sv_traceCacheMisses++;
+	SV_TraceUncached( results, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+
+	entry->key = key;
+	entry->generation = sv_traceGeneration;
+	entry->trace = *results;
+}
+
 
 
 /*
@@ -684,4 +1266,265 @@ int SV_PointContents( const vec3_t p, int passEntityNum ) {
 	return contents;
 }
 
+/*
+=============
+SV_TraceBench_f
+
+Runs the same set of random traces through the map with both
+broadphases and prints how much work each of them did.  The traces
+skip sv_traceCache.
+=============
+*/
+void SV_TraceBench_f( void ) {
+	static vec3_t	playerMins = { -15, -15, -24 };
+	static vec3_t	playerMaxs = { 15, 15, 32 };
+	vec3_t			worldMins, worldMaxs;
+	vec3_t			start, end;
+	trace_t			trace;
+	int				numTraces;
+	int				broadphase, oldBroadphase;
+	int				seed, startTime, time, hits;
+	int				i, j;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	numTraces = 100000;
+	if ( Cmd_Argc() > 1 ) {
+		numTraces = atoi( Cmd_Argv( 1 ) );
+		if ( numTraces < 1 ) {
+			numTraces = 1;
+		}
+	}
+
+	CM_ModelBounds( CM_InlineModel( 0 ), worldMins, worldMaxs );
+
+	oldBroadphase = sv_broadphase->integer;
+
+	for ( broadphase = 0 ; broadphase < 2 ; broadphase++ ) {
+		Cvar_Set( "sv_broadphase", va( "%i", broadphase ) );
+		sv_areaEntityChecks = 0;
+		hits = 0;
+		seed = 1;
+
+		startTime = Sys_Milliseconds();
+
+		for ( i = 0 ; i < numTraces ; i++ ) {
+			// short moves around the map, like the ones of players and missiles
+			for ( j = 0 ; j < 3 ; j++ ) {
+				start[j] = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] );
+				end[j] = start[j] + Q_crandom( &seed ) * 256;
+			}
+
+			// the second pass would only be timing sv_traceCache hits
+			SV_TraceUncached( &trace, start, playerMins, playerMaxs, end, ENTITYNUM_NONE, CONTENTS_SOLID|CONTENTS_PLAYERCLIP|CONTENTS_BODY, qfalse );
+			if ( trace.entityNum != ENTITYNUM_NONE && trace.entityNum != ENTITYNUM_WORLD ) {
+				hits++;
+			}
+		}
+
+		time = Sys_Milliseconds() - startTime;
+
+		Com_Printf( "%s: %i traces, %i msec, %i entity checks, %i entity hits\n",
+			broadphase ? "world tree" : "sectors", numTraces, time, sv_areaEntityChecks, hits );
+	}
+
+	Cvar_Set( "sv_broadphase", va( "%i", oldBroadphase ) );
+}
+
+typedef struct {
+	int				type;
+	clipHandle_t	model;		// inline model for TRACESTRESS_INLINE
+	vec3_t			start, end;
+	vec3_t			mins, maxs;
+	vec3_t			origin, angles;
+
+	trace_t			trace;			// serial results
+	int				contents;
+	qboolean		mismatch;		// set by the threads, which can't print
+} traceStressItem_t;
+
+enum {
+	TRACESTRESS_WORLD,			// box trace through the world tree
+	TRACESTRESS_INLINE,			// moved and rotated inline model
+	TRACESTRESS_BOX,			// temporary box model
+	TRACESTRESS_POINT,			// point contents
+	TRACESTRESS_TYPES
+};
+
+/*
+=============
+SV_TraceStressRun
+=============
+*/
+static void SV_TraceStressRun( const traceStressItem_t *item, trace_t *trace, int *contents ) {
+	clipHandle_t	box;
+
+	Com_Memset( trace, 0, sizeof( *trace ) );
+	*contents = 0;
+
+	switch ( item->type ) {
+	case TRACESTRESS_WORLD:
+		CM_BoxTrace( trace, item->start, item->end, (float *)item->mins, (float *)item->maxs,
+			0, MASK_ALL, qfalse );
+		*contents = CM_PointContents( item->end, 0 );
+		break;
+	case TRACESTRESS_INLINE:
+		CM_TransformedBoxTrace( trace, item->start, item->end, (float *)item->mins, (float *)item->maxs,
+			item->model, MASK_ALL, item->origin, item->angles, qfalse );
+		*contents = CM_TransformedPointContents( item->end, item->model, item->origin, item->angles );
+		break;
+	case TRACESTRESS_BOX:
+		// the box has to stay intact between these calls
+		box = CM_TempBoxModel( item->mins, item->maxs, qfalse );
+		CM_TransformedBoxTrace( trace, item->start, item->end, NULL, NULL,
+			box, MASK_ALL, item->origin, vec3_origin, qfalse );
+		*contents = CM_TransformedPointContents( item->end, box, item->origin, vec3_origin );
+		break;
+	default:
+		*contents = CM_PointContents( item->start, 0 );
+		break;
+	}
+}
+
+/*
+=============
+SV_TraceStressJob
+=============
+*/
+static void SV_TraceStressJob( void *data, int index ) {
+	traceStressItem_t	*item;
+	trace_t				trace;
+	int					contents;
+
+	item = (traceStressItem_t *)data + index;
+
+	SV_TraceStressRun( item, &trace, &contents );
+
+	if ( contents != item->contents
+		|| trace.allsolid != item->trace.allsolid
+		|| trace.startsolid != item->trace.startsolid
+		|| trace.fraction != item->trace.fraction
+		|| !VectorCompare( trace.endpos, item->trace.endpos )
+		|| !VectorCompare( trace.plane.normal, item->trace.plane.normal )
+		|| trace.plane.dist != item->trace.plane.dist
+		|| trace.surfaceFlags != item->trace.surfaceFlags
+		|| trace.contents != item->trace.contents ) {
+		item->mismatch = qtrue;
+	}
+}
+
+/*
+=============
+SV_TraceStress_f
+
+Runs random traces, point contents queries and box model traces on
+several threads at once and compares them with the results of the
+same queries made one by one on the main thread
+=============
+*/
+void SV_TraceStress_f( void ) {
+	traceStressItem_t	*items, *item;
+	vec3_t				worldMins, worldMaxs;
+	int					numThreads, numItems, numModels;
+	int					seed, startTime, serialTime, parallelTime;
+	int					mismatches;
+	int					pass;
+	int					i, j;
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	numThreads = Job_MaxThreads();
+	if ( Cmd_Argc() > 1 ) {
+		numThreads = atoi( Cmd_Argv( 1 ) );
+		if ( numThreads < 1 ) {
+			numThreads = 1;
+		} else if ( numThreads > MAX_JOB_THREADS ) {
+			numThreads = MAX_JOB_THREADS;
+		}
+	}
+
+	numItems = 20000;
+	if ( Cmd_Argc() > 2 ) {
+		numItems = atoi( Cmd_Argv( 2 ) );
+		if ( numItems < 1 ) {
+			numItems = 1;
+		}
+	}
+
+	CM_ModelBounds( CM_InlineModel( 0 ), worldMins, worldMaxs );
+	numModels = CM_NumInlineModels();
+
+	items = Hunk_AllocateTempMemory( numItems * sizeof( *items ) );
+	Com_Memset( items, 0, numItems * sizeof( *items ) );
+
+	seed = 1;
+	for ( i = 0, item = items ; i < numItems ; i++, item++ ) {
+		item->type = i % TRACESTRESS_TYPES;
+		if ( item->type == TRACESTRESS_INLINE ) {
+			if ( numModels < 2 ) {
+				item->type = TRACESTRESS_WORLD;
+			} else {
+				item->model = CM_InlineModel( 1 + i / TRACESTRESS_TYPES % ( numModels - 1 ) );
+			}
+		}
+
+		for ( j = 0 ; j < 3 ; j++ ) {
+			item->start[j] = worldMins[j] + Q_random( &seed ) * ( worldMaxs[j] - worldMins[j] );
+			item->end[j] = item->start[j] + Q_crandom( &seed ) * 512;
+			// half of them are point traces
+			if ( ( i / TRACESTRESS_TYPES ) & 1 ) {
+				item->mins[j] = -Q_random( &seed ) * 32;
+				item->maxs[j] = Q_random( &seed ) * 32;
+			}
+		}
+
+		if ( item->type == TRACESTRESS_INLINE ) {
+			// put the model somewhere along the trace
+			for ( j = 0 ; j < 3 ; j++ ) {
+				item->origin[j] = Q_crandom( &seed ) * 128;
+			}
+			item->angles[YAW] = Q_random( &seed ) * 360;
+		} else if ( item->type == TRACESTRESS_BOX ) {
+			for ( j = 0 ; j < 3 ; j++ ) {
+				item->origin[j] = item->start[j] + ( item->end[j] - item->start[j] ) * Q_random( &seed );
+				item->mins[j] = -8 - Q_random( &seed ) * 32;
+				item->maxs[j] = 8 + Q_random( &seed ) * 32;
+			}
+		}
+	}
+
+	startTime = Sys_Milliseconds();
+	for ( i = 0, item = items ; i < numItems ; i++, item++ ) {
+		SV_TraceStressRun( item, &item->trace, &item->contents );
+	}
+	serialTime = Sys_Milliseconds() - startTime;
+
+	// a few passes, to give the threads a chance to trip over each other
+	startTime = Sys_Milliseconds();
+	for ( pass = 0 ; pass < 4 ; pass++ ) {
+		Job_ParallelFor( SV_TraceStressJob, items, numItems, numThreads );
+	}
+	parallelTime = ( Sys_Milliseconds() - startTime ) / 4;
+
+	mismatches = 0;
+	for ( i = 0, item = items ; i < numItems ; i++, item++ ) {
+		if ( item->mismatch ) {
+			if ( !mismatches ) {
+				Com_Printf( S_COLOR_RED "query %i: (%.1f %.1f %.1f) to (%.1f %.1f %.1f) differs from the serial result\n",
+					i, item->start[0], item->start[1], item->start[2], item->end[0], item->end[1], item->end[2] );
+			}
+			mismatches++;
+		}
+	}
+
+	Hunk_FreeTempMemory( items );
 
+	Com_Printf( "%i queries, %i threads: %i msec serial, %i msec threaded, %i mismatches\n",
+		numItems, numThreads, serialTime, parallelTime, mismatches );
+}
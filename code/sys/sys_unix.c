@@ -40,6 +40,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <fenv.h>
 #include <sys/wait.h>
 #include <time.h>
+#include <pthread.h>
 
 qboolean stdinIsATTY;
 
@@ -176,6 +177,20 @@ int Sys_Milliseconds (void)
 	return curtime;
 }
 
+/*
+==================
+Sys_Nanoseconds
+==================
+*/
+int64_t Sys_Nanoseconds( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 /*
 ==================
 Sys_RandomBytes
@@ -948,6 +963,224 @@ void Sys_SetEnv(const char *name, const char *value)
 		unsetenv(name);
 }
 
+/*
+==============================================================
+
+THREADS
+
+==============================================================
+*/
+
+typedef struct
+{
+	threadFunc_t	func;
+	void			*arg;
+	pthread_t		thread;
+} sysThread_t;
+
+typedef struct
+{
+	pthread_mutex_t	mutex;
+	pthread_cond_t	cond;
+	int				count;
+} sysSemaphore_t;
+
+/*
+==============
+Sys_ThreadMain
+==============
+*/
+static void *Sys_ThreadMain( void *arg )
+{
+	sysThread_t *thread = arg;
+
+	thread->func( thread->arg );
+	return NULL;
+}
+
+/*
+==============
+Sys_CreateThread
+
+Returns NULL if the platform can't start threads, callers are
+expected to fall back to doing the work themselves
+==============
+*/
+void *Sys_CreateThread( threadFunc_t func, void *arg )
+{
+	sysThread_t *thread;
+
+	thread = malloc( sizeof( *thread ) );
+	if( !thread )
+		return NULL;
+
+	thread->func = func;
+	thread->arg = arg;
+
+	if( pthread_create( &thread->thread, NULL, Sys_ThreadMain, thread ) != 0 )
+	{
+		free( thread );
+		return NULL;
+	}
+
+	return thread;
+}
+
+/*
+==============
+Sys_JoinThread
+==============
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = thread;
+
+	pthread_join( t->thread, NULL );
+	free( t );
+}
+
+/*
+==============
+Sys_CreateMutex
+==============
+*/
+void *Sys_CreateMutex( void )
+{
+	pthread_mutex_t *mutex;
+
+	mutex = malloc( sizeof( *mutex ) );
+	if( !mutex )
+		Sys_Error( "Sys_CreateMutex: out of memory" );
+
+	pthread_mutex_init( mutex, NULL );
+	return mutex;
+}
+
+/*
+==============
+Sys_DestroyMutex
+==============
+*/
+void Sys_DestroyMutex( void *mutex )
+{
+	pthread_mutex_destroy( mutex );
+	free( mutex );
+}
+
+/*
+==============
+Sys_LockMutex
+==============
+*/
+void Sys_LockMutex( void *mutex )
+{
+	pthread_mutex_lock( mutex );
+}
+
+/*
+==============
+Sys_UnlockMutex
+==============
+*/
+void Sys_UnlockMutex( void *mutex )
+{
+	pthread_mutex_unlock( mutex );
+}
+
+/*
+==============
+Sys_CreateSemaphore
+
+Unnamed POSIX semaphores aren't available on macOS, so
+build a counting semaphore from a mutex and a condition
+==============
+*/
+void *Sys_CreateSemaphore( void )
+{
+	sysSemaphore_t *sem;
+
+	sem = malloc( sizeof( *sem ) );
+	if( !sem )
+		Sys_Error( "Sys_CreateSemaphore: out of memory" );
+
+	pthread_mutex_init( &sem->mutex, NULL );
+	pthread_cond_init( &sem->cond, NULL );
+	sem->count = 0;
+	return sem;
+}
+
+/*
+==============
+Sys_DestroySemaphore
+==============
+*/
+void Sys_DestroySemaphore( void *semaphore )
+{
+	sysSemaphore_t *sem = semaphore;
+
+	pthread_cond_destroy( &sem->cond );
+	pthread_mutex_destroy( &sem->mutex );
+	free( sem );
+}
+
+/*
+==============
+Sys_SemaphoreWait
+==============
+*/
+void Sys_SemaphoreWait( void *semaphore )
+{
+	sysSemaphore_t *sem = semaphore;
+
+	pthread_mutex_lock( &sem->mutex );
+	while( sem->count <= 0 )
+		pthread_cond_wait( &sem->cond, &sem->mutex );
+	sem->count--;
+	pthread_mutex_unlock( &sem->mutex );
+}
+
+/*
+==============
+Sys_SemaphorePost
+==============
+*/
+void Sys_SemaphorePost( void *semaphore )
+{
+	sysSemaphore_t *sem = semaphore;
+
+	pthread_mutex_lock( &sem->mutex );
+	sem->count++;
+	pthread_cond_signal( &sem->cond );
+	pthread_mutex_unlock( &sem->mutex );
+}
+
+/*
+==============
+Sys_AtomicAdd
+
+Returns the new value
+==============
+*/
+int Sys_AtomicAdd( volatile int *value, int add )
+{
+	return __sync_add_and_fetch( value, add );
+}
+
+/*
+==============
+Sys_ProcessorCount
+==============
+*/
+int Sys_ProcessorCount( void )
+{
+	long count = sysconf( _SC_NPROCESSORS_ONLN );
+
+	if( count < 1 )
+		return 1;
+
+	return (int)count;
+}
+
 /*
 ==============
 Sys_PID
@@ -266,6 +266,25 @@ int Sys_Milliseconds (void)
 	return sys_curtime;
 }
 
+/*
+================
+Sys_Nanoseconds
+================
+*/
+int64_t Sys_Nanoseconds( void )
+{
+	static LARGE_INTEGER frequency;
+	LARGE_INTEGER counter;
+
+	if ( !frequency.QuadPart ) {
+		QueryPerformanceFrequency( &frequency );
+	}
+	QueryPerformanceCounter( &counter );
+
+	return ( counter.QuadPart / frequency.QuadPart ) * 1000000000 +
+		( counter.QuadPart % frequency.QuadPart ) * 1000000000 / frequency.QuadPart;
+}
+
 /*
 ================
 Sys_RandomBytes
@@ -869,6 +888,199 @@ void Sys_SetEnv(const char *name, const char *value)
 		_putenv(va("%s=", name));
 }
 
+/*
+==============================================================
+
+THREADS
+
+==============================================================
+*/
+
+typedef struct
+{
+	threadFunc_t	func;
+	void			*arg;
+	HANDLE			handle;
+} sysThread_t;
+
+/*
+==============
+Sys_ThreadMain
+==============
+*/
+static DWORD WINAPI Sys_ThreadMain( LPVOID arg )
+{
+	sysThread_t *thread = arg;
+
+	thread->func( thread->arg );
+	return 0;
+}
+
+/*
+==============
+Sys_CreateThread
+
+Returns NULL if the platform can't start threads, callers are
+expected to fall back to doing the work themselves
+==============
+*/
+void *Sys_CreateThread( threadFunc_t func, void *arg )
+{
+	sysThread_t *thread;
+
+	thread = malloc( sizeof( *thread ) );
+	if( !thread )
+		return NULL;
+
+	thread->func = func;
+	thread->arg = arg;
+	thread->handle = CreateThread( NULL, 0, Sys_ThreadMain, thread, 0, NULL );
+
+	if( !thread->handle )
+	{
+		free( thread );
+		return NULL;
+	}
+
+	return thread;
+}
+
+/*
+==============
+Sys_JoinThread
+==============
+*/
+void Sys_JoinThread( void *thread )
+{
+	sysThread_t *t = thread;
+
+	WaitForSingleObject( t->handle, INFINITE );
+	CloseHandle( t->handle );
+	free( t );
+}
+
+/*
+==============
+Sys_CreateMutex
+==============
+*/
+void *Sys_CreateMutex( void )
+{
+	CRITICAL_SECTION *mutex;
+
+	mutex = malloc( sizeof( *mutex ) );
+	if( !mutex )
+		Sys_Error( "Sys_CreateMutex: out of memory" );
+
+	InitializeCriticalSection( mutex );
+	return mutex;
+}
+
+/*
+==============
+Sys_DestroyMutex
+==============
+*/
+void Sys_DestroyMutex( void *mutex )
+{
+	DeleteCriticalSection( mutex );
+	free( mutex );
+}
+
+/*
+==============
+Sys_LockMutex
+==============
+*/
+void Sys_LockMutex( void *mutex )
+{
+	EnterCriticalSection( mutex );
+}
+
+/*
+==============
+Sys_UnlockMutex
+==============
+*/
+void Sys_UnlockMutex( void *mutex )
+{
+	LeaveCriticalSection( mutex );
+}
+
+/*
+==============
+Sys_CreateSemaphore
+==============
+*/
+void *Sys_CreateSemaphore( void )
+{
+	HANDLE sem;
+
+	sem = CreateSemaphore( NULL, 0, 0x7fffffff, NULL );
+	if( !sem )
+		Sys_Error( "Sys_CreateSemaphore: failed (%lu)", GetLastError( ) );
+
+	return sem;
+}
+
+/*
+==============
+Sys_DestroySemaphore
+==============
+*/
+void Sys_DestroySemaphore( void *semaphore )
+{
+	CloseHandle( semaphore );
+}
+
+/*
+==============
+Sys_SemaphoreWait
+==============
+*/
+void Sys_SemaphoreWait( void *semaphore )
+{
+	WaitForSingleObject( semaphore, INFINITE );
+}
+
+/*
+==============
+Sys_SemaphorePost
+==============
+*/
+void Sys_SemaphorePost( void *semaphore )
+{
+	ReleaseSemaphore( semaphore, 1, NULL );
+}
+
+/*
+==============
+Sys_AtomicAdd
+
+Returns the new value
+==============
+*/
+int Sys_AtomicAdd( volatile int *value, int add )
+{
+	return InterlockedExchangeAdd( (volatile LONG *)value, add ) + add;
+}
+
+/*
+==============
+Sys_ProcessorCount
+==============
+*/
+int Sys_ProcessorCount( void )
+{
+	SYSTEM_INFO info;
+
+	GetSystemInfo( &info );
+	if( info.dwNumberOfProcessors < 1 )
+		return 1;
+
+	return (int)info.dwNumberOfProcessors;
+}
+
 /*
 ==============
 Sys_PID
@@ -0,0 +1,269 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+//
+// vmtest.c -- test module for the vmcompare command
+//
+// Runs every QVM opcode on pseudo random values and passes the results to
+// the engine through trap_Hash, so vmcompare can check that a bytecode
+// compiler agrees with the interpreter:
+//
+//   vmcompare vmtest 0 <rounds> <seed>
+//
+// Only talks to the engine through trap_Hash and doesn't include any game
+// headers, see misc/vmcompare.sh for running it.
+
+int trap_Hash( int value );
+
+typedef struct {
+	int				i;
+	short			s;
+	char			c;
+	unsigned char	uc;
+	float			f;
+	char			name[11];
+} vmTestRecord_t;
+
+typedef int (*vmTestOp_t)( int a, int b );
+
+static int Test_Run( int rounds );
+
+static int				seed;
+static vmTestRecord_t	records[8];
+static char				text[64];
+
+/*
+================
+vmMain
+
+This must be the very first function compiled into the .qvm file
+================
+*/
+int vmMain( int command, int arg0, int arg1 ) {
+	if ( command != 0 ) {
+		return -1;
+	}
+
+	seed = arg1;
+	return Test_Run( arg0 > 0 ? arg0 : 1000 );
+}
+
+static int Rand( void ) {
+	seed = seed * 1103515245 + 12345;
+	return seed;
+}
+
+static int FloatBits( float f ) {
+	return *(int *)&f;
+}
+
+static int Test_Integers( int a, int b ) {
+	unsigned	ua, ub;
+	int			flags;
+
+	ua = a;
+	ub = b;
+
+	trap_Hash( a + b );
+	trap_Hash( a - b );
+	trap_Hash( a * b );
+	trap_Hash( ua * ub );
+
+	// leave out what traps or is undefined on some hosts
+	if ( b != 0 && !( a == (int)0x80000000 && b == -1 ) ) {
+		trap_Hash( a / b );
+		trap_Hash( a % b );
+	}
+	if ( ub != 0 ) {
+		trap_Hash( ua / ub );
+		trap_Hash( ua % ub );
+	}
+
+	trap_Hash( a & b );
+	trap_Hash( a | b );
+	trap_Hash( a ^ b );
+	trap_Hash( ~a );
+	trap_Hash( -a );
+	trap_Hash( a << ( b & 31 ) );
+	trap_Hash( a >> ( b & 31 ) );
+	trap_Hash( ua >> ( b & 31 ) );
+
+	trap_Hash( (char)a );
+	trap_Hash( (short)a );
+
+	flags = 0;
+	if ( a == b ) flags |= 1;
+	if ( a != b ) flags |= 2;
+	if ( a < b ) flags |= 4;
+	if ( a <= b ) flags |= 8;
+	if ( a > b ) flags |= 16;
+	if ( a >= b ) flags |= 32;
+	if ( ua < ub ) flags |= 64;
+	if ( ua <= ub ) flags |= 128;
+	if ( ua > ub ) flags |= 256;
+	if ( ua >= ub ) flags |= 512;
+
+	return trap_Hash( flags );
+}
+
+static int Test_Floats( int a, int b ) {
+	float	fa, fb;
+	int		flags;
+
+	// small enough for the conversions back to int to stay in range
+	fa = (float)( a >> 12 ) * 0.125f;
+	fb = (float)( b >> 12 ) * -0.25f;
+
+	trap_Hash( FloatBits( fa + fb ) );
+	trap_Hash( FloatBits( fa - fb ) );
+	trap_Hash( FloatBits( fa * fb ) );
+	if ( fb != 0.0f ) {
+		trap_Hash( FloatBits( fa / fb ) );
+	}
+	trap_Hash( FloatBits( -fa ) );
+	trap_Hash( (int)fa );
+	trap_Hash( (int)( fa * 0.001f ) );
+	trap_Hash( (int)( fa - fb ) );
+
+	flags = 0;
+	if ( fa == fb ) flags |= 1;
+	if ( fa != fb ) flags |= 2;
+	if ( fa < fb ) flags |= 4;
+	if ( fa <= fb ) flags |= 8;
+	if ( fa > fb ) flags |= 16;
+	if ( fa >= fb ) flags |= 32;
+	if ( fa == fa ) flags |= 64;
+
+	return trap_Hash( flags );
+}
+
+static int Test_Memory( int a, int b ) {
+	vmTestRecord_t	local;
+	vmTestRecord_t	*r;
+	int				i;
+
+	r = &records[a & 7];
+	r->i = a;
+	r->s = b;
+	r->c = a >> 8;
+	r->uc = b >> 8;
+	r->f = (float)( a & 0xffff );
+	for ( i = 0 ; i < (int)sizeof( r->name ) - 1 ; i++ ) {
+		r->name[i] = 'a' + ( ( a >> i ) & 15 );
+	}
+	r->name[i] = 0;
+
+	// structure copies are block copies, to and from the program stack
+	local = records[b & 7];
+	records[( a >> 3 ) & 7] = local;
+	local = *r;
+
+	trap_Hash( local.i + local.s + local.c + local.uc );
+	trap_Hash( FloatBits( local.f ) );
+
+	for ( i = 0 ; local.name[i] ; i++ ) {
+		text[( a + i ) & 63] = local.name[i];
+	}
+
+	return trap_Hash( text[b & 63] + records[i & 7].s );
+}
+
+static int Op_Add( int a, int b ) {
+	return a + b;
+}
+
+static int Op_Sub( int a, int b ) {
+	return a - b;
+}
+
+static int Op_Mul( int a, int b ) {
+	return a * b;
+}
+
+static int Op_Xor( int a, int b ) {
+	return a ^ b;
+}
+
+static vmTestOp_t ops[4] = { Op_Add, Op_Sub, Op_Mul, Op_Xor };
+
+static int Fibonacci( int n ) {
+	if ( n < 2 ) {
+		return n;
+	}
+	return Fibonacci( n - 1 ) + Fibonacci( n - 2 );
+}
+
+static int Test_Calls( int a, int b ) {
+	int		result;
+
+	// calls through pointers aren't turned into direct branches
+	result = ops[a & 3]( a, b );
+	result += Fibonacci( b & 15 );
+
+	// dense enough for a jump table
+	switch ( b & 15 ) {
+	case 0: result += 3; break;
+	case 1: result ^= 5; break;
+	case 2: result -= 7; break;
+	case 3: result *= 11; break;
+	case 4: result >>= 1; break;
+	case 5: result = ~result; break;
+	case 6: result = -result; break;
+	case 7: result |= 0x100; break;
+	case 8: result &= 0xff00ff; break;
+	case 9: result += a; break;
+	default: result -= b; break;
+	}
+
+	return trap_Hash( result );
+}
+
+static int Test_Deep( int a, int b ) {
+	// keeps most of these on the opStack at once
+	return trap_Hash( a + ( b * ( a - ( b ^ ( a + ( b * ( a - ( b ^ ( a + ( b * ( a - ( b ^
+		( a + ( b * ( a - ( b ^ ( a + ( b * ( a - ( b ^ ( a + b ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) ) );
+}
+
+static int Test_Run( int rounds ) {
+	int		i, a, b, result;
+
+	result = 0;
+	for ( i = 0 ; i < rounds ; i++ ) {
+		a = Rand();
+		b = Rand();
+
+		// small values for shifts, divisions and the jump table
+		if ( i & 1 ) {
+			b >>= 24;
+		}
+		if ( ( i & 7 ) == 2 ) {
+			b = a;
+		}
+
+		result ^= Test_Integers( a, b );
+		result ^= Test_Floats( a, b );
+		result ^= Test_Memory( a, b );
+		result ^= Test_Calls( a, b );
+		result ^= Test_Deep( a, b );
+	}
+
+	return result;
+}
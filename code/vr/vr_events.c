@@ -5,6 +5,7 @@
 #include "../client/client.h"
 #include "vr_macros.h"
 #include "vr_gameplay.h"
+#include "vr_renderer.h"
 #include "vr_session.h"
 
 void _VR_HandleSessionStateChange(VR_App* app, XrSessionState newState);
@@ -109,6 +110,7 @@ void _VR_HandleSessionStateChange(VR_App* app, XrSessionState newState)
 		case XR_SESSION_STATE_STOPPING:
 			app->Visible = XR_FALSE;
 			CHECK(app->SessionActive, "");
+			VR_Renderer_SyncRenderThread();
 			XR_CHECK(VR_EndSession(app->Session), "Failed to end XR session");
 			app->SessionActive = XR_FALSE;
 			break;
@@ -30,15 +30,34 @@ XrTime lastPredictedDisplayTime = 0;
 qboolean frameStarted = qfalse;
 qboolean needRecenter = qtrue;
 
-// Data per-frame data held between BeginFrame and EndFrame
-XrFovf fov = { 0 };
-XrView views[2];
-uint32_t viewCount = 2;
-uint32_t swapchainColorIndex = 0;
-qboolean overlayAcquiredThisFrame = qfalse;
+// Data per-frame data held between BeginFrame and EndFrame. With r_smp the
+// render thread may still be submitting one frame while the main thread
+// builds the next, so there is one of these for each.
+typedef struct
+{
+	VR_Engine* engine;
+	XrTime predictedDisplayTime;
+	XrFovf fov;
+	XrView views[2];
+	uint32_t viewCount;
+	uint32_t swapchainColorIndex;
+	qboolean overlayAcquired;
+	qboolean useVirtualScreen;
+	qboolean deferred;	// swapchain work handed to the renderer's frame callbacks
+	qboolean acquired;	// xrBeginFrame called and swapchain images acquired
+	float hmdYaw;		// vr.hmdorientation[YAW] when the frame was begun
+	float menuYaw;		// set when the frame is submitted, latched into vr.menuYaw
+} VR_FrameData;
+
+static VR_FrameData frames[2];
+static VR_FrameData* frame = &frames[0];
 
 void VR_Renderer_BeginFrame(VR_Engine* engine, XrBool32 needsRecenter);
 void VR_Renderer_EndFrame(VR_Engine* engine);
+static void VR_Renderer_AcquireFrame(VR_FrameData* frameData);
+static void VR_Renderer_SubmitFrame(VR_FrameData* frameData);
+static void VR_Renderer_FrameBegin(void* data);
+static void VR_Renderer_FrameEnd(void* data);
 void VR_Recenter(VR_Engine* engine, XrTime predictedDisplayTime);
 void VR_ClearFrameBuffer( int width, int height);
 void VR_UpdatePerFrameState( void );
@@ -131,11 +150,21 @@ void VR_ProcessFrame( VR_Engine* engine )
 
 	if (needRecenter)
 	{
+		// The render thread's xrEndFrame uses the current space
+		VR_Renderer_SyncRenderThread();
 		VR_Recenter(engine, lastPredictedDisplayTime);
 		needRecenter = qfalse;
 	}
 }
 
+void VR_Renderer_SyncRenderThread( void )
+{
+	if (re.SyncRenderThread)
+	{
+		re.SyncRenderThread();
+	}
+}
+
 void VR_Renderer_RestoreState(VR_Engine* engine)
 {
 	if (!frameStarted)
@@ -144,6 +173,13 @@ void VR_Renderer_RestoreState(VR_Engine* engine)
 		return;
 	}
 
+	// The renderer was restarted with the session; a deferred frame that
+	// never reached it is dropped along with the old swapchains
+	if (re.SetFrameCallbacks)
+	{
+		re.SetFrameCallbacks(NULL, NULL, NULL);
+	}
+
 	VR_UpdatePerFrameState();
 
 	// If we need to re-start frame until `Com_Frame()` call, we need session to
@@ -159,25 +195,47 @@ void VR_Renderer_RestoreState(VR_Engine* engine)
 
 void VR_Renderer_BeginFrame(VR_Engine* engine, XrBool32 needsRecenter)
 {
+	const XrTime predictedDisplayTime = VR_WaitFrame(engine->appState.Session).predictedDisplayTime;
+
+	frame = (frame == &frames[0]) ? &frames[1] : &frames[0];
+	frame->engine = engine;
+	frame->predictedDisplayTime = predictedDisplayTime;
+	frame->viewCount = 2;
+	frame->acquired = qfalse;
+
+	// With r_smp, xrBeginFrame and the swapchain images wait until the
+	// renderer hands this frame's commands to the render thread, so the
+	// previous frame can still be drawing while this one is built. Loading
+	// screens keep the direct path, they submit frames from within Com_Frame().
+	frame->deferred = cls.glconfig.smpActive && re.SetFrameCallbacks && clc.state == CA_ACTIVE;
+	if (!frame->deferred || needsRecenter)
+	{
+		VR_Renderer_SyncRenderThread();
+	}
+
 	frameStarted = qtrue;
-	lastPredictedDisplayTime = VR_WaitFrame(engine->appState.Session).predictedDisplayTime;
+	lastPredictedDisplayTime = predictedDisplayTime;
 
 	if (needsRecenter)
 	{
 		VR_Recenter(engine, lastPredictedDisplayTime);
 	}
 
-	VR_BeginFrame(engine->appState.Session);
+	if (!frame->deferred)
+	{
+		VR_BeginFrame(engine->appState.Session);
+	}
 
 	const XrViewState viewState = VR_LocateViews(
 		engine->appState.Session,
 		lastPredictedDisplayTime,
 		engine->appState.CurrentSpace,
-		views,
-		&viewCount);
+		frame->views,
+		&frame->viewCount);
 
 	// Update HMD position/views
-	IN_VRUpdateHMD(views, viewCount, &fov);
+	IN_VRUpdateHMD(frame->views, frame->viewCount, &frame->fov);
+	frame->hmdYaw = vr.hmdorientation[YAW];
 
 	// [Input] poll actions, update controller state, issue action commands
 	IN_VRSyncActions(engine);
@@ -185,32 +243,15 @@ void VR_Renderer_BeginFrame(VR_Engine* engine, XrBool32 needsRecenter)
 
 	VR_SwapchainInfos* swapchains = &engine->appState.Renderer.Swapchains;
 
-	VR_Swapchains_Acquire(swapchains, &swapchainColorIndex);
-	VR_Swapchains_BindFramebuffers(swapchains, swapchainColorIndex);
-	VR_ClearFrameBuffer(swapchains->color.width, swapchains->color.height);
-
-	// Acquire overlay swapchain for 2D screen overlays (vignette, damage, reticle, HUD mode 2)
-	// Skip during loading states to avoid submitting uninitialized overlay content
-	// Skip when in virtual screen mode - overlay would obscure the virtual screen
-	overlayAcquiredThisFrame = qfalse;
-	if (swapchains->screenOverlay.swapchain != XR_NULL_HANDLE && clc.state == CA_ACTIVE && !vr.virtual_screen)
+	if (!frame->deferred)
 	{
-		uint32_t overlayIndex;
-		VR_Swapchains_AcquireOverlay(&swapchains->screenOverlay, &overlayIndex);
-		VR_Swapchains_BindOverlayFramebuffer(swapchains, overlayIndex);
-		overlayAcquiredThisFrame = qtrue;
-
-		// Tell renderer about the overlay buffer so it can bind it when drawing screen overlays
-		// Also provide the main scene read buffer for mono blit when weapon is zoomed
-		re.SetScreenOverlayBuffer(
-			swapchains->screenOverlayFramebuffer,
-			swapchains->screenOverlay.width,
-			swapchains->screenOverlay.height,
-			swapchains->eyeFramebuffers[0][swapchainColorIndex],
-			swapchains->color.width,
-			swapchains->color.height);
+		VR_Renderer_AcquireFrame(frame);
 	}
 
+	const XrFovf fov = frame->fov;
+	const XrView* views = frame->views;
+	const uint32_t viewCount = frame->viewCount;
+
 	// Set renderer params
 	// Near plane must be in Quake units to match our view matrices
 	// Default r_znear is 4 Quake units. With worldscale=32, that's 4/32 = 0.125 meters
@@ -261,31 +302,139 @@ void VR_Renderer_BeginFrame(VR_Engine* engine, XrBool32 needsRecenter)
 		halfIpdMeters = sqrtf(dx*dx + dy*dy + dz*dz) * 0.5f;
 	}
 
-	re.SetVRHeadsetParms(vrMatrixProjection.m, vrMatrixMono.m, swapchains->framebuffers[swapchainColorIndex],
+	// A deferred frame gets its render buffer once the image is acquired
+	re.SetVRHeadsetParms(vrMatrixProjection.m, vrMatrixMono.m,
+						 frame->deferred ? 0 : swapchains->framebuffers[frame->swapchainColorIndex],
 						 vrMatrixEye[0].m, vrMatrixEye[1].m, combinedFovX, halfIpdMeters);
+
+	if (frame->deferred)
+	{
+		re.SetFrameCallbacks(VR_Renderer_FrameBegin, VR_Renderer_FrameEnd, frame);
+	}
+}
+
+// Begins the XR frame and acquires the swapchain images it draws into
+static void VR_Renderer_AcquireFrame(VR_FrameData* frameData)
+{
+	VR_Engine* engine = frameData->engine;
+	VR_SwapchainInfos* swapchains = &engine->appState.Renderer.Swapchains;
+
+	if (frameData->deferred)
+	{
+		VR_BeginFrame(engine->appState.Session);
+	}
+
+	VR_Swapchains_Acquire(swapchains, &frameData->swapchainColorIndex);
+	VR_Swapchains_BindFramebuffers(swapchains, frameData->swapchainColorIndex);
+	VR_ClearFrameBuffer(swapchains->color.width, swapchains->color.height);
+
+	// Acquire overlay swapchain for 2D screen overlays (vignette, damage, reticle, HUD mode 2)
+	// Skip during loading states to avoid submitting uninitialized overlay content
+	// Skip when in virtual screen mode - overlay would obscure the virtual screen
+	frameData->overlayAcquired = qfalse;
+	if (swapchains->screenOverlay.swapchain != XR_NULL_HANDLE && clc.state == CA_ACTIVE && !vr.virtual_screen)
+	{
+		uint32_t overlayIndex;
+		VR_Swapchains_AcquireOverlay(&swapchains->screenOverlay, &overlayIndex);
+		VR_Swapchains_BindOverlayFramebuffer(swapchains, overlayIndex);
+		frameData->overlayAcquired = qtrue;
+
+		// Tell renderer about the overlay buffer so it can bind it when drawing screen overlays
+		// Also provide the main scene read buffer for mono blit when weapon is zoomed
+		re.SetScreenOverlayBuffer(
+			swapchains->screenOverlayFramebuffer,
+			swapchains->screenOverlay.width,
+			swapchains->screenOverlay.height,
+			swapchains->eyeFramebuffers[0][frameData->swapchainColorIndex],
+			swapchains->color.width,
+			swapchains->color.height);
+	}
+
+	if (frameData->deferred)
+	{
+		re.SetVRRenderBuffer(swapchains->framebuffers[frameData->swapchainColorIndex]);
+	}
+
+	frameData->acquired = qtrue;
+}
+
+// Frame callbacks for deferred frames: the renderer calls the first right
+// before it hands the frame's commands to the back end, the second from
+// the back end once they have been drawn
+static void VR_Renderer_FrameBegin(void* data)
+{
+	VR_FrameData* frameData = (VR_FrameData*)data;
+	VR_FrameData* previous = (frameData == &frames[0]) ? &frames[1] : &frames[0];
+
+	// The back end is idle, so the previous frame's submission is done
+	vr.menuYaw = previous->menuYaw;
+
+	VR_Renderer_AcquireFrame(frameData);
+	frameData->useVirtualScreen = VR_Gameplay_ShouldRenderInVirtualScreen();
+}
+
+static void VR_Renderer_FrameEnd(void* data)
+{
+	VR_Renderer_SubmitFrame((VR_FrameData*)data);
 }
 
 void VR_Renderer_EndFrame(VR_Engine* engine)
 {
+	if (frame->deferred)
+	{
+		// RE_EndFrame normally took the submission to the render thread; if
+		// nothing was drawn this frame, finish it here instead
+		if (re.SetFrameCallbacks && re.SetFrameCallbacks(NULL, NULL, NULL))
+		{
+			VR_Renderer_SyncRenderThread();
+			if (!frame->acquired)
+			{
+				VR_Renderer_AcquireFrame(frame);
+			}
+			frame->useVirtualScreen = VR_Gameplay_ShouldRenderInVirtualScreen();
+			VR_Renderer_SubmitFrame(frame);
+			vr.menuYaw = frame->menuYaw;
+		}
+	}
+	else
+	{
+		// The renderer's back end may still be drawing into the swapchain
+		VR_Renderer_SyncRenderThread();
+		frame->useVirtualScreen = VR_Gameplay_ShouldRenderInVirtualScreen();
+		VR_Renderer_SubmitFrame(frame);
+		vr.menuYaw = frame->menuYaw;
+	}
+
+	GLimp_UpdateFullscreen();
+
+	frameStarted = qfalse;
+}
+
+// Releases the swapchain images, mirrors the frame to the desktop window and
+// ends the XR frame; on the render thread for deferred frames, so it only
+// writes to frameData
+static void VR_Renderer_SubmitFrame(VR_FrameData* frameData)
+{
+	VR_Engine* engine = frameData->engine;
 	VR_SwapchainInfos* swapchains = &engine->appState.Renderer.Swapchains;
 
 	// Draw Virtual Screen if needed
-	const int use_virtual_screen = VR_Gameplay_ShouldRenderInVirtualScreen();
+	const int use_virtual_screen = frameData->useVirtualScreen;
 	if (use_virtual_screen)
 	{
-		VR_DrawVirtualScreen(swapchains, swapchainColorIndex, fov, views, viewCount);
-		vr.menuYaw = VR_VirtualScreen_GetCurrentYaw();
+		VR_DrawVirtualScreen(swapchains, frameData->swapchainColorIndex, frameData->fov, frameData->views, frameData->viewCount);
+		frameData->menuYaw = VR_VirtualScreen_GetCurrentYaw();
 	}
 	else
 	{
 		VR_VirtualScreen_ResetPosition();
-		vr.menuYaw = vr.hmdorientation[YAW];
+		frameData->menuYaw = frameData->hmdYaw;
 	}
 
 	VR_Swapchains_Release(swapchains);
 
 	// Release overlay swapchain only if it was acquired this frame
-	if (overlayAcquiredThisFrame)
+	if (frameData->overlayAcquired)
 	{
 		VR_Swapchains_ReleaseOverlay(&swapchains->screenOverlay);
 	}
@@ -293,23 +442,21 @@ void VR_Renderer_EndFrame(VR_Engine* engine)
 	VR_Swapchains_BindFramebuffers(NULL, 0);
 
 	// Blit to main FBO (desktop window) - use virtual screen if active, otherwise eye view
-	VR_Swapchains_BlitXRToMainFbo(swapchains, swapchainColorIndex, VR_GetDesktopViewConfiguration(), use_virtual_screen);
+	VR_Swapchains_BlitXRToMainFbo(swapchains, frameData->swapchainColorIndex, VR_GetDesktopViewConfiguration(), use_virtual_screen);
 
 	VR_EndFrame(
 		engine->appState.Session,
 		swapchains,
-		views,
-		viewCount,
-		fov,
+		frameData->views,
+		frameData->viewCount,
+		frameData->fov,
 		engine->appState.CurrentSpace,
 		engine->appState.ViewSpace,
-		lastPredictedDisplayTime,
-		overlayAcquiredThisFrame);
+		frameData->predictedDisplayTime,
+		frameData->overlayAcquired);
 
 	// Flip desktop window's buffer
-	GLimp_EndFrame();
-
-	frameStarted = qfalse;
+	GLimp_SwapBuffers();
 }
 
 void VR_Recenter(VR_Engine* engine, XrTime predictedDisplayTime)
@@ -370,8 +517,9 @@ void VR_Recenter(VR_Engine* engine, XrTime predictedDisplayTime)
 		engine->appState.CurrentSpace = engine->appState.StageSpace;
 	}
 
-	// Update menu orientation
+	// Update menu orientation, including the one the next latch picks up
 	vr.menuYaw = 0;
+	frames[0].menuYaw = frames[1].menuYaw = 0;
 
 	// Reset VirtualScreen's position
 	VR_VirtualScreen_ResetPosition();
@@ -21,4 +21,8 @@ void VR_Renderer_RestoreState( VR_Engine* engine );
 // Submit VR frame during loading if needed (returns qtrue if a frame was submitted)
 qboolean VR_Renderer_SubmitLoadingFrame(VR_Engine* engine);
 
+// Wait for the renderer's r_smp render thread to finish the frame it is
+// drawing and submitting; needed before touching the session or swapchains
+void VR_Renderer_SyncRenderThread( void );
+
 #endif
@@ -0,0 +1,53 @@
+#!/bin/bash
+
+# Runs the vmtest module through vmcompare in a dedicated server and fails
+# unless the bytecode compiler agrees with the interpreter. The server can
+# be built for another architecture and run under qemu-user, e.g.
+#
+#   misc/vmcompare.sh build/Release/vmtest.qvm \
+#       qemu-aarch64 -L /usr/aarch64-linux-gnu build-arm64/Release/q3vr-ded
+#
+# vmtest.qvm is built with BUILD_GAME_QVMS, see code/tools/vmtest.
+
+set -e
+
+if [ $# -lt 2 ]; then
+    echo "usage: $0 <vmtest.qvm> <server command>..."
+    exit 1
+fi
+
+QVM="$1"
+shift
+
+ROUNDS=${ROUNDS:-2000}
+SEEDS=${SEEDS:-"1 12345 -7 2147483647"}
+
+BASEPATH=$(mktemp -d)
+trap 'rm -rf "${BASEPATH}"' EXIT
+
+mkdir -p "${BASEPATH}/baseq3/vm"
+cp "${QVM}" "${BASEPATH}/baseq3/vm/vmtest.qvm"
+echo "// vmcompare" > "${BASEPATH}/baseq3/default.cfg"
+
+# with and without calls and jumps to constants turned into direct branches
+COMMANDS=()
+for OPTIMIZE in 0 1; do
+    COMMANDS+=(+set vm_optimize ${OPTIMIZE})
+    for SEED in ${SEEDS}; do
+        COMMANDS+=(+vmcompare vmtest 0 ${ROUNDS} ${SEED})
+    done
+done
+
+LOG="${BASEPATH}/vmcompare.log"
+"$@" +set fs_basepath "${BASEPATH}" +set fs_homepath "${BASEPATH}" \
+    +set vm_arm64Compiler 1 "${COMMANDS[@]}" +quit 2>&1 | tee "${LOG}"
+
+MATCHES=$(grep -c "vmtest: results match" "${LOG}" || true)
+EXPECTED=$(( $(echo ${SEEDS} | wc -w) * 2 ))
+
+if [ "${MATCHES}" -ne "${EXPECTED}" ]; then
+    echo "vmcompare: ${MATCHES} of ${EXPECTED} runs matched"
+    exit 1
+fi
+
+echo "vmcompare: all ${EXPECTED} runs matched"